@@ -0,0 +1,374 @@
+#include "elf_client.h"
+#include "histogram.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define ENTRY_OFFSET 24               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NAME_LEN 64                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_OUTSTANDING 4096      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_REQUESTS 200000       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_KEYS 1000000          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_SEC 1000000000.0
+#define NS_PER_US 1000.0
+#define P50 0.50
+#define P90 0.90
+#define P99 0.99
+#define P999 0.999
+
+/*
+ * Drives elf_client_submit_header against one or more daemons, keeping
+ * -c requests outstanding on one client, and reports throughput and
+ * latency percentiles. Latency runs from the submit to the callback,
+ * so it includes any waits the client spends on busy daemons. Each
+ * request sends the header of one file with its entry point rewritten
+ * to one of -k values, which spreads requests across the daemons by
+ * content as real files would.
+ *
+ * With -S the daemon's metrics socket is read before and after the run,
+ * and the allocations, bytes and peak live bytes it counted per request
+ * are reported too. Only a daemon built with ALLOC_STATS counts them.
+ */
+struct slot
+{
+    struct bench *bench;
+    size_t        index;
+    uint64_t      started_ns;
+};
+
+struct bench
+{
+    struct elf_client client;
+    uint8_t           header[ELF_CLIENT_HEADER_LEN];
+    size_t            header_len;
+    size_t            keys;
+    size_t            requests;
+    size_t            submitted;
+    size_t            finished;
+    size_t            failed;
+    struct slot      *slots;
+    size_t           *free_slots;
+    size_t            free_count;
+    struct histogram  latency;
+};
+
+struct daemon_allocs
+{
+    uint64_t allocations;
+    uint64_t bytes;
+    uint64_t peak_bytes;
+    uint64_t requests;
+    int      counted;
+};
+
+static void answered(void *arg, const struct elf_client_answer *answer);
+static int  submit(struct bench *bench);
+static int  load_header(struct bench *bench, const char *path);
+static int  read_allocs(const char *path, struct daemon_allocs *allocs);
+static void report_allocs(const struct daemon_allocs *before, const struct daemon_allocs *after);
+static void usage(const char *program_name);
+
+static void answered(void *arg, const struct elf_client_answer *answer)
+{
+    struct slot  *slot;
+    struct bench *bench;
+
+    slot  = (struct slot *)arg;
+    bench = slot->bench;
+    histogram_record(&bench->latency, histogram_now_ns() - slot->started_ns);
+
+    if(answer->error != NULL)
+    {
+        bench->failed++;
+    }
+
+    bench->finished++;
+    bench->free_slots[bench->free_count++] = slot->index;
+}
+
+static int submit(struct bench *bench)
+{
+    struct slot *slot;
+    char         name[NAME_LEN];
+    uint8_t      header[ELF_CLIENT_HEADER_LEN];
+    size_t       key;
+
+    key = bench->submitted % bench->keys;
+    memcpy(header, bench->header, bench->header_len);
+    memcpy(header + ENTRY_OFFSET, &key, sizeof(key) < bench->header_len - ENTRY_OFFSET ? sizeof(key) : bench->header_len - ENTRY_OFFSET);
+    snprintf(name, sizeof(name), "/bench/%zu", key);
+
+    slot             = &bench->slots[bench->free_slots[--bench->free_count]];
+    slot->started_ns = histogram_now_ns();
+    bench->submitted++;
+
+    if(elf_client_submit_header(&bench->client, name, header, bench->header_len, answered, slot) == -1)
+    {
+        bench->free_slots[bench->free_count++] = slot->index;
+        bench->failed++;
+        bench->finished++;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int load_header(struct bench *bench, const char *path)
+{
+    ssize_t read_len;
+    int     fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    read_len = read(fd, bench->header, sizeof(bench->header));
+    close(fd);
+
+    if(read_len <= ENTRY_OFFSET)
+    {
+        return -1;
+    }
+
+    bench->header_len = (size_t)read_len;
+
+    return 0;
+}
+
+/*
+ * Sums the per call site allocation counters out of one scrape of the
+ * daemon's metrics. counted stays 0 for a daemon built without them.
+ */
+static int read_allocs(const char *path, struct daemon_allocs *allocs)
+{
+    struct sockaddr_un addr;
+    FILE              *in;
+    char              *line;
+    size_t             line_cap;
+    int                fd;
+
+    memset(allocs, 0, sizeof(*allocs));
+    memset(&addr, 0, sizeof(addr));
+
+    if(init_sockaddr_un(&addr, path) == -1)
+    {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    in = fdopen(fd, "r");
+
+    if(in == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+
+    line     = NULL;
+    line_cap = 0;
+
+    while(getline(&line, &line_cap, in) != -1)
+    {
+        unsigned long long value;
+        const char        *space;
+
+        space = strrchr(line, ' ');
+
+        if(line[0] == '#' || space == NULL || sscanf(space, "%llu", &value) != 1)
+        {
+            continue;
+        }
+
+        if(strncmp(line, "elfinspectd_allocations_total{", strlen("elfinspectd_allocations_total{")) == 0)
+        {
+            allocs->allocations += value;
+        }
+        else if(strncmp(line, "elfinspectd_allocated_bytes_total{", strlen("elfinspectd_allocated_bytes_total{")) == 0)
+        {
+            allocs->bytes += value;
+        }
+        else if(strncmp(line, "elfinspectd_peak_live_bytes ", strlen("elfinspectd_peak_live_bytes ")) == 0)
+        {
+            allocs->peak_bytes = value;
+        }
+        else if(strncmp(line, "elfinspectd_allocation_requests_total ", strlen("elfinspectd_allocation_requests_total ")) == 0)
+        {
+            allocs->requests = value;
+            allocs->counted  = 1;
+        }
+    }
+
+    free(line);
+    fclose(in);
+
+    return 0;
+}
+
+static void report_allocs(const struct daemon_allocs *before, const struct daemon_allocs *after)
+{
+    double requests;
+
+    if(!after->counted)
+    {
+        puts("Daemon allocations: not counted, build elfinspectd with -DALLOC_STATS");
+        return;
+    }
+
+    requests = after->requests > before->requests ? (double)(after->requests - before->requests) : 1.0;
+    printf("Daemon allocations per request: %.2f allocations, %.1f bytes, peak %llu bytes live\n",
+           (double)(after->allocations - before->allocations) / requests,
+           (double)(after->bytes - before->bytes) / requests,
+           (unsigned long long)after->peak_bytes);
+}
+
+static void usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [-h] [-c <outstanding>] [-n <requests>] [-k <keys>] [-S <metrics-socket-path>] <socket-path>[,<socket-path>...] <elf-file-path>\n", program_name);
+    fputs("Options:\n", stderr);
+    fputs(" -h Display this help message\n", stderr);
+    fputs(" -c Requests to keep outstanding (default 4096)\n", stderr);
+    fputs(" -n Requests to send (default 200000)\n", stderr);
+    fputs(" -k Distinct file contents to cycle through (default 1000000)\n", stderr);
+    fputs(" -S Metrics socket of a daemon to report allocations per request from\n", stderr);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench         bench;
+    struct daemon_allocs allocs_before;
+    struct daemon_allocs allocs_after;
+    const char          *metrics_path;
+    size_t               outstanding;
+    uint64_t             began_ns;
+    double               elapsed;
+    int                  opt;
+
+    memset(&bench, 0, sizeof(bench));
+    outstanding    = DEFAULT_OUTSTANDING;
+    bench.requests = DEFAULT_REQUESTS;
+    bench.keys     = DEFAULT_KEYS;
+    metrics_path   = NULL;
+
+    while((opt = getopt(argc, argv, "hc:n:k:S:")) != -1)
+    {
+        size_t *value;
+
+        if(opt == 'S')
+        {
+            metrics_path = optarg;
+            continue;
+        }
+
+        value = opt == 'c' ? &outstanding : opt == 'n' ? &bench.requests : opt == 'k' ? &bench.keys : NULL;
+
+        if(value == NULL || parse_size(optarg, value) == -1 || *value == 0)
+        {
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if(argc - optind != 2 || load_header(&bench, argv[optind + 1]) == -1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(elf_client_open(&bench.client, argv[optind]) == -1)
+    {
+        perror("elf_client_open");
+        return EXIT_FAILURE;
+    }
+
+    outstanding      = outstanding < bench.requests ? outstanding : bench.requests;
+    bench.slots      = (struct slot *)calloc(outstanding, sizeof(struct slot));
+    bench.free_slots = (size_t *)calloc(outstanding, sizeof(size_t));
+
+    if(bench.slots == NULL || bench.free_slots == NULL)
+    {
+        perror("calloc");
+        free(bench.slots);
+        free(bench.free_slots);
+        elf_client_close(&bench.client);
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < outstanding; i++)
+    {
+        bench.slots[i].bench = &bench;
+        bench.slots[i].index = i;
+        bench.free_slots[i]  = i;
+    }
+
+    if(metrics_path != NULL && read_allocs(metrics_path, &allocs_before) == -1)
+    {
+        perror(metrics_path);
+        free(bench.slots);
+        free(bench.free_slots);
+        elf_client_close(&bench.client);
+        return EXIT_FAILURE;
+    }
+
+    bench.free_count = outstanding;
+    began_ns         = histogram_now_ns();
+
+    while(bench.finished < bench.requests)
+    {
+        // every answer frees a slot for the next request, so the load stays at -c
+        while(bench.free_count > 0 && bench.submitted < bench.requests)
+        {
+            submit(&bench);
+        }
+
+        if(bench.finished < bench.requests && elf_client_process(&bench.client, -1) == -1 && errno != EINTR)
+        {
+            perror("elf_client_process");
+            break;
+        }
+    }
+
+    elapsed = (double)(histogram_now_ns() - began_ns) / NS_PER_SEC;
+    printf("%zu requests, %zu outstanding, %zu distinct contents: %.3f s, %.0f requests/s\n", bench.requests, outstanding, bench.keys, elapsed, (double)bench.finished / elapsed);
+    printf("Latency (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", (double)histogram_quantile(&bench.latency, P50) / NS_PER_US, (double)histogram_quantile(&bench.latency, P90) / NS_PER_US,
+           (double)histogram_quantile(&bench.latency, P99) / NS_PER_US, (double)histogram_quantile(&bench.latency, P999) / NS_PER_US, (double)bench.latency.max_ns / NS_PER_US);
+    printf("%llu busy retries, %llu connect retries, %zu failed\n", (unsigned long long)bench.client.busy, (unsigned long long)bench.client.retries, bench.failed);
+
+    if(metrics_path != NULL)
+    {
+        if(read_allocs(metrics_path, &allocs_after) == -1)
+        {
+            perror(metrics_path);
+        }
+        else
+        {
+            report_allocs(&allocs_before, &allocs_after);
+        }
+    }
+
+    elf_client_close(&bench.client);
+    free(bench.slots);
+    free(bench.free_slots);
+
+    return bench.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
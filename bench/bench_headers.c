@@ -0,0 +1,235 @@
+#include "header_reader.h"
+#include "histogram.h"
+#include "util.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NFTW_FDS 64                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_ROUNDS 3              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define INITIAL_PATHS 1024            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_SEC 1000000000.0
+#define NS_PER_MS 1000000.0
+
+/*
+ * Measures how fast the header reader gets through a tree, with plain
+ * system calls and with io_uring, from a cold and from a warm page
+ * cache. Cold means every file's cached pages were dropped with
+ * posix_fadvise(POSIX_FADV_DONTNEED) just before the run; that leaves
+ * the dentry and inode caches warm, so as root it is worth comparing
+ * against a run right after writing 3 to /proc/sys/vm/drop_caches.
+ */
+struct paths
+{
+    char  **paths;
+    size_t  count;
+    size_t  capacity;
+};
+
+static struct paths collected;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static int    collect(const char *path, const struct stat *stats, int type, struct FTW *walk);
+static void   drop_cache(const struct paths *paths);
+static double run(const struct paths *paths, size_t depth, bool use_uring, bool *used_uring);
+static void   usage(const char *program_name);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static int collect(const char *path, const struct stat *stats, int type, struct FTW *walk)
+{
+    if(type != FTW_F || !S_ISREG(stats->st_mode))
+    {
+        return 0;
+    }
+
+    if(collected.count == collected.capacity)
+    {
+        char **grown;
+        size_t capacity;
+
+        capacity = collected.capacity == 0 ? INITIAL_PATHS : collected.capacity * 2;
+        grown    = (char **)realloc((void *)collected.paths, capacity * sizeof(char *));
+
+        if(grown == NULL)
+        {
+            return -1;
+        }
+
+        collected.paths    = grown;
+        collected.capacity = capacity;
+    }
+
+    collected.paths[collected.count] = strdup(path);
+
+    return collected.paths[collected.count++] == NULL ? -1 : 0;
+}
+
+#pragma GCC diagnostic pop
+
+static void drop_cache(const struct paths *paths)
+{
+    for(size_t i = 0; i < paths->count; i++)
+    {
+        int fd;
+
+        fd = open(paths->paths[i], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+        if(fd != -1)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+// returns the seconds it took to read every header, or -1 if the reader could not be set up
+static double run(const struct paths *paths, size_t depth, bool use_uring, bool *used_uring)
+{
+    struct header_reader reader;
+    size_t               submitted;
+    size_t               taken;
+    uint64_t             began_ns;
+
+    if(header_reader_open(&reader, depth, use_uring) == -1)
+    {
+        return -1;
+    }
+
+    *used_uring = header_reader_uses_uring(&reader);
+    submitted   = 0;
+    taken       = 0;
+    began_ns    = histogram_now_ns();
+
+    while(taken < paths->count)
+    {
+        struct header_read *read;
+
+        while(submitted < paths->count && header_reader_has_room(&reader))
+        {
+            header_reader_submit(&reader, strdup(paths->paths[submitted++]));
+        }
+
+        header_reader_drive(&reader);
+
+        while((read = header_reader_take(&reader)) != NULL)
+        {
+            free(read->path);
+            header_reader_release(&reader, read);
+            taken++;
+        }
+
+        // nothing to take yet, so wait for the kernel rather than spin
+        if(taken < paths->count && header_reader_poll_fd(&reader) != 0)
+        {
+            struct pollfd fd;
+
+            fd.fd     = header_reader_poll_fd(&reader);
+            fd.events = POLLIN;
+            poll(&fd, 1, -1);
+        }
+    }
+
+    header_reader_close(&reader);
+
+    return (double)(histogram_now_ns() - began_ns) / NS_PER_SEC;
+}
+
+static void usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [-h] [-d <depth>] [-n <rounds>] <directory>\n", program_name);
+    fputs("Options:\n", stderr);
+    fputs(" -h Display this help message\n", stderr);
+    fputs(" -d Files in flight with io_uring (default 256)\n", stderr);
+    fputs(" -n Runs of each kind, of which the fastest is reported (default 3)\n", stderr);
+}
+
+int main(int argc, char *argv[])
+{
+    static const bool uring_modes[] = {false, true};
+    static const bool cold_modes[]  = {true, false};
+    size_t            depth;
+    size_t            rounds;
+    int               opt;
+
+    depth  = HEADER_READER_DEFAULT_DEPTH;
+    rounds = DEFAULT_ROUNDS;
+
+    while((opt = getopt(argc, argv, "hd:n:")) != -1)
+    {
+        size_t *value;
+
+        value = opt == 'd' ? &depth : opt == 'n' ? &rounds : NULL;
+
+        if(value == NULL || parse_size(optarg, value) == -1 || *value == 0 || (opt == 'd' && *value > HEADER_READER_MAX_DEPTH))
+        {
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if(argc - optind != 1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(nftw(argv[optind], collect, NFTW_FDS, FTW_PHYS) == -1 || collected.count == 0)
+    {
+        fprintf(stderr, "No regular files found below %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu files, depth %zu\n", collected.count, depth);
+
+    for(size_t u = 0; u < sizeof(uring_modes); u++)
+    {
+        for(size_t c = 0; c < sizeof(cold_modes); c++)
+        {
+            double best;
+            bool   used_uring;
+
+            best       = -1;
+            used_uring = false;
+
+            for(size_t round = 0; round < rounds; round++)
+            {
+                double seconds;
+
+                if(cold_modes[c])
+                {
+                    drop_cache(&collected);
+                }
+                else if(round == 0)
+                {
+                    // one untimed pass to make sure the cache is warm
+                    run(&collected, depth, uring_modes[u], &used_uring);
+                }
+
+                seconds = run(&collected, depth, uring_modes[u], &used_uring);
+                best    = best < 0 || (seconds >= 0 && seconds < best) ? seconds : best;
+            }
+
+            if(uring_modes[u] && !used_uring)
+            {
+                puts("io_uring: not available");
+                break;
+            }
+
+            printf("%-8s %-4s: %.0f files/s (%.1f ms)\n", uring_modes[u] ? "io_uring" : "plain", cold_modes[c] ? "cold" : "warm", (double)collected.count / best, best * NS_PER_SEC / NS_PER_MS);
+        }
+    }
+
+    for(size_t i = 0; i < collected.count; i++)
+    {
+        free(collected.paths[i]);
+    }
+
+    free((void *)collected.paths);
+
+    return EXIT_SUCCESS;
+}
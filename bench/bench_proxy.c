@@ -0,0 +1,287 @@
+#include "histogram.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define HEADER_LEN 64                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ENTRY_OFFSET 24                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RESPONSE_LEN 2048              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NAME_LEN 64                    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_CONCURRENCY 64         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_REQUESTS 100000        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEFAULT_KEYS 1                 // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define POLL_MS 1000                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_SEC 1000000000.0
+#define NS_PER_US 1000.0
+#define P50 0.50
+#define P90 0.90
+#define P99 0.99
+#define P999 0.999
+
+/*
+ * A load generator for the proxy, or anything else speaking the
+ * daemon's protocol: keeps a fixed number of requests in flight over
+ * raw sockets and reports throughput and latency percentiles. Every
+ * request sends the first bytes of one file with its entry point
+ * rewritten to one of -k values, so -k 1 measures the proxy's cache
+ * and a -k larger than its cache measures forwarding to the backends.
+ */
+struct request
+{
+    int      fd;
+    uint64_t started_ns;
+    char     response[RESPONSE_LEN];
+    size_t   response_len;
+};
+
+struct bench
+{
+    struct sockaddr_un addr;
+    uint8_t            header[HEADER_LEN];
+    size_t             header_len;
+    size_t             keys;
+    size_t             requests;
+    size_t             started;
+    size_t             finished;
+    size_t             busy;
+    size_t             failed;
+    struct histogram   latency;
+};
+
+static int  start_request(struct bench *bench, struct request *request);
+static void finish_request(struct bench *bench, struct request *request);
+static int  load_header(struct bench *bench, const char *path);
+static void usage(const char *program_name);
+
+static int start_request(struct bench *bench, struct request *request)
+{
+    char    name[NAME_LEN];
+    uint8_t header[HEADER_LEN];
+    size_t  key;
+    int     name_len;
+
+    request->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(request->fd == -1)
+    {
+        return -1;
+    }
+
+    request->started_ns   = histogram_now_ns();
+    request->response_len = 0;
+
+    // a full listen queue shows up as failures, as it would to any client
+    if(connect(request->fd, (struct sockaddr *)&bench->addr, sizeof(bench->addr)) == -1)
+    {
+        close(request->fd);
+        request->fd = -1;
+        return -1;
+    }
+
+    key = bench->started % bench->keys;
+    memcpy(header, bench->header, bench->header_len);
+    memcpy(header + ENTRY_OFFSET, &key, sizeof(key) < bench->header_len - ENTRY_OFFSET ? sizeof(key) : bench->header_len - ENTRY_OFFSET);
+    name_len = snprintf(name, sizeof(name), "/bench/%zu\n", key);
+
+    // a request fits any socket buffer, so writing it whole never blocks
+    if(name_len < 0 || write(request->fd, name, (size_t)name_len) != name_len || write(request->fd, header, bench->header_len) != (ssize_t)bench->header_len || shutdown(request->fd, SHUT_WR) == -1 ||
+       fcntl(request->fd, F_SETFL, O_NONBLOCK) == -1)
+    {
+        close(request->fd);
+        request->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void finish_request(struct bench *bench, struct request *request)
+{
+    histogram_record(&bench->latency, histogram_now_ns() - request->started_ns);
+
+    if(request->response_len >= strlen(BUSY_PREFIX) && memcmp(request->response, BUSY_PREFIX, strlen(BUSY_PREFIX)) == 0)
+    {
+        bench->busy++;
+    }
+    else if(request->response_len < strlen("File: ") || memcmp(request->response, "File: ", strlen("File: ")) != 0)
+    {
+        bench->failed++;
+    }
+
+    close(request->fd);
+    request->fd = -1;
+    bench->finished++;
+}
+
+static int load_header(struct bench *bench, const char *path)
+{
+    ssize_t read_len;
+    int     fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    read_len = read(fd, bench->header, sizeof(bench->header));
+    close(fd);
+
+    if(read_len <= ENTRY_OFFSET)
+    {
+        return -1;
+    }
+
+    bench->header_len = (size_t)read_len;
+
+    return 0;
+}
+
+static void usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [-h] [-c <concurrency>] [-n <requests>] [-k <keys>] <socket-path> <elf-file-path>\n", program_name);
+    fputs("Options:\n", stderr);
+    fputs(" -h Display this help message\n", stderr);
+    fputs(" -c Requests to keep in flight (default 64)\n", stderr);
+    fputs(" -n Requests to send (default 100000)\n", stderr);
+    fputs(" -k Distinct file contents to cycle through (default 1)\n", stderr);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench    bench;
+    struct request *requests;
+    struct pollfd  *fds;
+    size_t          concurrency;
+    uint64_t        began_ns;
+    double          elapsed;
+    int             opt;
+
+    memset(&bench, 0, sizeof(bench));
+    concurrency    = DEFAULT_CONCURRENCY;
+    bench.requests = DEFAULT_REQUESTS;
+    bench.keys     = DEFAULT_KEYS;
+
+    while((opt = getopt(argc, argv, "hc:n:k:")) != -1)
+    {
+        size_t *value;
+
+        value = opt == 'c' ? &concurrency : opt == 'n' ? &bench.requests : opt == 'k' ? &bench.keys : NULL;
+
+        if(value == NULL || parse_size(optarg, value) == -1 || *value == 0)
+        {
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if(argc - optind != 2 || init_sockaddr_un(&bench.addr, argv[optind]) == -1 || load_header(&bench, argv[optind + 1]) == -1)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    concurrency = concurrency < bench.requests ? concurrency : bench.requests;
+    requests    = (struct request *)calloc(concurrency, sizeof(struct request));
+    fds         = (struct pollfd *)calloc(concurrency, sizeof(struct pollfd));
+
+    if(requests == NULL || fds == NULL)
+    {
+        perror("calloc");
+        free(requests);
+        free(fds);
+        return EXIT_FAILURE;
+    }
+
+    began_ns = histogram_now_ns();
+
+    for(size_t i = 0; i < concurrency; i++)
+    {
+        requests[i].fd = -1;
+    }
+
+    while(bench.finished < bench.requests)
+    {
+        // every free slot starts the next request, so the load stays at -c
+        for(size_t i = 0; i < concurrency; i++)
+        {
+            while(requests[i].fd == -1 && bench.started < bench.requests)
+            {
+                bench.started++;
+
+                if(start_request(&bench, &requests[i]) == -1)
+                {
+                    bench.failed++;
+                    bench.finished++;
+                }
+            }
+
+            fds[i].fd      = requests[i].fd;
+            fds[i].events  = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if(bench.finished == bench.requests)
+        {
+            break;
+        }
+
+        if(poll(fds, concurrency, POLL_MS) == -1 && errno != EINTR)
+        {
+            perror("poll");
+            break;
+        }
+
+        for(size_t i = 0; i < concurrency; i++)
+        {
+            struct request *request;
+            ssize_t         read_len;
+
+            if(fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            request  = &requests[i];
+            read_len = read(request->fd, request->response + request->response_len, sizeof(request->response) - request->response_len);
+
+            if(read_len > 0)
+            {
+                request->response_len += (size_t)read_len;
+            }
+
+            if(read_len == 0 || (read_len == -1 && errno != EAGAIN && errno != EINTR) || request->response_len == sizeof(request->response))
+            {
+                finish_request(&bench, request);
+            }
+        }
+    }
+
+    elapsed = (double)(histogram_now_ns() - began_ns) / NS_PER_SEC;
+    printf("%zu requests, %zu in flight, %zu distinct contents: %.3f s, %.0f requests/s\n", bench.requests, concurrency, bench.keys, elapsed, (double)bench.requests / elapsed);
+    printf("Latency (us): p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", (double)histogram_quantile(&bench.latency, P50) / NS_PER_US, (double)histogram_quantile(&bench.latency, P90) / NS_PER_US,
+           (double)histogram_quantile(&bench.latency, P99) / NS_PER_US, (double)histogram_quantile(&bench.latency, P999) / NS_PER_US, (double)bench.latency.max_ns / NS_PER_US);
+    printf("%zu told to retry, %zu failed\n", bench.busy, bench.failed);
+
+    for(size_t i = 0; i < concurrency; i++)
+    {
+        if(requests[i].fd != -1)
+        {
+            close(requests[i].fd);
+        }
+    }
+
+    free(requests);
+    free(fds);
+
+    return bench.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
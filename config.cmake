@@ -11,6 +11,8 @@ set(CMAKE_C_EXTENSIONS OFF)
 set(STANDARD_FLAGS
         -D_POSIX_C_SOURCE=200809L
         -D_XOPEN_SOURCE=700
+        #-DFSM_TIMING
+        #-DALLOC_STATS
         #-D_GNU_SOURCE
         #-D_DARWIN_C_SOURCE
         #-D__BSD_VISIBLE
@@ -21,27 +23,90 @@ set(STANDARD_FLAGS
 set(EXECUTABLE_TARGETS
         elfinspectd
         elfinspect
+        elfinspect-proxy
+        elfinspect-activate
+        elfquery
+)
+set(LIBRARY_TARGETS
+        elfinspect_shared
+        elfinspect_static
 )
-set(LIBRARY_TARGETS "")
 
-set(elfinspectd_SOURCES
-        src/elfinspectd.c
+# libelfinspect: in-process inspection and a non-blocking daemon client, built both ways under one name
+set(LIBELFINSPECT_SOURCES
+        src/content_key.c
+        src/elf_client.c
+        src/elf_inspect.c
         src/elf_validator.c
+        src/shard_ring.c
         src/util.c
 )
 
+set(LIBELFINSPECT_HEADERS
+        include/content_key.h
+        include/elf_client.h
+        include/elf_inspect.h
+        include/elf_ident.h
+        include/elf_result.h
+        include/elf_validator.h
+        include/elfinspect_export.h
+        include/elf32_header.h
+        include/elf64_header.h
+        include/shard_ring.h
+        include/util.h
+        include/verification_set.h
+)
+
+set(elfinspect_shared_SOURCES ${LIBELFINSPECT_SOURCES})
+set(elfinspect_shared_HEADERS ${LIBELFINSPECT_HEADERS})
+set(elfinspect_shared_TYPE SHARED)
+set(elfinspect_shared_OUTPUT_NAME elfinspect)
+set(elfinspect_shared_VISIBILITY hidden)
+
+set(elfinspect_static_SOURCES ${LIBELFINSPECT_SOURCES})
+set(elfinspect_static_HEADERS ${LIBELFINSPECT_HEADERS})
+set(elfinspect_static_TYPE STATIC)
+set(elfinspect_static_OUTPUT_NAME elfinspect)
+
+set(elfinspectd_SOURCES
+        src/elfinspectd.c
+        src/alloc_stats.c
+        src/catalog.c
+        src/fsm_timing.c
+        src/handoff.c
+        src/histogram.c
+        src/listener.c
+        src/metrics.c
+        src/perf_counters.c
+        src/shm_cache.c
+        src/timer_wheel.c
+        src/trace.c
+)
+
 set(elfinspectd_HEADERS
+        include/alloc_stats.h
         include/argumentsd.h
+        include/catalog.h
         include/errorsd.h
         include/contextd.h
-        include/elf_file_details.h
-        include/elf_ident.h
-        include/elf32_header.h
-        include/elf64_header.h
+        include/content_key.h
+        include/elf_inspect.h
+        include/elf_result.h
         include/elf_validator.h
+        include/fsm_timing.h
+        include/handoff.h
+        include/histogram.h
+        include/listener.h
+        include/metrics.h
+        include/perf_counters.h
+        include/probes.h
+        include/shm_cache.h
+        include/timer_wheel.h
+        include/trace.h
 )
 
 set(elfinspectd_LINK_LIBRARIES
+        elfinspect_static
         p101_error
         p101_env
         p101_c
@@ -50,20 +115,124 @@ set(elfinspectd_LINK_LIBRARIES
         p101_fsm
         p101_convert
         m
+        pthread
 )
 
 set(elfinspect_SOURCES
         src/elfinspect.c
-        src/util.c
+        src/batch.c
+        src/fsm_timing.c
+        src/header_reader.c
+        src/histogram.c
+        src/scanner.c
+        src/stat_cache.c
+        src/trace.c
+        src/watcher.c
 )
 
 set(elfinspect_HEADERS
         include/arguments.h
+        include/batch.h
+        include/content_key.h
         include/context.h
+        include/elf_client.h
+        include/elf_inspect.h
         include/errors.h
+        include/fsm_timing.h
+        include/header_reader.h
+        include/histogram.h
+        include/probes.h
+        include/scanner.h
+        include/shard_ring.h
+        include/stat_cache.h
+        include/trace.h
+        include/watcher.h
 )
 
 set(elfinspect_LINK_LIBRARIES
+        elfinspect_static
+        p101_error
+        p101_env
+        p101_c
+        p101_posix
+        p101_unix
+        p101_fsm
+        p101_convert
+        m
+        pthread
+)
+
+set(elfinspect-proxy_SOURCES
+        src/elfinspect_proxy.c
+        src/relay.c
+        src/response_cache.c
+        src/timer_wheel.c
+)
+
+set(elfinspect-proxy_HEADERS
+        include/argumentsp.h
+        include/content_key.h
+        include/contextp.h
+        include/errorsp.h
+        include/relay.h
+        include/response_cache.h
+        include/shard_ring.h
+        include/timer_wheel.h
+)
+
+set(elfinspect-proxy_LINK_LIBRARIES
+        elfinspect_static
+        p101_error
+        p101_env
+        p101_c
+        p101_posix
+        p101_unix
+        p101_fsm
+        p101_convert
+        m
+)
+
+set(elfinspect-activate_SOURCES
+        src/elfinspect_activate.c
+)
+
+set(elfinspect-activate_HEADERS
+        include/argumentsa.h
+        include/contexta.h
+        include/errorsa.h
+        include/util.h
+)
+
+set(elfinspect-activate_LINK_LIBRARIES
+        elfinspect_static
+        p101_error
+        p101_env
+        p101_c
+        p101_posix
+        p101_unix
+        p101_fsm
+        p101_convert
+)
+
+set(elfquery_SOURCES
+        src/elfquery.c
+        src/catalog.c
+        src/columnar.c
+)
+
+set(elfquery_HEADERS
+        include/argumentsq.h
+        include/catalog.h
+        include/columnar.h
+        include/content_key.h
+        include/contextq.h
+        include/elf_result.h
+        include/elf_validator.h
+        include/errorsq.h
+)
+
+set(elfquery_LINK_LIBRARIES
+        elfinspect_static
         p101_error
         p101_env
         p101_c
@@ -72,4 +241,126 @@ set(elfinspect_LINK_LIBRARIES
         p101_fsm
         p101_convert
         m
-)
\ No newline at end of file
+        pthread
+)
+
+# Unit tests, run by ctest; each is a plain program that exits non-zero when a check fails
+set(TEST_TARGETS
+        test_catalog
+        test_content_key
+        test_elf_inspect
+        test_header_reader
+        test_histogram
+        test_shard_ring
+        test_shm_cache
+        test_stat_cache
+        test_timer_wheel
+)
+
+set(test_catalog_SOURCES
+        tests/test_catalog.c
+        src/catalog.c
+)
+
+set(test_catalog_LINK_LIBRARIES
+        elfinspect_static
+        pthread
+)
+
+set(test_content_key_SOURCES
+        tests/test_content_key.c
+)
+
+set(test_content_key_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(test_elf_inspect_SOURCES
+        tests/test_elf_inspect.c
+)
+
+set(test_elf_inspect_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(test_header_reader_SOURCES
+        tests/test_header_reader.c
+        src/header_reader.c
+        src/stat_cache.c
+)
+
+set(test_header_reader_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(test_histogram_SOURCES
+        tests/test_histogram.c
+        src/histogram.c
+)
+
+set(test_shard_ring_SOURCES
+        tests/test_shard_ring.c
+)
+
+set(test_shard_ring_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(test_shm_cache_SOURCES
+        tests/test_shm_cache.c
+        src/shm_cache.c
+)
+
+set(test_shm_cache_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(test_stat_cache_SOURCES
+        tests/test_stat_cache.c
+        src/stat_cache.c
+)
+
+set(test_stat_cache_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(test_timer_wheel_SOURCES
+        tests/test_timer_wheel.c
+        src/timer_wheel.c
+)
+
+# Benchmarks: load generators to run by hand against running daemons or a proxy
+set(BENCHMARK_TARGETS
+        bench_client
+        bench_headers
+        bench_proxy
+)
+
+set(bench_client_SOURCES
+        bench/bench_client.c
+        src/histogram.c
+)
+
+set(bench_client_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(bench_headers_SOURCES
+        bench/bench_headers.c
+        src/header_reader.c
+        src/histogram.c
+        src/stat_cache.c
+)
+
+set(bench_headers_LINK_LIBRARIES
+        elfinspect_static
+)
+
+set(bench_proxy_SOURCES
+        bench/bench_proxy.c
+        src/histogram.c
+)
+
+set(bench_proxy_LINK_LIBRARIES
+        elfinspect_static
+)
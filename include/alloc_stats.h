@@ -0,0 +1,97 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ALLOC_STATS_MAX_SITES 16    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * The call that allocated, named by its function and line. ALLOC_SITE
+ * names the call it is written in.
+ */
+struct alloc_site
+{
+    const char *function;
+    int         line;
+};
+
+#define ALLOC_SITE ((struct alloc_site){__func__, __LINE__})
+
+/*
+ * What the daemon allocates through its p101_env while serving, by the
+ * call that asked for it. Builds define ALLOC_STATS to turn it on;
+ * otherwise the macros below expand to nothing and the daemon carries
+ * no struct alloc_stats. Like struct metrics it is only touched by the
+ * serving thread. Call sites past ALLOC_STATS_MAX_SITES share the last
+ * entry.
+ */
+struct alloc_stats
+{
+    struct alloc_site sites[ALLOC_STATS_MAX_SITES];
+    uint64_t          allocations[ALLOC_STATS_MAX_SITES];
+    uint64_t          bytes[ALLOC_STATS_MAX_SITES];
+    size_t            site_count;
+    uint64_t          frees;
+    uint64_t          live_bytes;
+    uint64_t          peak_bytes;
+    uint64_t          requests;
+};
+
+/**
+ * Counts one allocation.
+ *
+ * @param stats the stats to count in
+ * @param site the call that allocated
+ * @param bytes the size allocated
+ */
+void alloc_stats_allocated(struct alloc_stats *stats, struct alloc_site site, uint64_t bytes);
+
+/**
+ * Counts one free.
+ *
+ * @param stats the stats to count in
+ * @param bytes the size of what was freed
+ */
+void alloc_stats_freed(struct alloc_stats *stats, uint64_t bytes);
+
+/**
+ * Counts one request served, for allocations per request.
+ *
+ * @param stats the stats to count in
+ */
+void alloc_stats_request(struct alloc_stats *stats);
+
+/**
+ * Writes the stats in the Prometheus text format.
+ *
+ * @param stats the stats to write
+ * @param out where to write them
+ */
+void alloc_stats_write(const struct alloc_stats *stats, FILE *out);
+
+/**
+ * Writes a summary of allocations and bytes per request, with a line
+ * for each call site.
+ *
+ * @param stats the stats to summarize
+ * @param out where to write it
+ */
+void alloc_stats_summary(const struct alloc_stats *stats, FILE *out);
+
+#ifdef ALLOC_STATS
+    #define ALLOC_STATS_ALLOCATED(stats, site, bytes) alloc_stats_allocated((stats), (site), (bytes))
+    #define ALLOC_STATS_FREED(stats, bytes) alloc_stats_freed((stats), (bytes))
+    #define ALLOC_STATS_REQUEST(stats) alloc_stats_request(stats)
+    #define ALLOC_STATS_WRITE(stats, out) alloc_stats_write((stats), (out))
+    #define ALLOC_STATS_SUMMARY(stats, out) alloc_stats_summary((stats), (out))
+#else
+    #define ALLOC_STATS_ALLOCATED(stats, site, bytes) ((void)0)
+    #define ALLOC_STATS_FREED(stats, bytes) ((void)0)
+    #define ALLOC_STATS_REQUEST(stats) ((void)0)
+    #define ALLOC_STATS_WRITE(stats, out) ((void)0)
+    #define ALLOC_STATS_SUMMARY(stats, out) ((void)0)
+#endif
+
+#endif    // ALLOC_STATS_H
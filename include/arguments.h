@@ -1,12 +1,33 @@
 #ifndef ARGUMENTS_H
 #define ARGUMENTS_H
 
+#include "watcher.h"
+#include <stdbool.h>
+#include <stddef.h>
+
 struct arguments
 {
     int argc;
     const char *program_name;
     const char *socket_path;
     const char *elf_path;
+    char **elf_paths;
+    size_t elf_path_count;
+    size_t jobs;
+    bool batch;
+    bool null_separated;
+    const char *scan_root;
+    size_t scan_threads;
+    bool plain_reads;
+    const char *watch_roots[WATCHER_MAX_ROOTS];
+    size_t watch_root_count;
+    size_t debounce_ms;
+    const char *cache_path;
+    bool revalidate;
+    bool local;
+    size_t budget_ms;
+    const char *trace_path;
+    size_t trace_sample;
     char **argv;
 };
 
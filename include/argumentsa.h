@@ -0,0 +1,18 @@
+#ifndef ARGUMENTSA_H
+#define ARGUMENTSA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct argumentsa
+{
+    int argc;
+    const char *program_name;
+    const char *socket_path;
+    size_t backlog;
+    bool lazy;
+    char **daemon_argv;
+    char **argv;
+};
+
+#endif    // ARGUMENTSA_H
@@ -1,11 +1,30 @@
 #ifndef ARGUMENTSD_H
 #define ARGUMENTSD_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 struct argumentsd
 {
     int argc;
     const char *program_name;
     const char *socket_path;
+    const char *cache_path;
+    size_t cache_slots;
+    const char *catalog_path;
+    const char *control_path;
+    const char *metrics_path;
+    const char *trace_path;
+    size_t trace_sample;
+    bool perf_counters;
+    size_t header_ms;
+    size_t body_ms;
+    size_t total_ms;
+    size_t max_connections;
+    size_t buffer_budget;
+    size_t backlog;
+    size_t rate;
+    size_t burst;
     char **argv;
 };
 
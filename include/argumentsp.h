@@ -0,0 +1,20 @@
+#ifndef ARGUMENTSP_H
+#define ARGUMENTSP_H
+
+#include <stddef.h>
+
+struct argumentsp
+{
+    int argc;
+    const char *program_name;
+    const char *socket_path;
+    const char *backend_list;
+    size_t cache_entries;
+    size_t header_ms;
+    size_t body_ms;
+    size_t backend_ms;
+    size_t max_connections;
+    char **argv;
+};
+
+#endif    // ARGUMENTSP_H
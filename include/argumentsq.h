@@ -0,0 +1,16 @@
+#ifndef ARGUMENTSQ_H
+#define ARGUMENTSQ_H
+
+#include "columnar.h"
+
+struct argumentsq
+{
+    int argc;
+    const char *program_name;
+    const char *catalog_path;
+    const char *columns_path;
+    struct columnar_query query;
+    char **argv;
+};
+
+#endif    // ARGUMENTSQ_H
@@ -0,0 +1,88 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "content_key.h"
+#include "elf_client.h"
+#include "stat_cache.h"
+#include "trace.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define BATCH_DEFAULT_JOBS 16           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BATCH_MAX_JOBS 65536            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BATCH_RETRY_MS 1                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum batch_next
+{
+    BATCH_NEXT_DONE,
+    BATCH_NEXT_PATH,
+    BATCH_NEXT_PENDING,
+};
+
+/**
+ * Hands out the next path to inspect. A source that produces paths in
+ * the background may report BATCH_NEXT_PENDING, but only when wait is
+ * false; the engine then polls it again shortly.
+ *
+ * @param arg the source state
+ * @param wait block until a path is available or the source is drained
+ * @param path where to store a path the engine will free
+ * @return BATCH_NEXT_PATH, BATCH_NEXT_DONE once drained, or BATCH_NEXT_PENDING
+ */
+typedef enum batch_next (*batch_next_path)(void *arg, bool wait, char **path);
+
+struct batch_options
+{
+    const char        *socket_paths;
+    size_t             jobs;
+    size_t             depth;
+    bool               use_uring;
+    struct stat_cache *cache;
+    bool               revalidate;
+    bool               elf_only;
+    size_t             budget_ms;
+    struct trace      *trace;
+    batch_next_path    next_path;
+    void              *source_arg;
+    FILE              *out;
+};
+
+struct batch_stats
+{
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t cached;
+    uint64_t skipped;
+    bool     used_uring;
+};
+
+/**
+ * Inspects every path the source hands out, keeping up to jobs
+ * requests in flight across the daemons on socket_paths through an
+ * elf_client. Headers are read
+ * ahead, up to depth files at once through io_uring when use_uring is
+ * set and available, while other requests wait on their daemon.
+ * Responses are written to out as they complete, and per file failures
+ * go to stderr. With a cache, a file whose stat identity matches a
+ * recorded answer is answered from it without being opened, unless
+ * revalidate is set; every answer received is recorded. With elf_only,
+ * for sources that hand out every file they find, a file that cannot
+ * be read or whose header lacks the ELF magic is neither sent nor
+ * reported, and is counted as skipped instead of submitted. A budget_ms
+ * other than 0 is the time each request may take before it fails.
+ * With a trace, each sampled request records a span from the moment
+ * its header is handed to the client until its answer comes back.
+ * Only each file's header is sent, so the daemon's limit on file data
+ * does not apply: a file over it is inspected here, where the same
+ * file sent whole on its own is answered "File data too large".
+ *
+ * @param options the daemons, concurrency, read ahead, cache, ELF filter, time budget, trace, path source and output stream
+ * @param stats where to count the requests
+ * @return 0 once the source is drained, -1 if the engine itself failed
+ */
+int batch_run(const struct batch_options *options, struct batch_stats *stats);
+
+#endif    // BATCH_H
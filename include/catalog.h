@@ -0,0 +1,195 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "content_key.h"
+#include "elf_result.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CATALOG_MAGIC 0x54414345u              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_INDEX_MAGIC 0x58444945u        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_RECORD_MARKER 0x43455245u      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_VERSION 2                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_HEADER_LEN 64                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_INITIAL_CAPACITY 65536         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_GROW_BYTES (64 * 1024 * 1024)  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_COMPACT_MIN_DEAD 4096          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_MIGRATE_STEP 64                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_MIGRATE_IDLE_STEP 65536        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_INDEX_SUFFIX ".idx"
+#define CATALOG_COMPACT_SUFFIX ".compact"
+
+/*
+ * Log layout: a CATALOG_HEADER_LEN header followed by fixed size
+ * records. The file is grown in CATALOG_GROW_BYTES steps, so the
+ * unwritten tail is zero and fails the marker check. A torn record
+ * fails the checksum, which is where recovery stops.
+ */
+struct catalog_log_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t log_id;
+    uint32_t record_size;
+    uint32_t result_size;
+};
+
+/*
+ * The header bytes the key was computed from are kept with the result,
+ * so a key collision, accidental or planted, reads as a miss rather
+ * than as another file's answer.
+ */
+struct catalog_record
+{
+    uint32_t          marker;
+    uint32_t          checksum;
+    uint64_t          key;
+    uint32_t          header_len;
+    uint8_t           header[CONTENT_KEY_SPAN];
+    struct elf_result result;
+};
+
+/*
+ * Index layout: a header followed by an open addressing table of
+ * (key, log offset) pairs. indexed_len is the log length the table
+ * covers; only records past it are replayed at startup.
+ */
+struct catalog_index_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t log_id;
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t dead;
+    uint64_t indexed_len;
+};
+
+struct catalog_index_slot
+{
+    uint64_t key;
+    uint64_t offset;
+};
+
+/*
+ * While the index grows, old_index is the table being moved into the
+ * new, twice as large index a few slots at a time; lookups try both.
+ * The old table stays at index_path with its indexed_len frozen until
+ * the move is done, so a crash midway just replays the difference.
+ *
+ * Compaction runs on a thread of its own with its own read only map of
+ * the log up to compact_snapshot, which is never written again; the
+ * main thread touches none of the compact_ fields until compact_done.
+ */
+struct catalog
+{
+    char                        *log_path;
+    char                        *index_path;
+    int                          log_fd;
+    int                          index_fd;
+    uint8_t                     *log_map;
+    size_t                       log_map_len;
+    uint64_t                     tail;
+    struct catalog_index_header *index;
+    struct catalog_index_slot   *slots;
+    size_t                       index_map_len;
+    char                        *grow_path;
+    int                          old_index_fd;
+    struct catalog_index_header *old_index;
+    struct catalog_index_slot   *old_slots;
+    size_t                       old_index_map_len;
+    uint64_t                     migrated;
+    pthread_t                    compactor;
+    bool                         compacting;
+    atomic_bool                  compact_stop;
+    atomic_bool                  compact_done;
+    int                          compact_status;
+    uint64_t                     compact_snapshot;
+};
+
+/**
+ * Opens or creates the catalog at path and its index at
+ * path CATALOG_INDEX_SUFFIX. Records written after the index was last
+ * updated are replayed, and a missing or mismatched index is rebuilt
+ * from the log. Only one process may hold a catalog open.
+ *
+ * @param catalog the catalog to fill
+ * @param path the log file
+ * @return 0 if successful, -1 if not
+ */
+int catalog_open(struct catalog *catalog, const char *path);
+
+/**
+ * Maps an existing catalog read only, without taking the writer lock
+ * and without replaying, so it can be read while a daemon appends.
+ * Only records already in the index are visible.
+ *
+ * @param catalog the catalog to fill
+ * @param path the log file
+ * @return 0 if successful, -1 if the catalog or its index is unusable
+ */
+int catalog_open_snapshot(struct catalog *catalog, const char *path);
+
+/**
+ * Calls visit for every live record in the index.
+ *
+ * @param catalog the catalog to walk
+ * @param visit the function to call with each key and result
+ * @param arg passed through to visit
+ * @return the number of records visited
+ */
+uint64_t catalog_scan(const struct catalog *catalog, void (*visit)(uint64_t key, const struct elf_result *result, void *arg), void *arg);
+
+/**
+ * Syncs and unmaps the catalog, stopping a compaction in progress.
+ *
+ * @param catalog the catalog to close
+ */
+void catalog_close(struct catalog *catalog);
+
+/**
+ * Looks up the result stored for a header. Only the first
+ * CONTENT_KEY_SPAN bytes of the header count, as for the key.
+ *
+ * @param catalog the catalog to search
+ * @param key the content key of the header
+ * @param header the header the key was computed from
+ * @param header_len the length of the header
+ * @param result where to copy the record
+ * @return 0 on a hit, -1 on a miss
+ */
+int catalog_get(const struct catalog *catalog, uint64_t key, const void *header, size_t header_len, struct elf_result *result);
+
+/**
+ * Appends a result and indexes it, superseding an older one. When the
+ * index fills up a larger one is started, and each put moves
+ * CATALOG_MIGRATE_STEP slots of the old table into it, so no single
+ * request pays for a whole rehash.
+ *
+ * @param catalog the catalog to append to
+ * @param key the content key of the header
+ * @param header the header the key was computed from
+ * @param header_len the length of the header
+ * @param result the record to append
+ * @return 0 if successful, -1 if not
+ */
+int catalog_put(struct catalog *catalog, uint64_t key, const void *header, size_t header_len, const struct elf_result *result);
+
+/**
+ * Housekeeping to call between requests. Moves a larger share of a
+ * growing index than catalog_put does, starts a compaction on a
+ * thread once superseded records pile up and no growth is moving, and
+ * swaps in the compacted files once the thread is done, finishing any
+ * growth begun meanwhile first. If the compacted catalog cannot be
+ * opened the old one carries on, detached from the path, and is
+ * compacted again on the next call.
+ *
+ * @param catalog the catalog to maintain
+ * @return 0 if successful, -1 if a finished compaction could not be swapped in
+ */
+int catalog_maintain(struct catalog *catalog);
+
+#endif    // CATALOG_H
@@ -0,0 +1,145 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include "catalog.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define COLUMNAR_MAGIC 0x4c4f4345u          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define COLUMNAR_VERSION 1                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define COLUMNAR_ALIGN 64                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define COLUMNAR_BLOCK_ROWS 4096            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define COLUMNAR_MAX_FILTERS 8              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define COLUMNAR_MAX_GROUPS 2               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum column
+{
+    COLUMN_VALID,
+    COLUMN_CLASS,
+    COLUMN_DATA,
+    COLUMN_TYPE,
+    COLUMN_MACHINE,
+    COLUMN_FLAGS,
+    COLUMN_ENTRY,
+    COLUMN_COUNT,
+};
+
+/*
+ * File layout: this header, then one packed array per column, each
+ * starting on a COLUMNAR_ALIGN boundary so scans run on aligned,
+ * contiguous values of a single width.
+ */
+struct columnar_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t rows;
+    uint64_t offsets[COLUMN_COUNT];
+};
+
+struct columnar_table
+{
+    struct columnar_header *header;
+    size_t                  map_len;
+    const void             *columns[COLUMN_COUNT];
+};
+
+struct columnar_filter
+{
+    enum column column;
+    uint64_t    value;
+};
+
+struct columnar_group
+{
+    uint64_t values[COLUMNAR_MAX_GROUPS];
+    uint64_t count;
+};
+
+struct columnar_query
+{
+    struct columnar_filter filters[COLUMNAR_MAX_FILTERS];
+    size_t                 filter_count;
+    enum column            groups[COLUMNAR_MAX_GROUPS];
+    size_t                 group_count;
+};
+
+struct columnar_result
+{
+    uint64_t               scanned;
+    uint64_t               matched;
+    struct columnar_group *groups;
+    size_t                 group_count;
+};
+
+/**
+ * Looks up a column by its name (valid, class, data, type,
+ * machine, flags, entry).
+ *
+ * @param name the column name
+ * @param column where to store the column
+ * @return 0 if successful, -1 if there is no such column
+ */
+int columnar_column_by_name(const char *name, enum column *column);
+
+/**
+ * Returns the name of a column.
+ *
+ * @param column the column
+ * @return the name
+ */
+const char *columnar_column_name(enum column column);
+
+/**
+ * Returns the largest value a column can hold, so that a filter value
+ * wider than the column can be turned away instead of truncated.
+ *
+ * @param column the column
+ * @return the largest value
+ */
+uint64_t columnar_column_max(enum column column);
+
+/**
+ * Writes every live record of a catalog to a columnar file.
+ *
+ * @param catalog the catalog to export
+ * @param path the file to write
+ * @return the number of rows written or -1 if the file could not be written
+ */
+int64_t columnar_export(const struct catalog *catalog, const char *path);
+
+/**
+ * Maps a columnar file read only.
+ *
+ * @param table the table to fill
+ * @param path the file to map
+ * @return 0 if successful, -1 if not
+ */
+int columnar_open(struct columnar_table *table, const char *path);
+
+/**
+ * Unmaps a columnar file.
+ *
+ * @param table the table to unmap
+ */
+void columnar_close(struct columnar_table *table);
+
+/**
+ * Counts the rows matching every filter, grouped by up to
+ * COLUMNAR_MAX_GROUPS columns. Groups are sorted by value.
+ *
+ * @param table the table to scan
+ * @param query the filters and group columns
+ * @param result where to store the counts, release with columnar_result_free
+ * @return 0 if successful, -1 if memory ran out
+ */
+int columnar_run(const struct columnar_table *table, const struct columnar_query *query, struct columnar_result *result);
+
+/**
+ * Releases the groups of a result.
+ *
+ * @param result the result to release
+ */
+void columnar_result_free(struct columnar_result *result);
+
+#endif    // COLUMNAR_H
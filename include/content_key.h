@@ -0,0 +1,47 @@
+#ifndef CONTENT_KEY_H
+#define CONTENT_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTENT_KEY_SPAN 64    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/**
+ * Computes the content key of a file from its leading bytes.
+ * Only the first CONTENT_KEY_SPAN bytes take part, since the
+ * inspection result depends on nothing past the ELF header.
+ *
+ * @param buf the leading bytes of the file
+ * @param len the number of bytes available in buf
+ * @return the 64 bit content key
+ */
+uint64_t content_key(const void *buf, size_t len);
+
+/**
+ * Returns how many of len leading bytes content_key hashes, which
+ * is what a cache keeps to tell colliding keys apart.
+ *
+ * @param len the number of bytes available
+ * @return len, capped at CONTENT_KEY_SPAN
+ */
+size_t content_key_span(size_t len);
+
+/**
+ * Hashes a whole file name, however long, the same way in every
+ * process.
+ *
+ * @param name the NUL terminated file name
+ * @return the 64 bit key
+ */
+uint64_t name_key(const char *name);
+
+/**
+ * Scrambles the bits of a 64 bit value so that nearby inputs
+ * land far apart.
+ *
+ * @param value the value to mix
+ * @return the mixed value
+ */
+uint64_t mix64(uint64_t value);
+
+#endif    // CONTENT_KEY_H
@@ -2,6 +2,15 @@
 #define CONTEXT_H
 
 #include "arguments.h"
+#include "batch.h"
+#include "fsm_timing.h"
+#include "scanner.h"
+#include "shard_ring.h"
+#include "stat_cache.h"
+#include "trace.h"
+#include "watcher.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 struct context
 {
@@ -9,6 +18,28 @@ struct context
 
     int socket_fd;
     int elf_fd;
+    size_t busy_retries;
+    uint64_t jitter;
+    uint64_t deadline_ms;
+
+    struct shard_ring ring;
+    uint64_t content_key;
+
+    size_t next_path;
+    struct batch_stats batch_stats;
+    struct scanner scanner;
+    struct watcher watcher;
+    struct stat_cache cache;
+
+    struct trace trace;
+    uint64_t trace_id;
+    bool traced;
+    uint64_t request_ns;
+    uint64_t connect_ns;
+
+#ifdef FSM_TIMING
+    struct fsm_timing fsm_timing;
+#endif
 
     int exit_code;
 };
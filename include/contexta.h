@@ -0,0 +1,15 @@
+#ifndef CONTEXTA_H
+#define CONTEXTA_H
+
+#include "argumentsa.h"
+
+struct contexta
+{
+    struct argumentsa *arguments;
+
+    int socket_fd;
+
+    int exit_code;
+};
+
+#endif    // CONTEXTA_H
@@ -1,17 +1,56 @@
 #ifndef CONTEXTD_H
 #define CONTEXTD_H
 
+#include "alloc_stats.h"
 #include "argumentsd.h"
-#include "elf_file_details.h"
+#include "catalog.h"
+#include "elf_inspect.h"
+#include "elf_result.h"
+#include "fsm_timing.h"
+#include "listener.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "shm_cache.h"
+#include "trace.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct contextd
 {
     struct argumentsd *arguments;
 
     int socket_fd;
+    int control_fd;
+    int metrics_fd;
     int request_fd;
-    struct elf_file_details elf_details;
-    char* response_message;
+    struct listener listener;
+    struct listener_conn *conn;
+    char *file_name;
+    uint8_t header[ELF_INSPECT_HEADER_LEN];
+    size_t header_len;
+
+    uint64_t content_key;
+    struct elf_result result;
+    bool result_found;
+    struct shm_cache shm_cache;
+    struct catalog catalog;
+
+    struct metrics metrics;
+    uint64_t handed_ns;
+    uint64_t lookup_ns;
+    uint64_t respond_ns;
+    uint64_t responded_ns;
+    struct trace trace;
+    struct perf_counters perf;
+
+#ifdef FSM_TIMING
+    struct fsm_timing fsm_timing;
+#endif
+
+#ifdef ALLOC_STATS
+    struct alloc_stats alloc_stats;
+#endif
 
     int exit_code;
 };
@@ -0,0 +1,26 @@
+#ifndef CONTEXTP_H
+#define CONTEXTP_H
+
+#include "argumentsp.h"
+#include "relay.h"
+#include "response_cache.h"
+#include "shard_ring.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+struct contextp
+{
+    struct argumentsp *arguments;
+
+    int socket_fd;
+
+    struct shard_ring backends;
+    struct response_cache cache;
+    struct relay relay;
+    bool relay_open;
+
+    int exit_code;
+};
+
+#endif    // CONTEXTP_H
@@ -0,0 +1,19 @@
+#ifndef CONTEXTQ_H
+#define CONTEXTQ_H
+
+#include "argumentsq.h"
+#include "catalog.h"
+#include "columnar.h"
+
+struct contextq
+{
+    struct argumentsq *arguments;
+
+    struct catalog catalog;
+    struct columnar_table table;
+    struct columnar_result result;
+
+    int exit_code;
+};
+
+#endif    // CONTEXTQ_H
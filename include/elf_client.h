@@ -0,0 +1,163 @@
+#ifndef ELF_CLIENT_H
+#define ELF_CLIENT_H
+
+#include "elfinspect_export.h"
+#include "shard_ring.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ELF_CLIENT_NAME_LEN 4096        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_CLIENT_HEADER_LEN 64        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_CLIENT_RESPONSE_LEN 1028    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_CLIENT_RETRY_MS 1           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_CLIENT_BUSY_RETRIES 16      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_CLIENT_MAX_BUSY_MS 1000     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_CLIENT_MAX_EVENTS 256       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * How a request ended. On success response holds the daemon's answer
+ * and error is NULL; otherwise error says why and response is NULL.
+ * Everything here is only valid during the callback.
+ */
+struct elf_client_answer
+{
+    const char *name;
+    const char *response;
+    size_t      response_len;
+    const char *error;
+};
+
+/**
+ * Called once for every request that was submitted successfully. The
+ * callback may submit further requests but must not close the client.
+ *
+ * @param arg the argument given when the request was submitted
+ * @param answer how the request ended
+ */
+typedef void (*elf_client_callback)(void *arg, const struct elf_client_answer *answer);
+
+struct elf_client_request;
+
+/*
+ * Talks to the daemons without blocking. Every request in flight owns
+ * a non-blocking connection registered with one epoll instance, and
+ * that instance is the descriptor handed out, so the whole client sits
+ * in the caller's own poll or epoll loop as a single readable fd.
+ * Requests refused by a full listen backlog wait on a timer, which is
+ * registered the same way.
+ *
+ * A daemon that answers busy is asked again after the delay it named,
+ * doubled for each busy reply before and stretched by up to half again
+ * at random so that clients turned away together do not come back
+ * together. A request that is still refused
+ * after ELF_CLIENT_BUSY_RETRIES tries fails with "Server busy".
+ *
+ * With a time budget set, every request tells the daemon how long it
+ * has left, so the daemon can drop it unanswered once nobody waits for
+ * it, and fails with "Deadline exceeded" when the budget runs out. All
+ * timing shares the one timer, armed at the earliest retry or deadline.
+ */
+struct elf_client
+{
+    struct shard_ring          ring;
+    int                        epoll_fd;
+    int                        timer_fd;
+    struct elf_client_request *requests;
+    bool                       timer_armed;
+    uint64_t                   timer_at;
+    uint64_t                   jitter;
+    size_t                     budget_ms;
+    size_t                     outstanding;
+    uint64_t                   submitted;
+    uint64_t                   completed;
+    uint64_t                   failed;
+    uint64_t                   retries;
+    uint64_t                   busy;
+    uint64_t                   expired;
+};
+
+/**
+ * Sets up a client for the daemons on a comma separated list of
+ * socket paths. Requests are spread across them by content and fail
+ * over to the next one when a daemon is down.
+ *
+ * @param client the client to fill
+ * @param socket_paths the comma separated socket paths
+ * @return 0 if successful, -1 with errno set if not
+ */
+ELFINSPECT_EXPORT int elf_client_open(struct elf_client *client, const char *socket_paths);
+
+/**
+ * Closes the client. Requests still in flight are dropped without
+ * their callbacks being called.
+ *
+ * @param client the client to close
+ */
+ELFINSPECT_EXPORT void elf_client_close(struct elf_client *client);
+
+/**
+ * Sets the time budget of the requests submitted from now on.
+ *
+ * @param client the client to set it on
+ * @param budget_ms milliseconds each request may take from its submission, 0 for no limit
+ */
+ELFINSPECT_EXPORT void elf_client_set_budget(struct elf_client *client, size_t budget_ms);
+
+/**
+ * Returns the descriptor that polls readable whenever
+ * elf_client_process has work to do.
+ *
+ * @param client the client to ask
+ * @return the descriptor
+ */
+ELFINSPECT_EXPORT int elf_client_fd(const struct elf_client *client);
+
+/**
+ * Returns the number of requests whose callbacks have not run yet.
+ *
+ * @param client the client to ask
+ * @return the number of requests in flight
+ */
+ELFINSPECT_EXPORT size_t elf_client_outstanding(const struct elf_client *client);
+
+/**
+ * Sends a header the caller already holds. Only the connection is
+ * started here; the answer arrives through callback from
+ * elf_client_process.
+ *
+ * @param client the client to send with
+ * @param name the file name to report, without a newline
+ * @param header the leading bytes of the file
+ * @param header_len the number of bytes in header, at most ELF_CLIENT_HEADER_LEN are sent
+ * @param callback what to call with the answer
+ * @param arg passed to callback
+ * @return 0 if the request is on its way, -1 with errno set if the name is invalid, memory ran out or no daemon could be reached
+ */
+ELFINSPECT_EXPORT int elf_client_submit_header(struct elf_client *client, const char *name, const void *header, size_t header_len, elf_client_callback callback, void *arg);
+
+/**
+ * Reads the header of path and sends it. The read is a single pread of
+ * ELF_CLIENT_HEADER_LEN bytes; callers that cannot afford even that on
+ * their loop should read headers elsewhere and use
+ * elf_client_submit_header.
+ *
+ * @param client the client to send with
+ * @param path the file to inspect
+ * @param callback what to call with the answer
+ * @param arg passed to callback
+ * @return 0 if the request is on its way, -1 with errno set if the file could not be read or the request could not be sent
+ */
+ELFINSPECT_EXPORT int elf_client_submit(struct elf_client *client, const char *path, elf_client_callback callback, void *arg);
+
+/**
+ * Moves requests along as far as they can go and calls the callbacks
+ * of those that finished.
+ *
+ * @param client the client to drive
+ * @param timeout_ms how long to wait for something to happen, 0 to not wait, -1 to wait until it does
+ * @return the number of callbacks called, or -1 with errno set if waiting failed
+ */
+ELFINSPECT_EXPORT int elf_client_process(struct elf_client *client, int timeout_ms);
+
+#endif    // ELF_CLIENT_H
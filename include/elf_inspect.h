@@ -0,0 +1,81 @@
+#ifndef ELF_INSPECT_H
+#define ELF_INSPECT_H
+
+#include "elf_result.h"
+#include "elf_validator.h"
+#include "elfinspect_export.h"
+#include <stddef.h>
+
+#define ELF_INSPECT_HEADER_LEN 64       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_INSPECT_ADDRESS_LEN 19      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_INSPECT_RESPONSE_LEN 1024   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * The names behind a result's raw values, as the validators spell
+ * them. error holds the first validator complaint when describing
+ * fails.
+ */
+struct elf_description
+{
+    char class_name[MAX_VALIDATION_MSG];
+    char data_name[MAX_VALIDATION_MSG];
+    char type_name[MAX_VALIDATION_MSG];
+    char machine_name[MAX_VALIDATION_MSG];
+    char entry_point[ELF_INSPECT_ADDRESS_LEN];
+    char error[MAX_VALIDATION_MSG];
+};
+
+/**
+ * Inspects the leading bytes of a file. Only the first
+ * ELF_INSPECT_HEADER_LEN bytes are looked at. Data that is not a valid
+ * ELF header still fills result, with valid cleared and the reason in
+ * error.
+ *
+ * @param buf the leading bytes of the file
+ * @param len the number of bytes available in buf
+ * @param result where to store the outcome
+ * @return 0, since a buffer can always be inspected
+ */
+ELFINSPECT_EXPORT int elf_inspect_buffer(const void *buf, size_t len, struct elf_result *result);
+
+/**
+ * Reads the header from an open file, from offset 0 when the file can
+ * be positioned and from the current position otherwise, and inspects it.
+ *
+ * @param fd the file to read
+ * @param result where to store the outcome
+ * @return 0 if inspected, -1 with errno set if the file could not be read
+ */
+ELFINSPECT_EXPORT int elf_inspect_fd(int fd, struct elf_result *result);
+
+/**
+ * Opens path and inspects it. Anything but a regular file is refused
+ * with EINVAL.
+ *
+ * @param path the file to inspect
+ * @param result where to store the outcome
+ * @return 0 if inspected, -1 with errno set if the file could not be read
+ */
+ELFINSPECT_EXPORT int elf_inspect_path(const char *path, struct elf_result *result);
+
+/**
+ * Spells out the raw values of a result.
+ *
+ * @param result the result to describe
+ * @param description where to store the names
+ * @return 0 if successful, -1 if a value has no name, with the reason in description->error
+ */
+ELFINSPECT_EXPORT int elf_inspect_describe(const struct elf_result *result, struct elf_description *description);
+
+/**
+ * Writes a result in the daemon's response format.
+ *
+ * @param name the file name to report
+ * @param result the result to write
+ * @param buf where to write
+ * @param len the size of buf
+ * @return the length written, or -1 if buf is too small
+ */
+ELFINSPECT_EXPORT int elf_inspect_format(const char *name, const struct elf_result *result, char *buf, size_t len);
+
+#endif    // ELF_INSPECT_H
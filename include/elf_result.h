@@ -0,0 +1,26 @@
+#ifndef ELF_RESULT_H
+#define ELF_RESULT_H
+
+#include "elf_validator.h"
+#include <stdint.h>
+
+/*
+ * Fixed size, pointer free outcome of inspecting one ELF header.
+ * Names are not stored; they are rebuilt from the raw values with
+ * the elf_validator functions, which keeps the record small enough
+ * to share between processes and to keep on disk.
+ */
+struct elf_result
+{
+    uint64_t entry;
+    uint32_t flags;
+    uint16_t type;
+    uint16_t machine;
+    uint8_t  class;
+    uint8_t  data;
+    uint8_t  version;
+    uint8_t  valid;
+    char     error[MAX_VALIDATION_MSG];
+};
+
+#endif    // ELF_RESULT_H
@@ -0,0 +1,16 @@
+#ifndef ELFINSPECT_EXPORT_H
+#define ELFINSPECT_EXPORT_H
+
+/*
+ * Marks the functions libelfinspect exports. The shared library is
+ * built with hidden visibility, so the helpers it shares with the
+ * programs in this tree stay internal to it and only the elf_inspect
+ * and elf_client functions make up its ABI.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+    #define ELFINSPECT_EXPORT __attribute__((visibility("default")))
+#else
+    #define ELFINSPECT_EXPORT
+#endif
+
+#endif    // ELFINSPECT_EXPORT_H
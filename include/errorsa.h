@@ -0,0 +1,11 @@
+#ifndef ERRORSA_H
+#define ERRORSA_H
+
+enum errorsa
+{
+    ERRA_USAGE,
+    ERRA_SOCKET,
+    ERRA_EXEC,
+};
+
+#endif    // ERRORSA_H
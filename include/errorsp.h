@@ -0,0 +1,10 @@
+#ifndef ERRORSP_H
+#define ERRORSP_H
+
+enum errorsp
+{
+    ERRP_USAGE,
+    ERRP_SOCKET,
+};
+
+#endif    // ERRORSP_H
@@ -0,0 +1,11 @@
+#ifndef ERRORSQ_H
+#define ERRORSQ_H
+
+enum errorsq
+{
+    ERRQ_USAGE,
+    ERRQ_CATALOG,
+    ERRQ_COLUMNS,
+};
+
+#endif    // ERRORSQ_H
@@ -0,0 +1,52 @@
+#ifndef FSM_TIMING_H
+#define FSM_TIMING_H
+
+#include "histogram.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define FSM_TIMING_STATES 32    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * Time spent in each state of a state machine, from the moment its
+ * function is entered to the moment the next one is. Builds define
+ * FSM_TIMING to turn it on; otherwise the macros below expand to
+ * nothing and the programs carry no timing and no struct fsm_timing.
+ */
+struct fsm_timing
+{
+    struct histogram states[FSM_TIMING_STATES];
+    int              current;
+    uint64_t         entered_ns;
+};
+
+/**
+ * Closes the time spent in the state being left and starts the one
+ * being entered.
+ *
+ * @param timing the timings to record in
+ * @param state the state being entered, below FSM_TIMING_STATES
+ */
+void fsm_timing_enter(struct fsm_timing *timing, int state);
+
+/**
+ * Writes a table of the states that were entered with their count and
+ * their total, mean, median, 99th percentile and longest times.
+ *
+ * @param timing the timings to write
+ * @param names the name of each state, indexed by state, NULL for none
+ * @param name_count the number of names
+ * @param out where to write the table
+ */
+void fsm_timing_write(const struct fsm_timing *timing, const char *const names[], size_t name_count, FILE *out);
+
+#ifdef FSM_TIMING
+    #define FSM_TIMING_ENTER(timing, state) fsm_timing_enter((timing), (state))
+    #define FSM_TIMING_WRITE(timing, names, out) fsm_timing_write((timing), (names), sizeof(names) / sizeof(*(names)), (out))
+#else
+    #define FSM_TIMING_ENTER(timing, state) ((void)0)
+    #define FSM_TIMING_WRITE(timing, names, out) ((void)0)
+#endif
+
+#endif    // FSM_TIMING_H
@@ -0,0 +1,47 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#define HANDOFF_TIMEOUT_MS 5000    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HANDOFF_GIVE 'S'
+#define HANDOFF_ACK 'A'
+
+/*
+ * A running daemon listens on a control socket for its successor. The
+ * successor connects, the daemon sends HANDOFF_GIVE with its listening
+ * socket attached as SCM_RIGHTS, and the successor answers HANDOFF_ACK
+ * once it holds the socket. Both sides give up after
+ * HANDOFF_TIMEOUT_MS, so a hung peer cannot stall the other. The
+ * listening socket is never closed or rebound, so clients connecting
+ * during the exchange wait in its queue for whichever process accepts
+ * first.
+ */
+
+/**
+ * Binds and listens on the control socket at path, replacing a stale
+ * socket file. Only the owner may connect to it.
+ *
+ * @param path the control socket path
+ * @return the control socket, or -1 if it could not be set up
+ */
+int handoff_listen(const char *path);
+
+/**
+ * Asks the daemon on the control socket at path for its listening
+ * socket.
+ *
+ * @param path the control socket path
+ * @return the listening socket, or -1 with errno ENOENT or ECONNREFUSED if no daemon listens there, or any other errno if the exchange failed
+ */
+int handoff_take(const char *path);
+
+/**
+ * Accepts one connection on a control socket and hands it the listening
+ * socket. A peer running as another user is refused.
+ *
+ * @param control_fd the socket from handoff_listen
+ * @param socket_fd the listening socket to hand over
+ * @return 0 if the peer acknowledged the socket, -1 if it is still only this process's
+ */
+int handoff_give(int control_fd, int socket_fd);
+
+#endif    // HANDOFF_H
@@ -0,0 +1,146 @@
+#ifndef HEADER_READER_H
+#define HEADER_READER_H
+
+#include "content_key.h"
+#include "stat_cache.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define HEADER_READER_URING 1    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+        #include <linux/stat.h>
+    #endif
+#endif
+
+#define HEADER_READER_DEFAULT_DEPTH 256    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HEADER_READER_MAX_DEPTH 4096       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * One file on its way through open, stat and the header read. error
+ * stays NULL when the header was read, and identity then holds what
+ * stat saw; the path is handed over to whoever takes the read.
+ */
+struct header_read
+{
+    char                *path;
+    uint8_t              header[CONTENT_KEY_SPAN];
+    size_t               header_len;
+    struct file_identity identity;
+    const char          *error;
+    int                  fd;
+    unsigned             pending;
+#ifdef HEADER_READER_URING
+    struct statx stats;
+#endif
+};
+
+struct header_ring;
+
+/*
+ * Reads the headers of many files at once. With io_uring the opens,
+ * statx calls and reads of up to depth files are in flight together
+ * and complete in any order; without it each file is read in turn at
+ * submission and depth is 1. Should the kernel fall behind on taking
+ * submissions, a file is read with plain system calls rather than wait.
+ */
+struct header_reader
+{
+    struct header_read  *reads;
+    size_t               depth;
+    size_t              *free_list;
+    size_t               free_count;
+    size_t              *done;
+    size_t               done_head;
+    size_t               done_count;
+    size_t               in_flight;
+    struct header_ring  *ring;
+};
+
+/**
+ * Sets up a reader. io_uring is used when asked for and the kernel
+ * allows it, otherwise the reader falls back to plain system calls.
+ *
+ * @param reader the reader to fill
+ * @param depth the number of files in flight with io_uring
+ * @param use_uring whether to try io_uring
+ * @return 0 if successful, -1 if memory ran out
+ */
+int header_reader_open(struct header_reader *reader, size_t depth, bool use_uring);
+
+/**
+ * Releases the reader, closing files it still holds.
+ *
+ * @param reader the reader to release
+ */
+void header_reader_close(struct header_reader *reader);
+
+/**
+ * Tells whether the reader goes through io_uring.
+ *
+ * @param reader the reader to ask
+ * @return true if it does
+ */
+bool header_reader_uses_uring(const struct header_reader *reader);
+
+/**
+ * Tells whether another path can be submitted.
+ *
+ * @param reader the reader to ask
+ * @return true if there is room
+ */
+bool header_reader_has_room(const struct header_reader *reader);
+
+/**
+ * Tells whether nothing is in flight or waiting to be taken.
+ *
+ * @param reader the reader to ask
+ * @return true if the reader is empty
+ */
+bool header_reader_empty(const struct header_reader *reader);
+
+/**
+ * Starts reading the header of path, which the reader now owns.
+ * Only call when header_reader_has_room says so.
+ *
+ * @param reader the reader to submit to
+ * @param path the file to read
+ */
+void header_reader_submit(struct header_reader *reader, char *path);
+
+/**
+ * Hands queued work to the kernel and collects whatever has completed,
+ * without waiting.
+ *
+ * @param reader the reader to drive
+ */
+void header_reader_drive(struct header_reader *reader);
+
+/**
+ * Returns a descriptor that polls readable when completions are
+ * waiting, or 0 when there is nothing to wait for.
+ *
+ * @param reader the reader to ask
+ * @return the descriptor or 0
+ */
+int header_reader_poll_fd(const struct header_reader *reader);
+
+/**
+ * Takes the oldest finished read. Return it with header_reader_release
+ * once its path has been taken over or freed.
+ *
+ * @param reader the reader to take from
+ * @return the read, or NULL if none has finished
+ */
+struct header_read *header_reader_take(struct header_reader *reader);
+
+/**
+ * Gives a taken read's slot back to the reader.
+ *
+ * @param reader the reader the read came from
+ * @param read the read to give back
+ */
+void header_reader_release(struct header_reader *reader, struct header_read *read);
+
+#endif    // HEADER_READER_H
@@ -0,0 +1,61 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 3                                                       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HISTOGRAM_SUB_BUCKETS (1U << HISTOGRAM_SUB_BITS)                           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * A log-linear histogram of nanoseconds in the style of HDR histograms:
+ * values below HISTOGRAM_SUB_BUCKETS have a bucket each, and every
+ * power of two above is split into HISTOGRAM_SUB_BUCKETS equal buckets,
+ * so any value is known to within an eighth whatever its size. It is
+ * not shared between threads; recording is a plain increment.
+ */
+struct histogram
+{
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+};
+
+/**
+ * Returns the monotonic clock in nanoseconds, for timing what is
+ * recorded.
+ *
+ * @return the current time
+ */
+uint64_t histogram_now_ns(void);
+
+/**
+ * Records one value.
+ *
+ * @param histogram the histogram to record in
+ * @param ns the value in nanoseconds
+ */
+void histogram_record(struct histogram *histogram, uint64_t ns);
+
+/**
+ * Counts the values recorded below a power of two, which is exact
+ * since buckets never straddle one.
+ *
+ * @param histogram the histogram to count in
+ * @param bit the power of two
+ * @return the number of values below 1 << bit
+ */
+uint64_t histogram_below(const struct histogram *histogram, unsigned bit);
+
+/**
+ * Estimates a quantile as the upper end of the bucket it falls in.
+ *
+ * @param histogram the histogram to read
+ * @param quantile the quantile, from 0 to 1
+ * @return the value in nanoseconds, or 0 if nothing was recorded
+ */
+uint64_t histogram_quantile(const struct histogram *histogram, double quantile);
+
+#endif    // HISTOGRAM_H
@@ -0,0 +1,259 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include "content_key.h"
+#include "timer_wheel.h"
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LISTENER_NAME_LEN 256                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_MAX_BODY_LEN 1048576           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_DEFAULT_MAX_CONNECTIONS 1024   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_DEFAULT_BUFFER_BUDGET 262144   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_BUSY_RETRY_MS 10               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_ACCEPT_BATCH 64                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_DEFAULT_HEADER_MS 2000         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_DEFAULT_BODY_MS 5000           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_DEFAULT_TOTAL_MS 10000         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_READ_CHUNK 65536               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_SMALL_BODY_LEN 65536           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_LARGE_READS 1                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_LARGE_SHARE 4                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_QUANTUM 1                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_DEFAULT_BURST 32               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTENER_WATCHES 2                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum listener_phase
+{
+    LISTENER_FREE,
+    LISTENER_NAME,
+    LISTENER_BODY,
+    LISTENER_READY,
+    LISTENER_ACTIVE,
+};
+
+enum listener_lane
+{
+    LISTENER_SMALL,
+    LISTENER_LARGE,
+    LISTENER_LANES,
+};
+
+enum listener_deadline
+{
+    LISTENER_PHASE_DEADLINE,
+    LISTENER_TOTAL_DEADLINE,
+    LISTENER_CLIENT_DEADLINE,
+};
+
+enum listener_wait
+{
+    LISTENER_REQUEST,
+    LISTENER_INTERRUPTED,
+    LISTENER_CONTROL,
+    LISTENER_DRAINED,
+    LISTENER_FAILED,
+};
+
+struct listener_tenant;
+
+/*
+ * One client connection. The name line is collected whole; of the
+ * body only the first CONTENT_KEY_SPAN bytes are kept, which is all
+ * the inspection and the content key look at, and the rest is only
+ * counted. error is set instead when the request is malformed. File
+ * descriptors use 0 for none, as elsewhere. lane turns LISTENER_LARGE
+ * once more than LISTENER_SMALL_BODY_LEN bytes of body have arrived.
+ * client_deadline is when the client said it would stop waiting, 0 if
+ * it did not, and deadline names whichever deadline the timer is on.
+ * accepted_ns is the accept again, to the nanosecond, for timing, and
+ * named_ns and read_ns are when the name line and the whole request
+ * had arrived. Those two are only taken with the timestamps option or
+ * while a probe wants them, and are 0 otherwise or if the arrival
+ * never happened.
+ */
+struct listener_conn
+{
+    enum listener_phase     phase;
+    int                     fd;
+    char                    name[LISTENER_NAME_LEN];
+    size_t                  name_len;
+    uint8_t                 header[CONTENT_KEY_SPAN];
+    size_t                  header_len;
+    size_t                  body_len;
+    const char             *error;
+    enum listener_lane      lane;
+    struct listener_tenant *tenant;
+    uint64_t                accepted_ms;
+    uint64_t                accepted_ns;
+    uint64_t                named_ns;
+    uint64_t                read_ns;
+    uint64_t                client_deadline;
+    enum listener_deadline  deadline;
+    struct timer_entry      timer;
+    struct listener_conn   *next_ready;
+};
+
+/*
+ * Everything the listener keeps about one peer user. Tokens count
+ * thousandths of a request, so a rate of r requests a second refills r
+ * of them a millisecond. A tenant whose connections are all gone keeps
+ * its slot, and its bucket with it, until another user needs the slot.
+ */
+struct listener_tenant
+{
+    uid_t                   uid;
+    size_t                  conns;
+    uint64_t                tokens;
+    uint64_t                refilled_ms;
+    size_t                  deficit;
+    bool                    active;
+    struct listener_conn   *ready_head[LISTENER_LANES];
+    struct listener_conn   *ready_tail[LISTENER_LANES];
+    size_t                  small_run;
+    struct listener_tenant *next_active;
+};
+
+struct listener_options
+{
+    size_t header_ms;
+    size_t body_ms;
+    size_t total_ms;
+    size_t max_connections;
+    size_t buffer_budget;
+    size_t rate;
+    size_t burst;
+    bool   timestamps;
+};
+
+/*
+ * Reads requests from many clients at once so that a slow or stalled
+ * one cannot hold the daemon. Every connection is on a deadline: the
+ * name line must arrive within header_ms of the accept, the body
+ * within body_ms of the name line, and the whole request within
+ * total_ms. A connection that misses its deadline is cut off and
+ * counted. Complete requests are handed out one at a time in the order
+ * they completed.
+ *
+ * Admission is capped twice: at max_connections open requests, and at
+ * buffer_budget bytes of names and headers held across all of them.
+ * A client over either cap is accepted only to be told to come back
+ * after LISTENER_BUSY_RETRY_MS, so the table and the memory behind it
+ * stay the size they were opened at however many clients arrive.
+ *
+ * Requests are kept in two lanes by the size of their body, since the
+ * protocol does not declare one up front. A small request is read until
+ * its socket runs dry; a large one gets only LISTENER_LARGE_READS reads
+ * per pass, and once complete waits in its own queue that is served
+ * one time in LISTENER_LARGE_SHARE while small requests are waiting.
+ * A header-only probe thus never waits behind an upload, and uploads
+ * still always move.
+ *
+ * Every connection belongs to the tenant of its peer's uid, read with
+ * SO_PEERCRED. Tenants with complete requests take turns by deficit
+ * round robin: each turn adds LISTENER_QUANTUM to a tenant's credit,
+ * and a request costs one plus a unit for every LISTENER_SMALL_BODY_LEN
+ * bytes of body read for it, so a user with a mass scan or uploads
+ * gets the same share as one asking about a single file. With a rate
+ * set, each tenant also has a token bucket of burst requests refilled
+ * at rate a second, and a client arriving to an empty bucket is told
+ * to retry once the next token is due.
+ *
+ * A client may end its name line with BUDGET_SEPARATOR and the number
+ * of milliseconds it will wait, counted from the accept. Its connection
+ * is dropped without an answer once that time is up, whether it is
+ * still being read or waiting for its turn, and so is one whose client
+ * hung up before its turn came.
+ *
+ * Up to LISTENER_WATCHES sockets of the caller's, such as control
+ * sockets, are polled alongside the clients, and control_ready marks
+ * those the caller should act on. Once draining, neither they nor the
+ * listening socket are polled any more, and the connections already
+ * open are served to the end.
+ */
+struct listener
+{
+    int                     socket_fd;
+    int                     control_fds[LISTENER_WATCHES];
+    bool                    control_ready[LISTENER_WATCHES];
+    bool                    draining;
+    struct listener_options options;
+    struct listener_conn   *conns;
+    size_t                 *free_list;
+    size_t                  free_count;
+    struct pollfd          *fds;
+    size_t                 *fd_conns;
+    struct listener_tenant *tenants;
+    size_t                  tenant_count;
+    struct listener_tenant *active_head;
+    struct listener_tenant *active_tail;
+    struct timer_wheel      wheel;
+    size_t                  buffered;
+    uint64_t                accepted;
+    uint64_t                busy;
+    uint64_t                limited;
+    uint64_t                header_timeouts;
+    uint64_t                body_timeouts;
+    uint64_t                total_timeouts;
+    uint64_t                abandoned;
+};
+
+/**
+ * Takes over a listening socket, which is made non-blocking.
+ *
+ * @param listener the listener to fill
+ * @param socket_fd the listening socket
+ * @param options the deadlines in milliseconds, the admission caps and the per user rate, 0 for none
+ * @return 0 if successful, -1 if memory ran out
+ */
+int listener_open(struct listener *listener, int socket_fd, const struct listener_options *options);
+
+/**
+ * Closes every connection and frees the listener. The listening socket
+ * is left to the caller.
+ *
+ * @param listener the listener to close
+ */
+void listener_close(struct listener *listener);
+
+/**
+ * Has listener_next also watch a socket of the caller's, such as a
+ * control socket.
+ *
+ * @param listener the listener to watch with
+ * @param slot which of the LISTENER_WATCHES sockets it is
+ * @param control_fd the socket to watch, 0 to stop watching
+ */
+void listener_watch(struct listener *listener, size_t slot, int control_fd);
+
+/**
+ * Stops accepting, so the listening socket is left to whoever else
+ * holds it, while the connections already accepted are finished.
+ *
+ * @param listener the listener to drain
+ */
+void listener_drain(struct listener *listener);
+
+/**
+ * Waits for the next complete or malformed request. Its connection is
+ * blocking again when it is handed out, and stays the caller's until
+ * it is given back with listener_release.
+ *
+ * @param listener the listener to wait on
+ * @param conn where to store the connection
+ * @return LISTENER_REQUEST, LISTENER_INTERRUPTED if a signal arrived first, LISTENER_CONTROL if a watched socket is readable, LISTENER_DRAINED once a draining listener has no connections left, or LISTENER_FAILED if polling failed
+ */
+enum listener_wait listener_next(struct listener *listener, struct listener_conn **conn);
+
+/**
+ * Closes a connection handed out by listener_next.
+ *
+ * @param listener the listener it came from
+ * @param conn the connection to close
+ */
+void listener_release(struct listener *listener, struct listener_conn *conn);
+
+#endif    // LISTENER_H
@@ -0,0 +1,73 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "histogram.h"
+#include "listener.h"
+#include <stdint.h>
+#include <stdio.h>
+
+enum metrics_counter
+{
+    METRICS_ELF,
+    METRICS_NOT_ELF,
+    METRICS_BAD_REQUEST,
+    METRICS_SHM_HIT,
+    METRICS_CATALOG_HIT,
+    METRICS_INSPECTED,
+    METRICS_CLIENT_GONE,
+    METRICS_COUNTERS,
+};
+
+enum metrics_stage
+{
+    METRICS_QUEUE,
+    METRICS_LOOKUP,
+    METRICS_INSPECT,
+    METRICS_RESPOND,
+    METRICS_SERVICE,
+    METRICS_STAGES,
+};
+
+/*
+ * Everything the daemon records about the requests it answers. It is
+ * written only by the thread serving requests, so recording is a plain
+ * increment with no atomics or locks; a daemon serving from several
+ * threads would give each its own and add them up when writing. Stages
+ * are timed with histogram_now_ns.
+ */
+struct metrics
+{
+    uint64_t         counters[METRICS_COUNTERS];
+    struct histogram stages[METRICS_STAGES];
+};
+
+/**
+ * Counts one event.
+ *
+ * @param metrics the metrics to count in
+ * @param counter the event
+ */
+void metrics_count(struct metrics *metrics, enum metrics_counter counter);
+
+/**
+ * Records how long one request spent in a stage.
+ *
+ * @param metrics the metrics to record in
+ * @param stage the stage
+ * @param ns the time spent in nanoseconds
+ */
+void metrics_record(struct metrics *metrics, enum metrics_stage stage, uint64_t ns);
+
+/**
+ * Writes the metrics and the listener's connection counts in the
+ * Prometheus text format. Histogram buckets are written at every power
+ * of two nanoseconds from about a microsecond to about a minute, the
+ * same set every time.
+ *
+ * @param metrics the metrics to write
+ * @param listener the listener whose counts to write
+ * @param out where to write them
+ */
+void metrics_write(const struct metrics *metrics, const struct listener *listener, FILE *out);
+
+#endif    // METRICS_H
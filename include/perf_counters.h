@@ -0,0 +1,97 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/perf_event.h>)
+        #define PERF_COUNTERS_AVAILABLE 1    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #endif
+#endif
+
+#define PERF_COUNTERS_STAGES 32    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum perf_counter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS,
+};
+
+/*
+ * Hardware counters of the calling thread, opened as one perf_event
+ * group so all four are scheduled, and read, together. Each stage is
+ * charged what the counters advanced from its entry to the next
+ * stage's, the way struct fsm_timing charges time, which costs one
+ * read(2) per stage entered. Kernel work is counted where
+ * perf_event_paranoid allows it and user space only otherwise.
+ *
+ * When other events compete for the PMU the kernel multiplexes the
+ * group, and it only counts for part of the time it is enabled. Each
+ * stage's counts are then scaled by how long the group was enabled
+ * over how long it actually ran, and enabled_ns and running_ns keep
+ * both times per stage so the share that was measured can be
+ * reported. A stage the group never ran in gets no counts at all.
+ */
+struct perf_counters
+{
+    int      fds[PERF_COUNTERS];
+    bool     open;
+    bool     user_only;
+    int      current;
+    uint64_t last[PERF_COUNTERS];
+    uint64_t last_enabled_ns;
+    uint64_t last_running_ns;
+    uint64_t totals[PERF_COUNTERS_STAGES][PERF_COUNTERS];
+    uint64_t entries[PERF_COUNTERS_STAGES];
+    uint64_t enabled_ns[PERF_COUNTERS_STAGES];
+    uint64_t running_ns[PERF_COUNTERS_STAGES];
+};
+
+/**
+ * Opens and starts the counter group for the calling thread.
+ *
+ * @param counters the counters to open
+ * @return 0 if counting, -1 if the platform, the CPU or perf_event_paranoid does not allow it
+ */
+int perf_counters_open(struct perf_counters *counters);
+
+/**
+ * Stops counting and closes the group. Counters that were never opened
+ * are left alone.
+ *
+ * @param counters the counters to close
+ */
+void perf_counters_close(struct perf_counters *counters);
+
+/**
+ * Charges the counts since the last stage entered to that stage and
+ * starts the one being entered. Does nothing unless the counters are
+ * open.
+ *
+ * @param counters the counters
+ * @param stage the stage being entered, below PERF_COUNTERS_STAGES
+ */
+void perf_counters_enter(struct perf_counters *counters, int stage);
+
+/**
+ * Writes the totals of every stage entered in the Prometheus text
+ * format, as prefix_stage_events_total{stage,event},
+ * prefix_stage_entries_total{stage} and
+ * prefix_stage_counted_ratio{stage}, the share of each stage's time the
+ * counters were actually running; below 1 the events are estimates.
+ *
+ * @param counters the counters to write
+ * @param prefix the metric name prefix
+ * @param names the name of each stage, indexed by stage, NULL for none
+ * @param name_count the number of names
+ * @param out where to write them
+ */
+void perf_counters_write(const struct perf_counters *counters, const char *prefix, const char *const names[], size_t name_count, FILE *out);
+
+#endif    // PERF_COUNTERS_H
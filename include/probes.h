@@ -0,0 +1,66 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * Static probe points for bpftrace, perf and SystemTap, in the USDT
+ * form <sys/sdt.h> emits. Each probe is one nop in the text and a note
+ * saying where its arguments are. Every probe also has a semaphore that
+ * a tracer bumps while attached; an argument that costs something to
+ * work out, such as a fresh timestamp, is only computed inside
+ * if(PROBE_ENABLED(provider, name)), so a probe no one is attached to
+ * costs a load and a branch. Without <sys/sdt.h> (systemtap-sdt-dev,
+ * or a platform that has none) or with NO_PROBES defined, the probes
+ * expand to nothing and PROBE_ENABLED to false.
+ *
+ * elfinspectd:
+ *  accept(int fd, size_t connections)            a connection took a slot
+ *  name_parsed(char *name, size_t len, u64 ns)   its name line arrived, ns after the accept
+ *  body_complete(char *name, size_t len, u64 ns) the whole request arrived, ns after the accept
+ *  bad_request(char *error, u64 ns)              the request was malformed, ns after the accept
+ *  validated(char *name, u8 valid, u8 class,     the answer is known, ns after the lookup began
+ *            u16 machine, u64 ns)
+ *  response_written(char *name, size_t len,      the answer was written, ns after the accept
+ *                   u64 ns)
+ *
+ * elfinspect:
+ *  request_sent(char *name)                      a request went out
+ *  answer_received(char *name, size_t len,       its answer came back, error NULL unless it failed
+ *                  char *error)
+ *
+ * For example: bpftrace -e 'usdt:./elfinspectd:validated { @[arg3] = hist(arg4); }'
+ */
+#if !defined(NO_PROBES) && defined(__has_include)
+    #if __has_include(<sys/sdt.h>)
+        #define _SDT_HAS_SEMAPHORES 1    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp)
+        #include <sys/sdt.h>
+        #define PROBES_ENABLED
+    #endif
+#endif
+
+#ifdef PROBES_ENABLED
+    #define PROBE1(provider, name, a) DTRACE_PROBE1(provider, name, a)
+    #define PROBE2(provider, name, a, b) DTRACE_PROBE2(provider, name, a, b)
+    #define PROBE3(provider, name, a, b, c) DTRACE_PROBE3(provider, name, a, b, c)
+    #define PROBE5(provider, name, a, b, c, d, e) DTRACE_PROBE5(provider, name, a, b, c, d, e)
+    #define PROBE_ENABLED(provider, name) __builtin_expect(provider##_##name##_semaphore != 0, 0)
+
+    // weak, so every file including this header can define them and the linker keeps one of each
+    #define PROBE_SEMAPHORE(provider, name) volatile unsigned short provider##_##name##_semaphore __attribute__((weak, section(".probes")))    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+PROBE_SEMAPHORE(elfinspectd, accept);
+PROBE_SEMAPHORE(elfinspectd, name_parsed);
+PROBE_SEMAPHORE(elfinspectd, body_complete);
+PROBE_SEMAPHORE(elfinspectd, bad_request);
+PROBE_SEMAPHORE(elfinspectd, validated);
+PROBE_SEMAPHORE(elfinspectd, response_written);
+PROBE_SEMAPHORE(elfinspect, request_sent);
+PROBE_SEMAPHORE(elfinspect, answer_received);
+#else
+    #define PROBE1(provider, name, a) ((void)0)
+    #define PROBE2(provider, name, a, b) ((void)0)
+    #define PROBE3(provider, name, a, b, c) ((void)0)
+    #define PROBE5(provider, name, a, b, c, d, e) ((void)0)
+    #define PROBE_ENABLED(provider, name) 0
+#endif
+
+#endif    // PROBES_H
@@ -0,0 +1,160 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "content_key.h"
+#include "response_cache.h"
+#include "shard_ring.h"
+#include "timer_wheel.h"
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RELAY_NAME_LEN 256                    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_MAX_BODY_LEN 1048576            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_RESPONSE_LEN 1024               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_DEFAULT_MAX_CONNECTIONS 1024    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_DEFAULT_HEADER_MS 2000          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_DEFAULT_BODY_MS 5000            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_DEFAULT_BACKEND_MS 5000         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_REPLY_MS 2000                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_CONNECT_RETRY_MS 5              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_BUSY_RETRY_MS 10                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_ACCEPT_BATCH 64                 // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RELAY_READ_CHUNK 65536                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum relay_phase
+{
+    RELAY_FREE,
+    RELAY_NAME,
+    RELAY_BODY,
+    RELAY_CONNECT,
+    RELAY_SEND,
+    RELAY_RECEIVE,
+    RELAY_REPLY,
+};
+
+enum relay_wait
+{
+    RELAY_EVENTS,
+    RELAY_INTERRUPTED,
+    RELAY_FAILED,
+};
+
+/*
+ * One client request on its way through the proxy. Like the daemon,
+ * the proxy keeps the name line whole and of the body only the first
+ * CONTENT_KEY_SPAN bytes, which is all an answer depends on, and
+ * counts the rest. file_len is the length of the file name proper,
+ * before any time budget and the newline. What goes to the backend is
+ * the name line, the kept header and, for a body over
+ * RELAY_MAX_BODY_LEN, zeros up to one byte past it, so the daemon
+ * still words every answer. File descriptors use 0 for none. deadline
+ * is when the current attempt on a backend gives up.
+ */
+struct relay_conn
+{
+    enum relay_phase   phase;
+    int                client_fd;
+    int                backend_fd;
+    char               name[RELAY_NAME_LEN];
+    size_t             name_len;
+    size_t             file_len;
+    uint8_t            header[CONTENT_KEY_SPAN];
+    size_t             header_len;
+    size_t             body_len;
+    bool               cacheable;
+    uint64_t           content_key;
+    size_t             order[MAX_SHARD_ENDPOINTS];
+    size_t             candidates;
+    size_t             candidate;
+    uint64_t           deadline;
+    size_t             sent;
+    char               response[RELAY_RESPONSE_LEN + RELAY_NAME_LEN];
+    size_t             response_len;
+    size_t             response_off;
+    struct timer_entry timer;
+};
+
+struct relay_options
+{
+    size_t header_ms;
+    size_t body_ms;
+    size_t backend_ms;
+    size_t max_connections;
+};
+
+/*
+ * Drives every client and backend socket of the proxy from one poll
+ * loop, so a slow client or a stalled backend holds only its own
+ * request and as many backends are busy at once as there are requests
+ * to send them. Every phase is on a deadline: the name line must
+ * arrive within header_ms of the accept and the body within body_ms of
+ * the name line, or the client is told it timed out; a backend that
+ * has not answered within backend_ms of the connect is dropped for the
+ * next one on the ring, and once none is left the client is told there
+ * is no backend. A client over max_connections is told to retry after
+ * RELAY_BUSY_RETRY_MS, as the daemon does.
+ *
+ * Well formed requests are answered from the cache when their content
+ * key is in it, and the answers backends give them are stored there.
+ */
+struct relay
+{
+    int                      socket_fd;
+    struct relay_options     options;
+    const struct shard_ring *backends;
+    struct response_cache   *cache;
+    struct relay_conn       *conns;
+    size_t                  *free_list;
+    size_t                   free_count;
+    struct pollfd           *fds;
+    size_t                  *fd_conns;
+    nfds_t                   nfds;
+    struct timer_wheel       wheel;
+    uint64_t                 accepted;
+    uint64_t                 busy;
+    uint64_t                 hits;
+    uint64_t                 forwarded;
+    uint64_t                 failovers;
+    uint64_t                 no_backend;
+    uint64_t                 client_timeouts;
+};
+
+/**
+ * Takes over a listening socket, which is made non-blocking.
+ *
+ * @param relay the relay to fill
+ * @param socket_fd the listening socket
+ * @param options the deadlines in milliseconds and the connection cap
+ * @param backends the ring of backend daemons, which must outlive the relay
+ * @param cache the response cache, which must outlive the relay
+ * @return 0 if successful, -1 if memory ran out
+ */
+int relay_open(struct relay *relay, int socket_fd, const struct relay_options *options, const struct shard_ring *backends, struct response_cache *cache);
+
+/**
+ * Closes every client and backend connection and frees the relay. The
+ * listening socket is left to the caller.
+ *
+ * @param relay the relay to close
+ */
+void relay_close(struct relay *relay);
+
+/**
+ * Waits until a socket is ready or a deadline is due.
+ *
+ * @param relay the relay to wait on
+ * @return RELAY_EVENTS when relay_dispatch has work, RELAY_INTERRUPTED if a signal arrived first, or RELAY_FAILED if polling failed
+ */
+enum relay_wait relay_wait(struct relay *relay);
+
+/**
+ * Cuts off whatever missed its deadline and moves every ready request
+ * on as far as its sockets allow without blocking.
+ *
+ * @param relay the relay to dispatch
+ */
+void relay_dispatch(struct relay *relay);
+
+#endif    // RELAY_H
@@ -0,0 +1,80 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "content_key.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define RESPONSE_CACHE_WAYS 4               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RESPONSE_CACHE_TEXT_LEN 1024        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RESPONSE_CACHE_DEFAULT_ENTRIES 4096 // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * The header bytes the key was computed from are kept with the text,
+ * so a client whose request collides with another's key is forwarded
+ * rather than answered for a different file.
+ */
+struct response_entry
+{
+    uint64_t key;
+    uint64_t last_used;
+    uint16_t header_len;
+    uint16_t len;
+    uint8_t  header[CONTENT_KEY_SPAN];
+    char     text[RESPONSE_CACHE_TEXT_LEN];
+};
+
+struct response_cache
+{
+    struct response_entry *entries;
+    size_t                 sets;
+    uint64_t               tick;
+    uint64_t               hits;
+    uint64_t               misses;
+};
+
+/**
+ * Allocates a set associative cache able to hold at least
+ * entries responses. Least recently used entries of a set are
+ * replaced first.
+ *
+ * @param cache the cache to fill
+ * @param entries the number of responses to hold
+ * @return 0 if successful, -1 if memory ran out
+ */
+int response_cache_create(struct response_cache *cache, size_t entries);
+
+/**
+ * Releases the memory held by the cache.
+ *
+ * @param cache the cache to release
+ */
+void response_cache_destroy(struct response_cache *cache);
+
+/**
+ * Looks up the response stored for a header. Only the first
+ * CONTENT_KEY_SPAN bytes of the header count, as for the key.
+ *
+ * @param cache the cache to search
+ * @param key the content key of the header
+ * @param header the header the key was computed from
+ * @param header_len the length of the header
+ * @param len where to store the length of the response
+ * @return the cached text (not NUL terminated) or NULL on a miss
+ */
+const char *response_cache_get(struct response_cache *cache, uint64_t key, const void *header, size_t header_len, size_t *len);
+
+/**
+ * Stores a response under key, replacing an older one if needed.
+ * Responses longer than RESPONSE_CACHE_TEXT_LEN are not stored.
+ *
+ * @param cache the cache to fill
+ * @param key the content key of the header
+ * @param header the header the key was computed from
+ * @param header_len the length of the header
+ * @param text the response text
+ * @param len the length of text
+ */
+void response_cache_put(struct response_cache *cache, uint64_t key, const void *header, size_t header_len, const char *text, size_t len);
+
+#endif    // RESPONSE_CACHE_H
@@ -0,0 +1,102 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCANNER_MAX_THREADS 64          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SCANNER_QUEUE_LEN 4096          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SCANNER_DIRENT_BUF_LEN 65536    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum scanner_next
+{
+    SCANNER_DONE,
+    SCANNER_PATH,
+    SCANNER_PENDING,
+};
+
+/*
+ * Directories still to read. The owning worker pushes and pops at the
+ * tail, idle workers steal from the head, so thieves take the oldest
+ * and usually largest subtrees.
+ */
+struct scan_deque
+{
+    pthread_mutex_t lock;
+    char          **items;
+    size_t          head;
+    size_t          tail;
+    size_t          capacity;
+};
+
+struct scanner;
+
+struct scan_worker
+{
+    struct scanner   *scanner;
+    struct scan_deque deque;
+    size_t            index;
+    char             *dirents;
+};
+
+struct scanner
+{
+    struct scan_worker *workers;
+    pthread_t          *threads;
+    size_t              worker_count;
+    size_t              started;
+
+    atomic_size_t pending;
+    atomic_size_t running;
+    atomic_bool   stop;
+
+    pthread_mutex_t idle_lock;
+    pthread_cond_t  idle_cond;
+
+    pthread_mutex_t out_lock;
+    pthread_cond_t  out_not_empty;
+    pthread_cond_t  out_not_full;
+    char           *out[SCANNER_QUEUE_LEN];
+    size_t          out_head;
+    size_t          out_count;
+    bool            out_done;
+
+    atomic_uint_fast64_t directories;
+    atomic_uint_fast64_t files;
+};
+
+/**
+ * Starts walking root on worker_count threads. Regular files are
+ * queued for scanner_next without being opened; everything else,
+ * including symbolic links, is skipped. Telling ELF files apart is
+ * left to whoever reads the headers.
+ *
+ * @param scanner the scanner to fill
+ * @param root the directory to walk
+ * @param worker_count the number of threads, at most SCANNER_MAX_THREADS
+ * @return 0 if successful, -1 if root is not a directory or the threads could not be started
+ */
+int scanner_start(struct scanner *scanner, const char *root, size_t worker_count);
+
+/**
+ * Takes the next ELF candidate.
+ *
+ * @param scanner the scanner to take from
+ * @param wait block until a path arrives or the walk ends
+ * @param path where to store a path the caller must free
+ * @return SCANNER_PATH, SCANNER_DONE once the walk is over, or SCANNER_PENDING if not waiting and nothing is queued yet
+ */
+enum scanner_next scanner_next(struct scanner *scanner, bool wait, char **path);
+
+/**
+ * Stops the walk if it is still running, joins the threads and frees
+ * everything.
+ *
+ * @param scanner the scanner to stop
+ */
+void scanner_stop(struct scanner *scanner);
+
+#endif    // SCANNER_H
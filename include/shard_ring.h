@@ -0,0 +1,57 @@
+#ifndef SHARD_RING_H
+#define SHARD_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHARD_VNODES 64              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAX_SHARD_ENDPOINTS 64       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SHARD_ENDPOINT_SEPARATOR ','
+
+struct shard_point
+{
+    uint64_t hash;
+    size_t   endpoint;
+};
+
+struct shard_ring
+{
+    char                *endpoint_list;
+    const char         **endpoints;
+    size_t               endpoint_count;
+    struct shard_point  *points;
+    size_t               point_count;
+};
+
+/**
+ * Builds a consistent hash ring from a comma separated list of
+ * endpoints. Each endpoint is placed on the ring SHARD_VNODES times.
+ * The ring keeps its own copy of the list.
+ *
+ * @param ring the ring to fill
+ * @param endpoint_list the comma separated endpoints
+ * @return 0 if successful, -1 if the list is empty, too long or memory ran out
+ */
+int shard_ring_create(struct shard_ring *ring, const char *endpoint_list);
+
+/**
+ * Releases everything held by the ring.
+ *
+ * @param ring the ring to release
+ */
+void shard_ring_destroy(struct shard_ring *ring);
+
+/**
+ * Fills order with the distinct endpoint indices met when walking
+ * the ring clockwise from key. The first entry owns the key, the
+ * rest are its failover candidates.
+ *
+ * @param ring the ring to walk
+ * @param key the content key to route
+ * @param order where to write the endpoint indices
+ * @param max the capacity of order
+ * @return the number of indices written
+ */
+size_t shard_ring_route(const struct shard_ring *ring, uint64_t key, size_t *order, size_t max);
+
+#endif    // SHARD_RING_H
@@ -0,0 +1,103 @@
+#ifndef SHM_CACHE_H
+#define SHM_CACHE_H
+
+#include "content_key.h"
+#include "elf_result.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_CACHE_MAGIC 0x454c4643u      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SHM_CACHE_VERSION 3              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SHM_CACHE_WAYS 4                 // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SHM_CACHE_DEFAULT_SLOTS 65536    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+struct shm_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t slot_count;
+    uint64_t slot_size;
+};
+
+/*
+ * One record. seq is a seqlock: odd while a writer is inside the slot,
+ * bumped to the next even value when it leaves. Readers never block,
+ * they retry or give up when seq moves under them. Writers also hold
+ * an open file description lock on the slot's bytes, which the kernel
+ * drops when a writer dies, so a slot found odd under that lock was
+ * left by a dead writer and is taken back instead of staying locked
+ * for good, wherever the processes' pid namespaces are.
+ *
+ * The key only picks the set; the header bytes it was hashed from are
+ * kept and compared, so a key collision, accidental or planted by
+ * another user of the cache, is a miss rather than someone else's
+ * answer.
+ */
+struct shm_cache_slot
+{
+    _Atomic uint64_t  seq;
+    uint64_t          key;
+    uint32_t          used;
+    uint32_t          header_len;
+    uint8_t           header[CONTENT_KEY_SPAN];
+    struct elf_result result;
+};
+
+struct shm_cache
+{
+    struct shm_cache_header *header;
+    struct shm_cache_slot   *slots;
+    size_t                   slot_count;
+    size_t                   map_len;
+    int                      fd;
+};
+
+/**
+ * Maps the cache file at path, creating and sizing it when it does
+ * not exist yet. Every process mapping the same path shares the
+ * records, and the records outlive the processes. The file stays open
+ * for the slot locks; a cache is used by one thread at a time.
+ *
+ * @param cache the cache to fill
+ * @param path the backing file, usually under /dev/shm
+ * @param slot_count the number of records for a new file
+ * @return 0 if successful, -1 if not
+ */
+int shm_cache_open(struct shm_cache *cache, const char *path, size_t slot_count);
+
+/**
+ * Unmaps and closes the cache. The records stay in the backing file.
+ *
+ * @param cache the cache to unmap
+ */
+void shm_cache_close(struct shm_cache *cache);
+
+/**
+ * Copies the record stored for a header without taking any lock.
+ * Only the first CONTENT_KEY_SPAN bytes of the header count, as for
+ * the key.
+ *
+ * @param cache the cache to search
+ * @param key the content key of the header
+ * @param header the header the key was computed from
+ * @param header_len the length of the header
+ * @param result where to copy the record
+ * @return 0 on a hit, -1 on a miss
+ */
+int shm_cache_get(const struct shm_cache *cache, uint64_t key, const void *header, size_t header_len, struct elf_result *result);
+
+/**
+ * Stores a record for a header. A slot being written by another
+ * process is skipped rather than waited for, unless that process has
+ * died, in which case the slot is reclaimed.
+ *
+ * @param cache the cache to fill
+ * @param key the content key of the header
+ * @param header the header the key was computed from
+ * @param header_len the length of the header
+ * @param result the record to store
+ */
+void shm_cache_put(struct shm_cache *cache, uint64_t key, const void *header, size_t header_len, const struct elf_result *result);
+
+#endif    // SHM_CACHE_H
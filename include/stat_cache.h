@@ -0,0 +1,119 @@
+#ifndef STAT_CACHE_H
+#define STAT_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define STAT_CACHE_MAGIC 0x48435453u           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define STAT_CACHE_VERSION 1                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define STAT_CACHE_INITIAL_CAPACITY 16384      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define STAT_CACHE_BODY_LEN 440                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define STAT_CACHE_TMP_SUFFIX ".tmp"
+
+/*
+ * What a file looks like from stat alone. Writing the file moves
+ * mtime and ctime, and replacing it moves the inode, so an unchanged
+ * identity means the last answer still holds.
+ */
+struct file_identity
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    int64_t  ctime_sec;
+    int64_t  ctime_nsec;
+};
+
+/*
+ * File layout: a header followed by an open addressing table of fixed
+ * size records placed by (dev, ino), so a file that changes overwrites
+ * its own record. body is the daemon's answer without its "File:"
+ * line, which is rebuilt from the path asked about. stored_sec is the
+ * wall clock when the answer was recorded.
+ */
+struct stat_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t count;
+};
+
+struct stat_cache_record
+{
+    struct file_identity identity;
+    int64_t              stored_sec;
+    uint32_t             checksum;
+    uint32_t             body_len;
+    char                 body[STAT_CACHE_BODY_LEN];
+};
+
+struct stat_cache
+{
+    char                     *path;
+    int                       fd;
+    struct stat_cache_header *header;
+    struct stat_cache_record *records;
+    size_t                    map_len;
+};
+
+/**
+ * Fills an identity from stat results.
+ *
+ * @param stats the result of stat or fstat
+ * @param identity the identity to fill
+ */
+void file_identity_from_stat(const struct stat *stats, struct file_identity *identity);
+
+/**
+ * Opens or creates the cache file. A file written by another layout
+ * is started over; a file that is not a cache at all is refused. Only
+ * one process may hold a cache open.
+ *
+ * @param cache the cache to fill
+ * @param path the cache file
+ * @return 0 if successful, -1 if not
+ */
+int stat_cache_open(struct stat_cache *cache, const char *path);
+
+/**
+ * Unmaps and closes the cache.
+ *
+ * @param cache the cache to close
+ */
+void stat_cache_close(struct stat_cache *cache);
+
+/**
+ * Looks up the answer recorded for a file. Anything but an exact
+ * identity match is a miss, and so is an answer recorded in the same
+ * second the file last changed, since a coarse timestamp cannot tell
+ * a later write in that second apart.
+ *
+ * @param cache the cache to search
+ * @param identity the file as stat sees it now
+ * @param body where to point at the recorded answer
+ * @param body_len where to store its length
+ * @return 0 on a hit, -1 on a miss
+ */
+int stat_cache_get(const struct stat_cache *cache, const struct file_identity *identity, const char **body, size_t *body_len);
+
+/**
+ * Records the answer for a file, replacing what was recorded for its
+ * inode before. Answers longer than STAT_CACHE_BODY_LEN are not kept.
+ *
+ * @param cache the cache to write to
+ * @param identity the file as it was when its header was read
+ * @param body the answer without its "File:" line
+ * @param body_len the length of body
+ * @return 0 if recorded, -1 if not
+ */
+int stat_cache_put(struct stat_cache *cache, const struct file_identity *identity, const char *body, size_t body_len);
+
+#endif    // STAT_CACHE_H
@@ -0,0 +1,96 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS 6                                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TIMER_WHEEL_SLOTS (1U << TIMER_WHEEL_BITS)          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TIMER_WHEEL_LEVELS 4                                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TIMER_WHEEL_SPAN (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * A timer lives inside whatever it times, so arming and cancelling
+ * never allocate. slot points at the list head it is on, or is NULL
+ * while the timer is not armed.
+ */
+struct timer_entry
+{
+    uint64_t             expires;
+    struct timer_entry **slot;
+    struct timer_entry  *prev;
+    struct timer_entry  *next;
+    void                *data;
+};
+
+/*
+ * A hierarchical timer wheel with one tick per millisecond. Level 0
+ * holds timers due within TIMER_WHEEL_SLOTS ticks, one slot per tick;
+ * each level above covers TIMER_WHEEL_SLOTS times the span of the one
+ * below and is cascaded down a slot at a time as the clock reaches it.
+ * Arming and cancelling are O(1); timers further out than
+ * TIMER_WHEEL_SPAN ticks fire at the edge of the wheel.
+ */
+struct timer_wheel
+{
+    uint64_t            now;
+    size_t              count;
+    struct timer_entry *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+/**
+ * Empties the wheel and sets its clock.
+ *
+ * @param wheel the wheel to set up
+ * @param now the current tick
+ */
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now);
+
+/**
+ * Arms a timer, moving it if it is already armed. A tick that has
+ * already passed fires on the next one.
+ *
+ * @param wheel the wheel to arm on
+ * @param entry the timer to arm
+ * @param expires the tick it is due at
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_entry *entry, uint64_t expires);
+
+/**
+ * Disarms a timer. Disarming one that is not armed does nothing.
+ *
+ * @param wheel the wheel it is armed on
+ * @param entry the timer to disarm
+ */
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer_entry *entry);
+
+/**
+ * Tells whether a timer is armed.
+ *
+ * @param entry the timer to ask about
+ * @return true if it is
+ */
+bool timer_wheel_armed(const struct timer_entry *entry);
+
+/**
+ * Moves the clock forward and hands back every timer that came due,
+ * already disarmed and linked through next.
+ *
+ * @param wheel the wheel to advance
+ * @param now the current tick
+ * @return the timers that fired, or NULL if none did
+ */
+struct timer_entry *timer_wheel_advance(struct timer_wheel *wheel, uint64_t now);
+
+/**
+ * Returns how many ticks the caller can sleep before it needs to call
+ * timer_wheel_advance again. This is exact for timers in the next
+ * level 0 rotation and otherwise the distance to the next cascade.
+ *
+ * @param wheel the wheel to ask
+ * @return the ticks to wait, or -1 if nothing is armed
+ */
+int64_t timer_wheel_timeout(const struct timer_wheel *wheel);
+
+#endif    // TIMER_WHEEL_H
@@ -0,0 +1,110 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_RINGS 16             // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TRACE_RING_EVENTS 4096     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TRACE_DETAIL_LEN 96        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TRACE_FLUSH_MS 100         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TRACE_DEFAULT_SAMPLE 64    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * One span of one request. name is a string literal; detail, if not
+ * empty, is shown as the span's path. A span that starts and ends at
+ * the same nanosecond is written as an instant.
+ */
+struct trace_event
+{
+    const char *name;
+    uint64_t    id;
+    uint64_t    start_ns;
+    uint64_t    end_ns;
+    char        detail[TRACE_DETAIL_LEN];
+};
+
+/*
+ * A single producer, single consumer ring. Only the thread that claimed
+ * it advances head and only the flusher advances tail, so neither side
+ * takes a lock; a span that finds the ring full is dropped and counted.
+ */
+struct trace_ring
+{
+    _Atomic size_t     head;
+    _Atomic size_t     tail;
+    struct trace_event events[TRACE_RING_EVENTS];
+};
+
+/*
+ * Request spans written to a Trace Event JSON file that Perfetto and
+ * about:tracing open. Each recording thread claims a ring of its own on
+ * its first span, and a flusher thread drains them all to the file
+ * every TRACE_FLUSH_MS, so recording never waits on the disk. Only one
+ * request in sample is traced, chosen by a hash of its file name, so a
+ * client and a daemon tracing with the same sample pick the same
+ * requests. Times are on the monotonic clock, which processes on one
+ * host share, so their files line up when loaded together.
+ */
+struct trace
+{
+    FILE                *out;
+    struct trace_ring   *rings;
+    _Atomic size_t       ring_count;
+    atomic_uint_fast64_t dropped;
+    uint64_t             sample;
+    const char          *category;
+    int                  pid;
+    atomic_bool          stop;
+    pthread_t            flusher;
+    pthread_mutex_t      lock;
+    pthread_cond_t       wake;
+};
+
+/**
+ * Creates the trace file and starts the flusher.
+ *
+ * @param trace the trace to set up
+ * @param path the file to write, replaced if it exists
+ * @param category the name the process and its spans are shown under, a string literal
+ * @param sample trace one request in this many, 1 for all of them
+ * @return 0 if successful, -1 if the file or the flusher could not be set up
+ */
+int trace_open(struct trace *trace, const char *path, const char *category, uint64_t sample);
+
+/**
+ * Stops the flusher, writes every span still in the rings and closes
+ * the file. A trace that was never opened is left alone.
+ *
+ * @param trace the trace to close
+ */
+void trace_close(struct trace *trace);
+
+/**
+ * Decides whether a request is traced. Without an open trace this
+ * returns at once without looking at the name.
+ *
+ * @param trace the trace
+ * @param name the file name the request is about
+ * @param id where to store the request's id for trace_span
+ * @return true if the request's spans should be recorded
+ */
+bool trace_sample(const struct trace *trace, const char *name, uint64_t *id);
+
+/**
+ * Records a span of a sampled request in the calling thread's ring.
+ *
+ * @param trace the trace
+ * @param id the request's id from trace_sample
+ * @param name what the span covers, a string literal
+ * @param start_ns when it started, on the monotonic clock
+ * @param end_ns when it ended, on the monotonic clock
+ * @param detail the file name to show with it, or NULL
+ */
+void trace_span(struct trace *trace, uint64_t id, const char *name, uint64_t start_ns, uint64_t end_ns, const char *detail);
+
+#endif    // TRACE_H
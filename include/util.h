@@ -2,9 +2,24 @@
 #define UTIL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#define BUSY_PREFIX "Busy: retry after "
+#define BUSY_SUFFIX " ms\n"
+#define BUDGET_SEPARATOR '\0'
+#define BUDGET_MAX_DIGITS 20    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTEN_FDS_START 3      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LISTEN_PID_ENV "LISTEN_PID"
+#define LISTEN_FDS_ENV "LISTEN_FDS"
+#define LISTEN_FDNAMES_ENV "LISTEN_FDNAMES"
+#define FNV32_OFFSET_BASIS 0x811c9dc5u              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FNV32_PRIME 0x01000193u                     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FNV64_OFFSET_BASIS 0xcbf29ce484222325ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FNV64_PRIME 0x100000001b3ULL                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
 /**
  * Safely reads count bytes from the given file descriptor or until eof.
  * Returns the number of characters read or -1 if an error occurs.
@@ -86,4 +101,93 @@ void byte_swap(void *buf, int size);
  */
 int init_sockaddr_un(struct sockaddr_un *addr, const char *path);
 
+/**
+ * Parses an unsigned decimal number, rejecting empty strings,
+ * trailing characters and values that do not fit.
+ *
+ * @param str the string to parse
+ * @param value where to store the parsed number
+ * @return 0 if successful, -1 if not
+ */
+int parse_size(const char *str, size_t *value);
+
+/**
+ * Recognizes the reply a daemon sends when it turns a request away,
+ * BUSY_PREFIX followed by the delay and BUSY_SUFFIX.
+ *
+ * @param response the reply
+ * @param len the length of the reply
+ * @param retry_ms where to store the delay the daemon asked for
+ * @return 0 if the reply is a busy reply, -1 if not
+ */
+int parse_busy(const char *response, size_t len, size_t *retry_ms);
+
+/**
+ * Backs off from the delay a busy daemon asked for, doubling it for
+ * every earlier busy reply to the same request and stretching it by up
+ * to half again at random, so that clients turned away together do not
+ * come back together.
+ *
+ * @param retry_ms the delay the daemon asked for
+ * @param attempt the number of busy replies before this one
+ * @param max_ms the longest delay before the stretch
+ * @param jitter the caller's random state, any value but 0, advanced on every call
+ * @return the delay to wait in milliseconds
+ */
+size_t busy_delay(size_t retry_ms, size_t attempt, size_t max_ms, uint64_t *jitter);
+
+/**
+ * Claims a listening socket passed in by a service manager or launcher
+ * under the LISTEN_FDS convention: LISTEN_FDS_ENV sockets from
+ * LISTEN_FDS_START on, meant for the process named by LISTEN_PID_ENV.
+ * The variables are removed once read, as sd_listen_fds does, so a
+ * program this process goes on to execute is not told about a socket
+ * that was never meant for it. Only the first socket is used.
+ *
+ * @return the listening socket, or -1 with errno ENOENT if none was passed, or another errno if it is not a listening socket
+ */
+int inherited_socket(void);
+
+/**
+ * Builds a new string of path followed directly by suffix, as for a
+ * file kept next to another under the same name.
+ *
+ * @param path the path to extend
+ * @param suffix what to append, copied as is
+ * @return the new path for the caller to free, or NULL if out of memory
+ */
+char *concat_path(const char *path, const char *suffix);
+
+/**
+ * Builds the path of name inside the directory parent, putting a slash
+ * between them unless parent already ends in one.
+ *
+ * @param parent the directory
+ * @param name the entry in it
+ * @return the new path for the caller to free, or NULL if out of memory
+ */
+char *join_path(const char *parent, const char *name);
+
+/**
+ * Folds len bytes into a 32 bit FNV-1a hash. Start from
+ * FNV32_OFFSET_BASIS, or pass an earlier result to hash in pieces.
+ *
+ * @param buf the bytes to hash
+ * @param len the number of bytes
+ * @param hash the hash so far
+ * @return the hash with the bytes folded in
+ */
+uint32_t fnv1a32(const void *buf, size_t len, uint32_t hash);
+
+/**
+ * Folds len bytes into a 64 bit FNV-1a hash. Start from
+ * FNV64_OFFSET_BASIS, or pass an earlier result to hash in pieces.
+ *
+ * @param buf the bytes to hash
+ * @param len the number of bytes
+ * @param hash the hash so far
+ * @return the hash with the bytes folded in
+ */
+uint64_t fnv1a64(const void *buf, size_t len, uint64_t hash);
+
 #endif    // UTIL_H
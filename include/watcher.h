@@ -0,0 +1,90 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WATCHER_MAX_ROOTS 64              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define WATCHER_DEFAULT_DEBOUNCE_MS 200    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define WATCHER_EVENT_BUF_LEN 65536        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum watcher_next
+{
+    WATCHER_PATH,
+    WATCHER_PENDING,
+};
+
+/*
+ * A file that changed and is waiting out the debounce window. Changes
+ * are kept oldest first, and a file that changes again moves to the
+ * back, so the head is always the next one to settle.
+ */
+struct watch_change
+{
+    char                *path;
+    uint64_t             hash;
+    int64_t              deadline_ms;
+    struct watch_change *older;
+    struct watch_change *newer;
+    struct watch_change *bucket_next;
+};
+
+/*
+ * Watches every directory below the roots for files that are written,
+ * moved in or created with a new directory. Nothing runs between calls
+ * to watcher_next, so an idle watcher costs nothing but its blocking poll.
+ * Settled paths are handed out unopened; telling ELF files from the rest
+ * is left to whoever reads their headers.
+ */
+struct watcher
+{
+    int                   notify_fd;
+    int                   wake_fd;
+    const char          **roots;
+    size_t                root_count;
+    int64_t               debounce_ms;
+    char                **dirs;
+    size_t                dir_capacity;
+    size_t                dir_count;
+    struct watch_change **buckets;
+    size_t                bucket_count;
+    size_t                change_count;
+    struct watch_change  *oldest;
+    struct watch_change  *newest;
+    char                 *events;
+    uint64_t              events_seen;
+    uint64_t              overflows;
+    uint64_t              submitted;
+};
+
+/**
+ * Starts watching every directory below the roots.
+ *
+ * @param watcher the watcher to fill
+ * @param roots the directories to watch, which must outlive the watcher
+ * @param root_count the number of roots, at most WATCHER_MAX_ROOTS
+ * @param debounce_ms how long a file must stay quiet before it is handed out
+ * @param wake_fd a descriptor that turns readable to break a blocking wait, or -1
+ * @return 0 if successful, -1 if a root is not a directory or watching is not supported
+ */
+int watcher_start(struct watcher *watcher, const char **roots, size_t root_count, size_t debounce_ms, int wake_fd);
+
+/**
+ * Takes the next changed file whose debounce window has passed.
+ *
+ * @param watcher the watcher to take from
+ * @param wait block until a change settles, a signal arrives or wake_fd turns readable
+ * @param path where to store a path the caller must free
+ * @return WATCHER_PATH, or WATCHER_PENDING if nothing has settled yet
+ */
+enum watcher_next watcher_next(struct watcher *watcher, bool wait, char **path);
+
+/**
+ * Stops watching and frees everything, dropping changes still waiting.
+ *
+ * @param watcher the watcher to stop
+ */
+void watcher_stop(struct watcher *watcher);
+
+#endif    // WATCHER_H
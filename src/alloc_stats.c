@@ -0,0 +1,108 @@
+#include "alloc_stats.h"
+#include <inttypes.h>
+#include <string.h>
+
+static size_t find_site(struct alloc_stats *stats, struct alloc_site site);
+
+static size_t find_site(struct alloc_stats *stats, struct alloc_site site)
+{
+    size_t index;
+
+    for(index = 0; index < stats->site_count; index++)
+    {
+        if(stats->sites[index].line == site.line && strcmp(stats->sites[index].function, site.function) == 0)
+        {
+            return index;
+        }
+    }
+
+    if(stats->site_count == ALLOC_STATS_MAX_SITES)
+    {
+        return ALLOC_STATS_MAX_SITES - 1;
+    }
+
+    stats->sites[stats->site_count] = site;
+
+    return stats->site_count++;
+}
+
+void alloc_stats_allocated(struct alloc_stats *stats, struct alloc_site site, uint64_t bytes)
+{
+    size_t index;
+
+    index = find_site(stats, site);
+    stats->allocations[index]++;
+    stats->bytes[index] += bytes;
+    stats->live_bytes += bytes;
+
+    if(stats->live_bytes > stats->peak_bytes)
+    {
+        stats->peak_bytes = stats->live_bytes;
+    }
+}
+
+void alloc_stats_freed(struct alloc_stats *stats, uint64_t bytes)
+{
+    stats->frees++;
+    stats->live_bytes -= bytes;
+}
+
+void alloc_stats_request(struct alloc_stats *stats)
+{
+    stats->requests++;
+}
+
+void alloc_stats_write(const struct alloc_stats *stats, FILE *out)
+{
+    fputs("# HELP elfinspectd_allocations_total Allocations made while serving, by the call that made them.\n# TYPE elfinspectd_allocations_total counter\n", out);
+
+    for(size_t site = 0; site < stats->site_count; site++)
+    {
+        fprintf(out, "elfinspectd_allocations_total{site=\"%s:%d\"} %" PRIu64 "\n", stats->sites[site].function, stats->sites[site].line, stats->allocations[site]);
+    }
+
+    fputs("# HELP elfinspectd_allocated_bytes_total Bytes allocated while serving, by the call that allocated them.\n# TYPE elfinspectd_allocated_bytes_total counter\n", out);
+
+    for(size_t site = 0; site < stats->site_count; site++)
+    {
+        fprintf(out, "elfinspectd_allocated_bytes_total{site=\"%s:%d\"} %" PRIu64 "\n", stats->sites[site].function, stats->sites[site].line, stats->bytes[site]);
+    }
+
+    fprintf(out, "# HELP elfinspectd_frees_total Allocations freed.\n# TYPE elfinspectd_frees_total counter\nelfinspectd_frees_total %" PRIu64 "\n", stats->frees);
+    fprintf(out, "# HELP elfinspectd_live_bytes Bytes allocated and not yet freed.\n# TYPE elfinspectd_live_bytes gauge\nelfinspectd_live_bytes %" PRIu64 "\n", stats->live_bytes);
+    fprintf(out, "# HELP elfinspectd_peak_live_bytes The most bytes ever live at once.\n# TYPE elfinspectd_peak_live_bytes gauge\nelfinspectd_peak_live_bytes %" PRIu64 "\n", stats->peak_bytes);
+    fprintf(out, "# HELP elfinspectd_allocation_requests_total Requests served while allocations were counted.\n# TYPE elfinspectd_allocation_requests_total counter\nelfinspectd_allocation_requests_total %" PRIu64 "\n", stats->requests);
+}
+
+void alloc_stats_summary(const struct alloc_stats *stats, FILE *out)
+{
+    uint64_t allocations;
+    uint64_t bytes;
+    double   requests;
+
+    allocations = 0;
+    bytes       = 0;
+
+    for(size_t site = 0; site < stats->site_count; site++)
+    {
+        allocations += stats->allocations[site];
+        bytes += stats->bytes[site];
+    }
+
+    requests = stats->requests == 0 ? 1.0 : (double)stats->requests;
+
+    fprintf(out,
+            "Allocated %" PRIu64 " times (%.2f per request) and %" PRIu64 " bytes (%.1f per request), freed %" PRIu64 " times, %" PRIu64 " bytes still live and at most %" PRIu64 " at once\n",
+            allocations,
+            (double)allocations / requests,
+            bytes,
+            (double)bytes / requests,
+            stats->frees,
+            stats->live_bytes,
+            stats->peak_bytes);
+
+    for(size_t site = 0; site < stats->site_count; site++)
+    {
+        fprintf(out, "  %s:%d: %.2f allocations and %.1f bytes per request\n", stats->sites[site].function, stats->sites[site].line, (double)stats->allocations[site] / requests, (double)stats->bytes[site] / requests);
+    }
+}
@@ -0,0 +1,310 @@
+#include "batch.h"
+#include "elf_validator.h"
+#include "header_reader.h"
+#include "histogram.h"
+#include "probes.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define ELF_MAGIC_LEN 4    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * What an answer needs once it comes back: where to write it, what to
+ * count it in, the identity it gets cached under and, if it is traced,
+ * its trace id and when it was handed to the client.
+ */
+struct batch_request
+{
+    const struct batch_options *options;
+    struct batch_stats         *stats;
+    struct file_identity        identity;
+    bool                        traced;
+    uint64_t                    trace_id;
+    uint64_t                    submitted_ns;
+};
+
+static bool answer_from_cache(const struct batch_options *options, struct batch_stats *stats, const char *path);
+static void record_answer(const struct batch_options *options, const struct file_identity *identity, const struct elf_client_answer *answer);
+static void on_answer(void *arg, const struct elf_client_answer *answer);
+static void start_request(const struct batch_options *options, struct batch_stats *stats, struct elf_client *client, const struct header_read *read);
+
+/*
+ * A file whose stat identity matches a recorded answer is answered
+ * right away, never opened and never sent to a daemon.
+ */
+static bool answer_from_cache(const struct batch_options *options, struct batch_stats *stats, const char *path)
+{
+    struct stat          file_stats;
+    struct file_identity identity;
+    const char          *body;
+    size_t               body_len;
+
+    if(options->cache == NULL || options->revalidate || stat(path, &file_stats) == -1 || !S_ISREG(file_stats.st_mode))
+    {
+        return false;
+    }
+
+    file_identity_from_stat(&file_stats, &identity);
+
+    if(stat_cache_get(options->cache, &identity, &body, &body_len) == -1)
+    {
+        return false;
+    }
+
+    fprintf(options->out, "File: %s\n", path);
+    fwrite(body, 1, body_len, options->out);
+
+    if(body[body_len - 1] != '\n')
+    {
+        fputc('\n', options->out);
+    }
+
+    stats->completed++;
+    stats->cached++;
+
+    return true;
+}
+
+/*
+ * Records an answer under the identity its header was read with. The
+ * "File:" line names the path asked about, which another link to the
+ * same inode would not share, so only what follows it is kept.
+ */
+static void record_answer(const struct batch_options *options, const struct file_identity *identity, const struct elf_client_answer *answer)
+{
+    const char *body;
+    const char *end;
+
+    if(options->cache == NULL || answer->response_len < sizeof("File: ") || strncmp(answer->response, "File: ", sizeof("File: ") - 1) != 0)
+    {
+        return;
+    }
+
+    body = (const char *)memchr(answer->response, '\n', answer->response_len);
+    end  = answer->response + answer->response_len;
+
+    if(body != NULL && body + 1 < end)
+    {
+        body++;
+        stat_cache_put(options->cache, identity, body, (size_t)(end - body));
+    }
+}
+
+static void on_answer(void *arg, const struct elf_client_answer *answer)
+{
+    struct batch_request *request;
+
+    request = (struct batch_request *)arg;
+    PROBE3(elfinspect, answer_received, answer->name, answer->response_len, answer->error);
+
+    if(request->traced)
+    {
+        trace_span(request->options->trace, request->trace_id, "request", request->submitted_ns, histogram_now_ns(), answer->name);
+    }
+
+    if(answer->error != NULL)
+    {
+        fprintf(stderr, "%s: %s\n", answer->name, answer->error);
+        request->stats->failed++;
+        free(request);
+        return;
+    }
+
+    fwrite(answer->response, 1, answer->response_len, request->options->out);
+
+    if(answer->response[answer->response_len - 1] != '\n')
+    {
+        fputc('\n', request->options->out);
+    }
+
+    record_answer(request->options, &request->identity, answer);
+    request->stats->completed++;
+    free(request);
+}
+
+/*
+ * Hands a finished header read to the client, which routes it by
+ * content and starts the connection.
+ */
+static void start_request(const struct batch_options *options, struct batch_stats *stats, struct elf_client *client, const struct header_read *read)
+{
+    struct batch_request *request;
+
+    // the source handed out every file it found, so this one may never have been a candidate
+    if(options->elf_only && (read->error != NULL || read->header_len < ELF_MAGIC_LEN || verify_magic(read->header, NULL) == -1))
+    {
+        stats->submitted--;
+        stats->skipped++;
+        return;
+    }
+
+    if(read->error != NULL)
+    {
+        fprintf(stderr, "%s: %s\n", read->path, read->error);
+        stats->failed++;
+        return;
+    }
+
+    request = (struct batch_request *)malloc(sizeof(*request));
+
+    if(request == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", read->path, "Out of memory");
+        stats->failed++;
+        return;
+    }
+
+    request->options  = options;
+    request->stats    = stats;
+    request->identity = read->identity;
+    request->traced   = options->trace != NULL && trace_sample(options->trace, read->path, &request->trace_id);
+
+    if(request->traced)
+    {
+        request->submitted_ns = histogram_now_ns();
+    }
+
+    if(elf_client_submit_header(client, read->path, read->header, read->header_len, on_answer, request) == -1)
+    {
+        fprintf(stderr, "%s: %s\n", read->path, errno == EINVAL ? "File name too long" : "Failed to connect to server");
+        stats->failed++;
+        free(request);
+        return;
+    }
+
+    PROBE1(elfinspect, request_sent, read->path);
+}
+
+int batch_run(const struct batch_options *options, struct batch_stats *stats)
+{
+    struct header_reader reader;
+    struct elf_client    client;
+    bool                 drained;
+    int                  ret_val;
+
+    memset(stats, 0, sizeof(*stats));
+    drained = false;
+    ret_val = -1;
+
+    if(elf_client_open(&client, options->socket_paths) == -1)
+    {
+        fflush(options->out);
+        return -1;
+    }
+
+    elf_client_set_budget(&client, options->budget_ms);
+
+    if(header_reader_open(&reader, options->depth, options->use_uring) == -1)
+    {
+        goto close_client;
+    }
+
+    stats->used_uring = header_reader_uses_uring(&reader);
+
+    for(;;)
+    {
+        struct pollfd fds[2];
+        nfds_t        nfds;
+        bool          starved;
+        int           reader_fd;
+
+        starved = false;
+
+        // plain reads finish on submission, so feeding the reader and starting requests interleave
+        do
+        {
+            struct header_read *read;
+
+            while(elf_client_outstanding(&client) < options->jobs && (read = header_reader_take(&reader)) != NULL)
+            {
+                start_request(options, stats, &client, read);
+                free(read->path);
+                header_reader_release(&reader, read);
+            }
+
+            // read ahead of the requests, only blocking on the source when nothing else can progress
+            while(!drained && !starved && header_reader_has_room(&reader))
+            {
+                enum batch_next next;
+                char           *path;
+
+                next = options->next_path(options->source_arg, elf_client_outstanding(&client) == 0 && header_reader_empty(&reader), &path);
+
+                if(next == BATCH_NEXT_DONE)
+                {
+                    drained = true;
+                }
+                else if(next == BATCH_NEXT_PENDING)
+                {
+                    starved = true;
+                }
+                else
+                {
+                    stats->submitted++;
+
+                    if(answer_from_cache(options, stats, path))
+                    {
+                        free(path);
+                        continue;
+                    }
+
+                    header_reader_submit(&reader, path);
+                }
+            }
+
+            header_reader_drive(&reader);
+        } while(elf_client_outstanding(&client) < options->jobs && reader.done_count != 0);
+
+        nfds      = 0;
+        reader_fd = header_reader_poll_fd(&reader);
+
+        if(elf_client_outstanding(&client) != 0)
+        {
+            fds[nfds].fd     = elf_client_fd(&client);
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+
+        if(reader_fd != 0)
+        {
+            fds[nfds].fd     = reader_fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+
+        if(nfds == 0)
+        {
+            if(drained && header_reader_empty(&reader))
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        // reader completions are collected at the top of the loop
+        if(poll(fds, nfds, starved ? BATCH_RETRY_MS : -1) == -1 && errno != EINTR)
+        {
+            goto done;
+        }
+
+        if(elf_client_outstanding(&client) != 0 && elf_client_process(&client, 0) == -1)
+        {
+            goto done;
+        }
+    }
+
+    ret_val = 0;
+
+done:
+    header_reader_close(&reader);
+
+close_client:
+    elf_client_close(&client);
+    fflush(options->out);
+
+    return ret_val;
+}
@@ -0,0 +1,859 @@
+#include "catalog.h"
+#include "content_key.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PID_SHIFT 32    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TMP_SUFFIX ".tmp"
+
+static uint32_t                   checksum(const struct catalog_record *record);
+static bool                       record_intact(const struct catalog_record *record);
+static bool                       record_valid(const struct catalog *catalog, uint64_t offset);
+static int                        map_file(int fd, size_t len, void **map);
+static int                        open_log(struct catalog *catalog);
+static int                        create_index(const char *path, uint64_t capacity, uint64_t log_id, int *fd, void **map, size_t *len);
+static int                        open_index(struct catalog *catalog);
+static struct catalog_index_slot *probe(const struct catalog_index_header *index, struct catalog_index_slot *slots, uint64_t key);
+static int                        start_growth(struct catalog *catalog);
+static void                       migrate(struct catalog *catalog, uint64_t count);
+static void                       finish_growth(struct catalog *catalog);
+static int                        index_insert(struct catalog *catalog, uint64_t key, uint64_t offset);
+static struct catalog_index_slot *find_slot(const struct catalog *catalog, uint64_t key);
+static int                        replay(struct catalog *catalog, uint64_t from);
+static int                        compact_record(struct catalog *compacted, const struct catalog_record *record);
+static void                      *compact_main(void *arg);
+static void                       start_compaction(struct catalog *catalog);
+static int                        finish_compaction(struct catalog *catalog);
+static void                       remove_compaction_files(const struct catalog *catalog);
+
+static uint32_t checksum(const struct catalog_record *record)
+{
+    // everything after the marker and the checksum itself
+    return fnv1a32(&record->key, sizeof(*record) - offsetof(struct catalog_record, key), FNV32_OFFSET_BASIS);
+}
+
+static bool record_intact(const struct catalog_record *record)
+{
+    return record->marker == CATALOG_RECORD_MARKER && record->checksum == checksum(record);
+}
+
+static bool record_valid(const struct catalog *catalog, uint64_t offset)
+{
+    if(offset < CATALOG_HEADER_LEN || offset + sizeof(struct catalog_record) > catalog->log_map_len)
+    {
+        return false;
+    }
+
+    return record_intact((const struct catalog_record *)(catalog->log_map + offset));
+}
+
+static int map_file(int fd, size_t len, void **map)
+{
+    void *mapped;
+
+    mapped = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(mapped == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    *map = mapped;
+    return 0;
+}
+
+static int open_log(struct catalog *catalog)
+{
+    struct catalog_log_header header;
+    struct flock              lock;
+    struct stat               file_stats;
+    void                     *map;
+
+    catalog->log_fd = open(catalog->log_path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    if(catalog->log_fd == -1)
+    {
+        catalog->log_fd = 0;
+        return -1;
+    }
+
+    // one writer per catalog; a second daemon pointed at it is refused
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type   = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+
+    if(fcntl(catalog->log_fd, F_SETLK, &lock) == -1 || fstat(catalog->log_fd, &file_stats) == -1)
+    {
+        return -1;
+    }
+
+    if(file_stats.st_size >= CATALOG_HEADER_LEN)
+    {
+        if(pread(catalog->log_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != CATALOG_MAGIC)
+        {
+            // not a catalog at all, refuse rather than overwrite it
+            return -1;
+        }
+
+        if(header.version == CATALOG_VERSION && header.record_size == sizeof(struct catalog_record) && header.result_size == sizeof(struct elf_result))
+        {
+            if(map_file(catalog->log_fd, (size_t)file_stats.st_size, &map) == -1)
+            {
+                return -1;
+            }
+
+            catalog->log_map     = (uint8_t *)map;
+            catalog->log_map_len = (size_t)file_stats.st_size;
+            return 0;
+        }
+    }
+
+    // new, or written by an older layout: start an empty log
+    memset(&header, 0, sizeof(header));
+    header.magic       = CATALOG_MAGIC;
+    header.version     = CATALOG_VERSION;
+    header.log_id      = mix64((uint64_t)time(NULL) ^ ((uint64_t)getpid() << PID_SHIFT) ^ (uint64_t)file_stats.st_ino);
+    header.record_size = sizeof(struct catalog_record);
+    header.result_size = sizeof(struct elf_result);
+
+    if(ftruncate(catalog->log_fd, 0) == -1 || ftruncate(catalog->log_fd, CATALOG_GROW_BYTES) == -1 || pwrite(catalog->log_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    {
+        return -1;
+    }
+
+    if(map_file(catalog->log_fd, CATALOG_GROW_BYTES, &map) == -1)
+    {
+        return -1;
+    }
+
+    catalog->log_map     = (uint8_t *)map;
+    catalog->log_map_len = CATALOG_GROW_BYTES;
+
+    return 0;
+}
+
+static int create_index(const char *path, uint64_t capacity, uint64_t log_id, int *fd, void **map, size_t *len)
+{
+    struct catalog_index_header *header;
+
+    *len = sizeof(struct catalog_index_header) + (capacity * sizeof(struct catalog_index_slot));
+    *fd  = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    if(*fd == -1)
+    {
+        return -1;
+    }
+
+    if(ftruncate(*fd, (off_t)*len) == -1 || map_file(*fd, *len, map) == -1)
+    {
+        close(*fd);
+        *fd = -1;
+        return -1;
+    }
+
+    header              = (struct catalog_index_header *)*map;
+    header->magic       = CATALOG_INDEX_MAGIC;
+    header->version     = CATALOG_VERSION;
+    header->log_id      = log_id;
+    header->capacity    = capacity;
+    header->indexed_len = CATALOG_HEADER_LEN;
+
+    return 0;
+}
+
+static int open_index(struct catalog *catalog)
+{
+    const struct catalog_log_header *log_header;
+    struct catalog_index_header      header;
+    struct stat                      file_stats;
+    void                            *map;
+    int                              fd;
+
+    log_header = (const struct catalog_log_header *)catalog->log_map;
+    fd         = open(catalog->index_path, O_RDWR | O_CLOEXEC);
+
+    if(fd != -1 && fstat(fd, &file_stats) == 0 && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && header.magic == CATALOG_INDEX_MAGIC && header.version == CATALOG_VERSION &&
+       header.log_id == log_header->log_id && header.capacity != 0 && (header.capacity & (header.capacity - 1)) == 0 &&
+       (size_t)file_stats.st_size == sizeof(header) + (header.capacity * sizeof(struct catalog_index_slot)) && header.indexed_len >= CATALOG_HEADER_LEN && header.indexed_len <= catalog->log_map_len &&
+       (header.indexed_len - CATALOG_HEADER_LEN) % sizeof(struct catalog_record) == 0 && map_file(fd, (size_t)file_stats.st_size, &map) == 0)
+    {
+        catalog->index_fd      = fd;
+        catalog->index         = (struct catalog_index_header *)map;
+        catalog->slots         = (struct catalog_index_slot *)(catalog->index + 1);
+        catalog->index_map_len = (size_t)file_stats.st_size;
+        return 0;
+    }
+
+    // missing, torn or belonging to another log: rebuild it from the whole log
+    if(fd != -1)
+    {
+        close(fd);
+    }
+
+    if(create_index(catalog->index_path, CATALOG_INITIAL_CAPACITY, log_header->log_id, &catalog->index_fd, &map, &catalog->index_map_len) == -1)
+    {
+        catalog->index_fd = 0;
+        return -1;
+    }
+
+    catalog->index = (struct catalog_index_header *)map;
+    catalog->slots = (struct catalog_index_slot *)(catalog->index + 1);
+
+    return 0;
+}
+
+static struct catalog_index_slot *probe(const struct catalog_index_header *index, struct catalog_index_slot *slots, uint64_t key)
+{
+    uint64_t mask;
+    uint64_t position;
+
+    mask     = index->capacity - 1;
+    position = key & mask;
+
+    while(slots[position].offset != 0 && slots[position].key != key)
+    {
+        position = (position + 1) & mask;
+    }
+
+    return &slots[position];
+}
+
+static int start_growth(struct catalog *catalog)
+{
+    struct catalog_index_header *header;
+    void                        *map;
+    size_t                       len;
+    int                          fd;
+
+    if(create_index(catalog->grow_path, catalog->index->capacity * 2, catalog->index->log_id, &fd, &map, &len) == -1)
+    {
+        return -1;
+    }
+
+    // the old table keeps its indexed_len, the new one takes over from here
+    header              = (struct catalog_index_header *)map;
+    header->dead        = catalog->index->dead;
+    header->indexed_len = catalog->index->indexed_len;
+
+    catalog->old_index_fd      = catalog->index_fd;
+    catalog->old_index         = catalog->index;
+    catalog->old_slots         = catalog->slots;
+    catalog->old_index_map_len = catalog->index_map_len;
+    catalog->migrated          = 0;
+    catalog->index_fd          = fd;
+    catalog->index             = header;
+    catalog->slots             = (struct catalog_index_slot *)(header + 1);
+    catalog->index_map_len     = len;
+
+    return 0;
+}
+
+static void migrate(struct catalog *catalog, uint64_t count)
+{
+    uint64_t end;
+
+    end = catalog->old_index->capacity - catalog->migrated < count ? catalog->old_index->capacity : catalog->migrated + count;
+
+    for(; catalog->migrated < end; catalog->migrated++)
+    {
+        const struct catalog_index_slot *old;
+        struct catalog_index_slot       *slot;
+
+        old = &catalog->old_slots[catalog->migrated];
+
+        if(old->offset == 0)
+        {
+            continue;
+        }
+
+        // a key already in the new table was superseded since, and counted dead then
+        slot = probe(catalog->index, catalog->slots, old->key);
+
+        if(slot->offset == 0)
+        {
+            *slot = *old;
+            catalog->index->count++;
+        }
+    }
+
+    if(catalog->migrated == catalog->old_index->capacity)
+    {
+        finish_growth(catalog);
+    }
+}
+
+static void finish_growth(struct catalog *catalog)
+{
+    // if the rename fails the stale table stays behind and the difference is replayed at startup
+    if(rename(catalog->grow_path, catalog->index_path) == -1)
+    {
+        unlink(catalog->grow_path);
+    }
+
+    munmap(catalog->old_index, catalog->old_index_map_len);
+    close(catalog->old_index_fd);
+    catalog->old_index_fd      = 0;
+    catalog->old_index         = NULL;
+    catalog->old_slots         = NULL;
+    catalog->old_index_map_len = 0;
+    catalog->migrated          = 0;
+}
+
+static int index_insert(struct catalog *catalog, uint64_t key, uint64_t offset)
+{
+    struct catalog_index_slot *slot;
+
+    if(catalog->old_index != NULL)
+    {
+        migrate(catalog, CATALOG_MIGRATE_STEP);
+    }
+
+    // keep the load factor at or under one half so probes stay short; the
+    // old table is moved long before the new one reaches that
+    if(catalog->old_index == NULL && (catalog->index->count + 1) * 2 > catalog->index->capacity && start_growth(catalog) == -1)
+    {
+        return -1;
+    }
+
+    slot = probe(catalog->index, catalog->slots, key);
+
+    if(slot->offset != 0)
+    {
+        catalog->index->dead++;
+    }
+    else
+    {
+        if(catalog->old_index != NULL && probe(catalog->old_index, catalog->old_slots, key)->offset != 0)
+        {
+            catalog->index->dead++;
+        }
+
+        slot->key = key;
+        catalog->index->count++;
+    }
+
+    slot->offset = offset;
+
+    return 0;
+}
+
+// the new table holds everything written since a growth began, so it is tried first
+static struct catalog_index_slot *find_slot(const struct catalog *catalog, uint64_t key)
+{
+    struct catalog_index_slot *slot;
+
+    slot = probe(catalog->index, catalog->slots, key);
+
+    if(slot->offset == 0 && catalog->old_index != NULL)
+    {
+        slot = probe(catalog->old_index, catalog->old_slots, key);
+    }
+
+    return slot->offset == 0 ? NULL : slot;
+}
+
+static int replay(struct catalog *catalog, uint64_t from)
+{
+    uint64_t offset;
+
+    offset = from;
+
+    // the unwritten tail is zeroed, so a missing marker is the end of the log
+    while(offset + sizeof(struct catalog_record) <= catalog->log_map_len && ((const struct catalog_record *)(catalog->log_map + offset))->marker == CATALOG_RECORD_MARKER)
+    {
+        if(record_valid(catalog, offset) && index_insert(catalog, ((const struct catalog_record *)(catalog->log_map + offset))->key, offset) == -1)
+        {
+            return -1;
+        }
+
+        offset += sizeof(struct catalog_record);
+    }
+
+    catalog->tail               = offset;
+    catalog->index->indexed_len = offset;
+
+    return 0;
+}
+
+int catalog_open(struct catalog *catalog, const char *path)
+{
+    memset(catalog, 0, sizeof(*catalog));
+    catalog->log_path   = strdup(path);
+    catalog->index_path = concat_path(path, CATALOG_INDEX_SUFFIX);
+    catalog->grow_path  = catalog->index_path == NULL ? NULL : concat_path(catalog->index_path, TMP_SUFFIX);
+
+    if(catalog->log_path == NULL || catalog->grow_path == NULL || open_log(catalog) == -1 || open_index(catalog) == -1 || replay(catalog, catalog->index->indexed_len) == -1)
+    {
+        catalog_close(catalog);
+        return -1;
+    }
+
+    // opening is not a request, so finish any move the replay started
+    if(catalog->old_index != NULL)
+    {
+        migrate(catalog, catalog->old_index->capacity);
+    }
+
+    return 0;
+}
+
+int catalog_open_snapshot(struct catalog *catalog, const char *path)
+{
+    const struct catalog_log_header *log_header;
+    struct stat                      file_stats;
+    void                            *map;
+
+    memset(catalog, 0, sizeof(*catalog));
+    catalog->log_path   = strdup(path);
+    catalog->index_path = concat_path(path, CATALOG_INDEX_SUFFIX);
+
+    if(catalog->log_path == NULL || catalog->index_path == NULL)
+    {
+        goto fail;
+    }
+
+    catalog->log_fd = open(catalog->log_path, O_RDONLY | O_CLOEXEC);
+
+    if(catalog->log_fd == -1 || fstat(catalog->log_fd, &file_stats) == -1 || file_stats.st_size < CATALOG_HEADER_LEN)
+    {
+        goto fail;
+    }
+
+    map = mmap(NULL, (size_t)file_stats.st_size, PROT_READ, MAP_SHARED, catalog->log_fd, 0);
+
+    if(map == MAP_FAILED)
+    {
+        goto fail;
+    }
+
+    catalog->log_map     = (uint8_t *)map;
+    catalog->log_map_len = (size_t)file_stats.st_size;
+    log_header           = (const struct catalog_log_header *)map;
+
+    if(log_header->magic != CATALOG_MAGIC || log_header->version != CATALOG_VERSION || log_header->record_size != sizeof(struct catalog_record) || log_header->result_size != sizeof(struct elf_result))
+    {
+        goto fail;
+    }
+
+    catalog->index_fd = open(catalog->index_path, O_RDONLY | O_CLOEXEC);
+
+    if(catalog->index_fd == -1 || fstat(catalog->index_fd, &file_stats) == -1 || (size_t)file_stats.st_size < sizeof(struct catalog_index_header))
+    {
+        goto fail;
+    }
+
+    map = mmap(NULL, (size_t)file_stats.st_size, PROT_READ, MAP_SHARED, catalog->index_fd, 0);
+
+    if(map == MAP_FAILED)
+    {
+        goto fail;
+    }
+
+    catalog->index         = (struct catalog_index_header *)map;
+    catalog->slots         = (struct catalog_index_slot *)(catalog->index + 1);
+    catalog->index_map_len = (size_t)file_stats.st_size;
+
+    if(catalog->index->magic != CATALOG_INDEX_MAGIC || catalog->index->log_id != log_header->log_id || catalog->index->capacity == 0 || (catalog->index->capacity & (catalog->index->capacity - 1)) != 0 ||
+       (size_t)file_stats.st_size != sizeof(struct catalog_index_header) + (catalog->index->capacity * sizeof(struct catalog_index_slot)))
+    {
+        goto fail;
+    }
+
+    catalog->tail = catalog->index->indexed_len;
+    return 0;
+
+fail:
+    if(catalog->log_fd == -1)
+    {
+        catalog->log_fd = 0;
+    }
+
+    if(catalog->index_fd == -1)
+    {
+        catalog->index_fd = 0;
+    }
+
+    catalog_close(catalog);
+    return -1;
+}
+
+uint64_t catalog_scan(const struct catalog *catalog, void (*visit)(uint64_t key, const struct elf_result *result, void *arg), void *arg)
+{
+    uint64_t visited;
+
+    visited = 0;
+
+    if(catalog->index == NULL)
+    {
+        return 0;
+    }
+
+    for(uint64_t i = 0; i < catalog->index->capacity; i++)
+    {
+        if(catalog->slots[i].offset != 0 && record_valid(catalog, catalog->slots[i].offset))
+        {
+            const struct catalog_record *record;
+
+            record = (const struct catalog_record *)(catalog->log_map + catalog->slots[i].offset);
+            visit(record->key, &record->result, arg);
+            visited++;
+        }
+    }
+
+    return visited;
+}
+
+void catalog_close(struct catalog *catalog)
+{
+    if(catalog->compacting)
+    {
+        atomic_store(&catalog->compact_stop, true);
+        pthread_join(catalog->compactor, NULL);
+        remove_compaction_files(catalog);
+    }
+
+    if(catalog->old_index != NULL)
+    {
+        migrate(catalog, catalog->old_index->capacity);
+    }
+
+    if(catalog->index != NULL)
+    {
+        msync(catalog->index, catalog->index_map_len, MS_SYNC);
+        munmap(catalog->index, catalog->index_map_len);
+    }
+
+    if(catalog->log_map != NULL)
+    {
+        msync(catalog->log_map, catalog->log_map_len, MS_SYNC);
+        munmap(catalog->log_map, catalog->log_map_len);
+    }
+
+    // a zeroed catalog was never opened, 0 stands for no descriptor as elsewhere
+    if(catalog->index_fd > 0)
+    {
+        close(catalog->index_fd);
+    }
+
+    if(catalog->log_fd > 0)
+    {
+        close(catalog->log_fd);
+    }
+
+    free(catalog->grow_path);
+    free(catalog->index_path);
+    free(catalog->log_path);
+    memset(catalog, 0, sizeof(*catalog));
+}
+
+int catalog_get(const struct catalog *catalog, uint64_t key, const void *header, size_t header_len, struct elf_result *result)
+{
+    const struct catalog_index_slot *slot;
+    const struct catalog_record     *record;
+
+    if(catalog->index == NULL)
+    {
+        return -1;
+    }
+
+    slot = find_slot(catalog, key);
+
+    if(slot == NULL || !record_valid(catalog, slot->offset))
+    {
+        return -1;
+    }
+
+    record = (const struct catalog_record *)(catalog->log_map + slot->offset);
+
+    header_len = content_key_span(header_len);
+
+    if(record->key != key || record->header_len != header_len || memcmp(record->header, header, header_len) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(result, &record->result, sizeof(*result));
+    result->error[sizeof(result->error) - 1] = '\0';
+    return 0;
+}
+
+int catalog_put(struct catalog *catalog, uint64_t key, const void *header, size_t header_len, const struct elf_result *result)
+{
+    struct catalog_record *record;
+
+    if(catalog->index == NULL)
+    {
+        return -1;
+    }
+
+    if(catalog->tail + sizeof(struct catalog_record) > catalog->log_map_len)
+    {
+        size_t len;
+        void  *map;
+
+        len = catalog->log_map_len + CATALOG_GROW_BYTES;
+
+        if(ftruncate(catalog->log_fd, (off_t)len) == -1 || map_file(catalog->log_fd, len, &map) == -1)
+        {
+            return -1;
+        }
+
+        munmap(catalog->log_map, catalog->log_map_len);
+        catalog->log_map     = (uint8_t *)map;
+        catalog->log_map_len = len;
+    }
+
+    // the marker goes in last so a torn append reads as the end of the log
+    record = (struct catalog_record *)(catalog->log_map + catalog->tail);
+    memset(record, 0, sizeof(*record));
+    record->key        = key;
+    record->header_len = (uint32_t)content_key_span(header_len);
+    memcpy(record->header, header, record->header_len);
+    memcpy(&record->result, result, sizeof(*result));
+    record->checksum = checksum(record);
+    record->marker   = CATALOG_RECORD_MARKER;
+
+    if(index_insert(catalog, key, catalog->tail) == -1)
+    {
+        return -1;
+    }
+
+    catalog->tail += sizeof(struct catalog_record);
+    catalog->index->indexed_len = catalog->tail;
+
+    return 0;
+}
+
+int catalog_maintain(struct catalog *catalog)
+{
+    if(catalog->index == NULL)
+    {
+        return 0;
+    }
+
+    if(catalog->old_index != NULL)
+    {
+        migrate(catalog, CATALOG_MIGRATE_IDLE_STEP);
+    }
+
+    if(catalog->compacting)
+    {
+        if(!atomic_load(&catalog->compact_done))
+        {
+            return 0;
+        }
+
+        pthread_join(catalog->compactor, NULL);
+        catalog->compacting = false;
+
+        if(catalog->compact_status == -1)
+        {
+            remove_compaction_files(catalog);
+            return 0;
+        }
+
+        return finish_compaction(catalog);
+    }
+
+    // a compaction copies from one whole index, so it waits for a growth to finish moving
+    if(catalog->old_index == NULL && catalog->index->dead >= CATALOG_COMPACT_MIN_DEAD && catalog->index->dead > catalog->index->count)
+    {
+        start_compaction(catalog);
+    }
+
+    return 0;
+}
+
+// a key seen before is overwritten in place, so the compacted log holds no superseded records
+static int compact_record(struct catalog *compacted, const struct catalog_record *record)
+{
+    const struct catalog_index_slot *slot;
+    struct catalog_record           *existing;
+
+    slot = find_slot(compacted, record->key);
+
+    if(slot == NULL)
+    {
+        return catalog_put(compacted, record->key, record->header, record->header_len, &record->result);
+    }
+
+    existing             = (struct catalog_record *)(compacted->log_map + slot->offset);
+    existing->header_len = record->header_len;
+    memcpy(existing->header, record->header, sizeof(existing->header));
+    memcpy(&existing->result, &record->result, sizeof(record->result));
+    existing->checksum = checksum(existing);
+
+    return 0;
+}
+
+static void *compact_main(void *arg)
+{
+    struct catalog *catalog;
+    struct catalog  compacted;
+    char           *tmp_path;
+    void           *map;
+    int             status;
+
+    catalog = (struct catalog *)arg;
+    status  = -1;
+    remove_compaction_files(catalog);
+    tmp_path = concat_path(catalog->log_path, CATALOG_COMPACT_SUFFIX);
+
+    // the main thread may remap the log as it grows, so this thread maps the part it reads itself
+    map = mmap(NULL, catalog->compact_snapshot, PROT_READ, MAP_SHARED, catalog->log_fd, 0);
+
+    if(map != MAP_FAILED && tmp_path != NULL && catalog_open(&compacted, tmp_path) == 0)
+    {
+        uint64_t offset;
+
+        status = 0;
+
+        // replaying the log in order leaves the latest result for every key
+        for(offset = CATALOG_HEADER_LEN; status == 0 && offset + sizeof(struct catalog_record) <= catalog->compact_snapshot && !atomic_load(&catalog->compact_stop); offset += sizeof(struct catalog_record))
+        {
+            const struct catalog_record *record;
+
+            record = (const struct catalog_record *)((const uint8_t *)map + offset);
+
+            if(record_intact(record))
+            {
+                status = compact_record(&compacted, record);
+            }
+        }
+
+        status = atomic_load(&catalog->compact_stop) ? -1 : status;
+        catalog_close(&compacted);
+    }
+
+    if(map != MAP_FAILED)
+    {
+        munmap(map, catalog->compact_snapshot);
+    }
+
+    free(tmp_path);
+    catalog->compact_status = status;
+    atomic_store(&catalog->compact_done, true);
+
+    return NULL;
+}
+
+/*
+ * A thread rather than a child process: the daemon may be running a
+ * trace flusher, and a fork of a threaded process must not call malloc,
+ * stdio or open before it execs.
+ */
+static void start_compaction(struct catalog *catalog)
+{
+    catalog->compact_snapshot = catalog->tail;
+    catalog->compact_status   = 0;
+    atomic_store(&catalog->compact_stop, false);
+    atomic_store(&catalog->compact_done, false);
+    catalog->compacting = pthread_create(&catalog->compactor, NULL, compact_main, catalog) == 0;
+}
+
+static int finish_compaction(struct catalog *catalog)
+{
+    struct catalog compacted;
+    struct catalog reopened;
+    char          *path;
+    char          *tmp_path;
+    char          *tmp_index_path;
+    int            ok;
+    int            result;
+
+    // a growth begun since the compaction started must be renamed into place now, not over the compacted index later
+    if(catalog->old_index != NULL)
+    {
+        migrate(catalog, catalog->old_index->capacity);
+    }
+
+    memset(&compacted, 0, sizeof(compacted));
+    path           = strdup(catalog->log_path);
+    tmp_path       = concat_path(catalog->log_path, CATALOG_COMPACT_SUFFIX);
+    tmp_index_path = tmp_path == NULL ? NULL : concat_path(tmp_path, CATALOG_INDEX_SUFFIX);
+    ok             = path != NULL && tmp_index_path != NULL && catalog_open(&compacted, tmp_path) == 0;
+
+    // records appended while the compaction thread worked are carried over here
+    for(uint64_t offset = catalog->compact_snapshot; ok && offset < catalog->tail; offset += sizeof(struct catalog_record))
+    {
+        if(record_valid(catalog, offset))
+        {
+            const struct catalog_record *record;
+
+            record = (const struct catalog_record *)(catalog->log_map + offset);
+            ok     = compact_record(&compacted, record) == 0;
+        }
+    }
+
+    if(compacted.index != NULL)
+    {
+        catalog_close(&compacted);
+    }
+
+    result = 0;
+
+    // the log is swapped first; its new id makes a stale index rebuild itself
+    if(ok && rename(tmp_path, catalog->log_path) == 0)
+    {
+        rename(tmp_index_path, catalog->index_path);
+
+        // keep serving from the old, now unlinked, files until the new ones open;
+        // its dead count is unchanged, so the next call compacts again
+        if(catalog_open(&reopened, path) == 0)
+        {
+            catalog_close(catalog);
+            *catalog = reopened;
+        }
+        else
+        {
+            result = -1;
+        }
+    }
+    else
+    {
+        remove_compaction_files(catalog);
+    }
+
+    free(tmp_index_path);
+    free(tmp_path);
+    free(path);
+
+    return result;
+}
+
+static void remove_compaction_files(const struct catalog *catalog)
+{
+    char *tmp_path;
+    char *tmp_index_path;
+
+    if(catalog->log_path == NULL)
+    {
+        return;
+    }
+
+    tmp_path = concat_path(catalog->log_path, CATALOG_COMPACT_SUFFIX);
+
+    if(tmp_path == NULL)
+    {
+        return;
+    }
+
+    tmp_index_path = concat_path(tmp_path, CATALOG_INDEX_SUFFIX);
+    unlink(tmp_path);
+
+    if(tmp_index_path != NULL)
+    {
+        unlink(tmp_index_path);
+    }
+
+    free(tmp_index_path);
+    free(tmp_path);
+}
@@ -0,0 +1,538 @@
+#include "columnar.h"
+#include "content_key.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DIRECT_GROUP_MAX_WIDTH 2         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define GROUP_TABLE_INITIAL 1024         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BITS_PER_BYTE 8                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+struct export_state
+{
+    const struct columnar_table *table;
+    uint64_t                     capacity;
+    uint64_t                     rows;
+};
+
+struct group_table
+{
+    struct columnar_group *slots;
+    size_t                 capacity;
+    size_t                 count;
+};
+
+static const char *const column_names[COLUMN_COUNT] = {"valid", "class", "data", "type", "machine", "flags", "entry"};
+static const size_t      column_widths[COLUMN_COUNT] = {sizeof(uint8_t), sizeof(uint8_t), sizeof(uint8_t), sizeof(uint16_t), sizeof(uint16_t), sizeof(uint32_t), sizeof(uint64_t)};
+
+static uint64_t align_up(uint64_t value);
+static uint64_t layout(struct columnar_header *header, uint64_t rows);
+static void     attach_columns(struct columnar_table *table);
+static void     export_row(uint64_t key, const struct elf_result *result, void *arg);
+static uint64_t column_value(const struct columnar_table *table, enum column column, uint64_t row);
+static void     filter_block(const struct columnar_table *table, const struct columnar_filter *filter, uint64_t start, size_t len, uint8_t *mask);
+static int      group_table_add(struct group_table *groups, const uint64_t *values, uint64_t count);
+static int      compare_groups(const void *a, const void *b);
+
+static uint64_t align_up(uint64_t value)
+{
+    return (value + COLUMNAR_ALIGN - 1) & ~(uint64_t)(COLUMNAR_ALIGN - 1);
+}
+
+static uint64_t layout(struct columnar_header *header, uint64_t rows)
+{
+    uint64_t offset;
+
+    offset = align_up(sizeof(*header));
+
+    for(size_t column = 0; column < COLUMN_COUNT; column++)
+    {
+        header->offsets[column] = offset;
+        offset                  = align_up(offset + (rows * column_widths[column]));
+    }
+
+    return offset;
+}
+
+static void attach_columns(struct columnar_table *table)
+{
+    for(size_t column = 0; column < COLUMN_COUNT; column++)
+    {
+        table->columns[column] = (const uint8_t *)table->header + table->header->offsets[column];
+    }
+}
+
+int columnar_column_by_name(const char *name, enum column *column)
+{
+    for(size_t i = 0; i < COLUMN_COUNT; i++)
+    {
+        if(strcmp(name, column_names[i]) == 0)
+        {
+            *column = (enum column)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+const char *columnar_column_name(enum column column)
+{
+    return column_names[column];
+}
+
+uint64_t columnar_column_max(enum column column)
+{
+    return column_widths[column] == sizeof(uint64_t) ? UINT64_MAX : ((uint64_t)1 << (column_widths[column] * BITS_PER_BYTE)) - 1;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static void export_row(uint64_t key, const struct elf_result *result, void *arg)
+{
+    struct export_state *state;
+    uint64_t             row;
+
+    state = (struct export_state *)arg;
+    row   = state->rows;
+
+    if(row >= state->capacity)
+    {
+        return;
+    }
+
+    // the table was mapped writable by columnar_export, the const is for readers
+    ((uint8_t *)(uintptr_t)state->table->columns[COLUMN_VALID])[row]    = result->valid;
+    ((uint8_t *)(uintptr_t)state->table->columns[COLUMN_CLASS])[row]    = result->class;
+    ((uint8_t *)(uintptr_t)state->table->columns[COLUMN_DATA])[row]     = result->data;
+    ((uint16_t *)(uintptr_t)state->table->columns[COLUMN_TYPE])[row]    = result->type;
+    ((uint16_t *)(uintptr_t)state->table->columns[COLUMN_MACHINE])[row] = result->machine;
+    ((uint32_t *)(uintptr_t)state->table->columns[COLUMN_FLAGS])[row]   = result->flags;
+    ((uint64_t *)(uintptr_t)state->table->columns[COLUMN_ENTRY])[row]   = result->entry;
+    state->rows++;
+}
+
+#pragma GCC diagnostic pop
+
+int64_t columnar_export(const struct catalog *catalog, const char *path)
+{
+    struct columnar_table  table;
+    struct columnar_header header;
+    struct export_state    state;
+    uint64_t               len;
+    void                  *map;
+    int                    fd;
+    int64_t                ret_val;
+
+    if(catalog->index == NULL)
+    {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic   = COLUMNAR_MAGIC;
+    header.version = COLUMNAR_VERSION;
+    len            = layout(&header, catalog->index->count);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    ret_val = -1;
+
+    if(ftruncate(fd, (off_t)len) == -1)
+    {
+        goto close_fd;
+    }
+
+    map = mmap(NULL, (size_t)len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(map == MAP_FAILED)
+    {
+        goto close_fd;
+    }
+
+    memset(&table, 0, sizeof(table));
+    table.header  = (struct columnar_header *)map;
+    table.map_len = (size_t)len;
+    memcpy(table.header, &header, sizeof(header));
+    attach_columns(&table);
+
+    state.table    = &table;
+    state.capacity = catalog->index->count;
+    state.rows     = 0;
+    catalog_scan(catalog, export_row, &state);
+
+    // count can run ahead of the live records while a writer is mid update
+    table.header->rows = state.rows;
+
+    if(msync(map, (size_t)len, MS_SYNC) == 0)
+    {
+        ret_val = (int64_t)state.rows;
+    }
+
+    munmap(map, (size_t)len);
+
+close_fd:
+    close(fd);
+    return ret_val;
+}
+
+int columnar_open(struct columnar_table *table, const char *path)
+{
+    struct columnar_header header;
+    struct stat            file_stats;
+    void                  *map;
+    int                    fd;
+
+    memset(table, 0, sizeof(*table));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    map = MAP_FAILED;
+
+    if(fstat(fd, &file_stats) == 0 && (size_t)file_stats.st_size >= sizeof(struct columnar_header))
+    {
+        map = mmap(NULL, (size_t)file_stats.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    close(fd);
+
+    if(map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    table->header  = (struct columnar_header *)map;
+    table->map_len = (size_t)file_stats.st_size;
+
+    // the offsets must be the ones this build would lay out for the row count
+    memset(&header, 0, sizeof(header));
+
+    if(table->header->magic != COLUMNAR_MAGIC || table->header->version != COLUMNAR_VERSION || table->header->rows > table->map_len || layout(&header, table->header->rows) > table->map_len ||
+       memcmp(header.offsets, table->header->offsets, sizeof(header.offsets)) != 0)
+    {
+        columnar_close(table);
+        return -1;
+    }
+
+    attach_columns(table);
+
+    return 0;
+}
+
+void columnar_close(struct columnar_table *table)
+{
+    if(table->header != NULL)
+    {
+        munmap(table->header, table->map_len);
+    }
+
+    memset(table, 0, sizeof(*table));
+}
+
+static uint64_t column_value(const struct columnar_table *table, enum column column, uint64_t row)
+{
+    switch(column_widths[column])
+    {
+        case sizeof(uint8_t):
+            return ((const uint8_t *)table->columns[column])[row];
+        case sizeof(uint16_t):
+            return ((const uint16_t *)table->columns[column])[row];
+        case sizeof(uint32_t):
+            return ((const uint32_t *)table->columns[column])[row];
+        default:
+            return ((const uint64_t *)table->columns[column])[row];
+    }
+}
+
+/*
+ * One tight loop per column width with no branches in the body, so
+ * the compiler turns each into packed compares over the block.
+ */
+static void filter_block(const struct columnar_table *table, const struct columnar_filter *filter, uint64_t start, size_t len, uint8_t *mask)
+{
+    switch(column_widths[filter->column])
+    {
+        case sizeof(uint8_t):
+        {
+            const uint8_t *values = (const uint8_t *)table->columns[filter->column] + start;
+            const uint8_t  value  = (uint8_t)filter->value;
+
+            for(size_t i = 0; i < len; i++)
+            {
+                mask[i] &= (uint8_t)(values[i] == value);
+            }
+            break;
+        }
+        case sizeof(uint16_t):
+        {
+            const uint16_t *values = (const uint16_t *)table->columns[filter->column] + start;
+            const uint16_t  value  = (uint16_t)filter->value;
+
+            for(size_t i = 0; i < len; i++)
+            {
+                mask[i] &= (uint8_t)(values[i] == value);
+            }
+            break;
+        }
+        case sizeof(uint32_t):
+        {
+            const uint32_t *values = (const uint32_t *)table->columns[filter->column] + start;
+            const uint32_t  value  = (uint32_t)filter->value;
+
+            for(size_t i = 0; i < len; i++)
+            {
+                mask[i] &= (uint8_t)(values[i] == value);
+            }
+            break;
+        }
+        default:
+        {
+            const uint64_t *values = (const uint64_t *)table->columns[filter->column] + start;
+            const uint64_t  value  = filter->value;
+
+            for(size_t i = 0; i < len; i++)
+            {
+                mask[i] &= (uint8_t)(values[i] == value);
+            }
+            break;
+        }
+    }
+}
+
+static int group_table_add(struct group_table *groups, const uint64_t *values, uint64_t count)
+{
+    uint64_t position;
+    size_t   mask;
+
+    // keep the load at or below a half so probes stay short
+    if((groups->count + 1) * 2 > groups->capacity)
+    {
+        struct group_table grown;
+
+        grown.capacity = groups->capacity == 0 ? GROUP_TABLE_INITIAL : groups->capacity * 2;
+        grown.count    = 0;
+        grown.slots    = (struct columnar_group *)calloc(grown.capacity, sizeof(struct columnar_group));
+
+        if(grown.slots == NULL)
+        {
+            return -1;
+        }
+
+        for(size_t i = 0; i < groups->capacity; i++)
+        {
+            if(groups->slots[i].count != 0)
+            {
+                group_table_add(&grown, groups->slots[i].values, groups->slots[i].count);
+            }
+        }
+
+        free(groups->slots);
+        *groups = grown;
+    }
+
+    mask     = groups->capacity - 1;
+    position = mix64(values[0] ^ mix64(values[1]));
+
+    for(size_t probe = 0;; probe++)
+    {
+        struct columnar_group *slot;
+
+        slot = &groups->slots[(position + probe) & mask];
+
+        if(slot->count == 0)
+        {
+            memcpy(slot->values, values, sizeof(slot->values));
+            slot->count = count;
+            groups->count++;
+            return 0;
+        }
+
+        if(slot->values[0] == values[0] && slot->values[1] == values[1])
+        {
+            slot->count += count;
+            return 0;
+        }
+    }
+}
+
+static int compare_groups(const void *a, const void *b)
+{
+    const struct columnar_group *left;
+    const struct columnar_group *right;
+
+    left  = (const struct columnar_group *)a;
+    right = (const struct columnar_group *)b;
+
+    for(size_t i = 0; i < COLUMNAR_MAX_GROUPS; i++)
+    {
+        if(left->values[i] != right->values[i])
+        {
+            return left->values[i] < right->values[i] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+int columnar_run(const struct columnar_table *table, const struct columnar_query *query, struct columnar_result *result)
+{
+    uint8_t           *mask;
+    uint64_t          *direct;
+    size_t             direct_len;
+    struct group_table groups;
+    uint64_t           rows;
+    int                ret_val;
+
+    memset(result, 0, sizeof(*result));
+    memset(&groups, 0, sizeof(groups));
+    rows       = table->header->rows;
+    direct     = NULL;
+    direct_len = 0;
+    ret_val    = -1;
+    mask       = (uint8_t *)malloc(COLUMNAR_BLOCK_ROWS);
+
+    if(mask == NULL)
+    {
+        return -1;
+    }
+
+    // a single narrow group column is counted straight into an array indexed by value
+    if(query->group_count == 1 && column_widths[query->groups[0]] <= DIRECT_GROUP_MAX_WIDTH)
+    {
+        direct_len = (size_t)1 << (column_widths[query->groups[0]] * BITS_PER_BYTE);
+        direct     = (uint64_t *)calloc(direct_len, sizeof(uint64_t));
+
+        if(direct == NULL)
+        {
+            goto done;
+        }
+    }
+
+    for(uint64_t start = 0; start < rows; start += COLUMNAR_BLOCK_ROWS)
+    {
+        size_t len;
+
+        len = rows - start < COLUMNAR_BLOCK_ROWS ? (size_t)(rows - start) : COLUMNAR_BLOCK_ROWS;
+        memset(mask, 1, len);
+
+        for(size_t f = 0; f < query->filter_count; f++)
+        {
+            filter_block(table, &query->filters[f], start, len, mask);
+        }
+
+        if(query->group_count == 0)
+        {
+            uint64_t matched;
+
+            matched = 0;
+
+            for(size_t i = 0; i < len; i++)
+            {
+                matched += mask[i];
+            }
+
+            result->matched += matched;
+            continue;
+        }
+
+        for(size_t i = 0; i < len; i++)
+        {
+            uint64_t values[COLUMNAR_MAX_GROUPS];
+
+            if(mask[i] == 0)
+            {
+                continue;
+            }
+
+            result->matched++;
+
+            if(direct != NULL)
+            {
+                direct[column_value(table, query->groups[0], start + i)]++;
+                continue;
+            }
+
+            for(size_t g = 0; g < COLUMNAR_MAX_GROUPS; g++)
+            {
+                values[g] = g < query->group_count ? column_value(table, query->groups[g], start + i) : 0;
+            }
+
+            if(group_table_add(&groups, values, 1) == -1)
+            {
+                goto done;
+            }
+        }
+    }
+
+    result->scanned = rows;
+
+    if(direct != NULL)
+    {
+        for(size_t value = 0; value < direct_len; value++)
+        {
+            if(direct[value] != 0)
+            {
+                uint64_t values[COLUMNAR_MAX_GROUPS] = {value, 0};
+
+                if(group_table_add(&groups, values, direct[value]) == -1)
+                {
+                    goto done;
+                }
+            }
+        }
+    }
+
+    if(groups.count != 0)
+    {
+        size_t kept;
+
+        // compact the live slots to the front and hand the table over
+        kept = 0;
+
+        for(size_t i = 0; i < groups.capacity; i++)
+        {
+            if(groups.slots[i].count != 0)
+            {
+                groups.slots[kept++] = groups.slots[i];
+            }
+        }
+
+        qsort(groups.slots, kept, sizeof(struct columnar_group), compare_groups);
+        result->groups      = groups.slots;
+        result->group_count = kept;
+        groups.slots        = NULL;
+    }
+
+    ret_val = 0;
+
+done:
+    if(ret_val == -1)
+    {
+        result->matched = 0;
+    }
+
+    free(groups.slots);
+    free(direct);
+    free(mask);
+    return ret_val;
+}
+
+void columnar_result_free(struct columnar_result *result)
+{
+    free(result->groups);
+    memset(result, 0, sizeof(*result));
+}
@@ -0,0 +1,45 @@
+#include "content_key.h"
+#include "util.h"
+#include <string.h>
+
+#define MIX_SHIFT_A 30                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIX_SHIFT_B 27                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIX_SHIFT_C 31                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIX_MULT_A 0xbf58476d1ce4e5b9ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIX_MULT_B 0x94d049bb133111ebULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+uint64_t content_key(const void *buf, size_t len)
+{
+    uint64_t hash;
+    size_t   span;
+
+    span = content_key_span(len);
+    hash = fnv1a64(buf, span, FNV64_OFFSET_BASIS);
+
+    // files shorter than the span must not collide with their zero padded twins
+    hash ^= (uint64_t)span;
+    hash *= FNV64_PRIME;
+
+    return mix64(hash);
+}
+
+size_t content_key_span(size_t len)
+{
+    return len < CONTENT_KEY_SPAN ? len : CONTENT_KEY_SPAN;
+}
+
+uint64_t name_key(const char *name)
+{
+    return mix64(fnv1a64(name, strlen(name), FNV64_OFFSET_BASIS));
+}
+
+uint64_t mix64(uint64_t value)
+{
+    value ^= value >> MIX_SHIFT_A;
+    value *= MIX_MULT_A;
+    value ^= value >> MIX_SHIFT_B;
+    value *= MIX_MULT_B;
+    value ^= value >> MIX_SHIFT_C;
+
+    return value;
+}
@@ -0,0 +1,763 @@
+#include "elf_client.h"
+#include "content_key.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/epoll.h>
+    #include <sys/timerfd.h>
+#endif
+
+#if defined(__linux__)
+
+    #define MS_PER_SEC 1000         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define NS_PER_MS 1000000       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define PID_SHIFT 32            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum elf_client_phase
+{
+    ELF_CLIENT_BACKLOG,
+    ELF_CLIENT_CONNECTING,
+    ELF_CLIENT_SENDING,
+    ELF_CLIENT_RECEIVING,
+};
+
+/*
+ * One request in flight. The daemon takes one request per connection,
+ * so a request walks connect, send and receive down its failover order
+ * and is freed once its callback has run. The request text is the name
+ * line followed by the header, and the name is kept at its front.
+ * Every request is on the client's list until it is freed. The request
+ * text is composed again for every attempt, so the budget it carries
+ * is what is left of the one it started with. Times are on the
+ * monotonic clock in milliseconds: a request in the backlog phase waits
+ * for retry_at, and deadline is 0 for a request without a budget.
+ */
+struct elf_client_request
+{
+    enum elf_client_phase      phase;
+    int                        socket_fd;
+    size_t                     order[MAX_SHARD_ENDPOINTS];
+    size_t                     candidates;
+    size_t                     candidate;
+    char                      *request;
+    uint8_t                    header[ELF_CLIENT_HEADER_LEN];
+    size_t                     header_len;
+    size_t                     name_len;
+    size_t                     request_len;
+    size_t                     request_off;
+    char                       response[ELF_CLIENT_RESPONSE_LEN];
+    size_t                     response_len;
+    uint64_t                   retry_at;
+    uint64_t                   deadline;
+    size_t                     busy_retries;
+    elf_client_callback        callback;
+    void                      *arg;
+    struct elf_client_request *prev;
+    struct elf_client_request *next;
+};
+
+static uint64_t now_ms(void);
+static void     compose(struct elf_client_request *request);
+static int      try_connect(struct elf_client *client, struct elf_client_request *request);
+static void     park(struct elf_client *client, struct elf_client_request *request, uint64_t delay_ms);
+static void     arm_timer(struct elf_client *client, uint64_t at);
+static bool     retry_busy(struct elf_client *client, struct elf_client_request *request);
+static void     run_timer(struct elf_client *client, int *finished);
+static void     advance(struct elf_client *client, struct elf_client_request *request, uint32_t events, int *finished);
+static bool     send_some(struct elf_client_request *request);
+static bool     receive_some(struct elf_client_request *request, const char **error);
+static void     finish(struct elf_client *client, struct elf_client_request *request, const char *error);
+static void     free_request(struct elf_client *client, struct elf_client_request *request);
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * MS_PER_SEC) + ((uint64_t)now.tv_nsec / NS_PER_MS);
+}
+
+static void free_request(struct elf_client *client, struct elf_client_request *request)
+{
+    if(request->prev != NULL)
+    {
+        request->prev->next = request->next;
+    }
+    else
+    {
+        client->requests = request->next;
+    }
+
+    if(request->next != NULL)
+    {
+        request->next->prev = request->prev;
+    }
+
+    if(request->socket_fd > 0)
+    {
+        close(request->socket_fd);
+    }
+
+    free(request->request);
+    free(request);
+}
+
+/*
+ * Closing the socket also takes it out of the epoll set, so the
+ * request can be freed right after its callback.
+ */
+static void finish(struct elf_client *client, struct elf_client_request *request, const char *error)
+{
+    struct elf_client_answer answer;
+    char                     name[ELF_CLIENT_NAME_LEN];
+
+    memcpy(name, request->request, request->name_len);
+    name[request->name_len] = '\0';
+
+    answer.name         = name;
+    answer.response     = error == NULL ? request->response : NULL;
+    answer.response_len = error == NULL ? request->response_len : 0;
+    answer.error        = error;
+
+    if(request->socket_fd > 0)
+    {
+        close(request->socket_fd);
+        request->socket_fd = 0;
+    }
+
+    client->outstanding--;
+
+    if(error == NULL)
+    {
+        client->completed++;
+    }
+    else
+    {
+        client->failed++;
+    }
+
+    request->callback(request->arg, &answer);
+    free_request(client, request);
+}
+
+static void compose(struct elf_client_request *request)
+{
+    size_t len;
+
+    len = request->name_len;
+
+    if(request->deadline != 0)
+    {
+        uint64_t now;
+        int      digits;
+
+        now                     = now_ms();
+        request->request[len++] = BUDGET_SEPARATOR;
+        digits                  = snprintf(request->request + len, BUDGET_MAX_DIGITS + 1, "%" PRIu64, request->deadline > now ? request->deadline - now : 0);
+        len += (size_t)digits;
+    }
+
+    request->request[len++] = '\n';
+    memcpy(request->request + len, request->header, request->header_len);
+    request->request_len = len + request->header_len;
+    request->request_off = 0;
+}
+
+/*
+ * Non-blocking connect down the request's failover order. A full
+ * listen backlog (EAGAIN on a Unix socket) parks the request until the
+ * retry timer fires instead of moving it to another daemon.
+ */
+static int try_connect(struct elf_client *client, struct elf_client_request *request)
+{
+    while(request->candidate < request->candidates)
+    {
+        struct sockaddr_un addr;
+        struct epoll_event event;
+        int                socket_fd;
+
+        memset(&addr, 0, sizeof(addr));
+
+        if(init_sockaddr_un(&addr, client->ring.endpoints[request->order[request->candidate]]) == -1)
+        {
+            request->candidate++;
+            continue;
+        }
+
+        socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if(socket_fd == -1)
+        {
+            return -1;
+        }
+
+        compose(request);
+
+        if(connect(socket_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            request->phase = ELF_CLIENT_SENDING;
+        }
+        else if(errno == EINPROGRESS)
+        {
+            request->phase = ELF_CLIENT_CONNECTING;
+        }
+        else if(errno == EAGAIN)
+        {
+            close(socket_fd);
+            park(client, request, ELF_CLIENT_RETRY_MS);
+            return 0;
+        }
+        else
+        {
+            close(socket_fd);
+            request->candidate++;
+            continue;
+        }
+
+        memset(&event, 0, sizeof(event));
+        event.events   = EPOLLOUT;
+        event.data.ptr = request;
+
+        if(epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, socket_fd, &event) == -1)
+        {
+            close(socket_fd);
+            return -1;
+        }
+
+        request->socket_fd = socket_fd;
+        return 0;
+    }
+
+    errno = ECONNREFUSED;
+    return -1;
+}
+
+static void park(struct elf_client *client, struct elf_client_request *request, uint64_t delay_ms)
+{
+    request->phase    = ELF_CLIENT_BACKLOG;
+    request->retry_at = now_ms() + delay_ms;
+    arm_timer(client, request->retry_at);
+}
+
+/*
+ * The timer is one-shot and absolute. It is only ever moved earlier
+ * here; run_timer arms it again for whatever is left once it fires.
+ */
+static void arm_timer(struct elf_client *client, uint64_t at)
+{
+    struct itimerspec timer;
+
+    if(client->timer_armed && client->timer_at <= at)
+    {
+        return;
+    }
+
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec  = (time_t)(at / MS_PER_SEC);
+    timer.it_value.tv_nsec = (long)((at % MS_PER_SEC) * NS_PER_MS);
+    client->timer_at       = at;
+    client->timer_armed    = timerfd_settime(client->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) == 0;
+}
+
+/*
+ * Starts the request over on the same daemon once the delay it asked
+ * for has passed. Returns false when the request has used up its
+ * retries.
+ */
+static bool retry_busy(struct elf_client *client, struct elf_client_request *request)
+{
+    size_t retry_ms;
+
+    if(parse_busy(request->response, request->response_len, &retry_ms) == -1)
+    {
+        return true;
+    }
+
+    if(request->busy_retries == ELF_CLIENT_BUSY_RETRIES)
+    {
+        return false;
+    }
+
+    retry_ms = busy_delay(retry_ms, request->busy_retries, ELF_CLIENT_MAX_BUSY_MS, &client->jitter);
+    close(request->socket_fd);
+    request->socket_fd    = 0;
+    request->response_len = 0;
+    request->busy_retries++;
+    client->busy++;
+    park(client, request, retry_ms);
+
+    return true;
+}
+
+/*
+ * Walks every request, failing those past their deadline and retrying
+ * those whose wait in the backlog is over. Requests submitted by the
+ * callbacks join the front of the list and arm the timer themselves.
+ */
+static void run_timer(struct elf_client *client, int *finished)
+{
+    struct elf_client_request *request;
+    uint64_t                   expirations;
+    uint64_t                   now;
+    uint64_t                   earliest;
+
+    // the count does not matter, reading only clears the readiness
+    if(read(client->timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+    {
+        return;
+    }
+
+    client->timer_armed = false;
+    now                 = now_ms();
+    earliest            = UINT64_MAX;
+    request             = client->requests;
+
+    while(request != NULL)
+    {
+        struct elf_client_request *next;
+
+        next = request->next;
+
+        if(request->deadline != 0 && request->deadline <= now)
+        {
+            client->expired++;
+            finish(client, request, "Deadline exceeded");
+            (*finished)++;
+            request = next;
+            continue;
+        }
+
+        if(request->phase == ELF_CLIENT_BACKLOG && request->retry_at <= now)
+        {
+            client->retries++;
+
+            if(try_connect(client, request) == -1)
+            {
+                finish(client, request, "Failed to connect to server");
+                (*finished)++;
+                request = next;
+                continue;
+            }
+        }
+
+        if(request->phase == ELF_CLIENT_BACKLOG && request->retry_at < earliest)
+        {
+            earliest = request->retry_at;
+        }
+
+        if(request->deadline != 0 && request->deadline < earliest)
+        {
+            earliest = request->deadline;
+        }
+
+        request = next;
+    }
+
+    if(earliest != UINT64_MAX)
+    {
+        arm_timer(client, earliest);
+    }
+}
+
+static bool send_some(struct elf_client_request *request)
+{
+    while(request->request_off < request->request_len)
+    {
+        ssize_t written;
+
+        written = send(request->socket_fd, request->request + request->request_off, request->request_len - request->request_off, MSG_NOSIGNAL);
+
+        if(written == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return false;
+            }
+
+            // the daemon may have answered and closed already, read whatever it left
+            break;
+        }
+
+        request->request_off += (size_t)written;
+    }
+
+    shutdown(request->socket_fd, SHUT_WR);
+
+    return true;
+}
+
+static bool receive_some(struct elf_client_request *request, const char **error)
+{
+    for(;;)
+    {
+        ssize_t read_len;
+
+        if(request->response_len == ELF_CLIENT_RESPONSE_LEN)
+        {
+            *error = "Response too long!";
+            return true;
+        }
+
+        read_len = read(request->socket_fd, request->response + request->response_len, ELF_CLIENT_RESPONSE_LEN - request->response_len);
+
+        if(read_len > 0)
+        {
+            request->response_len += (size_t)read_len;
+            continue;
+        }
+
+        if(read_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return false;
+        }
+
+        *error = request->response_len == 0 ? "Could not parse response" : NULL;
+        return true;
+    }
+}
+
+static void advance(struct elf_client *client, struct elf_client_request *request, uint32_t events, int *finished)
+{
+    const char *error;
+
+    if(request->phase == ELF_CLIENT_CONNECTING)
+    {
+        int       socket_error;
+        socklen_t len;
+
+        len = sizeof(socket_error);
+
+        if(getsockopt(request->socket_fd, SOL_SOCKET, SO_ERROR, &socket_error, &len) == -1 || socket_error != 0)
+        {
+            close(request->socket_fd);
+            request->socket_fd = 0;
+            request->candidate++;
+
+            if(try_connect(client, request) == -1)
+            {
+                finish(client, request, "Failed to connect to server");
+                (*finished)++;
+            }
+
+            return;
+        }
+
+        request->phase = ELF_CLIENT_SENDING;
+    }
+
+    if(request->phase == ELF_CLIENT_SENDING)
+    {
+        struct epoll_event event;
+
+        if(!send_some(request))
+        {
+            return;
+        }
+
+        memset(&event, 0, sizeof(event));
+        event.events   = EPOLLIN;
+        event.data.ptr = request;
+        request->phase = ELF_CLIENT_RECEIVING;
+
+        if(epoll_ctl(client->epoll_fd, EPOLL_CTL_MOD, request->socket_fd, &event) == -1)
+        {
+            finish(client, request, "Failed to wait for the response");
+            (*finished)++;
+        }
+
+        return;
+    }
+
+    if(request->phase == ELF_CLIENT_RECEIVING && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 && receive_some(request, &error))
+    {
+        if(error == NULL && !retry_busy(client, request))
+        {
+            error = "Server busy";
+        }
+
+        if(request->phase == ELF_CLIENT_RECEIVING)
+        {
+            finish(client, request, error);
+            (*finished)++;
+        }
+    }
+}
+
+int elf_client_open(struct elf_client *client, const char *socket_paths)
+{
+    struct epoll_event event;
+
+    memset(client, 0, sizeof(*client));
+
+    if(shard_ring_create(&client->ring, socket_paths) == -1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    client->jitter   = (now_ms() ^ ((uint64_t)getpid() << PID_SHIFT)) | 1;
+    client->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    client->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if(client->epoll_fd == -1 || client->timer_fd == -1)
+    {
+        client->epoll_fd = client->epoll_fd == -1 ? 0 : client->epoll_fd;
+        client->timer_fd = client->timer_fd == -1 ? 0 : client->timer_fd;
+        elf_client_close(client);
+        return -1;
+    }
+
+    // the timer is the only registration without a request behind it
+    memset(&event, 0, sizeof(event));
+    event.events   = EPOLLIN;
+    event.data.ptr = NULL;
+
+    if(epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, client->timer_fd, &event) == -1)
+    {
+        elf_client_close(client);
+        return -1;
+    }
+
+    return 0;
+}
+
+void elf_client_close(struct elf_client *client)
+{
+    while(client->requests != NULL)
+    {
+        free_request(client, client->requests);
+    }
+
+    if(client->timer_fd > 0)
+    {
+        close(client->timer_fd);
+    }
+
+    if(client->epoll_fd > 0)
+    {
+        close(client->epoll_fd);
+    }
+
+    shard_ring_destroy(&client->ring);
+    memset(client, 0, sizeof(*client));
+}
+
+void elf_client_set_budget(struct elf_client *client, size_t budget_ms)
+{
+    client->budget_ms = budget_ms;
+}
+
+int elf_client_fd(const struct elf_client *client)
+{
+    return client->epoll_fd;
+}
+
+size_t elf_client_outstanding(const struct elf_client *client)
+{
+    return client->outstanding;
+}
+
+int elf_client_submit_header(struct elf_client *client, const char *name, const void *header, size_t header_len, elf_client_callback callback, void *arg)
+{
+    struct elf_client_request *request;
+    size_t                     name_len;
+
+    name_len   = strlen(name);
+    header_len = header_len < ELF_CLIENT_HEADER_LEN ? header_len : ELF_CLIENT_HEADER_LEN;
+
+    if(name_len == 0 || name_len + 1 > ELF_CLIENT_NAME_LEN || memchr(name, '\n', name_len) != NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    request = (struct elf_client_request *)calloc(1, sizeof(*request));
+
+    if(request == NULL)
+    {
+        return -1;
+    }
+
+    // room for the name, the budget with its separator, the newline and the header
+    request->request = (char *)malloc(name_len + 1 + BUDGET_MAX_DIGITS + 1 + 1 + header_len);
+
+    if(request->request == NULL)
+    {
+        free(request);
+        return -1;
+    }
+
+    memcpy(request->request, name, name_len);
+    memcpy(request->header, header, header_len);
+    request->name_len    = name_len;
+    request->header_len  = header_len;
+    request->deadline    = client->budget_ms != 0 ? now_ms() + client->budget_ms : 0;
+    request->callback    = callback;
+    request->arg         = arg;
+    request->candidates  = shard_ring_route(&client->ring, content_key(header, header_len), request->order, MAX_SHARD_ENDPOINTS);
+
+    if(try_connect(client, request) == -1)
+    {
+        int saved_errno;
+
+        saved_errno = errno;
+        free_request(client, request);
+        errno = saved_errno;
+        return -1;
+    }
+
+    request->next = client->requests;
+
+    if(client->requests != NULL)
+    {
+        client->requests->prev = request;
+    }
+
+    client->requests = request;
+    client->outstanding++;
+    client->submitted++;
+
+    if(request->deadline != 0)
+    {
+        arm_timer(client, request->deadline);
+    }
+
+    return 0;
+}
+
+int elf_client_submit(struct elf_client *client, const char *path, elf_client_callback callback, void *arg)
+{
+    uint8_t     header[ELF_CLIENT_HEADER_LEN];
+    struct stat file_stats;
+    ssize_t     header_len;
+    int         fd;
+
+    // O_NONBLOCK so a FIFO is refused below rather than waited on
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    if(fstat(fd, &file_stats) == -1 || !S_ISREG(file_stats.st_mode))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    header_len = pread(fd, header, sizeof(header), 0);
+    close(fd);
+
+    if(header_len == -1)
+    {
+        return -1;
+    }
+
+    return elf_client_submit_header(client, path, header, (size_t)header_len, callback, arg);
+}
+
+int elf_client_process(struct elf_client *client, int timeout_ms)
+{
+    struct epoll_event events[ELF_CLIENT_MAX_EVENTS];
+    int                ready;
+    int                finished;
+    bool               timer_fired;
+
+    ready = epoll_wait(client->epoll_fd, events, ELF_CLIENT_MAX_EVENTS, timeout_ms);
+
+    if(ready == -1)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    finished    = 0;
+    timer_fired = false;
+
+    // a callback may submit more, which only joins the set for the next call
+    for(int i = 0; i < ready; i++)
+    {
+        if(events[i].data.ptr == NULL)
+        {
+            timer_fired = true;
+        }
+        else
+        {
+            advance(client, (struct elf_client_request *)events[i].data.ptr, events[i].events, &finished);
+        }
+    }
+
+    // the timer frees expired requests, so it runs once no event in the batch can still point at one
+    if(timer_fired)
+    {
+        run_timer(client, &finished);
+    }
+
+    return finished;
+}
+
+#else
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wunused-parameter"
+
+int elf_client_open(struct elf_client *client, const char *socket_paths)
+{
+    memset(client, 0, sizeof(*client));
+    errno = ENOSYS;
+    return -1;
+}
+
+void elf_client_close(struct elf_client *client)
+{
+    memset(client, 0, sizeof(*client));
+}
+
+void elf_client_set_budget(struct elf_client *client, size_t budget_ms)
+{
+    client->budget_ms = budget_ms;
+}
+
+int elf_client_fd(const struct elf_client *client)
+{
+    return client->epoll_fd;
+}
+
+size_t elf_client_outstanding(const struct elf_client *client)
+{
+    return client->outstanding;
+}
+
+int elf_client_submit_header(struct elf_client *client, const char *name, const void *header, size_t header_len, elf_client_callback callback, void *arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int elf_client_submit(struct elf_client *client, const char *path, elf_client_callback callback, void *arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int elf_client_process(struct elf_client *client, int timeout_ms)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+    #pragma GCC diagnostic pop
+
+#endif
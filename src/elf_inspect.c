@@ -0,0 +1,252 @@
+#include "elf_inspect.h"
+#include "elf32_header.h"
+#include "elf64_header.h"
+#include "verification_set.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BITS_PER_BYTE 8    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static uint64_t decode(const uint8_t *field, size_t len, uint8_t data);
+static void     fail(struct elf_result *result, const char *reason);
+
+/*
+ * Reads a field in the file's own byte order, so the host's order
+ * never matters. Anything but big endian data is read as little endian.
+ */
+static uint64_t decode(const uint8_t *field, size_t len, uint8_t data)
+{
+    uint64_t value;
+
+    value = 0;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        size_t shift;
+
+        shift = data == ELFDATA2MSB ? len - 1 - i : i;
+        value |= (uint64_t)field[i] << (shift * BITS_PER_BYTE);
+    }
+
+    return value;
+}
+
+static void fail(struct elf_result *result, const char *reason)
+{
+    result->valid = 0;
+    snprintf(result->error, sizeof(result->error), "%s", reason);
+}
+
+int elf_inspect_buffer(const void *buf, size_t len, struct elf_result *result)
+{
+    const uint8_t         *bytes;
+    elf_ident              ident;
+    struct elf_description description;
+
+    bytes = (const uint8_t *)buf;
+    memset(result, 0, sizeof(*result));
+
+    if(len < ELF32_HEADER_LEN)
+    {
+        fail(result, "File data too short to be ELF32");
+        return 0;
+    }
+
+    memcpy(&ident, bytes, sizeof(ident));
+    result->class   = ident.ei_class;
+    result->data    = ident.ei_data;
+    result->version = ident.ei_version;
+
+    if(ident.ei_class == ELFCLASS32)
+    {
+        result->type    = (uint16_t)decode(bytes + offsetof(elf32_header, e_type), sizeof(uint16_t), ident.ei_data);
+        result->machine = (uint16_t)decode(bytes + offsetof(elf32_header, e_machine), sizeof(uint16_t), ident.ei_data);
+        result->entry   = decode(bytes + offsetof(elf32_header, e_entry), sizeof(uint32_t), ident.ei_data);
+        result->flags   = (uint32_t)decode(bytes + offsetof(elf32_header, e_flags), sizeof(uint32_t), ident.ei_data);
+    }
+    else if(ident.ei_class == ELFCLASS64)
+    {
+        if(len < ELF64_HEADER_LEN)
+        {
+            fail(result, "File data too short to be ELF64");
+            return 0;
+        }
+
+        result->type    = (uint16_t)decode(bytes + offsetof(elf64_header, e_type), sizeof(uint16_t), ident.ei_data);
+        result->machine = (uint16_t)decode(bytes + offsetof(elf64_header, e_machine), sizeof(uint16_t), ident.ei_data);
+        result->entry   = decode(bytes + offsetof(elf64_header, e_entry), sizeof(uint64_t), ident.ei_data);
+        result->flags   = (uint32_t)decode(bytes + offsetof(elf64_header, e_flags), sizeof(uint32_t), ident.ei_data);
+    }
+    else
+    {
+        fail(result, "Unknown ELF class");
+        return 0;
+    }
+
+    if(verify_magic(ident.ei_mag, NULL) == -1)
+    {
+        fail(result, "Bad magic number");
+    }
+    else if(elf_inspect_describe(result, &description) == -1)
+    {
+        fail(result, description.error);
+    }
+    else
+    {
+        result->valid = 1;
+    }
+
+    return 0;
+}
+
+int elf_inspect_fd(int fd, struct elf_result *result)
+{
+    uint8_t header[ELF_INSPECT_HEADER_LEN];
+    size_t  total;
+    ssize_t read_len;
+
+    total    = 0;
+    read_len = pread(fd, header, sizeof(header), 0);
+
+    if(read_len >= 0)
+    {
+        total = (size_t)read_len;
+    }
+    else if(errno == ESPIPE)
+    {
+        // pipes and sockets deliver the header in however many pieces they like
+        do
+        {
+            read_len = read(fd, header + total, sizeof(header) - total);
+
+            if(read_len > 0)
+            {
+                total += (size_t)read_len;
+            }
+        } while(total < sizeof(header) && (read_len > 0 || (read_len == -1 && errno == EINTR)));
+
+        if(read_len == -1 && errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        return -1;
+    }
+
+    return elf_inspect_buffer(header, total, result);
+}
+
+int elf_inspect_path(const char *path, struct elf_result *result)
+{
+    struct stat file_stats;
+    int         fd;
+    int         ret_val;
+
+    // non-blocking so a FIFO cannot stall the open
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    if(fstat(fd, &file_stats) == -1)
+    {
+        ret_val = -1;
+    }
+    else if(!S_ISREG(file_stats.st_mode))
+    {
+        errno   = EINVAL;
+        ret_val = -1;
+    }
+    else
+    {
+        ret_val = elf_inspect_fd(fd, result);
+    }
+
+    close(fd);
+
+    return ret_val;
+}
+
+int elf_inspect_describe(const struct elf_result *result, struct elf_description *description)
+{
+    char *class_name   = description->class_name;
+    char *data_name    = description->data_name;
+    char *type_name    = description->type_name;
+    char *machine_name = description->machine_name;
+
+    // the version has no name in the response, it only has to check out
+    const struct verification_set sets[] = {
+        {verify_class,   result->class,   &class_name  },
+        {verify_data,    result->data,    &data_name   },
+        {verify_version, result->version, NULL         },
+        {verify_type,    result->type,    &type_name   },
+        {verify_machine, result->machine, &machine_name},
+    };
+
+    memset(description, 0, sizeof(*description));
+
+    for(size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++)
+    {
+        char *buf;
+
+        buf = sets[i].buf != NULL ? *sets[i].buf : description->error;
+
+        if(sets[i].verifier(sets[i].input, buf) == -1)
+        {
+            if(buf != description->error)
+            {
+                memcpy(description->error, buf, sizeof(description->error));
+            }
+
+            return -1;
+        }
+    }
+
+    description->error[0] = '\0';
+    snprintf(description->entry_point, sizeof(description->entry_point), "%#" PRIx64, result->entry);
+
+    return 0;
+}
+
+int elf_inspect_format(const char *name, const struct elf_result *result, char *buf, size_t len)
+{
+    struct elf_description description;
+    int                    written;
+
+    if(!result->valid)
+    {
+        written = snprintf(buf, len, "File: %s\nValid ELF: no\nError: %s\n", name, result->error);
+    }
+    else if(elf_inspect_describe(result, &description) == -1)
+    {
+        written = snprintf(buf, len, "File: %s\nValid ELF: no\nError: %s\n", name, description.error);
+    }
+    else
+    {
+        written = snprintf(buf,
+                           len,
+                           "File: %s\nValid ELF: yes\nClass: %s\nEndianness: %s\nType: %s\nMachine: %s\nEntry point: %s",
+                           name,
+                           description.class_name,
+                           description.data_name,
+                           description.type_name,
+                           description.machine_name,
+                           description.entry_point);
+    }
+
+    if(written < 0 || (size_t)written >= len)
+    {
+        return -1;
+    }
+
+    return written;
+}
@@ -1,9 +1,22 @@
 #include "arguments.h"
+#include "batch.h"
+#include "content_key.h"
 #include "context.h"
+#include "elf_inspect.h"
 #include "errors.h"
+#include "header_reader.h"
+#include "histogram.h"
+#include "probes.h"
+#include "scanner.h"
+#include "shard_ring.h"
+#include "stat_cache.h"
 #include "util.h"
+#include "watcher.h"
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <p101_c/p101_stdlib.h>
 #include <p101_c/p101_string.h>
 #include <p101_fsm/fsm.h>
@@ -13,9 +26,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/un.h>
+#include <time.h>
 
 enum states
 {
@@ -25,22 +41,58 @@ enum states
     CONNECT,
     SEND_FILE,
     RECEIVE_DETAILS,
+    BATCH,
+    LOCAL,
     CLEANUP,
 };
 
-static volatile sig_atomic_t socket_close = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static volatile sig_atomic_t socket_close = 0;           // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static volatile sig_atomic_t watch_stop   = 0;           // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int                   stop_pipe[2] = {-1, -1};    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+#ifdef FSM_TIMING
+static const char *const state_names[] = {
+    [PARSE_ARGS]      = "parse_args",
+    [HANDLE_ARGS]     = "handle_args",
+    [USAGE]           = "usage",
+    [CONNECT]         = "connect",
+    [SEND_FILE]       = "send_file",
+    [RECEIVE_DETAILS] = "receive_details",
+    [BATCH]           = "batch",
+    [LOCAL]           = "local",
+    [CLEANUP]         = "cleanup",
+};
+#endif
 
 static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t connect_to_server(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t send_file(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t receive_details(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t run_batch(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t run_local(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t cleanup(const struct p101_env *env, struct p101_error *err, void *ctx);
-
-#define ERR_MSG_LEN 256         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define MAX_RECEIVE_LEN 1028    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define EXPECTED_ARGS 2         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+static enum batch_next  next_path(void *arg, bool wait, char **path);
+static char            *read_stdin_path(const struct context *context);
+static int              start_source(struct context *context, struct p101_error *err);
+static void             stop_source(struct context *context);
+static int              open_stop_pipe(void);
+static void             close_stop_pipe(void);
+static void             raise_fd_limit(size_t wanted);
+static uint64_t         now_ms(void);
+static size_t           remaining_ms(const struct context *context);
+static int              inspect_local(const char *path, bool elf_only, struct elf_result *result);
+
+#define ERR_MSG_LEN 256             // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAX_RECEIVE_LEN 1028        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define OUTPUT_BUFFER_LEN 65536     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MS_PER_SEC 1000.0           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_MS 1000000.0         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FD_HEADROOM 64              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PID_SHIFT 32                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ELF_MAGIC_LEN 4             // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define STDIN_PATH "-"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -50,6 +102,23 @@ static void handle_signal(int sig)
     socket_close = 1;
 }
 
+/*
+ * The flag alone is missed by a watcher that checked it just before it
+ * blocked, so the handler also makes the stop pipe readable, which the
+ * watcher polls alongside its events.
+ */
+static void handle_stop(int sig)
+{
+    ssize_t written;
+    int     saved_errno;
+
+    saved_errno = errno;
+    watch_stop  = 1;
+    written     = write(stop_pipe[1], "", 1);
+    (void)written;
+    errno = saved_errno;
+}
+
 #pragma GCC diagnostic pop
 
 int main(int argc, char *argv[])
@@ -60,10 +129,15 @@ int main(int argc, char *argv[])
         {PARSE_ARGS,      HANDLE_ARGS,     handle_arguments },
         {HANDLE_ARGS,     USAGE,           usage            },
         {HANDLE_ARGS,     CONNECT,         connect_to_server},
+        {HANDLE_ARGS,     BATCH,           run_batch        },
+        {HANDLE_ARGS,     LOCAL,           run_local        },
         {CONNECT,         SEND_FILE,       send_file        },
         {CONNECT,         CLEANUP,         cleanup          },
         {SEND_FILE,       RECEIVE_DETAILS, receive_details  },
+        {RECEIVE_DETAILS, CONNECT,         connect_to_server},
         {RECEIVE_DETAILS, CLEANUP,         cleanup          },
+        {BATCH,           CLEANUP,         cleanup          },
+        {LOCAL,           CLEANUP,         cleanup          },
         {USAGE,           CLEANUP,         cleanup          },
         {CLEANUP,         P101_FSM_EXIT,   NULL             }
     };
@@ -77,10 +151,23 @@ int main(int argc, char *argv[])
     struct p101_env      *fsm_env;
     struct arguments      args;
     struct context        ctx;
-
-    if(signal(SIGPIPE, handle_signal) == SIG_ERR)
+    struct sigaction      action;
+
+    // sigaction rather than signal, which may reset the handler after the first broken pipe and let a retry die of the second
+    memset(&action, 0, sizeof(struct sigaction));
+#ifdef __clang__
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif
+    action.sa_handler = handle_signal;
+#ifdef __clang__
+    #pragma clang diagnostic pop
+#endif
+    sigemptyset(&action.sa_mask);
+
+    if(sigaction(SIGPIPE, &action, NULL) == -1)
     {
-        perror("signal");
+        perror("sigaction");
         exit(EXIT_FAILURE);
     }
 
@@ -153,7 +240,9 @@ static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_
     next_state                       = HANDLE_ARGS;
     opterr                           = 0;
 
-    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "h")) != -1 && p101_error_has_no_error(err))
+    FSM_TIMING_ENTER(&context->fsm_timing, PARSE_ARGS);
+
+    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "hj:0lr:t:Uw:d:C:FT:X:x:")) != -1 && p101_error_has_no_error(err))
     {
         switch(opt)
         {
@@ -162,11 +251,106 @@ static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_
                 next_state = USAGE;
                 break;
             }
+            case 'j':
+            {
+                if(parse_size(optarg, &context->arguments->jobs) == -1 || context->arguments->jobs == 0 || context->arguments->jobs > BATCH_MAX_JOBS)
+                {
+                    P101_ERROR_RAISE_USER(err, "Jobs must be a number from 1 to 1024", ERR_USAGE);
+                }
+                context->arguments->batch = true;
+                break;
+            }
+            case '0':
+            {
+                context->arguments->null_separated = true;
+                break;
+            }
+            case 'l':
+            {
+                context->arguments->local = true;
+                break;
+            }
+            case 'C':
+            {
+                context->arguments->cache_path = optarg;
+                context->arguments->batch      = true;
+                break;
+            }
+            case 'F':
+            {
+                context->arguments->revalidate = true;
+                break;
+            }
+            case 'U':
+            {
+                context->arguments->plain_reads = true;
+                break;
+            }
+            case 'r':
+            {
+                context->arguments->scan_root = optarg;
+                context->arguments->batch     = true;
+                break;
+            }
+            case 'w':
+            {
+                if(context->arguments->watch_root_count == WATCHER_MAX_ROOTS)
+                {
+                    P101_ERROR_RAISE_USER(err, "At most 64 directories can be watched", ERR_USAGE);
+                }
+                else
+                {
+                    context->arguments->watch_roots[context->arguments->watch_root_count++] = optarg;
+                }
+                context->arguments->batch = true;
+                break;
+            }
+            case 'd':
+            {
+                if(parse_size(optarg, &context->arguments->debounce_ms) == -1 || context->arguments->debounce_ms == 0 || context->arguments->debounce_ms > INT_MAX)
+                {
+                    P101_ERROR_RAISE_USER(err, "Debounce must be a number of milliseconds from 1", ERR_USAGE);
+                }
+                break;
+            }
+            case 'T':
+            {
+                if(parse_size(optarg, &context->arguments->budget_ms) == -1 || context->arguments->budget_ms == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "The time budget must be a number of milliseconds from 1", ERR_USAGE);
+                }
+                break;
+            }
+            case 'X':
+            {
+                context->arguments->trace_path = optarg;
+                break;
+            }
+            case 'x':
+            {
+                if(parse_size(optarg, &context->arguments->trace_sample) == -1 || context->arguments->trace_sample == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "The trace sample must be a positive number", ERR_USAGE);
+                }
+                break;
+            }
+            case 't':
+            {
+                if(parse_size(optarg, &context->arguments->scan_threads) == -1 || context->arguments->scan_threads == 0 || context->arguments->scan_threads > SCANNER_MAX_THREADS)
+                {
+                    P101_ERROR_RAISE_USER(err, "Threads must be a number from 1 to 64", ERR_USAGE);
+                }
+                break;
+            }
             case '?':
             {
                 char msg[ERR_MSG_LEN];
 
-                if(isprint(optopt))
+                if(optopt == 'j' || optopt == 'r' || optopt == 't' || optopt == 'w' || optopt == 'd' || optopt == 'C' || optopt == 'T' || optopt == 'X' || optopt == 'x')
+                {
+                    snprintf(msg, sizeof msg, "Option '-%c' requires an argument.", optopt);
+                }
+                else if(isprint(optopt))
                 {
                     snprintf(msg, sizeof msg, "Unknown option '-%c'.", optopt);
                 }
@@ -188,14 +372,82 @@ static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_
 
     if(p101_error_has_no_error(err) && next_state != USAGE)
     {
-        if(context->arguments->argc - optind != EXPECTED_ARGS)
+        int socket_args;
+
+        // in process inspection needs no daemon, so there is no socket path argument
+        socket_args = context->arguments->local ? 0 : 1;
+
+        if(context->arguments->scan_root != NULL && context->arguments->watch_root_count != 0)
+        {
+            P101_ERROR_RAISE_USER(err, "Choose either a directory scan or watching", ERR_USAGE);
+        }
+        else if(context->arguments->revalidate && context->arguments->cache_path == NULL)
+        {
+            P101_ERROR_RAISE_USER(err, "Revalidating needs a cache file", ERR_USAGE);
+        }
+        else if(context->arguments->local && context->arguments->cache_path != NULL)
+        {
+            P101_ERROR_RAISE_USER(err, "The cache holds daemon answers and is not used in process", ERR_USAGE);
+        }
+        else if(context->arguments->local && context->arguments->budget_ms != 0)
+        {
+            P101_ERROR_RAISE_USER(err, "The time budget bounds daemon requests and is not used in process", ERR_USAGE);
+        }
+        else if(context->arguments->local && context->arguments->trace_path != NULL)
+        {
+            P101_ERROR_RAISE_USER(err, "Tracing follows daemon requests and is not used in process", ERR_USAGE);
+        }
+        else if(context->arguments->scan_root != NULL || context->arguments->watch_root_count != 0)
+        {
+            if(context->arguments->argc - optind != socket_args)
+            {
+                P101_ERROR_RAISE_USER(err, "A directory scan or watch takes no file paths", ERR_USAGE);
+            }
+            else if(!context->arguments->local)
+            {
+                context->arguments->socket_path = context->arguments->argv[optind];
+            }
+        }
+        else if(context->arguments->argc - optind < socket_args + 1)
         {
             P101_ERROR_RAISE_USER(err, "Incorrect number of arguments", ERR_USAGE);
         }
         else
         {
-            context->arguments->socket_path = context->arguments->argv[optind];
-            context->arguments->elf_path    = context->arguments->argv[optind + 1];
+            context->arguments->socket_path    = context->arguments->local ? NULL : context->arguments->argv[optind];
+            context->arguments->elf_path       = context->arguments->argv[optind + socket_args];
+            context->arguments->elf_paths      = &context->arguments->argv[optind + socket_args];
+            context->arguments->elf_path_count = (size_t)(context->arguments->argc - optind - socket_args);
+
+            // more than one file, or a list on stdin, goes through the batch engine
+            if(context->arguments->elf_path_count > 1 || strcmp(context->arguments->elf_path, STDIN_PATH) == 0)
+            {
+                context->arguments->batch = true;
+            }
+
+        }
+
+        if(context->arguments->jobs == 0)
+        {
+            context->arguments->jobs = BATCH_DEFAULT_JOBS;
+        }
+
+        if(context->arguments->debounce_ms == 0)
+        {
+            context->arguments->debounce_ms = WATCHER_DEFAULT_DEBOUNCE_MS;
+        }
+
+        if(context->arguments->trace_sample == 0)
+        {
+            context->arguments->trace_sample = TRACE_DEFAULT_SAMPLE;
+        }
+
+        if(context->arguments->scan_threads == 0)
+        {
+            long online;
+
+            online                           = sysconf(_SC_NPROCESSORS_ONLN);
+            context->arguments->scan_threads = online < 1 ? 1 : (online > SCANNER_MAX_THREADS ? SCANNER_MAX_THREADS : (size_t)online);
         }
     }
 
@@ -211,48 +463,82 @@ static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101
 {
     struct context  *context;
     p101_fsm_state_t next_state;
-    int              socket_fd;
+    int              elf_fd;
 
     P101_TRACE(env);
     context    = (struct context *)ctx;
     next_state = CONNECT;
 
-    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    FSM_TIMING_ENTER(&context->fsm_timing, HANDLE_ARGS);
+
+    if(context->arguments->local)
+    {
+        return LOCAL;
+    }
 
-    if(socket_fd == -1)
+    if(context->arguments->trace_path != NULL && trace_open(&context->trace, context->arguments->trace_path, "elfinspect", context->arguments->trace_sample) == -1)
     {
-        P101_ERROR_RAISE_USER(err, "Failed to create socket", ERR_USAGE);
+        P101_ERROR_RAISE_USER(err, "Failed to create the trace file", ERR_USAGE);
+        return USAGE;
+    }
+
+    if(context->arguments->batch)
+    {
+        if(shard_ring_create(&context->ring, context->arguments->socket_path) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Invalid socket path list", ERR_USAGE);
+            return USAGE;
+        }
+
+        return BATCH;
+    }
+
+    elf_fd = open(context->arguments->elf_path, O_RDONLY | O_CLOEXEC);
+
+    if(elf_fd == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to open ELF file", ERR_USAGE);
     }
     else
     {
-        int elf_fd;
-        elf_fd = open(context->arguments->elf_path, O_RDONLY | O_CLOEXEC);
+        struct stat file_stats;
+        int         stat_status;
 
-        if(elf_fd == -1)
+        context->elf_fd = elf_fd;
+        stat_status     = fstat(elf_fd, &file_stats);
+
+        if(stat_status == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to get fstat() of ELF file", ERR_USAGE);
+        }
+        else if(!S_ISREG(file_stats.st_mode))
         {
-            P101_ERROR_RAISE_USER(err, "Failed to open ELF file", ERR_USAGE);
+            P101_ERROR_RAISE_USER(err, "ELF file is not a regular file", ERR_USAGE);
         }
         else
         {
-            struct stat file_stats;
-            int         stat_status;
+            uint8_t header[CONTENT_KEY_SPAN];
+            ssize_t header_len;
 
-            stat_status = fstat(elf_fd, &file_stats);
+            header_len = pread(elf_fd, header, sizeof(header), 0);
 
-            if(stat_status == -1)
+            if(header_len == -1)
             {
-                P101_ERROR_RAISE_USER(err, "Failed to get fstat() of ELF file", ERR_USAGE);
+                P101_ERROR_RAISE_USER(err, "Failed to read ELF file", ERR_USAGE);
             }
-            else if(!S_ISREG(file_stats.st_mode))
+            else
             {
-                P101_ERROR_RAISE_USER(err, "ELF file is not a regular file", ERR_USAGE);
+                context->content_key = content_key(header, (size_t)header_len);
+                context->traced      = trace_sample(&context->trace, context->arguments->elf_path, &context->trace_id);
             }
-
-            context->elf_fd    = elf_fd;
-            context->socket_fd = socket_fd;
         }
     }
 
+    if(p101_error_has_no_error(err) && shard_ring_create(&context->ring, context->arguments->socket_path) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Invalid socket path list", ERR_USAGE);
+    }
+
     if(p101_error_has_error(err))
     {
         next_state = USAGE;
@@ -263,21 +549,78 @@ static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101
 
 static p101_fsm_state_t connect_to_server(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
-    const struct context *context;
-    p101_fsm_state_t      next_state;
-    struct sockaddr_un    addr;
+    struct context  *context;
+    p101_fsm_state_t next_state;
+    size_t           order[MAX_SHARD_ENDPOINTS];
+    size_t           candidates;
 
     P101_TRACE(env);
     context    = (struct context *)ctx;
     next_state = SEND_FILE;
+    candidates = shard_ring_route(&context->ring, context->content_key, order, MAX_SHARD_ENDPOINTS);
+
+    FSM_TIMING_ENTER(&context->fsm_timing, CONNECT);
+
+    if(context->traced)
+    {
+        context->connect_ns = histogram_now_ns();
+        context->request_ns = context->request_ns == 0 ? context->connect_ns : context->request_ns;
+    }
+
+    // the budget runs from the first attempt, so busy retries spend it too
+    if(context->arguments->budget_ms != 0 && context->deadline_ms == 0)
+    {
+        context->deadline_ms = now_ms() + context->arguments->budget_ms;
+    }
 
-    p101_memset(env, &addr, 0, sizeof(addr));
+    if(context->deadline_ms != 0 && remaining_ms(context) == 0)
+    {
+        P101_ERROR_RAISE_USER(err, "Deadline exceeded", ERR_SOCKET);
+        return CLEANUP;
+    }
 
-    if(init_sockaddr_un(&addr, context->arguments->socket_path) == -1)
+    // walk the ring from the owning daemon, failing over to the next one on each refusal
+    for(size_t i = 0; i < candidates && context->socket_fd == 0; i++)
     {
-        P101_ERROR_RAISE_USER(err, "Socket path too long", ERR_SOCKET);
+        struct sockaddr_un addr;
+        int                socket_fd;
+
+        p101_memset(env, &addr, 0, sizeof(addr));
+
+        if(init_sockaddr_un(&addr, context->ring.endpoints[order[i]]) == -1)
+        {
+            continue;
+        }
+
+        socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if(socket_fd == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to create socket", ERR_SOCKET);
+            break;
+        }
+
+        if(connect(socket_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            close(socket_fd);
+            continue;
+        }
+
+        // a blocked send or read gives up with the budget
+        if(context->deadline_ms != 0)
+        {
+            struct timeval timeout;
+
+            timeout.tv_sec  = (time_t)(remaining_ms(context) / (size_t)MS_PER_SEC);
+            timeout.tv_usec = (suseconds_t)((remaining_ms(context) % (size_t)MS_PER_SEC) * (size_t)MS_PER_SEC);
+            setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+
+        context->socket_fd = socket_fd;
     }
-    else if(connect(context->socket_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+
+    if(p101_error_has_no_error(err) && context->socket_fd == 0)
     {
         P101_ERROR_RAISE_USER(err, "Failed to connect to server", ERR_SOCKET);
     }
@@ -296,19 +639,44 @@ static p101_fsm_state_t connect_to_server(const struct p101_env *env, struct p10
 static p101_fsm_state_t send_file(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
     struct context *context;
+    uint64_t        started;
 
     P101_TRACE(env);
     context = (struct context *)ctx;
+    started = 0;
 
-    safe_write_line(context->socket_fd, context->arguments->elf_path, strlen(context->arguments->elf_path));
-    copy(context->elf_fd, context->socket_fd);
+    FSM_TIMING_ENTER(&context->fsm_timing, SEND_FILE);
 
-    if(socket_close)
+    if(context->traced)
     {
-        puts("Notice: Server closed socket mid write");
+        started = histogram_now_ns();
+        trace_span(&context->trace, context->trace_id, "connect", context->connect_ns, started, NULL);
+    }
+
+    if(context->deadline_ms != 0)
+    {
+        char budget[BUDGET_MAX_DIGITS + 2];
+        int  budget_len;
+
+        // the name line ends in what is left of the budget, after a NUL no path can contain
+        budget[0]  = BUDGET_SEPARATOR;
+        budget_len = snprintf(budget + 1, sizeof(budget) - 1, "%zu", remaining_ms(context));
+        safe_write(context->socket_fd, context->arguments->elf_path, strlen(context->arguments->elf_path));
+        safe_write_line(context->socket_fd, budget, 1 + (size_t)budget_len);
+    }
+    else
+    {
+        safe_write_line(context->socket_fd, context->arguments->elf_path, strlen(context->arguments->elf_path));
     }
 
+    copy(context->elf_fd, context->socket_fd);
     shutdown(context->socket_fd, SHUT_WR);
+    PROBE1(elfinspect, request_sent, context->arguments->elf_path);
+
+    if(context->traced)
+    {
+        trace_span(&context->trace, context->trace_id, "send", started, histogram_now_ns(), NULL);
+    }
 
     return RECEIVE_DETAILS;
 }
@@ -320,20 +688,81 @@ static p101_fsm_state_t send_file(const struct p101_env *env, struct p101_error
 
 static p101_fsm_state_t receive_details(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
-    const struct context *context;
-    char                  msg[MAX_RECEIVE_LEN + 1];
-    ssize_t               read;
+    struct context *context;
+    char            msg[MAX_RECEIVE_LEN + 1];
+    ssize_t         read;
+    size_t          retry_ms;
+    uint64_t        started;
 
     P101_TRACE(env);
     context = (struct context *)ctx;
+    started = context->traced ? histogram_now_ns() : 0;
+
+    FSM_TIMING_ENTER(&context->fsm_timing, RECEIVE_DETAILS);
+
     p101_memset(env, msg, 0, sizeof(msg));
 
     read = safe_read(context->socket_fd, msg, sizeof(msg), false);
+
+    if(context->traced)
+    {
+        trace_span(&context->trace, context->trace_id, "receive", started, histogram_now_ns(), NULL);
+    }
+
+    // a busy daemon is asked again after the delay it named, up to the same limit the batch client uses
+    if(read > 0 && parse_busy(msg, (size_t)read, &retry_ms) == 0 && context->busy_retries < ELF_CLIENT_BUSY_RETRIES && lseek(context->elf_fd, 0, SEEK_SET) == 0)
+    {
+        struct timespec delay;
+
+        // seeded on first use, so processes started together still spread apart
+        if(context->jitter == 0)
+        {
+            context->jitter = ((uint64_t)getpid() << PID_SHIFT) | (uint64_t)time(NULL) | 1;
+        }
+
+        retry_ms = busy_delay(retry_ms, context->busy_retries, ELF_CLIENT_MAX_BUSY_MS, &context->jitter);
+
+        // sleeping past the deadline would only delay the failure
+        if(context->deadline_ms != 0 && retry_ms > remaining_ms(context))
+        {
+            retry_ms = remaining_ms(context);
+        }
+
+        delay.tv_sec  = (time_t)(retry_ms / (size_t)MS_PER_SEC);
+        delay.tv_nsec = (long)((double)(retry_ms % (size_t)MS_PER_SEC) * NS_PER_MS);
+        context->busy_retries++;
+        close(context->socket_fd);
+        context->socket_fd = 0;
+        nanosleep(&delay, NULL);
+
+        // a busy daemon closes without reading, which is not the broken pipe the notice is about
+        socket_close = 0;
+
+        return CONNECT;
+    }
+
+    if(context->traced)
+    {
+        trace_span(&context->trace, context->trace_id, "request", context->request_ns, histogram_now_ns(), context->arguments->elf_path);
+    }
+
+    PROBE3(elfinspect, answer_received, context->arguments->elf_path, read > 0 ? (size_t)read : 0, read == -1 ? "Could not parse response" : NULL);
+
+    // reported only now, since being turned away busy is not worth a notice
+    if(socket_close)
+    {
+        puts("Notice: Server closed socket mid write");
+    }
+
     if(read == sizeof(msg))
     {
         puts("Response too long!");
     }
-    if(read == -1)
+    if(read == -1 && context->deadline_ms != 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        puts("Deadline exceeded");
+    }
+    else if(read == -1)
     {
         puts("Could not parse response");
     }
@@ -348,6 +777,455 @@ static p101_fsm_state_t receive_details(const struct p101_env *env, struct p101_
 
 #pragma GCC diagnostic pop
 
+static char *read_stdin_path(const struct context *context)
+{
+    char   *line;
+    size_t  line_cap;
+    ssize_t line_len;
+    int     delimiter;
+
+    delimiter = context->arguments->null_separated ? '\0' : '\n';
+
+    // blank entries are skipped rather than reported as missing files
+    for(;;)
+    {
+        line     = NULL;
+        line_cap = 0;
+        line_len = getdelim(&line, &line_cap, delimiter, stdin);
+
+        if(line_len == -1)
+        {
+            free(line);
+            return NULL;
+        }
+
+        if(line_len > 0 && line[line_len - 1] == delimiter)
+        {
+            line[--line_len] = '\0';
+        }
+
+        if(line_len > 0)
+        {
+            return line;
+        }
+
+        free(line);
+    }
+}
+
+static enum batch_next next_path(void *arg, bool wait, char **path)
+{
+    struct context *context;
+
+    context = (struct context *)arg;
+
+    // watching only ends on SIGINT or SIGTERM, which also breaks a blocking wait
+    if(context->arguments->watch_root_count != 0)
+    {
+        if(watch_stop)
+        {
+            return BATCH_NEXT_DONE;
+        }
+
+        return watcher_next(&context->watcher, wait, path) == WATCHER_PATH ? BATCH_NEXT_PATH : BATCH_NEXT_PENDING;
+    }
+
+    if(context->arguments->scan_root != NULL)
+    {
+        switch(scanner_next(&context->scanner, wait, path))
+        {
+            case SCANNER_PATH:
+                return BATCH_NEXT_PATH;
+            case SCANNER_PENDING:
+                return BATCH_NEXT_PENDING;
+            default:
+                return BATCH_NEXT_DONE;
+        }
+    }
+
+    while(context->next_path < context->arguments->elf_path_count)
+    {
+        const char *elf_path;
+
+        elf_path = context->arguments->elf_paths[context->next_path];
+
+        if(strcmp(elf_path, STDIN_PATH) != 0)
+        {
+            context->next_path++;
+            *path = strdup(elf_path);
+            return *path == NULL ? BATCH_NEXT_DONE : BATCH_NEXT_PATH;
+        }
+
+        *path = read_stdin_path(context);
+
+        if(*path != NULL)
+        {
+            return BATCH_NEXT_PATH;
+        }
+
+        context->next_path++;
+    }
+
+    return BATCH_NEXT_DONE;
+}
+
+static int start_source(struct context *context, struct p101_error *err)
+{
+    if(context->arguments->scan_root != NULL && scanner_start(&context->scanner, context->arguments->scan_root, context->arguments->scan_threads) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to start the directory scan", ERR_USAGE);
+        return -1;
+    }
+
+    if(context->arguments->watch_root_count != 0)
+    {
+        struct sigaction action;
+
+        if(open_stop_pipe() == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to create the stop pipe", ERR_USAGE);
+            return -1;
+        }
+
+        // sa_flags stays 0: no SA_RESTART, so the signal interrupts the wait for events, and the handler is not reset after one use
+        memset(&action, 0, sizeof(struct sigaction));
+#ifdef __clang__
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif
+        action.sa_handler = handle_stop;
+#ifdef __clang__
+    #pragma clang diagnostic pop
+#endif
+        sigemptyset(&action.sa_mask);
+
+        if(sigaction(SIGINT, &action, NULL) == -1 || sigaction(SIGTERM, &action, NULL) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to install the stop handler", ERR_USAGE);
+            return -1;
+        }
+
+        if(watcher_start(&context->watcher, context->arguments->watch_roots, context->arguments->watch_root_count, context->arguments->debounce_ms, stop_pipe[0]) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to watch the directories", ERR_USAGE);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void stop_source(struct context *context)
+{
+    if(context->arguments->scan_root != NULL)
+    {
+        fprintf(stderr,
+                "Scanned %" PRIu64 " directories and %" PRIu64 " files, %" PRIu64 " ELF candidates\n",
+                (uint64_t)atomic_load(&context->scanner.directories),
+                (uint64_t)atomic_load(&context->scanner.files),
+                context->batch_stats.submitted);
+        scanner_stop(&context->scanner);
+    }
+
+    if(context->arguments->watch_root_count != 0)
+    {
+        fprintf(stderr,
+                "Watched %zu directories, %" PRIu64 " events, %" PRIu64 " changed files, %" PRIu64 " of them ELF files, %" PRIu64 " overflows\n",
+                context->watcher.dir_count,
+                context->watcher.events_seen,
+                context->watcher.submitted,
+                context->batch_stats.submitted,
+                context->watcher.overflows);
+        watcher_stop(&context->watcher);
+        close_stop_pipe();
+    }
+}
+
+static int open_stop_pipe(void)
+{
+    if(pipe(stop_pipe) == -1)
+    {
+        return -1;
+    }
+
+    // the handler must never block on a full pipe, one unread byte is enough to wake the watcher
+    for(size_t i = 0; i < 2; i++)
+    {
+        int flags;
+
+        flags = fcntl(stop_pipe[i], F_GETFL);
+
+        if(flags == -1 || fcntl(stop_pipe[i], F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(stop_pipe[i], F_SETFD, FD_CLOEXEC) == -1)
+        {
+            close_stop_pipe();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void close_stop_pipe(void)
+{
+    for(size_t i = 0; i < 2; i++)
+    {
+        if(stop_pipe[i] != -1)
+        {
+            close(stop_pipe[i]);
+            stop_pipe[i] = -1;
+        }
+    }
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * (uint64_t)MS_PER_SEC) + ((uint64_t)now.tv_nsec / (uint64_t)NS_PER_MS);
+}
+
+static size_t remaining_ms(const struct context *context)
+{
+    uint64_t now;
+
+    now = now_ms();
+
+    return context->deadline_ms > now ? (size_t)(context->deadline_ms - now) : 0;
+}
+
+static void raise_fd_limit(size_t wanted)
+{
+    struct rlimit limit;
+
+    if(getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur >= wanted)
+    {
+        return;
+    }
+
+    limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max >= wanted ? (rlim_t)wanted : limit.rlim_max;
+
+    if(setrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur < wanted)
+    {
+        fprintf(stderr, "Only %lu descriptors available, requests beyond that will fail\n", (unsigned long)limit.rlim_cur);
+    }
+}
+
+static p101_fsm_state_t run_batch(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct context      *context;
+    struct batch_options options;
+    struct timespec      start;
+    struct timespec      end;
+    double               elapsed;
+
+    P101_TRACE(env);
+    context = (struct context *)ctx;
+
+    FSM_TIMING_ENTER(&context->fsm_timing, BATCH);
+
+    // one fully buffered stream for every response, flushed by the engine at the end; a watch streams them
+    setvbuf(stdout, NULL, context->arguments->watch_root_count != 0 ? _IOLBF : _IOFBF, OUTPUT_BUFFER_LEN);
+
+    options.socket_paths = context->arguments->socket_path;
+    options.jobs         = context->arguments->jobs;
+    options.depth        = context->arguments->jobs > HEADER_READER_DEFAULT_DEPTH ? context->arguments->jobs : HEADER_READER_DEFAULT_DEPTH;
+    options.depth        = options.depth < HEADER_READER_MAX_DEPTH ? options.depth : HEADER_READER_MAX_DEPTH;
+    options.use_uring    = !context->arguments->plain_reads;
+    options.cache        = NULL;
+    options.revalidate   = context->arguments->revalidate;
+    options.elf_only     = context->arguments->scan_root != NULL || context->arguments->watch_root_count != 0;
+    options.budget_ms    = context->arguments->budget_ms;
+    options.trace        = context->arguments->trace_path != NULL ? &context->trace : NULL;
+    options.next_path    = next_path;
+    options.source_arg   = context;
+    options.out          = stdout;
+
+    // every request in flight holds a socket and every header read a file
+    raise_fd_limit(options.jobs + options.depth + FD_HEADROOM);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(context->arguments->cache_path != NULL)
+    {
+        if(stat_cache_open(&context->cache, context->arguments->cache_path) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to open the cache file", ERR_USAGE);
+            return CLEANUP;
+        }
+
+        options.cache = &context->cache;
+    }
+
+    if(start_source(context, err) == -1)
+    {
+        return CLEANUP;
+    }
+
+    if(batch_run(&options, &context->batch_stats) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Batch engine failed", ERR_SOCKET);
+    }
+
+    stop_source(context);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = ((double)(end.tv_sec - start.tv_sec) * MS_PER_SEC) + ((double)(end.tv_nsec - start.tv_nsec) / NS_PER_MS);
+
+    fprintf(stderr,
+            "Inspected %" PRIu64 " of %" PRIu64 " files (%" PRIu64 " failed, %" PRIu64 " from the cache) in %.3f ms, headers read with %s\n",
+            context->batch_stats.completed,
+            context->batch_stats.submitted,
+            context->batch_stats.failed,
+            context->batch_stats.cached,
+            elapsed,
+            context->batch_stats.used_uring ? "io_uring" : "plain system calls");
+
+    if(context->batch_stats.failed != 0)
+    {
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    return CLEANUP;
+}
+
+/*
+ * A scan hands out every regular file it finds, so with elf_only the
+ * header is read here once, both to tell an ELF file apart and to
+ * inspect it. Returns 1 for a file to skip, one that cannot be read or
+ * lacks the ELF magic.
+ */
+static int inspect_local(const char *path, bool elf_only, struct elf_result *result)
+{
+    uint8_t header[ELF_INSPECT_HEADER_LEN];
+    ssize_t read_len;
+    int     fd;
+
+    if(!elf_only)
+    {
+        return elf_inspect_path(path, result);
+    }
+
+    fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        return 1;
+    }
+
+    read_len = pread(fd, header, sizeof(header), 0);
+    close(fd);
+
+    if(read_len < ELF_MAGIC_LEN || verify_magic(header, NULL) == -1)
+    {
+        return 1;
+    }
+
+    return elf_inspect_buffer(header, (size_t)read_len, result);
+}
+
+/*
+ * Inspects every path with libelfinspect in this process, for callers
+ * that trust their input and do not need the daemon's isolation.
+ * Answers are written exactly as a daemon would send them.
+ */
+static p101_fsm_state_t run_local(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct context  *context;
+    struct timespec  start;
+    struct timespec  end;
+    double           elapsed;
+    enum batch_next  next;
+    char            *path;
+
+    P101_TRACE(env);
+    context = (struct context *)ctx;
+
+    FSM_TIMING_ENTER(&context->fsm_timing, LOCAL);
+
+    setvbuf(stdout, NULL, context->arguments->watch_root_count != 0 ? _IOLBF : _IOFBF, OUTPUT_BUFFER_LEN);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(start_source(context, err) == -1)
+    {
+        return CLEANUP;
+    }
+
+    while((next = next_path(context, true, &path)) != BATCH_NEXT_DONE)
+    {
+        struct elf_result result;
+        char              response[ELF_INSPECT_RESPONSE_LEN];
+        int               inspected;
+        int               len;
+
+        // a watch hands out pending when a signal breaks the wait
+        if(next == BATCH_NEXT_PENDING)
+        {
+            continue;
+        }
+
+        context->batch_stats.submitted++;
+        inspected = inspect_local(path, context->arguments->scan_root != NULL || context->arguments->watch_root_count != 0, &result);
+
+        if(inspected == 1)
+        {
+            context->batch_stats.submitted--;
+            context->batch_stats.skipped++;
+            free(path);
+            continue;
+        }
+
+        if(inspected == -1)
+        {
+            fprintf(stderr, "%s: %s\n", path, errno == EINVAL ? "ELF file is not a regular file" : "Failed to open ELF file");
+            context->batch_stats.failed++;
+            free(path);
+            continue;
+        }
+
+        len = elf_inspect_format(path, &result, response, sizeof(response));
+
+        if(len == -1)
+        {
+            fprintf(stderr, "%s: %s\n", path, "Response too long");
+            context->batch_stats.failed++;
+            free(path);
+            continue;
+        }
+
+        fwrite(response, 1, (size_t)len, stdout);
+
+        if(response[len - 1] != '\n')
+        {
+            fputc('\n', stdout);
+        }
+
+        context->batch_stats.completed++;
+        free(path);
+    }
+
+    fflush(stdout);
+    stop_source(context);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = ((double)(end.tv_sec - start.tv_sec) * MS_PER_SEC) + ((double)(end.tv_nsec - start.tv_nsec) / NS_PER_MS);
+
+    fprintf(stderr,
+            "Inspected %" PRIu64 " of %" PRIu64 " files (%" PRIu64 " failed) in %.3f ms, in process\n",
+            context->batch_stats.completed,
+            context->batch_stats.submitted,
+            context->batch_stats.failed,
+            elapsed);
+
+    if(context->batch_stats.failed != 0)
+    {
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    return CLEANUP;
+}
+
 static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
     struct context *context;
@@ -355,6 +1233,8 @@ static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err
     P101_TRACE(env);
     context = (struct context *)ctx;
 
+    FSM_TIMING_ENTER(&context->fsm_timing, USAGE);
+
     if(p101_error_has_error(err))
     {
         const char *msg;
@@ -370,9 +1250,28 @@ static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err
         context->exit_code = EXIT_FAILURE;
     }
 
-    fprintf(stderr, "Usage: %s [-h] <socket-path> <elf-file-path>\n", context->arguments->program_name);
+    fprintf(stderr, "Usage: %s [-h] [-j <jobs>] [-0] [-U] [-T <ms>] [-X <trace> [-x <one-in>]] [-C <cache> [-F]] <socket-path>[,<socket-path>...] <elf-file-path|->...\n", context->arguments->program_name);
+    fprintf(stderr, "       %s [-h] [-j <jobs>] [-t <threads>] [-U] [-T <ms>] [-X <trace> [-x <one-in>]] [-C <cache> [-F]] -r <directory> <socket-path>[,<socket-path>...]\n", context->arguments->program_name);
+    fprintf(stderr, "       %s [-h] [-j <jobs>] [-d <ms>] [-U] [-T <ms>] [-X <trace> [-x <one-in>]] [-C <cache> [-F]] -w <directory> [-w <directory>...] <socket-path>[,<socket-path>...]\n", context->arguments->program_name);
+    fprintf(stderr, "       %s -l [-h] [-0] [-t <threads>] [-d <ms>] [-r <directory> | -w <directory>... | <elf-file-path|->...]\n", context->arguments->program_name);
     fputs("Options:\n", stderr);
     fputs(" -h Display this help message\n", stderr);
+    fputs(" -j Requests to keep in flight when inspecting many files (default 16, at most 65536)\n", stderr);
+    fputs(" -0 Paths read from stdin are NUL separated instead of newline separated\n", stderr);
+    fputs(" -r Inspect every ELF file below the directory\n", stderr);
+    fputs(" -t Threads walking the directory (default one per CPU)\n", stderr);
+    fputs(" -w Keep watching the directory and inspect ELF files as they are written or moved in, until SIGINT or SIGTERM\n", stderr);
+    fputs(" -d Milliseconds a changed file must stay quiet before it is inspected (default 200)\n", stderr);
+    fputs(" -C Answer files whose device, inode, size, mtime and ctime are unchanged from this cache file, and record new answers in it\n", stderr);
+    fputs(" -l Inspect in this process with libelfinspect instead of asking a daemon, taking no socket paths\n", stderr);
+    fputs(" -F Ask the daemons about every file again, refreshing the cache\n", stderr);
+    fputs(" -U Read file headers with plain system calls instead of io_uring\n", stderr);
+    fputs(" -T Milliseconds to wait for each answer before giving up; the daemon drops the request then as well\n", stderr);
+    fputs(" -X Write a span for each sampled request to this file in the Trace Event JSON format Perfetto opens\n", stderr);
+    fputs(" -x Trace one request in this many, picked by file name so elfinspectd -x picks the same ones (default 64)\n", stderr);
+    fputs("A path of - reads further paths from stdin\n", stderr);
+    fputs("Files are spread across the socket paths by content, failing over to the next one when a daemon is down\n", stderr);
+    fputs("A single file is sent whole and turned down past 1 MiB; many files send only their first 64 bytes, so any size is inspected\n", stderr);
 
     return CLEANUP;
 }
@@ -384,6 +1283,8 @@ static p101_fsm_state_t cleanup(const struct p101_env *env, struct p101_error *e
     P101_TRACE(env);
     context = (struct context *)ctx;
 
+    FSM_TIMING_ENTER(&context->fsm_timing, CLEANUP);
+
     if(p101_error_has_error(err))
     {
         const char *msg;
@@ -410,6 +1311,10 @@ static p101_fsm_state_t cleanup(const struct p101_env *env, struct p101_error *e
         context->socket_fd = 0;
     }
 
+    shard_ring_destroy(&context->ring);
+    stat_cache_close(&context->cache);
+    trace_close(&context->trace);
+
     if(p101_error_has_error(err))
     {
         fputs(p101_error_get_message(err), stderr);
@@ -417,5 +1322,7 @@ static p101_fsm_state_t cleanup(const struct p101_env *env, struct p101_error *e
         context->exit_code = EXIT_FAILURE;
     }
 
+    FSM_TIMING_WRITE(&context->fsm_timing, state_names, stderr);
+
     return P101_FSM_EXIT;
 }
@@ -0,0 +1,452 @@
+#include "argumentsa.h"
+#include "contexta.h"
+#include "errorsa.h"
+#include "util.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <p101_c/p101_stdlib.h>
+#include <p101_c/p101_string.h>
+#include <p101_fsm/fsm.h>
+#include <p101_posix/p101_string.h>
+#include <p101_posix/p101_unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+enum states
+{
+    PARSE_ARGS = P101_FSM_USER_START,
+    HANDLE_ARGS,
+    USAGE,
+    WAIT_FOR_CLIENT,
+    START_DAEMON,
+    CLEANUP_PROGRAM,
+};
+
+static volatile sig_atomic_t exit_flag = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static void             setup_signal_handlers(void);
+static void             sig_handler(int signal);
+static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t wait_for_client(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t start_daemon(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_error *err, void *ctx);
+
+#define ERR_MSG_LEN 256         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SOCK_QUEUE 5            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PID_DIGITS 24           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static void setup_signal_handlers(void)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(struct sigaction));
+
+#ifdef __clang__
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif
+    action.sa_handler = sig_handler;
+#ifdef __clang__
+    #pragma clang diagnostic pop
+#endif
+
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+
+    // caught rather than ignored, so the daemon started in this process gets its own defaults back
+    if(sigaction(SIGINT, &action, NULL) == -1)
+    {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static void sig_handler(int signal)
+{
+    exit_flag = 1;
+}
+
+#pragma GCC diagnostic pop
+
+int main(int argc, char *argv[])
+{
+    static struct p101_fsm_transition transitions[] = {
+        {P101_FSM_INIT,   PARSE_ARGS,      parse_arguments },
+        {PARSE_ARGS,      USAGE,           usage           },
+        {PARSE_ARGS,      HANDLE_ARGS,     handle_arguments},
+        {HANDLE_ARGS,     USAGE,           usage           },
+        {HANDLE_ARGS,     CLEANUP_PROGRAM, cleanup_program },
+        {HANDLE_ARGS,     WAIT_FOR_CLIENT, wait_for_client },
+        {HANDLE_ARGS,     START_DAEMON,    start_daemon    },
+        {WAIT_FOR_CLIENT, START_DAEMON,    start_daemon    },
+        {WAIT_FOR_CLIENT, CLEANUP_PROGRAM, cleanup_program },
+        {START_DAEMON,    CLEANUP_PROGRAM, cleanup_program },
+        {USAGE,           CLEANUP_PROGRAM, cleanup_program },
+        {CLEANUP_PROGRAM, P101_FSM_EXIT,   NULL            }
+    };
+
+    struct p101_error    *err;
+    struct p101_env      *env;
+    struct p101_fsm_info *fsm;
+    p101_fsm_state_t      from_state;
+    p101_fsm_state_t      to_state;
+    struct p101_error    *fsm_err;
+    struct p101_env      *fsm_env;
+    struct argumentsa     args;
+    struct contexta       ctx;
+
+    setup_signal_handlers();
+
+    err = p101_error_create(false);
+
+    if(err == NULL)
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto done;
+    }
+
+    env = p101_env_create(err, true, NULL);
+
+    if(p101_error_has_error(err))
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_error;
+    }
+
+    fsm_err = p101_error_create(false);
+
+    if(fsm_err == NULL)
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    fsm_env = p101_env_create(err, true, NULL);
+
+    if(p101_error_has_error(err))
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_fsm_error;
+    }
+
+    p101_memset(env, &args, 0, sizeof(args));
+    p101_memset(env, &ctx, 0, sizeof(ctx));
+    ctx.arguments          = &args;
+    ctx.arguments->argc    = argc;
+    ctx.arguments->argv    = argv;
+    ctx.arguments->backlog = SOCK_QUEUE;
+    ctx.exit_code          = EXIT_SUCCESS;
+
+    fsm = p101_fsm_info_create(env, err, "elf-inspect-activate-fsm", fsm_env, fsm_err, NULL);
+
+    p101_fsm_run(fsm, &from_state, &to_state, &ctx, transitions, sizeof(transitions));
+    p101_fsm_info_destroy(env, &fsm);
+
+    free(fsm_env);
+
+free_fsm_error:
+    p101_error_reset(fsm_err);
+    p101_free(env, fsm_err);
+
+free_env:
+    p101_free(env, env);
+
+free_error:
+    p101_error_reset(err);
+    free(err);
+
+done:
+    return ctx.exit_code;
+}
+
+static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contexta *context;
+    p101_fsm_state_t next_state;
+    int              opt;
+
+    P101_TRACE(env);
+    context                          = (struct contexta *)ctx;
+    context->arguments->program_name = context->arguments->argv[0];
+    next_state                       = HANDLE_ARGS;
+    opterr                           = 0;
+
+    // options stop at the socket path, so the daemon's own options are left to it
+    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "+hlq:")) != -1 && p101_error_has_no_error(err))
+    {
+        switch(opt)
+        {
+            case 'h':
+            {
+                next_state = USAGE;
+                break;
+            }
+            case 'l':
+            {
+                context->arguments->lazy = true;
+                break;
+            }
+            case 'q':
+            {
+                if(parse_size(optarg, &context->arguments->backlog) == -1 || context->arguments->backlog == 0 || context->arguments->backlog > INT_MAX)
+                {
+                    P101_ERROR_RAISE_USER(err, "The backlog must be a positive number", ERRA_USAGE);
+                }
+                break;
+            }
+            case '?':
+            {
+                char msg[ERR_MSG_LEN];
+
+                if(optopt == 'q')
+                {
+                    snprintf(msg, sizeof msg, "Option '-%c' requires an argument.", optopt);
+                }
+                else if(isprint(optopt))
+                {
+                    snprintf(msg, sizeof msg, "Unknown option '-%c'.", optopt);
+                }
+                else
+                {
+                    snprintf(msg, sizeof msg, "Unknown option character 0x%02X.", (unsigned)(unsigned char)optopt);
+                }
+
+                P101_ERROR_RAISE_USER(err, msg, ERRA_USAGE);
+                break;
+            }
+            default:
+            {
+                P101_ERROR_RAISE_USER(err, "Unknown getopt failure", ERRA_USAGE);
+                break;
+            }
+        }
+    }
+
+    if(p101_error_has_no_error(err) && next_state != USAGE)
+    {
+        if(context->arguments->argc - optind < 2)
+        {
+            P101_ERROR_RAISE_USER(err, "A socket path and a daemon to start must be specified", ERRA_USAGE);
+        }
+        else
+        {
+            context->arguments->socket_path = context->arguments->argv[optind];
+            context->arguments->daemon_argv = &context->arguments->argv[optind + 1];
+        }
+    }
+
+    if(p101_error_has_error(err))
+    {
+        next_state = USAGE;
+    }
+
+    return next_state;
+}
+
+static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contexta *context;
+    p101_fsm_state_t next_state;
+    int              socket_fd;
+
+    P101_TRACE(env);
+    context    = (struct contexta *)ctx;
+    next_state = context->arguments->lazy ? WAIT_FOR_CLIENT : START_DAEMON;
+
+    unlink(context->arguments->socket_path);
+
+    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(socket_fd == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to create socket", ERRA_SOCKET);
+    }
+    else
+    {
+        struct sockaddr_un addr;
+        p101_memset(env, &addr, 0, sizeof(addr));
+        context->socket_fd = socket_fd;
+
+        if(init_sockaddr_un(&addr, context->arguments->socket_path) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Socket path too long", ERRA_SOCKET);
+        }
+        else if(bind(socket_fd, (struct sockaddr *)&addr, sizeof addr) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to bind socket", ERRA_USAGE);
+        }
+        else if(listen(context->socket_fd, (int)context->arguments->backlog) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to listen to socket", ERRA_SOCKET);
+        }
+    }
+
+    // the convention puts the first socket right after stderr
+    if(p101_error_has_no_error(err) && context->socket_fd != LISTEN_FDS_START)
+    {
+        if(dup2(context->socket_fd, LISTEN_FDS_START) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to move the socket into place", ERRA_SOCKET);
+        }
+        else
+        {
+            close(context->socket_fd);
+            context->socket_fd = LISTEN_FDS_START;
+        }
+    }
+
+    if(p101_error_is_error(err, P101_ERROR_USER, ERRA_USAGE))
+    {
+        next_state = USAGE;
+    }
+    else if(p101_error_has_error(err))
+    {
+        next_state = CLEANUP_PROGRAM;
+    }
+
+    return next_state;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static p101_fsm_state_t wait_for_client(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contexta *context;
+    struct pollfd    polled;
+    int              ready;
+
+    P101_TRACE(env);
+    context = (struct contexta *)ctx;
+
+    // the client is not accepted here, it stays queued for the daemon
+    polled.fd      = context->socket_fd;
+    polled.events  = POLLIN;
+    polled.revents = 0;
+
+    do
+    {
+        ready = poll(&polled, 1, -1);
+    } while(ready == -1 && errno == EINTR && exit_flag == 0);
+
+    if(exit_flag == 1)
+    {
+        return CLEANUP_PROGRAM;
+    }
+
+    if(ready == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to wait for the first client", ERRA_SOCKET);
+        return CLEANUP_PROGRAM;
+    }
+
+    return START_DAEMON;
+}
+
+#pragma GCC diagnostic pop
+
+static p101_fsm_state_t start_daemon(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contexta *context;
+    char             pid[PID_DIGITS];
+
+    P101_TRACE(env);
+    context = (struct contexta *)ctx;
+
+    // exec keeps the process, so the pid named is the daemon's
+    snprintf(pid, sizeof(pid), "%ld", (long)getpid());
+
+    if(setenv(LISTEN_PID_ENV, pid, 1) == -1 || setenv(LISTEN_FDS_ENV, "1", 1) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to pass the socket on", ERRA_EXEC);
+        return CLEANUP_PROGRAM;
+    }
+
+    execvp(context->arguments->daemon_argv[0], context->arguments->daemon_argv);
+
+    // only reached if the daemon could not be started
+    P101_ERROR_RAISE_USER(err, "Failed to start the daemon", ERRA_EXEC);
+
+    return CLEANUP_PROGRAM;
+}
+
+static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contexta *context;
+
+    P101_TRACE(env);
+    context = (struct contexta *)ctx;
+
+    if(p101_error_has_error(err))
+    {
+        const char *msg;
+        msg = p101_error_get_message(err);
+
+        if(msg != NULL)
+        {
+            fputs(msg, stderr);
+            fputc('\n', stderr);
+        }
+
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Usage: %s [-h] [-l] [-q <backlog>] <socket-path> <daemon> [<daemon-argument>...]\n", context->arguments->program_name);
+    fputs("Options:\n", stderr);
+    fputs(" -h Display this help message\n", stderr);
+    fputs(" -l Start the daemon only once the first client connects\n", stderr);
+    fputs(" -q Connections the kernel queues before the daemon accepts them (default 5)\n", stderr);
+    fputs("Binds and listens on <socket-path>, then runs the daemon in this process with the socket passed under the LISTEN_FDS convention\n", stderr);
+    fputs("Clients connecting before the daemon is ready wait in the socket's queue\n", stderr);
+
+    return CLEANUP_PROGRAM;
+}
+
+static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contexta *context;
+
+    P101_TRACE(env);
+    context = (struct contexta *)ctx;
+
+    if(p101_error_has_error(err))
+    {
+        const char *msg;
+        msg = p101_error_get_message(err);
+
+        if(msg != NULL)
+        {
+            fputs(msg, stderr);
+            fputc('\n', stderr);
+        }
+
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    if(context->socket_fd != 0)
+    {
+        p101_close(env, err, context->socket_fd);
+        context->socket_fd = 0;
+    }
+
+    if(p101_error_has_error(err))
+    {
+        fputs(p101_error_get_message(err), stderr);
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    return P101_FSM_EXIT;
+}
@@ -0,0 +1,485 @@
+#include "argumentsp.h"
+#include "contextp.h"
+#include "errorsp.h"
+#include "relay.h"
+#include "response_cache.h"
+#include "shard_ring.h"
+#include "util.h"
+#include <ctype.h>
+#include <p101_c/p101_stdlib.h>
+#include <p101_c/p101_string.h>
+#include <p101_fsm/fsm.h>
+#include <p101_posix/p101_string.h>
+#include <p101_posix/p101_unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+enum states
+{
+    PARSE_ARGS = P101_FSM_USER_START,
+    HANDLE_ARGS,
+    USAGE,
+    WAIT_FOR_EVENTS,
+    HANDLE_EVENTS,
+    CLEANUP_PROGRAM,
+};
+
+static volatile sig_atomic_t exit_flag = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static void             setup_signal_handlers(void);
+static void             sig_handler(int signal);
+static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t wait_for_events(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t handle_events(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_error *err, void *ctx);
+
+#define ERR_MSG_LEN 256    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SOCK_QUEUE 128     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static void setup_signal_handlers(void)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(struct sigaction));
+
+#ifdef __clang__
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif
+    action.sa_handler = sig_handler;
+#ifdef __clang__
+    #pragma clang diagnostic pop
+#endif
+
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+
+    if(sigaction(SIGINT, &action, NULL) == -1)
+    {
+        perror("sigaction");
+        exit(EXIT_FAILURE);
+    }
+
+    // a vanished client or backend shows up as a failed write instead
+    if(signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+    {
+        perror("signal");
+        exit(EXIT_FAILURE);
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static void sig_handler(int signal)
+{
+    exit_flag = 1;
+}
+
+#pragma GCC diagnostic pop
+
+int main(int argc, char *argv[])
+{
+    static struct p101_fsm_transition transitions[] = {
+        {P101_FSM_INIT,   PARSE_ARGS,      parse_arguments },
+        {PARSE_ARGS,      USAGE,           usage           },
+        {PARSE_ARGS,      HANDLE_ARGS,     handle_arguments},
+        {HANDLE_ARGS,     USAGE,           usage           },
+        {HANDLE_ARGS,     CLEANUP_PROGRAM, cleanup_program },
+        {HANDLE_ARGS,     WAIT_FOR_EVENTS, wait_for_events },
+        {USAGE,           CLEANUP_PROGRAM, cleanup_program },
+        {WAIT_FOR_EVENTS, HANDLE_EVENTS,   handle_events   },
+        {WAIT_FOR_EVENTS, CLEANUP_PROGRAM, cleanup_program },
+        {HANDLE_EVENTS,   WAIT_FOR_EVENTS, wait_for_events },
+        {CLEANUP_PROGRAM, P101_FSM_EXIT,   NULL            }
+    };
+
+    struct p101_error    *err;
+    struct p101_env      *env;
+    struct p101_fsm_info *fsm;
+    p101_fsm_state_t      from_state;
+    p101_fsm_state_t      to_state;
+    struct p101_error    *fsm_err;
+    struct p101_env      *fsm_env;
+    struct argumentsp     args;
+    struct contextp       ctx;
+
+    setup_signal_handlers();
+
+    err = p101_error_create(false);
+
+    if(err == NULL)
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto done;
+    }
+
+    env = p101_env_create(err, true, NULL);
+
+    if(p101_error_has_error(err))
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_error;
+    }
+
+    fsm_err = p101_error_create(false);
+
+    if(fsm_err == NULL)
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    fsm_env = p101_env_create(err, true, NULL);
+
+    if(p101_error_has_error(err))
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_fsm_error;
+    }
+
+    p101_memset(env, &args, 0, sizeof(args));
+    p101_memset(env, &ctx, 0, sizeof(ctx));
+    ctx.arguments                = &args;
+    ctx.arguments->argc          = argc;
+    ctx.arguments->argv          = argv;
+    ctx.arguments->cache_entries   = RESPONSE_CACHE_DEFAULT_ENTRIES;
+    ctx.arguments->header_ms       = RELAY_DEFAULT_HEADER_MS;
+    ctx.arguments->body_ms         = RELAY_DEFAULT_BODY_MS;
+    ctx.arguments->backend_ms      = RELAY_DEFAULT_BACKEND_MS;
+    ctx.arguments->max_connections = RELAY_DEFAULT_MAX_CONNECTIONS;
+    ctx.exit_code                  = EXIT_SUCCESS;
+
+    fsm = p101_fsm_info_create(env, err, "elf-inspect-proxy-fsm", fsm_env, fsm_err, NULL);
+
+    p101_fsm_run(fsm, &from_state, &to_state, &ctx, transitions, sizeof(transitions));
+    p101_fsm_info_destroy(env, &fsm);
+
+    free(fsm_env);
+
+free_fsm_error:
+    p101_error_reset(fsm_err);
+    p101_free(env, fsm_err);
+
+free_env:
+    p101_free(env, env);
+
+free_error:
+    p101_error_reset(err);
+    free(err);
+
+done:
+    return ctx.exit_code;
+}
+
+static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextp *context;
+    p101_fsm_state_t next_state;
+    int              opt;
+
+    P101_TRACE(env);
+    context                          = (struct contextp *)ctx;
+    context->arguments->program_name = context->arguments->argv[0];
+    next_state                       = HANDLE_ARGS;
+    opterr                           = 0;
+
+    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "hc:H:B:W:m:")) != -1 && p101_error_has_no_error(err))
+    {
+        switch(opt)
+        {
+            case 'h':
+            {
+                next_state = USAGE;
+                break;
+            }
+            case 'c':
+            {
+                if(parse_size(optarg, &context->arguments->cache_entries) == -1 || context->arguments->cache_entries == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "Cache entries must be a positive number", ERRP_USAGE);
+                }
+                break;
+            }
+            case 'H':
+            case 'B':
+            case 'W':
+            {
+                size_t *deadline;
+
+                deadline = opt == 'H' ? &context->arguments->header_ms : opt == 'B' ? &context->arguments->body_ms : &context->arguments->backend_ms;
+
+                if(parse_size(optarg, deadline) == -1 || *deadline == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "Deadlines must be a positive number of milliseconds", ERRP_USAGE);
+                }
+                break;
+            }
+            case 'm':
+            {
+                if(parse_size(optarg, &context->arguments->max_connections) == -1 || context->arguments->max_connections == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "Connection limit must be a positive number", ERRP_USAGE);
+                }
+                break;
+            }
+            case '?':
+            {
+                char msg[ERR_MSG_LEN];
+
+                if(optopt == 'c' || optopt == 'H' || optopt == 'B' || optopt == 'W' || optopt == 'm')
+                {
+                    snprintf(msg, sizeof msg, "Option '-%c' requires an argument.", optopt);
+                }
+                else if(isprint(optopt))
+                {
+                    snprintf(msg, sizeof msg, "Unknown option '-%c'.", optopt);
+                }
+                else
+                {
+                    snprintf(msg, sizeof msg, "Unknown option character 0x%02X.", (unsigned)(unsigned char)optopt);
+                }
+
+                P101_ERROR_RAISE_USER(err, msg, ERRP_USAGE);
+                break;
+            }
+            default:
+            {
+                P101_ERROR_RAISE_USER(err, "Unknown getopt failure", ERRP_USAGE);
+                break;
+            }
+        }
+    }
+
+    if(p101_error_has_no_error(err) && next_state != USAGE)
+    {
+        if(context->arguments->argc - optind != 2)
+        {
+            P101_ERROR_RAISE_USER(err, "Incorrect number of arguments", ERRP_USAGE);
+        }
+        else
+        {
+            context->arguments->socket_path  = context->arguments->argv[optind];
+            context->arguments->backend_list = context->arguments->argv[optind + 1];
+        }
+    }
+
+    if(p101_error_has_error(err))
+    {
+        next_state = USAGE;
+    }
+
+    return next_state;
+}
+
+static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextp *context;
+    p101_fsm_state_t next_state;
+    int              socket_fd;
+
+    P101_TRACE(env);
+    context    = (struct contextp *)ctx;
+    next_state = WAIT_FOR_EVENTS;
+
+    if(shard_ring_create(&context->backends, context->arguments->backend_list) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Invalid backend socket path list", ERRP_USAGE);
+    }
+    else if(response_cache_create(&context->cache, context->arguments->cache_entries) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to allocate the response cache", ERRP_SOCKET);
+    }
+
+    if(p101_error_has_no_error(err))
+    {
+        unlink(context->arguments->socket_path);
+
+        socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(socket_fd == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to create socket", ERRP_SOCKET);
+        }
+        else
+        {
+            struct sockaddr_un addr;
+            p101_memset(env, &addr, 0, sizeof(addr));
+            context->socket_fd = socket_fd;
+
+            if(init_sockaddr_un(&addr, context->arguments->socket_path) == -1)
+            {
+                P101_ERROR_RAISE_USER(err, "Socket path too long", ERRP_SOCKET);
+            }
+            else if(bind(socket_fd, (struct sockaddr *)&addr, sizeof addr) == -1)
+            {
+                P101_ERROR_RAISE_USER(err, "Failed to bind socket", ERRP_USAGE);
+            }
+            else if(listen(context->socket_fd, SOCK_QUEUE) == -1)
+            {
+                P101_ERROR_RAISE_USER(err, "Failed to listen to socket", ERRP_SOCKET);
+            }
+        }
+    }
+
+    if(p101_error_has_no_error(err))
+    {
+        struct relay_options options;
+
+        options.header_ms       = context->arguments->header_ms;
+        options.body_ms         = context->arguments->body_ms;
+        options.backend_ms      = context->arguments->backend_ms;
+        options.max_connections = context->arguments->max_connections;
+
+        if(relay_open(&context->relay, context->socket_fd, &options, &context->backends, &context->cache) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to allocate the connection table", ERRP_SOCKET);
+        }
+        else
+        {
+            context->relay_open = true;
+        }
+    }
+
+    if(p101_error_is_error(err, P101_ERROR_USER, ERRP_USAGE))
+    {
+        next_state = USAGE;
+    }
+    else if(p101_error_has_error(err))
+    {
+        next_state = CLEANUP_PROGRAM;
+    }
+
+    return next_state;
+}
+
+static p101_fsm_state_t wait_for_events(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextp *context;
+    enum relay_wait  waited;
+
+    P101_TRACE(env);
+    context = (struct contextp *)ctx;
+
+    do
+    {
+        waited = relay_wait(&context->relay);
+    } while(waited == RELAY_INTERRUPTED && exit_flag == 0);
+
+    if(exit_flag == 1)
+    {
+        return CLEANUP_PROGRAM;
+    }
+
+    if(waited == RELAY_FAILED)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to wait for requests", ERRP_SOCKET);
+        return CLEANUP_PROGRAM;
+    }
+
+    return HANDLE_EVENTS;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+// a slow client or backend holds only its own request, every other one moves on here
+static p101_fsm_state_t handle_events(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextp *context;
+
+    P101_TRACE(env);
+    context = (struct contextp *)ctx;
+    relay_dispatch(&context->relay);
+
+    return WAIT_FOR_EVENTS;
+}
+
+#pragma GCC diagnostic pop
+
+static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextp *context;
+
+    P101_TRACE(env);
+    context = (struct contextp *)ctx;
+
+    if(p101_error_has_error(err))
+    {
+        const char *msg;
+        msg = p101_error_get_message(err);
+
+        if(msg != NULL)
+        {
+            fputs(msg, stderr);
+            fputc('\n', stderr);
+        }
+
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Usage: %s [-h] [-c <cache-entries>] [-H <ms>] [-B <ms>] [-W <ms>] [-m <connections>] <socket-path> <backend-socket-path>[,<backend-socket-path>...]\n", context->arguments->program_name);
+    fputs("Options:\n", stderr);
+    fputs(" -h Display this help message\n", stderr);
+    fputs(" -c Number of responses to cache (default 4096)\n", stderr);
+    fputs(" -H Milliseconds a client has to send the file name line after connecting (default 2000)\n", stderr);
+    fputs(" -B Milliseconds a client has to send the file data after the name line (default 5000)\n", stderr);
+    fputs(" -W Milliseconds a backend has to answer before the next one is tried (default 5000)\n", stderr);
+    fputs(" -m Requests to relay at once; clients beyond that are told to retry (default 1024)\n", stderr);
+
+    return CLEANUP_PROGRAM;
+}
+
+static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextp *context;
+
+    P101_TRACE(env);
+    context = (struct contextp *)ctx;
+
+    if(p101_error_has_error(err))
+    {
+        const char *msg;
+        msg = p101_error_get_message(err);
+
+        if(msg != NULL)
+        {
+            fputs(msg, stderr);
+            fputc('\n', stderr);
+        }
+
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    if(context->relay_open)
+    {
+        fprintf(stderr, "Relayed %llu requests: %llu from the cache, %llu forwarded, %llu failovers, %llu without a backend, %llu timed out, %llu turned away\n", (unsigned long long)context->relay.accepted, (unsigned long long)context->relay.hits, (unsigned long long)context->relay.forwarded, (unsigned long long)context->relay.failovers, (unsigned long long)context->relay.no_backend, (unsigned long long)context->relay.client_timeouts, (unsigned long long)context->relay.busy);
+        relay_close(&context->relay);
+        context->relay_open = false;
+    }
+
+    if(context->socket_fd != 0)
+    {
+        p101_close(env, err, context->socket_fd);
+        context->socket_fd = 0;
+    }
+
+    response_cache_destroy(&context->cache);
+    shard_ring_destroy(&context->backends);
+
+    if(p101_error_has_error(err))
+    {
+        fputs(p101_error_get_message(err), stderr);
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    return P101_FSM_EXIT;
+}
@@ -1,13 +1,22 @@
 #include "argumentsd.h"
+#include "catalog.h"
+#include "content_key.h"
 #include "contextd.h"
-#include "elf32_header.h"
-#include "elf64_header.h"
-#include "elf_ident.h"
-#include "elf_validator.h"
+#include "elf_inspect.h"
+#include "elf_result.h"
 #include "errorsd.h"
+#include "handoff.h"
+#include "listener.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "probes.h"
+#include "shm_cache.h"
 #include "util.h"
-#include "verification_set.h"
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <p101_c/p101_stdlib.h>
 #include <p101_c/p101_string.h>
 #include <p101_convert/integer.h>
@@ -20,6 +29,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <time.h>
 
 enum states
 {
@@ -27,7 +37,10 @@ enum states
     HANDLE_ARGS,
     USAGE,
     WAIT_FOR_REQUEST,
+    HAND_OVER,
+    SERVE_METRICS,
     PARSE_REQUEST,
+    LOOKUP_RESULT,
     VERIFY_ELF_HEADER,
     RESPOND,
     CLEANUP_RESPONSE,
@@ -36,27 +49,51 @@ enum states
 
 static volatile sig_atomic_t exit_flag    = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
 static volatile sig_atomic_t socket_close = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static volatile sig_atomic_t dump_flag    = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static const char *const state_names[] = {
+    [PARSE_ARGS]        = "parse_args",
+    [HANDLE_ARGS]       = "handle_args",
+    [USAGE]             = "usage",
+    [WAIT_FOR_REQUEST]  = "wait_for_request",
+    [HAND_OVER]         = "hand_over",
+    [SERVE_METRICS]     = "serve_metrics",
+    [PARSE_REQUEST]     = "parse_request",
+    [LOOKUP_RESULT]     = "lookup_result",
+    [VERIFY_ELF_HEADER] = "verify_elf_header",
+    [RESPOND]           = "respond",
+    [CLEANUP_RESPONSE]  = "cleanup_response",
+    [CLEANUP_PROGRAM]   = "cleanup_program",
+};
 
 static void             setup_signal_handlers(void);
 static void             sig_handler(int signal);
+static void             enter_state(struct contextd *context, p101_fsm_state_t state);
 static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t wait_for_request(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t hand_over(const struct p101_env *env, struct p101_error *err, void *ctx);
+static int              open_catalog(struct contextd *context, bool took_over);
+static p101_fsm_state_t serve_metrics(const struct p101_env *env, struct p101_error *err, void *ctx);
+static int              open_metrics_socket(const char *path);
 static p101_fsm_state_t parse_request(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t lookup_result(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t verify_elf_header(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t respond(const struct p101_env *env, struct p101_error *err, void *ctx);
 void                    free_if_not_null(const struct p101_env *env, char **buf);
+static void             trace_request(struct contextd *context);
+static char            *counted_strdup(struct contextd *context, struct alloc_site site, const struct p101_env *env, struct p101_error *err, const char *str);
+static void             counted_free(struct contextd *context, const struct p101_env *env, char **buf);
 static p101_fsm_state_t cleanup_response(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx);
 static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_error *err, void *ctx);
 
 #define ERR_MSG_LEN 256             // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define RESPONSE_MSG_LEN 1024       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 #define SOCK_QUEUE 5                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define MAX_FILE_NAME_LEN 256       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define MAX_FILE_LEN 1048576        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define CLASS_LOCATION 4            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
-#define MAX_ELF_ADDRESS_CHARS 19    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CATALOG_RETRY_NS 1000000    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_MS 1000000           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CONTROL_HANDOFF 0           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CONTROL_METRICS 1           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
 
 static void setup_signal_handlers(void)
 {
@@ -76,7 +113,8 @@ static void setup_signal_handlers(void)
     sigemptyset(&action.sa_mask);
     action.sa_flags = 0;
 
-    if(sigaction(SIGINT, &action, NULL) == -1)
+    // a client that gives up before its answer must not take the daemon down with it
+    if(sigaction(SIGINT, &action, NULL) == -1 || sigaction(SIGPIPE, &action, NULL) == -1 || sigaction(SIGUSR1, &action, NULL) == -1)
     {
         perror("sigaction");
         exit(EXIT_FAILURE);
@@ -96,6 +134,10 @@ static void sig_handler(int signal)
     {
         socket_close = 1;
     }
+    else if(signal == SIGUSR1)
+    {
+        dump_flag = 1;
+    }
 }
 
 #pragma GCC diagnostic pop
@@ -112,8 +154,14 @@ int main(int argc, char *argv[])
         {USAGE,             CLEANUP_PROGRAM,   cleanup_program  },
         {WAIT_FOR_REQUEST,  CLEANUP_PROGRAM,   cleanup_program  },
         {WAIT_FOR_REQUEST,  PARSE_REQUEST,     parse_request    },
+        {WAIT_FOR_REQUEST,  HAND_OVER,         hand_over        },
+        {HAND_OVER,         WAIT_FOR_REQUEST,  wait_for_request },
+        {WAIT_FOR_REQUEST,  SERVE_METRICS,     serve_metrics    },
+        {SERVE_METRICS,     WAIT_FOR_REQUEST,  wait_for_request },
         {PARSE_REQUEST,     RESPOND,           respond          },
-        {PARSE_REQUEST,     VERIFY_ELF_HEADER, verify_elf_header},
+        {PARSE_REQUEST,     LOOKUP_RESULT,     lookup_result    },
+        {LOOKUP_RESULT,     RESPOND,           respond          },
+        {LOOKUP_RESULT,     VERIFY_ELF_HEADER, verify_elf_header},
         {VERIFY_ELF_HEADER, RESPOND,           respond          },
         {RESPOND,           CLEANUP_RESPONSE,  cleanup_response },
         {CLEANUP_RESPONSE,  WAIT_FOR_REQUEST,  wait_for_request },
@@ -172,6 +220,16 @@ int main(int argc, char *argv[])
     ctx.arguments->argv = argv;
     ctx.exit_code       = EXIT_SUCCESS;
 
+    ctx.arguments->cache_slots     = SHM_CACHE_DEFAULT_SLOTS;
+    ctx.arguments->header_ms       = LISTENER_DEFAULT_HEADER_MS;
+    ctx.arguments->body_ms         = LISTENER_DEFAULT_BODY_MS;
+    ctx.arguments->total_ms        = LISTENER_DEFAULT_TOTAL_MS;
+    ctx.arguments->max_connections = LISTENER_DEFAULT_MAX_CONNECTIONS;
+    ctx.arguments->buffer_budget   = LISTENER_DEFAULT_BUFFER_BUDGET;
+    ctx.arguments->backlog         = SOCK_QUEUE;
+    ctx.arguments->burst           = LISTENER_DEFAULT_BURST;
+    ctx.arguments->trace_sample    = TRACE_DEFAULT_SAMPLE;
+
     fsm = p101_fsm_info_create(env, err, "elf-inspect-d-fsm", fsm_env, fsm_err, NULL);
 
     p101_fsm_run(fsm, &from_state, &to_state, &ctx, transitions, sizeof(transitions));
@@ -194,6 +252,13 @@ done:
     return ctx.exit_code;
 }
 
+// every state is timed under FSM_TIMING and charged its hardware events under -P
+static void enter_state(struct contextd *context, p101_fsm_state_t state)
+{
+    FSM_TIMING_ENTER(&context->fsm_timing, state);
+    perf_counters_enter(&context->perf, state);
+}
+
 static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
     struct contextd *context;
@@ -206,7 +271,9 @@ static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_
     next_state                       = HANDLE_ARGS;
     opterr                           = 0;
 
-    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "h")) != -1 && p101_error_has_no_error(err))
+    enter_state(context, PARSE_ARGS);
+
+    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "hs:n:c:u:S:X:x:PH:B:T:m:M:q:r:b:")) != -1 && p101_error_has_no_error(err))
     {
         switch(opt)
         {
@@ -215,11 +282,105 @@ static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_
                 next_state = USAGE;
                 break;
             }
+            case 's':
+            {
+                context->arguments->cache_path = optarg;
+                break;
+            }
+            case 'c':
+            {
+                context->arguments->catalog_path = optarg;
+                break;
+            }
+            case 'u':
+            {
+                context->arguments->control_path = optarg;
+                break;
+            }
+            case 'S':
+            {
+                context->arguments->metrics_path = optarg;
+                break;
+            }
+            case 'X':
+            {
+                context->arguments->trace_path = optarg;
+                break;
+            }
+            case 'P':
+            {
+                context->arguments->perf_counters = true;
+                break;
+            }
+            case 'x':
+            {
+                if(parse_size(optarg, &context->arguments->trace_sample) == -1 || context->arguments->trace_sample == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "The trace sample must be a positive number", ERRD_USAGE);
+                }
+                break;
+            }
+            case 'n':
+            {
+                if(parse_size(optarg, &context->arguments->cache_slots) == -1 || context->arguments->cache_slots == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "Cache slots must be a positive number", ERRD_USAGE);
+                }
+                break;
+            }
+            case 'H':
+            case 'B':
+            case 'T':
+            {
+                size_t *deadline;
+
+                deadline = opt == 'H' ? &context->arguments->header_ms : opt == 'B' ? &context->arguments->body_ms : &context->arguments->total_ms;
+
+                if(parse_size(optarg, deadline) == -1 || *deadline == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "Deadlines must be a positive number of milliseconds", ERRD_USAGE);
+                }
+                break;
+            }
+            case 'm':
+            case 'M':
+            case 'q':
+            {
+                size_t *limit;
+
+                limit = opt == 'm' ? &context->arguments->max_connections : opt == 'M' ? &context->arguments->buffer_budget : &context->arguments->backlog;
+
+                if(parse_size(optarg, limit) == -1 || *limit == 0 || (opt == 'q' && *limit > INT_MAX) || (opt == 'M' && *limit < LISTENER_NAME_LEN))
+                {
+                    P101_ERROR_RAISE_USER(err, "Connection and backlog limits must be positive numbers and the buffer budget must hold a whole name line", ERRD_USAGE);
+                }
+                break;
+            }
+            case 'r':
+            {
+                if(parse_size(optarg, &context->arguments->rate) == -1)
+                {
+                    P101_ERROR_RAISE_USER(err, "The request rate must be a number", ERRD_USAGE);
+                }
+                break;
+            }
+            case 'b':
+            {
+                if(parse_size(optarg, &context->arguments->burst) == -1 || context->arguments->burst == 0)
+                {
+                    P101_ERROR_RAISE_USER(err, "The burst must be a positive number", ERRD_USAGE);
+                }
+                break;
+            }
             case '?':
             {
                 char msg[ERR_MSG_LEN];
 
-                if(isprint(optopt))
+                if(optopt == 's' || optopt == 'n' || optopt == 'c' || optopt == 'u' || optopt == 'S' || optopt == 'X' || optopt == 'x' || optopt == 'H' || optopt == 'B' || optopt == 'T' || optopt == 'm' || optopt == 'M' || optopt == 'q' || optopt == 'r' || optopt == 'b')
+                {
+                    snprintf(msg, sizeof msg, "Option '-%c' requires an argument.", optopt);
+                }
+                else if(isprint(optopt))
                 {
                     snprintf(msg, sizeof msg, "Unknown option '-%c'.", optopt);
                 }
@@ -268,38 +429,152 @@ static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101
     struct contextd *context;
     p101_fsm_state_t next_state;
     int              socket_fd;
+    bool             inherited;
+    bool             took_over;
 
     P101_TRACE(env);
     context    = (struct contextd *)ctx;
     next_state = WAIT_FOR_REQUEST;
+    took_over  = false;
 
-    unlink(context->arguments->socket_path);
+    enter_state(context, HANDLE_ARGS);
 
-    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if(socket_fd == -1)
+    // a socket passed in is bound and listening already, and clients may be queued on it
+    socket_fd = inherited_socket();
+    inherited = socket_fd != -1;
+
+    if(!inherited && errno != ENOENT)
     {
-        P101_ERROR_RAISE_USER(err, "Failed to create socket", ERRD_SOCKET);
+        P101_ERROR_RAISE_USER(err, "The socket passed in LISTEN_FDS is not a listening socket", ERRD_SOCKET);
     }
-    else
+
+    // a daemon already on the control socket hands its listening socket over, so the path is never unbound
+    if(p101_error_has_no_error(err) && !inherited && context->arguments->control_path != NULL)
+    {
+        socket_fd = handoff_take(context->arguments->control_path);
+        took_over = socket_fd != -1;
+
+        if(!took_over && errno != ENOENT && errno != ECONNREFUSED)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to take the listening socket over from the running daemon", ERRD_SOCKET);
+        }
+    }
+
+    if(p101_error_has_no_error(err) && inherited)
+    {
+        // the backlog is the launcher's
+        context->socket_fd = socket_fd;
+    }
+    else if(p101_error_has_no_error(err) && took_over)
     {
-        struct sockaddr_un addr;
-        p101_memset(env, &addr, 0, sizeof(addr));
         context->socket_fd = socket_fd;
 
-        if(init_sockaddr_un(&addr, context->arguments->socket_path) == -1)
+        // already listening; listening again only sets this daemon's backlog
+        if(listen(context->socket_fd, (int)context->arguments->backlog) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to listen to socket", ERRD_SOCKET);
+        }
+    }
+    else if(p101_error_has_no_error(err))
+    {
+        unlink(context->arguments->socket_path);
+
+        socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(socket_fd == -1)
         {
-            P101_ERROR_RAISE_USER(err, "Socket path too long", ERRD_SOCKET);
+            P101_ERROR_RAISE_USER(err, "Failed to create socket", ERRD_SOCKET);
         }
-        else if(bind(socket_fd, (struct sockaddr *)&addr, sizeof addr) == -1)
+        else
         {
-            P101_ERROR_RAISE_USER(err, "Failed to bind socket", ERRD_USAGE);
+            struct sockaddr_un addr;
+            p101_memset(env, &addr, 0, sizeof(addr));
+            context->socket_fd = socket_fd;
+
+            if(init_sockaddr_un(&addr, context->arguments->socket_path) == -1)
+            {
+                P101_ERROR_RAISE_USER(err, "Socket path too long", ERRD_SOCKET);
+            }
+            else if(bind(socket_fd, (struct sockaddr *)&addr, sizeof addr) == -1)
+            {
+                P101_ERROR_RAISE_USER(err, "Failed to bind socket", ERRD_USAGE);
+            }
+            else if(listen(context->socket_fd, (int)context->arguments->backlog) == -1)
+            {
+                P101_ERROR_RAISE_USER(err, "Failed to listen to socket", ERRD_SOCKET);
+            }
         }
-        else if(listen(context->socket_fd, SOCK_QUEUE) == -1)
+    }
+
+    if(p101_error_has_no_error(err))
+    {
+        struct listener_options options;
+
+        options.header_ms       = context->arguments->header_ms;
+        options.body_ms         = context->arguments->body_ms;
+        options.total_ms        = context->arguments->total_ms;
+        options.max_connections = context->arguments->max_connections;
+        options.buffer_budget   = context->arguments->buffer_budget;
+        options.rate            = context->arguments->rate;
+        options.burst           = context->arguments->burst;
+        options.timestamps      = context->arguments->trace_path != NULL;
+
+        if(listener_open(&context->listener, context->socket_fd, &options) == -1)
         {
-            P101_ERROR_RAISE_USER(err, "Failed to listen to socket", ERRD_SOCKET);
+            P101_ERROR_RAISE_USER(err, "Failed to set up the listener", ERRD_SOCKET);
         }
     }
 
+    if(p101_error_has_no_error(err) && context->arguments->cache_path != NULL && shm_cache_open(&context->shm_cache, context->arguments->cache_path, context->arguments->cache_slots) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to map the shared result cache", ERRD_SOCKET);
+    }
+
+    if(p101_error_has_no_error(err) && context->arguments->catalog_path != NULL && open_catalog(context, took_over) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to open the result catalog (missing, in use or not a catalog)", ERRD_SOCKET);
+    }
+
+    // set up last, so a successor is only ever handed the socket by a daemon that is serving it
+    if(p101_error_has_no_error(err) && context->arguments->control_path != NULL)
+    {
+        context->control_fd = handoff_listen(context->arguments->control_path);
+
+        if(context->control_fd == -1)
+        {
+            context->control_fd = 0;
+            P101_ERROR_RAISE_USER(err, "Failed to set up the control socket", ERRD_SOCKET);
+        }
+        else
+        {
+            listener_watch(&context->listener, CONTROL_HANDOFF, context->control_fd);
+        }
+    }
+
+    if(p101_error_has_no_error(err) && context->arguments->metrics_path != NULL)
+    {
+        context->metrics_fd = open_metrics_socket(context->arguments->metrics_path);
+
+        if(context->metrics_fd == -1)
+        {
+            context->metrics_fd = 0;
+            P101_ERROR_RAISE_USER(err, "Failed to set up the metrics socket", ERRD_SOCKET);
+        }
+        else
+        {
+            listener_watch(&context->listener, CONTROL_METRICS, context->metrics_fd);
+        }
+    }
+
+    if(p101_error_has_no_error(err) && context->arguments->trace_path != NULL && trace_open(&context->trace, context->arguments->trace_path, "elfinspectd", context->arguments->trace_sample) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to create the trace file", ERRD_SOCKET);
+    }
+
+    if(p101_error_has_no_error(err) && context->arguments->perf_counters && perf_counters_open(&context->perf) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to open the hardware counters (no PMU, or perf_event_paranoid forbids it)", ERRD_SOCKET);
+    }
+
     if(p101_error_is_error(err, P101_ERROR_USER, ERRD_USAGE))
     {
         next_state = USAGE;
@@ -314,105 +589,220 @@ static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101
 
 static p101_fsm_state_t wait_for_request(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
-    struct contextd *context;
-    p101_fsm_state_t next_state;
-    int              request_fd;
+    struct contextd   *context;
+    p101_fsm_state_t   next_state;
+    enum listener_wait waited;
 
     P101_TRACE(env);
     context    = (struct contextd *)ctx;
     next_state = PARSE_REQUEST;
 
-    request_fd = accept(context->socket_fd, NULL, NULL);
+    enter_state(context, WAIT_FOR_REQUEST);
+
+    // slow clients are read alongside each other, so only a whole request comes out of here
+    do
+    {
+        waited = listener_next(&context->listener, &context->conn);
+
+        // asked for with SIGUSR1, and written here rather than in the handler
+        if(dump_flag == 1)
+        {
+            dump_flag = 0;
+            metrics_write(&context->metrics, &context->listener, stderr);
+            perf_counters_write(&context->perf, "elfinspectd", state_names, sizeof(state_names) / sizeof(*state_names), stderr);
+            ALLOC_STATS_WRITE(&context->alloc_stats, stderr);
+            FSM_TIMING_WRITE(&context->fsm_timing, state_names, stderr);
+            fflush(stderr);
+        }
+    } while(waited == LISTENER_INTERRUPTED && exit_flag == 0);
 
-    if(exit_flag == 1)
+    if(waited == LISTENER_CONTROL && exit_flag == 0)
+    {
+        next_state = context->listener.control_ready[CONTROL_HANDOFF] ? HAND_OVER : SERVE_METRICS;
+    }
+    else if(waited == LISTENER_DRAINED)
+    {
+        next_state = CLEANUP_PROGRAM;
+    }
+    else if(exit_flag == 1)
     {
+        if(waited == LISTENER_REQUEST)
+        {
+            listener_release(&context->listener, context->conn);
+            context->conn = NULL;
+        }
+
         next_state = CLEANUP_PROGRAM;
     }
-    else if(request_fd == -1)
+    else if(waited == LISTENER_FAILED)
     {
         P101_ERROR_RAISE_USER(err, "Failed to accept request", ERRD_SOCKET);
         next_state = CLEANUP_PROGRAM;
     }
     else
     {
-        context->request_fd = request_fd;
+        context->request_fd = context->conn->fd;
+        context->handed_ns  = histogram_now_ns();
+        metrics_record(&context->metrics, METRICS_QUEUE, context->handed_ns - context->conn->accepted_ns);
     }
 
     return next_state;
 }
 
-static p101_fsm_state_t parse_request(const struct p101_env *env, struct p101_error *err, void *ctx)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static p101_fsm_state_t hand_over(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
     struct contextd *context;
-    p101_fsm_state_t next_state;
-    char             name[MAX_FILE_NAME_LEN];
-    char             data[MAX_FILE_LEN + 1];
-    ssize_t          readName;
-    ssize_t          readData;
 
     P101_TRACE(env);
     context = (struct contextd *)ctx;
-    p101_memset(env, &name, 0, sizeof(name));
-    p101_memset(env, &data, 0, sizeof(data));
-    next_state                     = VERIFY_ELF_HEADER;
-    context->elf_details.valid_elf = true;
 
-    readName = safe_read_line(context->request_fd, name, sizeof(name), true);
-    readData = safe_read(context->request_fd, data, sizeof(data), true);
+    enter_state(context, HAND_OVER);
 
-    if(readName == -1)
+    // a successor that never acknowledged leaves this daemon serving as before
+    if(handoff_give(context->control_fd, context->socket_fd) == 0)
     {
-        P101_ERROR_RAISE_USER(err, "Bad request: Unparsable file name", ERRD_REQUEST);
+        // the successor is waiting for the catalog lock; what is left here is answered from the shared cache or afresh
+        catalog_close(&context->catalog);
+        listener_watch(&context->listener, CONTROL_HANDOFF, 0);
+        listener_drain(&context->listener);
+        close(context->control_fd);
+        context->control_fd = 0;
+        fputs("Handed the listening socket over, finishing the requests already accepted\n", stderr);
     }
-    else if(name[readName - 1] != '\n')
+
+    return WAIT_FOR_REQUEST;
+}
+
+static p101_fsm_state_t serve_metrics(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextd *context;
+    FILE            *out;
+    char            *text;
+    size_t           text_len;
+    int              fd;
+
+    P101_TRACE(env);
+    context = (struct contextd *)ctx;
+    fd      = accept(context->metrics_fd, NULL, NULL);
+
+    enter_state(context, SERVE_METRICS);
+
+    if(fd == -1)
     {
-        P101_ERROR_RAISE_USER(err, "Bad request: Too long/no termination for file name", ERRD_REQUEST);
+        return WAIT_FOR_REQUEST;
     }
-    else if(readData == -1)
+
+    text = NULL;
+    out  = open_memstream(&text, &text_len);
+
+    if(out != NULL)
     {
-        P101_ERROR_RAISE_USER(err, "Bad request: Unparsable file data", ERRD_REQUEST);
+        metrics_write(&context->metrics, &context->listener, out);
+        perf_counters_write(&context->perf, "elfinspectd", state_names, sizeof(state_names) / sizeof(*state_names), out);
+        ALLOC_STATS_WRITE(&context->alloc_stats, out);
+
+        // sent once without waiting, so a scraper that does not read cannot hold up requests
+        if(fclose(out) == 0)
+        {
+            send(fd, text, text_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+
+        free(text);
     }
-    else if(readData == sizeof(data))
+
+    close(fd);
+
+    return WAIT_FOR_REQUEST;
+}
+
+#pragma GCC diagnostic pop
+
+static int open_metrics_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int                fd;
+    int                flags;
+
+    memset(&addr, 0, sizeof(addr));
+
+    if(init_sockaddr_un(&addr, path) == -1)
     {
-        P101_ERROR_RAISE_USER(err, "Bad request: File data too large", ERRD_REQUEST);
+        return -1;
     }
-    else
+
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(fd == -1)
     {
-        name[readName]                 = '\0';
-        context->elf_details.file_name = p101_strdup(env, err, name);
-        context->elf_details.size      = readData;
+        return -1;
+    }
 
-        if(context->elf_details.size < ELF32_HEADER_LEN)
-        {
-            P101_ERROR_RAISE_USER(err, "File data too short to be ELF32", ERRD_ELF);
-        }
-        else
+    flags = fcntl(fd, F_GETFL);
+
+    if(flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOCK_QUEUE) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * A successor starts while its predecessor still holds the catalog, so
+ * it waits up to HANDOFF_TIMEOUT_MS for the predecessor to let go.
+ */
+static int open_catalog(struct contextd *context, bool took_over)
+{
+    struct timespec delay;
+
+    delay.tv_sec  = 0;
+    delay.tv_nsec = CATALOG_RETRY_NS;
+
+    for(size_t waited = 0; catalog_open(&context->catalog, context->arguments->catalog_path) == -1; waited++)
+    {
+        if(!took_over || waited * CATALOG_RETRY_NS >= (size_t)HANDOFF_TIMEOUT_MS * NS_PER_MS)
         {
-            switch(data[CLASS_LOCATION])
-            {
-                case ELFCLASS32:
-                    p101_memcpy(env, &context->elf_details.header.elf_32, data, ELF32_HEADER_LEN);
-                    context->elf_details.class = ELFCLASS32;
-                    break;
-                case ELFCLASS64:
-                    if(context->elf_details.size < ELF64_HEADER_LEN)
-                    {
-                        P101_ERROR_RAISE_USER(err, "File data too short to be ELF64", ERRD_ELF);
-                    }
-                    else
-                    {
-                        p101_memcpy(env, &context->elf_details.header.elf_64, data, ELF64_HEADER_LEN);
-                        context->elf_details.class = ELFCLASS64;
-                    }
-                    break;
-                default:
-                    P101_ERROR_RAISE_USER(err, "Unknown ELF class", ERRD_ELF);
-                    break;
-            }
+            return -1;
         }
+
+        nanosleep(&delay, NULL);
+    }
+
+    return 0;
+}
+
+static p101_fsm_state_t parse_request(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextd      *context;
+    struct listener_conn *conn;
+    p101_fsm_state_t      next_state;
+
+    P101_TRACE(env);
+    context    = (struct contextd *)ctx;
+    conn       = context->conn;
+    next_state = LOOKUP_RESULT;
+
+    enter_state(context, PARSE_REQUEST);
+
+    if(conn->error != NULL)
+    {
+        P101_ERROR_RAISE_USER(err, conn->error, ERRD_REQUEST);
+    }
+    else
+    {
+        // only the header is inspected, whatever else was sent only counts towards the size limit
+        context->file_name  = counted_strdup(context, ALLOC_SITE, env, err, conn->name);
+        context->header_len = conn->header_len;
+        p101_memcpy(env, context->header, conn->header, conn->header_len);
+        context->content_key = content_key(conn->header, conn->header_len);
     }
 
-    if(p101_error_is_error(err, P101_ERROR_USER, ERRD_REQUEST) || p101_error_is_error(err, P101_ERROR_USER, ERRD_ELF))
+    if(p101_error_is_error(err, P101_ERROR_USER, ERRD_REQUEST))
     {
         next_state = RESPOND;
     }
@@ -420,121 +810,214 @@ static p101_fsm_state_t parse_request(const struct p101_env *env, struct p101_er
     return next_state;
 }
 
-static p101_fsm_state_t verify_elf_header(const struct p101_env *env, struct p101_error *err, void *ctx)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static p101_fsm_state_t lookup_result(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
     struct contextd *context;
-    elf_ident        ident;
-    uint16_t         type;
-    uint16_t         machine;
-    uint64_t         entry;
-    char             address[MAX_ELF_ADDRESS_CHARS];
+    uint64_t         started;
 
     P101_TRACE(env);
     context = (struct contextd *)ctx;
+    started = histogram_now_ns();
+
+    enter_state(context, LOOKUP_RESULT);
 
-    if(context->elf_details.class == ELFCLASS32)
+    context->lookup_ns = started;
+
+    // the shared cache is cheapest, the catalog remembers results across restarts
+    if(context->shm_cache.header != NULL && shm_cache_get(&context->shm_cache, context->content_key, context->header, context->header_len, &context->result) == 0)
     {
-        ident   = context->elf_details.header.elf_32.e_ident;
-        type    = context->elf_details.header.elf_32.e_type;
-        machine = context->elf_details.header.elf_32.e_machine;
-        entry   = context->elf_details.header.elf_32.e_entry;
+        context->result_found = true;
+        metrics_count(&context->metrics, METRICS_SHM_HIT);
     }
-    else
+    else if(context->catalog.index != NULL && catalog_get(&context->catalog, context->content_key, context->header, context->header_len, &context->result) == 0)
     {
-        ident   = context->elf_details.header.elf_64.e_ident;
-        type    = context->elf_details.header.elf_64.e_type;
-        machine = context->elf_details.header.elf_64.e_machine;
-        entry   = context->elf_details.header.elf_64.e_entry;
+        context->result_found = true;
+        metrics_count(&context->metrics, METRICS_CATALOG_HIT);
+
+        if(context->shm_cache.header != NULL)
+        {
+            shm_cache_put(&context->shm_cache, context->content_key, context->header, context->header_len, &context->result);
+        }
     }
 
-    if((determine_endianness() && verify_data(ident.ei_data, NULL) == ELFDATA2MSB) || (!determine_endianness() && verify_data(type, NULL) == ELFDATA2LSB))
+    metrics_record(&context->metrics, METRICS_LOOKUP, histogram_now_ns() - started);
+
+    if(!context->result_found)
     {
-        byte_swap(&type, sizeof(type));
-        byte_swap(&machine, sizeof(machine));
-        byte_swap(&entry, sizeof(entry));
+        return VERIFY_ELF_HEADER;
     }
 
-    if(verify_magic(ident.ei_mag, NULL) == -1)
+    return RESPOND;
+}
+
+static p101_fsm_state_t verify_elf_header(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextd *context;
+    uint64_t         started;
+
+    P101_TRACE(env);
+    context = (struct contextd *)ctx;
+    started = histogram_now_ns();
+
+    enter_state(context, VERIFY_ELF_HEADER);
+
+    // a result that is not a valid ELF file is an answer too, so it is remembered the same way
+    elf_inspect_buffer(context->header, context->header_len, &context->result);
+
+    if(context->shm_cache.header != NULL)
     {
-        P101_ERROR_RAISE_USER(err, "Bad magic number", ERRD_ELF);
+        shm_cache_put(&context->shm_cache, context->content_key, context->header, context->header_len, &context->result);
     }
-    else
-    {
-        struct verification_set sets[] = {
-            {verify_class,   ident.ei_class,   &context->elf_details.class_name  },
-            {verify_data,    ident.ei_data,    &context->elf_details.data_name   },
-            {verify_version, ident.ei_version, NULL                              },
-            {verify_type,    type,             &context->elf_details.type_name   },
-            {verify_machine, machine,          &context->elf_details.machine_name},
-        };
 
-        for(size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++)
-        {
-            char msg[MAX_VALIDATION_MSG];
-            if(sets[i].verifier(sets[i].input, msg) == -1)
-            {
-                P101_ERROR_RAISE_USER(err, msg, ERRD_ELF);
-                break;
-            }
-            if(sets[i].buf != NULL)
-            {
-                *sets[i].buf = p101_strdup(env, err, msg);
-            }
-        }
+    if(context->catalog.index != NULL && catalog_put(&context->catalog, context->content_key, context->header, context->header_len, &context->result) == -1)
+    {
+        fputs("Failed to append to the result catalog\n", stderr);
     }
 
-    sprintf(address, "%#lx", entry);
-    context->elf_details.entry_point = p101_strdup(env, err, address);
+    metrics_count(&context->metrics, METRICS_INSPECTED);
+    metrics_record(&context->metrics, METRICS_INSPECT, histogram_now_ns() - started);
 
     return RESPOND;
 }
 
+#pragma GCC diagnostic pop
+
 static p101_fsm_state_t respond(const struct p101_env *env, struct p101_error *err, void *ctx)
 {
     struct contextd *context;
+    uint64_t         started;
 
     P101_TRACE(env);
     context = (struct contextd *)ctx;
+    started = histogram_now_ns();
+
+    enter_state(context, RESPOND);
 
     if(p101_error_is_error(err, P101_ERROR_USER, ERRD_REQUEST))
     {
         const char *msg;
         msg = p101_error_get_message(err);
         safe_write(context->request_fd, msg, p101_strlen(env, msg));
-    }
-    else if(p101_error_is_error(err, P101_ERROR_USER, ERRD_ELF))
-    {
-        char msg[RESPONSE_MSG_LEN];
-        snprintf(msg, sizeof(msg), "File: %sValid ELF: no\nError: %s\n", context->elf_details.file_name, p101_error_get_message(err));
-        safe_write(context->request_fd, msg, p101_strlen(env, msg));
+        metrics_count(&context->metrics, METRICS_BAD_REQUEST);
+
+        if(PROBE_ENABLED(elfinspectd, response_written))
+        {
+            PROBE3(elfinspectd, response_written, context->conn->name, p101_strlen(env, msg), histogram_now_ns() - context->conn->accepted_ns);
+        }
     }
     else
     {
-        char msg[RESPONSE_MSG_LEN];
-        snprintf(msg,
-                 sizeof(msg),
-                 "File: %sValid ELF: yes\nClass: %s\nEndianness: %s\nType: %s\nMachine: %s\nEntry point: %s",
-                 context->elf_details.file_name,
-                 context->elf_details.class_name,
-                 context->elf_details.data_name,
-                 context->elf_details.type_name,
-                 context->elf_details.machine_name,
-                 context->elf_details.entry_point);
-        safe_write(context->request_fd, msg, p101_strlen(env, msg));
+        char msg[ELF_INSPECT_RESPONSE_LEN];
+        int  msg_len;
+
+        PROBE5(elfinspectd, validated, context->file_name, context->result.valid, context->result.class, context->result.machine, started - context->lookup_ns);
+        msg_len = elf_inspect_format(context->file_name, &context->result, msg, sizeof(msg));
+
+        if(msg_len > 0)
+        {
+            safe_write(context->request_fd, msg, (size_t)msg_len);
+
+            if(PROBE_ENABLED(elfinspectd, response_written))
+            {
+                PROBE3(elfinspectd, response_written, context->file_name, (size_t)msg_len, histogram_now_ns() - context->conn->accepted_ns);
+            }
+        }
+
+        metrics_count(&context->metrics, context->result.valid ? METRICS_ELF : METRICS_NOT_ELF);
     }
 
     if(socket_close)
     {
-        fputs("Client socket closed, did not send response", stderr);
+        fputs("Client socket closed, did not send response\n", stderr);
         socket_close = 0;
+        metrics_count(&context->metrics, METRICS_CLIENT_GONE);
     }
 
+    context->respond_ns   = started;
+    context->responded_ns = histogram_now_ns();
+    metrics_record(&context->metrics, METRICS_RESPOND, context->responded_ns - started);
+
     shutdown(context->request_fd, SHUT_RDWR);
     p101_error_reset(err);
 
     return CLEANUP_RESPONSE;
 }
 
+/*
+ * Every timestamp a request collected on its way through is written out
+ * at once, if it was sampled, so unsampled requests cost nothing more
+ * than the timestamps metrics already takes. A name or body that never
+ * arrived and a bad request that was never looked up leave their spans
+ * out.
+ */
+static void trace_request(struct contextd *context)
+{
+    const struct listener_conn *conn;
+    uint64_t                    id;
+
+    conn = context->conn;
+
+    if(!trace_sample(&context->trace, conn->name, &id))
+    {
+        return;
+    }
+
+    trace_span(&context->trace, id, "request", conn->accepted_ns, histogram_now_ns(), conn->name);
+    trace_span(&context->trace, id, "accept", conn->accepted_ns, conn->accepted_ns, NULL);
+
+    if(conn->named_ns != 0)
+    {
+        trace_span(&context->trace, id, "read_name", conn->accepted_ns, conn->named_ns, NULL);
+        trace_span(&context->trace, id, "read_body", conn->named_ns, conn->read_ns, NULL);
+    }
+
+    trace_span(&context->trace, id, "queue", conn->read_ns, context->handed_ns, NULL);
+
+    if(context->lookup_ns != 0)
+    {
+        trace_span(&context->trace, id, "validate", context->lookup_ns, context->respond_ns, NULL);
+    }
+
+    trace_span(&context->trace, id, "respond", context->respond_ns, context->responded_ns, NULL);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+/*
+ * The allocations made while serving go through these two, so
+ * ALLOC_STATS builds can count them. Everything the daemon allocates
+ * per request is a string, which gives the size again when it is freed.
+ */
+static char *counted_strdup(struct contextd *context, struct alloc_site site, const struct p101_env *env, struct p101_error *err, const char *str)
+{
+    char *copy;
+
+    copy = p101_strdup(env, err, str);
+
+    if(copy != NULL)
+    {
+        ALLOC_STATS_ALLOCATED(&context->alloc_stats, site, strlen(copy) + 1);
+    }
+
+    return copy;
+}
+
+static void counted_free(struct contextd *context, const struct p101_env *env, char **buf)
+{
+    if(*buf != NULL)
+    {
+        ALLOC_STATS_FREED(&context->alloc_stats, strlen(*buf) + 1);
+    }
+
+    free_if_not_null(env, buf);
+}
+
+#pragma GCC diagnostic pop
+
 void free_if_not_null(const struct p101_env *env, char **buf)
 {
     if(*buf != NULL)
@@ -553,18 +1036,24 @@ static p101_fsm_state_t cleanup_response(const struct p101_env *env, struct p101
     context    = (struct contextd *)ctx;
     next_state = WAIT_FOR_REQUEST;
 
-    free_if_not_null(env, &context->response_message);
-    free_if_not_null(env, &context->elf_details.file_name);
-    free_if_not_null(env, &context->elf_details.class_name);
-    free_if_not_null(env, &context->elf_details.data_name);
-    free_if_not_null(env, &context->elf_details.type_name);
-    free_if_not_null(env, &context->elf_details.machine_name);
-    free_if_not_null(env, &context->elf_details.entry_point);
-    free_if_not_null(env, &context->elf_details.error);
-    p101_memset(env, &context->elf_details, 0, sizeof(context->elf_details));
-
-    p101_close(env, err, context->request_fd);
+    enter_state(context, CLEANUP_RESPONSE);
+
+    trace_request(context);
+    counted_free(context, env, &context->file_name);
+    ALLOC_STATS_REQUEST(&context->alloc_stats);
+    context->header_len   = 0;
+    context->result_found = false;
+    context->lookup_ns    = 0;
+
+    listener_release(&context->listener, context->conn);
+    context->conn       = NULL;
     context->request_fd = 0;
+    metrics_record(&context->metrics, METRICS_SERVICE, histogram_now_ns() - context->handed_ns);
+
+    if(catalog_maintain(&context->catalog) == -1)
+    {
+        fputs("Failed to reopen the result catalog after compaction, carrying on with the old files\n", stderr);
+    }
 
     if(p101_error_has_error(err))
     {
@@ -581,6 +1070,8 @@ static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err
     P101_TRACE(env);
     context = (struct contextd *)ctx;
 
+    enter_state(context, USAGE);
+
     if(p101_error_has_error(err))
     {
         const char *msg;
@@ -596,9 +1087,29 @@ static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err
         context->exit_code = EXIT_FAILURE;
     }
 
-    fprintf(stderr, "Usage: %s [-h] <socket-path>\n", context->arguments->program_name);
+    fprintf(stderr, "Usage: %s [-h] [-s <cache-path>] [-n <cache-slots>] [-c <catalog-path>] [-u <control-path>] [-S <metrics-path>] [-X <trace-path> [-x <one-in>]] [-P] [-H <ms>] [-B <ms>] [-T <ms>] [-m <connections>] [-M <bytes>] [-q <backlog>] [-r <per-second> [-b <burst>]] <socket-path>\n", context->arguments->program_name);
     fputs("Options:\n", stderr);
     fputs(" -h Display this help message\n", stderr);
+    fputs(" -s Share results with other daemons through the cache file at this path (e.g. under /dev/shm)\n", stderr);
+    fputs(" -n Number of records when creating the cache file (default 65536)\n", stderr);
+    fputs(" -c Keep results across restarts in the catalog at this path (index at <catalog-path>.idx)\n", stderr);
+    fputs(" -u Take the socket over from the daemon on this control socket, if one runs, and hand it to the next one the same way\n", stderr);
+    fputs(" -S Serve metrics in the Prometheus text format to each client of a socket at this path\n", stderr);
+    fputs(" -X Write a span for each stage of sampled requests to this file in the Trace Event JSON format Perfetto opens\n", stderr);
+    fputs(" -x Trace one request in this many, picked by file name so elfinspect -x picks the same ones (default 64)\n", stderr);
+    fputs(" -P Count cycles, instructions, cache misses and branch misses in each state with perf_event_open, served with the metrics\n", stderr);
+    fputs(" -H Milliseconds a client has to send the file name line after connecting (default 2000)\n", stderr);
+    fputs(" -B Milliseconds a client has to send the file data after the name line (default 5000)\n", stderr);
+    fputs(" -T Milliseconds a client has to send the whole request (default 10000)\n", stderr);
+    fputs(" -m Requests to read at once; clients beyond that are told to retry (default 1024)\n", stderr);
+    fputs(" -M Bytes of file names and headers to hold at once; clients beyond that are told to retry (default 262144)\n", stderr);
+    fputs(" -q Connections the kernel queues before the daemon accepts them (default 5)\n", stderr);
+    fputs(" -r Requests a second each user may send; clients beyond that are told to retry (default unlimited)\n", stderr);
+    fputs(" -b Requests each user may send at once before -r applies (default 32)\n", stderr);
+    fputs("A listening socket passed in under the LISTEN_FDS convention is served instead of binding <socket-path>\n", stderr);
+    fputs("SIGUSR1 writes the same metrics to stderr\n", stderr);
+    fputs("Requests from different users take turns, so one user's mass scan does not hold up the others\n", stderr);
+    fputs("Requests whose client has given up, by hanging up or by the time budget it sent, are dropped unanswered\n", stderr);
 
     return CLEANUP_PROGRAM;
 }
@@ -610,6 +1121,8 @@ static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_
     P101_TRACE(env);
     context = (struct contextd *)ctx;
 
+    enter_state(context, CLEANUP_PROGRAM);
+
     if(p101_error_has_error(err))
     {
         const char *msg;
@@ -625,28 +1138,57 @@ static p101_fsm_state_t cleanup_program(const struct p101_env *env, struct p101_
         context->exit_code = EXIT_FAILURE;
     }
 
-    free_if_not_null(env, &context->response_message);
-    free_if_not_null(env, &context->elf_details.file_name);
-    free_if_not_null(env, &context->elf_details.class_name);
-    free_if_not_null(env, &context->elf_details.data_name);
-    free_if_not_null(env, &context->elf_details.type_name);
-    free_if_not_null(env, &context->elf_details.machine_name);
-    free_if_not_null(env, &context->elf_details.entry_point);
-    free_if_not_null(env, &context->elf_details.error);
-
-    p101_memset(env, &context->elf_details, 0, sizeof(context->elf_details));
+    counted_free(context, env, &context->file_name);
 
-    if(context->request_fd != 0)
+    if(context->conn != NULL)
     {
-        p101_close(env, err, context->request_fd);
+        listener_release(&context->listener, context->conn);
+        context->conn       = NULL;
         context->request_fd = 0;
     }
+
+    if(context->listener.accepted != 0 || context->listener.busy != 0 || context->listener.limited != 0)
+    {
+        fprintf(stderr,
+                "Accepted %" PRIu64 " connections and turned %" PRIu64 " away busy and %" PRIu64 " over their rate, cut off %" PRIu64 " past the header deadline, %" PRIu64 " past the body deadline and %" PRIu64 " past the total deadline, and dropped %" PRIu64 " whose clients had given up\n",
+                context->listener.accepted,
+                context->listener.busy,
+                context->listener.limited,
+                context->listener.header_timeouts,
+                context->listener.body_timeouts,
+                context->listener.total_timeouts,
+                context->listener.abandoned);
+    }
+
+    ALLOC_STATS_SUMMARY(&context->alloc_stats, stderr);
+    FSM_TIMING_WRITE(&context->fsm_timing, state_names, stderr);
+    listener_close(&context->listener);
+
+    // still set only if the socket was never handed over, so the path is still this daemon's
+    if(context->control_fd != 0)
+    {
+        close(context->control_fd);
+        unlink(context->arguments->control_path);
+        context->control_fd = 0;
+    }
+
+    if(context->metrics_fd != 0)
+    {
+        close(context->metrics_fd);
+        context->metrics_fd = 0;
+    }
+
     if(context->socket_fd != 0)
     {
         p101_close(env, err, context->socket_fd);
         context->socket_fd = 0;
     }
 
+    shm_cache_close(&context->shm_cache);
+    catalog_close(&context->catalog);
+    trace_close(&context->trace);
+    perf_counters_close(&context->perf);
+
     if(p101_error_has_error(err))
     {
         fputs(p101_error_get_message(err), stderr);
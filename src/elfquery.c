@@ -0,0 +1,499 @@
+#include "argumentsq.h"
+#include "columnar.h"
+#include "contextq.h"
+#include "elf_validator.h"
+#include "errorsq.h"
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <p101_c/p101_stdlib.h>
+#include <p101_c/p101_string.h>
+#include <p101_fsm/fsm.h>
+#include <p101_posix/p101_unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum states
+{
+    PARSE_ARGS = P101_FSM_USER_START,
+    HANDLE_ARGS,
+    USAGE,
+    EXPORT,
+    QUERY,
+    CLEANUP,
+};
+
+static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t export_columns(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t query_columns(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx);
+static p101_fsm_state_t cleanup(const struct p101_env *env, struct p101_error *err, void *ctx);
+static int              parse_filter(char *arg, struct columnar_filter *filter);
+static int              parse_groups(char *arg, struct columnar_query *query);
+static double           elapsed_ms(const struct timespec *start);
+static void             print_value(enum column column, uint64_t value);
+
+#define ERR_MSG_LEN 256           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MS_PER_SEC 1000.0         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_MS 1000000.0       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FILTER_SEPARATOR '='
+#define GROUP_SEPARATOR ','
+
+int main(int argc, char *argv[])
+{
+    static struct p101_fsm_transition transitions[] = {
+        {P101_FSM_INIT, PARSE_ARGS,    parse_arguments },
+        {PARSE_ARGS,    USAGE,         usage           },
+        {PARSE_ARGS,    HANDLE_ARGS,   handle_arguments},
+        {HANDLE_ARGS,   CLEANUP,       cleanup         },
+        {HANDLE_ARGS,   EXPORT,        export_columns  },
+        {HANDLE_ARGS,   QUERY,         query_columns   },
+        {USAGE,         CLEANUP,       cleanup         },
+        {EXPORT,        CLEANUP,       cleanup         },
+        {QUERY,         CLEANUP,       cleanup         },
+        {CLEANUP,       P101_FSM_EXIT, NULL            }
+    };
+
+    struct p101_error    *err;
+    struct p101_env      *env;
+    struct p101_fsm_info *fsm;
+    p101_fsm_state_t      from_state;
+    p101_fsm_state_t      to_state;
+    struct p101_error    *fsm_err;
+    struct p101_env      *fsm_env;
+    struct argumentsq     args;
+    struct contextq       ctx;
+
+    err = p101_error_create(false);
+
+    if(err == NULL)
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto done;
+    }
+
+    env = p101_env_create(err, true, NULL);
+
+    if(p101_error_has_error(err))
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_error;
+    }
+
+    fsm_err = p101_error_create(false);
+
+    if(fsm_err == NULL)
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    fsm_env = p101_env_create(err, true, NULL);
+
+    if(p101_error_has_error(err))
+    {
+        ctx.exit_code = EXIT_FAILURE;
+        goto free_fsm_error;
+    }
+
+    p101_memset(env, &args, 0, sizeof(args));
+    p101_memset(env, &ctx, 0, sizeof(ctx));
+    ctx.arguments       = &args;
+    ctx.arguments->argc = argc;
+    ctx.arguments->argv = argv;
+    ctx.exit_code       = EXIT_SUCCESS;
+
+    fsm = p101_fsm_info_create(env, err, "elf-query-fsm", fsm_env, fsm_err, NULL);
+
+    p101_fsm_run(fsm, &from_state, &to_state, &ctx, transitions, sizeof(transitions));
+    p101_fsm_info_destroy(env, &fsm);
+
+    free(fsm_env);
+
+free_fsm_error:
+    p101_error_reset(fsm_err);
+    p101_free(env, fsm_err);
+
+free_env:
+    p101_free(env, env);
+
+free_error:
+    p101_error_reset(err);
+    free(err);
+
+done:
+    return ctx.exit_code;
+}
+
+static int parse_filter(char *arg, struct columnar_filter *filter)
+{
+    char              *separator;
+    char              *end;
+    unsigned long long value;
+
+    separator = strchr(arg, FILTER_SEPARATOR);
+
+    // strtoull would skip spaces and quietly negate a minus sign
+    if(separator == NULL || isdigit((unsigned char)separator[1]) == 0)
+    {
+        return -1;
+    }
+
+    *separator = '\0';
+
+    if(columnar_column_by_name(arg, &filter->column) == -1)
+    {
+        return -1;
+    }
+
+    errno = 0;
+    value = strtoull(separator + 1, &end, 0);
+
+    if(errno != 0 || *end != '\0' || value > columnar_column_max(filter->column))
+    {
+        return -1;
+    }
+
+    filter->value = (uint64_t)value;
+    return 0;
+}
+
+static int parse_groups(char *arg, struct columnar_query *query)
+{
+    char *name;
+    char *separator;
+
+    query->group_count = 0;
+    name               = arg;
+
+    while(name != NULL)
+    {
+        separator = strchr(name, GROUP_SEPARATOR);
+
+        if(separator != NULL)
+        {
+            *separator = '\0';
+        }
+
+        if(query->group_count == COLUMNAR_MAX_GROUPS || columnar_column_by_name(name, &query->groups[query->group_count]) == -1)
+        {
+            return -1;
+        }
+
+        query->group_count++;
+        name = separator == NULL ? NULL : separator + 1;
+    }
+
+    return 0;
+}
+
+static p101_fsm_state_t parse_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextq *context;
+    p101_fsm_state_t next_state;
+    int              opt;
+
+    P101_TRACE(env);
+    context                          = (struct contextq *)ctx;
+    context->arguments->program_name = context->arguments->argv[0];
+    next_state                       = HANDLE_ARGS;
+    opterr                           = 0;
+
+    while((opt = p101_getopt(env, context->arguments->argc, context->arguments->argv, "he:w:g:")) != -1 && p101_error_has_no_error(err))
+    {
+        switch(opt)
+        {
+            case 'h':
+            {
+                next_state = USAGE;
+                break;
+            }
+            case 'e':
+            {
+                context->arguments->catalog_path = optarg;
+                break;
+            }
+            case 'w':
+            {
+                struct columnar_query *query;
+
+                query = &context->arguments->query;
+
+                if(query->filter_count == COLUMNAR_MAX_FILTERS)
+                {
+                    P101_ERROR_RAISE_USER(err, "Too many filters", ERRQ_USAGE);
+                }
+                else if(parse_filter(optarg, &query->filters[query->filter_count]) == -1)
+                {
+                    P101_ERROR_RAISE_USER(err, "Filters must look like <column>=<number>, with the number in the column's range", ERRQ_USAGE);
+                }
+                else
+                {
+                    query->filter_count++;
+                }
+                break;
+            }
+            case 'g':
+            {
+                if(parse_groups(optarg, &context->arguments->query) == -1)
+                {
+                    P101_ERROR_RAISE_USER(err, "Group by takes one or two column names separated by a comma", ERRQ_USAGE);
+                }
+                break;
+            }
+            case '?':
+            {
+                char msg[ERR_MSG_LEN];
+
+                if(optopt == 'e' || optopt == 'w' || optopt == 'g')
+                {
+                    snprintf(msg, sizeof msg, "Option '-%c' requires an argument.", optopt);
+                }
+                else if(isprint(optopt))
+                {
+                    snprintf(msg, sizeof msg, "Unknown option '-%c'.", optopt);
+                }
+                else
+                {
+                    snprintf(msg, sizeof msg, "Unknown option character 0x%02X.", (unsigned)(unsigned char)optopt);
+                }
+
+                P101_ERROR_RAISE_USER(err, msg, ERRQ_USAGE);
+                break;
+            }
+            default:
+            {
+                P101_ERROR_RAISE_USER(err, "Unknown getopt failure", ERRQ_USAGE);
+                break;
+            }
+        }
+    }
+
+    if(p101_error_has_no_error(err) && next_state != USAGE)
+    {
+        if(context->arguments->argc - optind != 1)
+        {
+            P101_ERROR_RAISE_USER(err, "Incorrect number of arguments", ERRQ_USAGE);
+        }
+        else if(context->arguments->catalog_path != NULL && (context->arguments->query.filter_count != 0 || context->arguments->query.group_count != 0))
+        {
+            P101_ERROR_RAISE_USER(err, "Filters and groups do not apply to an export", ERRQ_USAGE);
+        }
+        else
+        {
+            context->arguments->columns_path = context->arguments->argv[optind];
+        }
+    }
+
+    if(p101_error_has_error(err))
+    {
+        next_state = USAGE;
+    }
+
+    return next_state;
+}
+
+static p101_fsm_state_t handle_arguments(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextq *context;
+
+    P101_TRACE(env);
+    context = (struct contextq *)ctx;
+
+    if(context->arguments->catalog_path != NULL)
+    {
+        if(catalog_open_snapshot(&context->catalog, context->arguments->catalog_path) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "Failed to open the catalog", ERRQ_CATALOG);
+            return CLEANUP;
+        }
+
+        return EXPORT;
+    }
+
+    if(columnar_open(&context->table, context->arguments->columns_path) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to open the columns file", ERRQ_COLUMNS);
+        return CLEANUP;
+    }
+
+    return QUERY;
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)(now.tv_sec - start->tv_sec) * MS_PER_SEC) + ((double)(now.tv_nsec - start->tv_nsec) / NS_PER_MS);
+}
+
+static p101_fsm_state_t export_columns(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextq *context;
+    struct timespec  start;
+    int64_t          rows;
+
+    P101_TRACE(env);
+    context = (struct contextq *)ctx;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    rows = columnar_export(&context->catalog, context->arguments->columns_path);
+
+    if(rows == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Failed to write the columns file", ERRQ_COLUMNS);
+    }
+    else
+    {
+        fprintf(stderr, "Exported %" PRId64 " rows in %.3f ms\n", rows, elapsed_ms(&start));
+    }
+
+    return CLEANUP;
+}
+
+static void print_value(enum column column, uint64_t value)
+{
+    char name[MAX_VALIDATION_MSG];
+
+    name[0] = '\0';
+
+    switch(column)
+    {
+        case COLUMN_CLASS:
+            verify_class(value, name);
+            break;
+        case COLUMN_DATA:
+            verify_data(value, name);
+            break;
+        case COLUMN_TYPE:
+            verify_type(value, name);
+            break;
+        case COLUMN_MACHINE:
+            verify_machine(value, name);
+            break;
+        case COLUMN_ENTRY:
+        case COLUMN_FLAGS:
+            printf("\t%s=0x%" PRIx64, columnar_column_name(column), value);
+            return;
+        default:
+            break;
+    }
+
+    printf("\t%s=%" PRIu64, columnar_column_name(column), value);
+
+    if(name[0] != '\0')
+    {
+        printf(" (%s)", name);
+    }
+}
+
+static p101_fsm_state_t query_columns(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextq             *context;
+    const struct columnar_query *query;
+    struct timespec              start;
+    double                       ms;
+
+    P101_TRACE(env);
+    context = (struct contextq *)ctx;
+    query   = &context->arguments->query;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(columnar_run(&context->table, query, &context->result) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "Out of memory running the query", ERRQ_COLUMNS);
+        return CLEANUP;
+    }
+
+    ms = elapsed_ms(&start);
+
+    if(query->group_count == 0)
+    {
+        printf("%" PRIu64 "\n", context->result.matched);
+    }
+
+    for(size_t i = 0; i < context->result.group_count; i++)
+    {
+        printf("%" PRIu64, context->result.groups[i].count);
+
+        for(size_t g = 0; g < query->group_count; g++)
+        {
+            print_value(query->groups[g], context->result.groups[i].values[g]);
+        }
+
+        putchar('\n');
+    }
+
+    fprintf(stderr, "Scanned %" PRIu64 " rows, matched %" PRIu64 " in %.3f ms\n", context->result.scanned, context->result.matched, ms);
+
+    return CLEANUP;
+}
+
+static p101_fsm_state_t usage(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextq *context;
+
+    P101_TRACE(env);
+    context = (struct contextq *)ctx;
+
+    if(p101_error_has_error(err))
+    {
+        const char *msg;
+        msg = p101_error_get_message(err);
+
+        if(msg != NULL)
+        {
+            fputs(msg, stderr);
+            fputc('\n', stderr);
+        }
+
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Usage: %s [-h] -e <catalog-path> <columns-path>\n", context->arguments->program_name);
+    fprintf(stderr, "       %s [-h] [-w <column>=<number>]... [-g <column>[,<column>]] <columns-path>\n", context->arguments->program_name);
+    fputs("Options:\n", stderr);
+    fputs(" -h Display this help message\n", stderr);
+    fputs(" -e Export the catalog to a columns file\n", stderr);
+    fputs(" -w Only count rows where the column equals the number (repeatable, all must match)\n", stderr);
+    fputs(" -g Count per distinct value of one or two columns\n", stderr);
+    fputs("Columns: valid, class, data, type, machine, flags, entry\n", stderr);
+
+    return CLEANUP;
+}
+
+static p101_fsm_state_t cleanup(const struct p101_env *env, struct p101_error *err, void *ctx)
+{
+    struct contextq *context;
+
+    P101_TRACE(env);
+    context = (struct contextq *)ctx;
+
+    if(p101_error_has_error(err))
+    {
+        const char *msg;
+        msg = p101_error_get_message(err);
+
+        if(msg != NULL)
+        {
+            fputs(msg, stderr);
+            fputc('\n', stderr);
+        }
+
+        p101_error_reset(err);
+        context->exit_code = EXIT_FAILURE;
+    }
+
+    columnar_result_free(&context->result);
+    columnar_close(&context->table);
+    catalog_close(&context->catalog);
+
+    return P101_FSM_EXIT;
+}
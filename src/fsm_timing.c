@@ -0,0 +1,57 @@
+#include "fsm_timing.h"
+#include <inttypes.h>
+
+#define NS_PER_US 1000.0    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MEDIAN 0.5          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TAIL 0.99           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+void fsm_timing_enter(struct fsm_timing *timing, int state)
+{
+    uint64_t now;
+
+    now = histogram_now_ns();
+
+    // the first state has nothing before it to close
+    if(timing->entered_ns != 0 && timing->current >= 0 && timing->current < FSM_TIMING_STATES)
+    {
+        histogram_record(&timing->states[timing->current], now - timing->entered_ns);
+    }
+
+    timing->current    = state;
+    timing->entered_ns = now;
+}
+
+void fsm_timing_write(const struct fsm_timing *timing, const char *const names[], size_t name_count, FILE *out)
+{
+    fprintf(out, "%-20s %10s %12s %10s %10s %10s %10s\n", "State (us)", "count", "total", "mean", "p50", "p99", "max");
+
+    for(size_t state = 0; state < FSM_TIMING_STATES; state++)
+    {
+        const struct histogram *histogram;
+
+        histogram = &timing->states[state];
+
+        if(histogram->count == 0)
+        {
+            continue;
+        }
+
+        if(state < name_count && names[state] != NULL)
+        {
+            fprintf(out, "%-20s", names[state]);
+        }
+        else
+        {
+            fprintf(out, "%-20zu", state);
+        }
+
+        fprintf(out,
+                " %10" PRIu64 " %12.1f %10.1f %10.1f %10.1f %10.1f\n",
+                histogram->count,
+                (double)histogram->sum_ns / NS_PER_US,
+                (double)histogram->sum_ns / (double)histogram->count / NS_PER_US,
+                (double)histogram_quantile(histogram, MEDIAN) / NS_PER_US,
+                (double)histogram_quantile(histogram, TAIL) / NS_PER_US,
+                (double)histogram->max_ns / NS_PER_US);
+    }
+}
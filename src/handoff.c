@@ -0,0 +1,236 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) struct ucred for SO_PEERCRED
+#endif
+
+#include "handoff.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MS_PER_SEC 1000    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define US_PER_MS 1000     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static int  set_timeout(int fd);
+static bool same_user(int fd);
+
+static int set_timeout(int fd)
+{
+    struct timeval timeout;
+
+    timeout.tv_sec  = HANDOFF_TIMEOUT_MS / MS_PER_SEC;
+    timeout.tv_usec = (HANDOFF_TIMEOUT_MS % MS_PER_SEC) * US_PER_MS;
+
+    if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+#if defined(__linux__)
+
+static bool same_user(int fd)
+{
+    struct ucred cred;
+    socklen_t    len;
+
+    len = sizeof(cred);
+
+    if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+    {
+        return false;
+    }
+
+    return cred.uid == geteuid();
+}
+
+#else
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wunused-parameter"
+
+// without peer credentials the mode of the control socket is the only check
+static bool same_user(int fd)
+{
+    return true;
+}
+
+    #pragma GCC diagnostic pop
+
+#endif
+
+int handoff_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int                fd;
+
+    memset(&addr, 0, sizeof(addr));
+
+    if(init_sockaddr_un(&addr, path) == -1)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    // non-blocking, so a successor that hung up between poll and accept cannot stall the daemon
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    unlink(path);
+
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || chmod(path, S_IRUSR | S_IWUSR) == -1 || listen(fd, 1) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int handoff_take(const char *path)
+{
+    struct sockaddr_un addr;
+    struct msghdr      msg;
+    struct iovec       iov;
+    struct cmsghdr    *cmsg;
+    char               tag;
+    int                fd;
+    int                socket_fd;
+    int                saved;
+
+    union
+    {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    memset(&addr, 0, sizeof(addr));
+
+    if(init_sockaddr_un(&addr, path) == -1)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    if(set_timeout(fd) == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base       = &tag;
+    iov.iov_len        = 1;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    socket_fd          = -1;
+
+    if(recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) == 1 && tag == HANDOFF_GIVE)
+    {
+        cmsg = CMSG_FIRSTHDR(&msg);
+
+        if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+        {
+            memcpy(&socket_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    // the old daemon keeps accepting until it hears the socket arrived
+    tag = HANDOFF_ACK;
+
+    if(socket_fd == -1 || send(fd, &tag, 1, MSG_NOSIGNAL) != 1)
+    {
+        saved = socket_fd == -1 ? EPROTO : errno;
+
+        if(socket_fd != -1)
+        {
+            close(socket_fd);
+        }
+
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    close(fd);
+
+    return socket_fd;
+}
+
+int handoff_give(int control_fd, int socket_fd)
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *cmsg;
+    char            tag;
+    int             fd;
+    int             result;
+
+    union
+    {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    fd = accept(control_fd, NULL, NULL);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    if(fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 || set_timeout(fd) == -1 || !same_user(fd))
+    {
+        close(fd);
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    tag                = HANDOFF_GIVE;
+    iov.iov_base       = &tag;
+    iov.iov_len        = 1;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg               = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level   = SOL_SOCKET;
+    cmsg->cmsg_type    = SCM_RIGHTS;
+    cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &socket_fd, sizeof(int));
+    result = -1;
+
+    if(sendmsg(fd, &msg, MSG_NOSIGNAL) == 1 && read(fd, &tag, 1) == 1 && tag == HANDOFF_ACK)
+    {
+        result = 0;
+    }
+
+    close(fd);
+
+    return result;
+}
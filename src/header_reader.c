@@ -0,0 +1,646 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) syscall() for io_uring, AT_EMPTY_PATH for statx
+#endif
+
+#include "header_reader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HEADER_READER_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/sysmacros.h>
+#endif
+
+#define OPEN_FAILED_MSG "Failed to open ELF file"
+#define NOT_REGULAR_MSG "ELF file is not a regular file"
+#define READ_FAILED_MSG "Failed to read ELF file"
+
+static void finish_read(struct header_reader *reader, size_t index);
+static void read_header(struct header_read *read);
+static void read_open_file(struct header_read *read, int fd);
+
+#ifdef HEADER_READER_URING
+
+    #define OP_BITS 2          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define OP_MASK 3U         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define SQ_PER_FILE 2      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define SQ_PER_SLOT 2      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum ring_op
+{
+    RING_OPEN,
+    RING_STATX,
+    RING_READ,
+    RING_CLOSE,
+};
+
+struct header_ring
+{
+    int                  fd;
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned             sq_entries;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *sqes;
+    void                *sq_map;
+    size_t               sq_map_len;
+    void                *cq_map;
+    size_t               cq_map_len;
+    size_t               sqe_map_len;
+    unsigned             to_submit;
+};
+
+static struct header_ring  *ring_create(size_t depth);
+static void                 ring_destroy(struct header_ring *ring);
+static bool                 ring_supports(int fd);
+static void                 ring_flush(struct header_ring *ring);
+static bool                 ring_reserve(struct header_ring *ring, unsigned count);
+static struct io_uring_sqe *ring_sqe(struct header_ring *ring, enum ring_op op, size_t index);
+static void                 ring_complete(struct header_reader *reader, uint64_t user_data, int32_t res);
+static void                 ring_reap(struct header_reader *reader);
+static void                 ring_drain(struct header_reader *reader);
+
+static bool ring_supports(int fd)
+{
+    static const uint8_t needed[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE};
+    struct io_uring_probe *probe;
+    size_t                 probe_len;
+    bool                   supported;
+
+    probe_len = sizeof(struct io_uring_probe) + (IORING_OP_LAST * sizeof(struct io_uring_probe_op));
+    probe     = (struct io_uring_probe *)calloc(1, probe_len);
+
+    if(probe == NULL)
+    {
+        return false;
+    }
+
+    supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0;
+
+    for(size_t i = 0; supported && i < sizeof(needed); i++)
+    {
+        supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+    free(probe);
+    return supported;
+}
+
+static struct header_ring *ring_create(size_t depth)
+{
+    struct io_uring_params params;
+    struct header_ring    *ring;
+    void                  *map;
+    long                   fd;
+
+    ring = (struct header_ring *)calloc(1, sizeof(struct header_ring));
+
+    if(ring == NULL)
+    {
+        return NULL;
+    }
+
+    // a slot has its statx and read queued, or its close and the next file's open
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, (unsigned)(depth * SQ_PER_SLOT), &params);
+
+    if(fd < 0)
+    {
+        free(ring);
+        return NULL;
+    }
+
+    ring->fd = (int)fd;
+
+    if((params.features & IORING_FEAT_NODROP) == 0 || !ring_supports(ring->fd))
+    {
+        close(ring->fd);
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_map_len  = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+    ring->cq_map_len  = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    ring->sqe_map_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+        ring->sq_map_len = ring->sq_map_len > ring->cq_map_len ? ring->sq_map_len : ring->cq_map_len;
+        ring->cq_map_len = 0;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    map          = ring->cq_map_len == 0 ? ring->sq_map : mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes   = (struct io_uring_sqe *)mmap(NULL, ring->sqe_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+
+    if(ring->sq_map == MAP_FAILED || map == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        ring->sq_map = ring->sq_map == MAP_FAILED ? NULL : ring->sq_map;
+        ring->cq_map = map == MAP_FAILED ? NULL : map;
+        ring->sqes   = ring->sqes == MAP_FAILED ? NULL : ring->sqes;
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    ring->cq_map     = map;
+    ring->sq_head    = (unsigned *)((char *)ring->sq_map + params.sq_off.head);
+    ring->sq_tail    = (unsigned *)((char *)ring->sq_map + params.sq_off.tail);
+    ring->sq_mask    = (unsigned *)((char *)ring->sq_map + params.sq_off.ring_mask);
+    ring->sq_array   = (unsigned *)((char *)ring->sq_map + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head    = (unsigned *)((char *)ring->cq_map + params.cq_off.head);
+    ring->cq_tail    = (unsigned *)((char *)ring->cq_map + params.cq_off.tail);
+    ring->cq_mask    = (unsigned *)((char *)ring->cq_map + params.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe *)((char *)ring->cq_map + params.cq_off.cqes);
+
+    return ring;
+}
+
+static void ring_destroy(struct header_ring *ring)
+{
+    if(ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqe_map_len);
+    }
+
+    if(ring->cq_map != NULL && ring->cq_map != ring->sq_map)
+    {
+        munmap(ring->cq_map, ring->cq_map_len);
+    }
+
+    if(ring->sq_map != NULL)
+    {
+        munmap(ring->sq_map, ring->sq_map_len);
+    }
+
+    close(ring->fd);
+    free(ring);
+}
+
+static void ring_flush(struct header_ring *ring)
+{
+    while(ring->to_submit != 0)
+    {
+        long submitted;
+
+        submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 0, 0, NULL, 0);
+
+        if(submitted < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            // EAGAIN or EBUSY, the entries stay queued for the next flush
+            return;
+        }
+
+        ring->to_submit -= (unsigned)submitted;
+    }
+}
+
+/*
+ * Makes sure count entries fit in the submission queue, handing the
+ * queued ones to the kernel first if they do not. A flush the kernel
+ * turns away (EAGAIN, EBUSY) leaves them queued, and the caller then
+ * falls back to plain system calls rather than overwrite them.
+ */
+static bool ring_reserve(struct header_ring *ring, unsigned count)
+{
+    if(ring->sq_entries - (*ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) >= count)
+    {
+        return true;
+    }
+
+    ring_flush(ring);
+
+    return ring->sq_entries - (*ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) >= count;
+}
+
+// only call once ring_reserve made room
+static struct io_uring_sqe *ring_sqe(struct header_ring *ring, enum ring_op op, size_t index)
+{
+    struct io_uring_sqe *sqe;
+    unsigned             tail;
+
+    tail = *ring->sq_tail;
+    sqe  = &ring->sqes[tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = ((uint64_t)index << OP_BITS) | (uint64_t)op;
+
+    ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+
+    return sqe;
+}
+
+/*
+ * statx and the read are chained by hand off the open, because the
+ * descriptor is only known once it completes, and then run side by
+ * side. Both go through the descriptor, so what statx reports is the
+ * file that was read even if the path is renamed over meanwhile. The
+ * close is fire and forget once both are done. With no room left in the
+ * submission queue the rest is done right here instead.
+ */
+static void ring_complete(struct header_reader *reader, uint64_t user_data, int32_t res)
+{
+    static const char    empty_path[] = "";
+    struct header_read  *read;
+    struct io_uring_sqe *sqe;
+    size_t               index;
+
+    index = (size_t)(user_data >> OP_BITS);
+    read  = &reader->reads[index];
+
+    switch((enum ring_op)(user_data & OP_MASK))
+    {
+        case RING_OPEN:
+        {
+            if(res < 0)
+            {
+                read->error = OPEN_FAILED_MSG;
+                read->pending--;
+                break;
+            }
+
+            read->fd = res;
+
+            if(!ring_reserve(reader->ring, SQ_PER_FILE))
+            {
+                read_open_file(read, read->fd);
+                close(read->fd);
+                read->fd = 0;
+                read->pending--;
+                break;
+            }
+
+            sqe              = ring_sqe(reader->ring, RING_STATX, index);
+            sqe->opcode      = IORING_OP_STATX;
+            sqe->fd          = read->fd;
+            sqe->addr        = (uint64_t)(uintptr_t)empty_path;
+            sqe->len         = STATX_TYPE | STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME;
+            sqe->off         = (uint64_t)(uintptr_t)&read->stats;
+            sqe->statx_flags = AT_EMPTY_PATH;
+
+            sqe         = ring_sqe(reader->ring, RING_READ, index);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd     = read->fd;
+            sqe->addr   = (uint64_t)(uintptr_t)read->header;
+            sqe->len    = sizeof(read->header);
+            sqe->off    = 0;
+
+            // the open is done, its statx and read are now what the slot waits for
+            read->pending += SQ_PER_FILE - 1;
+            return;
+        }
+        case RING_STATX:
+        {
+            if(res < 0)
+            {
+                read->error = read->error == NULL ? OPEN_FAILED_MSG : read->error;
+            }
+            else if(!S_ISREG(read->stats.stx_mode))
+            {
+                read->error = NOT_REGULAR_MSG;
+            }
+            else
+            {
+                read->identity.dev        = (uint64_t)makedev(read->stats.stx_dev_major, read->stats.stx_dev_minor);
+                read->identity.ino        = read->stats.stx_ino;
+                read->identity.size       = read->stats.stx_size;
+                read->identity.mtime_sec  = read->stats.stx_mtime.tv_sec;
+                read->identity.mtime_nsec = read->stats.stx_mtime.tv_nsec;
+                read->identity.ctime_sec  = read->stats.stx_ctime.tv_sec;
+                read->identity.ctime_nsec = read->stats.stx_ctime.tv_nsec;
+            }
+
+            read->pending--;
+            break;
+        }
+        case RING_READ:
+        {
+            if(res < 0)
+            {
+                read->error = read->error == NULL ? READ_FAILED_MSG : read->error;
+            }
+            else
+            {
+                read->header_len = (size_t)res;
+            }
+
+            read->pending--;
+            break;
+        }
+        default:
+        {
+            return;
+        }
+    }
+
+    if(read->pending != 0)
+    {
+        return;
+    }
+
+    if(read->fd > 0)
+    {
+        if(ring_reserve(reader->ring, 1))
+        {
+            sqe         = ring_sqe(reader->ring, RING_CLOSE, index);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd     = read->fd;
+        }
+        else
+        {
+            close(read->fd);
+        }
+
+        read->fd = 0;
+    }
+
+    reader->in_flight--;
+    finish_read(reader, index);
+}
+
+static void ring_reap(struct header_reader *reader)
+{
+    struct header_ring *ring;
+    unsigned            head;
+
+    ring = reader->ring;
+    head = *ring->cq_head;
+
+    while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        const struct io_uring_cqe *cqe;
+        uint64_t                   user_data;
+        int32_t                    res;
+
+        cqe       = &ring->cqes[head & *ring->cq_mask];
+        user_data = cqe->user_data;
+        res       = cqe->res;
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        ring_complete(reader, user_data, res);
+    }
+}
+
+/*
+ * Lets everything in flight finish before the ring goes away: an open
+ * the kernel completes after that would leave its descriptor behind
+ * with nobody to close it. Closes the kernel never took are done here.
+ */
+static void ring_drain(struct header_reader *reader)
+{
+    struct header_ring *ring;
+
+    ring = reader->ring;
+    ring_flush(ring);
+
+    while(reader->in_flight != 0)
+    {
+        if(syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        ring_reap(reader);
+        ring_flush(ring);
+    }
+
+    for(unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE); head != *ring->sq_tail; head++)
+    {
+        const struct io_uring_sqe *sqe;
+
+        sqe = &ring->sqes[ring->sq_array[head & *ring->sq_mask]];
+
+        if((sqe->user_data & OP_MASK) == RING_CLOSE)
+        {
+            close(sqe->fd);
+        }
+    }
+}
+
+#endif
+
+static void finish_read(struct header_reader *reader, size_t index)
+{
+    reader->done[(reader->done_head + reader->done_count) % reader->depth] = index;
+    reader->done_count++;
+}
+
+static void read_header(struct header_read *read)
+{
+    int fd;
+
+    // non-blocking so a FIFO cannot stall the open
+    fd = open(read->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if(fd == -1)
+    {
+        read->error = OPEN_FAILED_MSG;
+        return;
+    }
+
+    read_open_file(read, fd);
+    close(fd);
+}
+
+static void read_open_file(struct header_read *read, int fd)
+{
+    struct stat file_stats;
+    ssize_t     header_len;
+
+    if(fstat(fd, &file_stats) == -1 || !S_ISREG(file_stats.st_mode))
+    {
+        read->error = NOT_REGULAR_MSG;
+    }
+    else
+    {
+        file_identity_from_stat(&file_stats, &read->identity);
+        header_len = pread(fd, read->header, sizeof(read->header), 0);
+
+        if(header_len == -1)
+        {
+            read->error = READ_FAILED_MSG;
+        }
+        else
+        {
+            read->header_len = (size_t)header_len;
+        }
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+int header_reader_open(struct header_reader *reader, size_t depth, bool use_uring)
+{
+    memset(reader, 0, sizeof(*reader));
+
+#ifdef HEADER_READER_URING
+    if(use_uring && depth > 1)
+    {
+        reader->ring = ring_create(depth);
+    }
+#endif
+
+    reader->depth     = reader->ring == NULL ? 1 : depth;
+    reader->reads     = (struct header_read *)calloc(reader->depth, sizeof(struct header_read));
+    reader->free_list = (size_t *)calloc(reader->depth, sizeof(size_t));
+    reader->done      = (size_t *)calloc(reader->depth, sizeof(size_t));
+
+    if(reader->reads == NULL || reader->free_list == NULL || reader->done == NULL)
+    {
+        header_reader_close(reader);
+        return -1;
+    }
+
+    for(size_t i = 0; i < reader->depth; i++)
+    {
+        reader->free_list[i] = reader->depth - 1 - i;
+    }
+
+    reader->free_count = reader->depth;
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
+
+void header_reader_close(struct header_reader *reader)
+{
+#ifdef HEADER_READER_URING
+    if(reader->ring != NULL)
+    {
+        ring_drain(reader);
+        ring_destroy(reader->ring);
+    }
+#endif
+
+    if(reader->reads != NULL)
+    {
+        for(size_t i = 0; i < reader->depth; i++)
+        {
+            if(reader->reads[i].fd > 0)
+            {
+                close(reader->reads[i].fd);
+            }
+
+            free(reader->reads[i].path);
+        }
+    }
+
+    free(reader->done);
+    free(reader->free_list);
+    free(reader->reads);
+    memset(reader, 0, sizeof(*reader));
+}
+
+bool header_reader_uses_uring(const struct header_reader *reader)
+{
+    return reader->ring != NULL;
+}
+
+bool header_reader_has_room(const struct header_reader *reader)
+{
+    return reader->free_count != 0;
+}
+
+bool header_reader_empty(const struct header_reader *reader)
+{
+    return reader->free_count == reader->depth;
+}
+
+void header_reader_submit(struct header_reader *reader, char *path)
+{
+    struct header_read *read;
+    size_t              index;
+
+    index = reader->free_list[--reader->free_count];
+    read  = &reader->reads[index];
+    memset(read, 0, sizeof(*read));
+    read->path = path;
+
+#ifdef HEADER_READER_URING
+    if(reader->ring != NULL && ring_reserve(reader->ring, 1))
+    {
+        struct io_uring_sqe *sqe;
+
+        sqe             = ring_sqe(reader->ring, RING_OPEN, index);
+        sqe->opcode     = IORING_OP_OPENAT;
+        sqe->fd         = AT_FDCWD;
+        sqe->addr       = (uint64_t)(uintptr_t)read->path;
+        sqe->open_flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC;
+
+        read->pending = 1;
+        reader->in_flight++;
+        return;
+    }
+#endif
+
+    read_header(read);
+    finish_read(reader, index);
+}
+
+void header_reader_drive(struct header_reader *reader)
+{
+#ifdef HEADER_READER_URING
+    if(reader->ring != NULL)
+    {
+        ring_reap(reader);
+        ring_flush(reader->ring);
+    }
+#else
+    (void)reader;
+#endif
+}
+
+int header_reader_poll_fd(const struct header_reader *reader)
+{
+#ifdef HEADER_READER_URING
+    if(reader->ring != NULL && reader->in_flight != 0)
+    {
+        return reader->ring->fd;
+    }
+#else
+    (void)reader;
+#endif
+
+    return 0;
+}
+
+struct header_read *header_reader_take(struct header_reader *reader)
+{
+    struct header_read *read;
+
+    if(reader->done_count == 0)
+    {
+        return NULL;
+    }
+
+    read              = &reader->reads[reader->done[reader->done_head]];
+    reader->done_head = (reader->done_head + 1) % reader->depth;
+    reader->done_count--;
+
+    return read;
+}
+
+void header_reader_release(struct header_reader *reader, struct header_read *read)
+{
+    read->path                              = NULL;
+    reader->free_list[reader->free_count++] = (size_t)(read - reader->reads);
+}
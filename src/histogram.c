@@ -0,0 +1,144 @@
+#include "histogram.h"
+#include <time.h>
+
+#define NS_PER_SEC 1000000000ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HIGHEST_SHIFT 32            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HIGHEST_BIT_MAX 63          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static unsigned highest_bit(uint64_t value);
+static size_t   bucket_of(uint64_t ns);
+static uint64_t bucket_top(size_t bucket);
+
+#if defined(__GNUC__)
+
+// one instruction where the compiler has it, which is most of what recording costs
+static unsigned highest_bit(uint64_t value)
+{
+    return (unsigned)(HIGHEST_BIT_MAX - __builtin_clzll(value));
+}
+
+#else
+
+static unsigned highest_bit(uint64_t value)
+{
+    unsigned bit;
+
+    bit = 0;
+
+    for(unsigned shift = HIGHEST_SHIFT; shift > 0; shift >>= 1)
+    {
+        if(value >> shift != 0)
+        {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+
+    return bit;
+}
+
+#endif
+
+/*
+ * The power of two picks the group and the next HISTOGRAM_SUB_BITS
+ * bits below it the bucket within the group.
+ */
+static size_t bucket_of(uint64_t ns)
+{
+    unsigned top;
+
+    if(ns < HISTOGRAM_SUB_BUCKETS)
+    {
+        return (size_t)ns;
+    }
+
+    top = highest_bit(ns);
+
+    return ((size_t)(top - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS) + (size_t)((ns >> (top - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// the largest value that lands in a bucket
+static uint64_t bucket_top(size_t bucket)
+{
+    unsigned shift;
+    uint64_t sub;
+
+    if(bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+        return (uint64_t)bucket;
+    }
+
+    shift = (unsigned)(bucket / HISTOGRAM_SUB_BUCKETS) - 1;
+    sub   = HISTOGRAM_SUB_BUCKETS + (bucket % HISTOGRAM_SUB_BUCKETS);
+
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t histogram_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * NS_PER_SEC) + (uint64_t)now.tv_nsec;
+}
+
+void histogram_record(struct histogram *histogram, uint64_t ns)
+{
+    histogram->buckets[bucket_of(ns)]++;
+    histogram->count++;
+    histogram->sum_ns += ns;
+
+    if(ns > histogram->max_ns)
+    {
+        histogram->max_ns = ns;
+    }
+}
+
+uint64_t histogram_below(const struct histogram *histogram, unsigned bit)
+{
+    uint64_t below;
+    size_t   buckets;
+
+    below   = 0;
+    buckets = bit <= HISTOGRAM_SUB_BITS ? (size_t)1 << bit : (size_t)(bit - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+    for(size_t bucket = 0; bucket < buckets && bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        below += histogram->buckets[bucket];
+    }
+
+    return below;
+}
+
+uint64_t histogram_quantile(const struct histogram *histogram, double quantile)
+{
+    uint64_t wanted;
+    uint64_t seen;
+
+    if(histogram->count == 0)
+    {
+        return 0;
+    }
+
+    wanted = (uint64_t)(quantile * (double)histogram->count);
+    seen   = 0;
+
+    if(wanted == 0)
+    {
+        wanted = 1;
+    }
+
+    for(size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+
+        // the top of the last bucket may be above anything seen
+        if(seen >= wanted)
+        {
+            return bucket_top(bucket) < histogram->max_ns ? bucket_top(bucket) : histogram->max_ns;
+        }
+    }
+
+    return histogram->max_ns;
+}
@@ -0,0 +1,856 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) struct ucred for SO_PEERCRED
+#endif
+
+#include "listener.h"
+#include "probes.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MS_PER_SEC 1000          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_MS 1000000        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_SEC 1000000000    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TOKEN 1000               // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BUSY_MSG_LEN 64          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TIMED_OUT_MSG "Bad request: Request timed out"
+
+static uint64_t                now_ms(void);
+static uint64_t                now_ns(void);
+static void                    arm_deadline(struct listener *listener, struct listener_conn *conn, size_t phase_ms, uint64_t since);
+static void                    free_conn(struct listener *listener, struct listener_conn *conn);
+static void                    turn_away(int fd, size_t retry_ms);
+static uid_t                   peer_uid(int fd);
+static struct listener_tenant *find_tenant(struct listener *listener, uid_t uid);
+static size_t                  take_token(const struct listener *listener, struct listener_tenant *tenant);
+static bool                    take_budget(struct listener *listener, struct listener_conn *conn);
+static bool                    given_up(const struct listener_conn *conn);
+static bool                    over_budget(struct listener *listener, struct listener_conn *conn, size_t more);
+static void                    finish_read(struct listener *listener, struct listener_conn *conn, const char *error);
+static void                    accept_all(struct listener *listener);
+static void                    consume(struct listener *listener, struct listener_conn *conn, const uint8_t *data, size_t len);
+static void                    read_conn(struct listener *listener, struct listener_conn *conn);
+static void                    expire(struct listener *listener);
+static enum listener_lane      pick_lane(const struct listener_tenant *tenant);
+static struct listener_conn   *take_ready(struct listener *listener);
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * MS_PER_SEC) + ((uint64_t)now.tv_nsec / NS_PER_MS);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * NS_PER_SEC) + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * A connection is always on the earliest of its phase deadline, its
+ * total deadline and its client's own, and remembers which one so a
+ * cut off is counted right.
+ */
+static void arm_deadline(struct listener *listener, struct listener_conn *conn, size_t phase_ms, uint64_t since)
+{
+    uint64_t phase_deadline;
+    uint64_t total_deadline;
+    uint64_t expires;
+
+    phase_deadline = since + phase_ms;
+    total_deadline = conn->accepted_ms + listener->options.total_ms;
+    conn->deadline = total_deadline <= phase_deadline ? LISTENER_TOTAL_DEADLINE : LISTENER_PHASE_DEADLINE;
+    expires        = total_deadline <= phase_deadline ? total_deadline : phase_deadline;
+
+    if(conn->client_deadline != 0 && conn->client_deadline < expires)
+    {
+        conn->deadline = LISTENER_CLIENT_DEADLINE;
+        expires        = conn->client_deadline;
+    }
+
+    timer_wheel_add(&listener->wheel, &conn->timer, expires);
+}
+
+/*
+ * Splits the client's time budget off the end of a complete name line.
+ * Returns false if there is one but it is not a number.
+ */
+static bool take_budget(struct listener *listener, struct listener_conn *conn)
+{
+    const char *separator;
+    size_t      budget_ms;
+    size_t      name_len;
+
+    separator = (const char *)memchr(conn->name, BUDGET_SEPARATOR, conn->name_len);
+
+    if(separator == NULL)
+    {
+        return true;
+    }
+
+    if(parse_size(separator + 1, &budget_ms) == -1)
+    {
+        return false;
+    }
+
+    name_len = (size_t)(separator - conn->name);
+    listener->buffered -= conn->name_len - name_len;
+    conn->name_len        = name_len;
+    conn->client_deadline = conn->accepted_ms + (budget_ms < UINT32_MAX ? budget_ms : UINT32_MAX);
+
+    return true;
+}
+
+/*
+ * Asked just before a request is handed out. A client that closed its
+ * socket altogether shows as a hang up, since it had already shut down
+ * its sending side to end the request.
+ */
+static bool given_up(const struct listener_conn *conn)
+{
+    struct pollfd pfd;
+
+    if(conn->client_deadline != 0 && now_ms() >= conn->client_deadline)
+    {
+        return true;
+    }
+
+    pfd.fd      = conn->fd;
+    pfd.events  = 0;
+    pfd.revents = 0;
+
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLHUP | POLLERR)) != 0;
+}
+
+static void free_conn(struct listener *listener, struct listener_conn *conn)
+{
+    timer_wheel_cancel(&listener->wheel, &conn->timer);
+
+    if(conn->fd > 0)
+    {
+        close(conn->fd);
+    }
+
+    if(conn->tenant != NULL)
+    {
+        conn->tenant->conns--;
+    }
+
+    listener->buffered -= conn->name_len + conn->header_len;
+    conn->fd    = 0;
+    conn->phase = LISTENER_FREE;
+    listener->free_list[listener->free_count++] = (size_t)(conn - listener->conns);
+}
+
+/*
+ * The reply fits any fresh socket buffer, so it never waits on the
+ * client, and the connection never takes a slot.
+ */
+static void turn_away(int fd, size_t retry_ms)
+{
+    char msg[BUSY_MSG_LEN];
+    int  msg_len;
+
+    msg_len = snprintf(msg, sizeof(msg), "%s%zu%s", BUSY_PREFIX, retry_ms, BUSY_SUFFIX);
+
+    if(msg_len > 0)
+    {
+        send(fd, msg, (size_t)msg_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+
+    close(fd);
+}
+
+#if defined(__linux__)
+
+static uid_t peer_uid(int fd)
+{
+    struct ucred cred;
+    socklen_t    len;
+
+    len = sizeof(cred);
+
+    if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+    {
+        return (uid_t)-1;
+    }
+
+    return cred.uid;
+}
+
+#else
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wunused-parameter"
+
+// without peer credentials every client is the same tenant
+static uid_t peer_uid(int fd)
+{
+    return (uid_t)-1;
+}
+
+    #pragma GCC diagnostic pop
+
+#endif
+
+/*
+ * The table is scanned, since it only holds as many tenants as there
+ * are users on the host. Tenants with a connection always number fewer
+ * than the free connection slots that let this one in, so when the
+ * table is full one without connections can be reused.
+ */
+static struct listener_tenant *find_tenant(struct listener *listener, uid_t uid)
+{
+    struct listener_tenant *spare;
+
+    spare = NULL;
+
+    for(size_t i = 0; i < listener->tenant_count; i++)
+    {
+        if(listener->tenants[i].uid == uid)
+        {
+            return &listener->tenants[i];
+        }
+
+        if(spare == NULL && listener->tenants[i].conns == 0)
+        {
+            spare = &listener->tenants[i];
+        }
+    }
+
+    if(listener->tenant_count < listener->options.max_connections)
+    {
+        spare = &listener->tenants[listener->tenant_count++];
+    }
+
+    memset(spare, 0, sizeof(*spare));
+    spare->uid         = uid;
+    spare->tokens      = (uint64_t)listener->options.burst * TOKEN;
+    spare->refilled_ms = listener->wheel.now;
+
+    return spare;
+}
+
+/*
+ * Returns 0 if the tenant may send another request, or the
+ * milliseconds until its next token otherwise.
+ */
+static size_t take_token(const struct listener *listener, struct listener_tenant *tenant)
+{
+    uint64_t capacity;
+
+    if(listener->options.rate == 0)
+    {
+        return 0;
+    }
+
+    capacity = (uint64_t)listener->options.burst * TOKEN;
+    tenant->tokens += (listener->wheel.now - tenant->refilled_ms) * listener->options.rate;
+    tenant->tokens      = tenant->tokens < capacity ? tenant->tokens : capacity;
+    tenant->refilled_ms = listener->wheel.now;
+
+    if(tenant->tokens >= TOKEN)
+    {
+        tenant->tokens -= TOKEN;
+        return 0;
+    }
+
+    return (size_t)((TOKEN - tenant->tokens + listener->options.rate - 1) / listener->options.rate);
+}
+
+/*
+ * Turns a client away part way through its request when holding more
+ * of it would go over the budget.
+ */
+static bool over_budget(struct listener *listener, struct listener_conn *conn, size_t more)
+{
+    int fd;
+
+    if(listener->buffered + more <= listener->options.buffer_budget)
+    {
+        return false;
+    }
+
+    fd       = conn->fd;
+    conn->fd = 0;
+    free_conn(listener, conn);
+    turn_away(fd, LISTENER_BUSY_RETRY_MS);
+    listener->busy++;
+
+    return true;
+}
+
+static void finish_read(struct listener *listener, struct listener_conn *conn, const char *error)
+{
+    struct listener_tenant *tenant;
+
+    timer_wheel_cancel(&listener->wheel, &conn->timer);
+    tenant           = conn->tenant;
+    conn->error      = error;
+    conn->phase      = LISTENER_READY;
+    conn->next_ready = NULL;
+
+    if(listener->options.timestamps || PROBE_ENABLED(elfinspectd, body_complete) || PROBE_ENABLED(elfinspectd, bad_request))
+    {
+        conn->read_ns = now_ns();
+
+        if(error == NULL)
+        {
+            PROBE3(elfinspectd, body_complete, conn->name, conn->body_len, conn->read_ns - conn->accepted_ns);
+        }
+        else
+        {
+            PROBE2(elfinspectd, bad_request, error, conn->read_ns - conn->accepted_ns);
+        }
+    }
+
+    if(tenant->ready_tail[conn->lane] != NULL)
+    {
+        tenant->ready_tail[conn->lane]->next_ready = conn;
+    }
+    else
+    {
+        tenant->ready_head[conn->lane] = conn;
+    }
+
+    tenant->ready_tail[conn->lane] = conn;
+
+    if(!tenant->active)
+    {
+        tenant->active      = true;
+        tenant->next_active = NULL;
+
+        if(listener->active_tail != NULL)
+        {
+            listener->active_tail->next_active = tenant;
+        }
+        else
+        {
+            listener->active_head = tenant;
+        }
+
+        listener->active_tail = tenant;
+    }
+}
+
+/*
+ * Small requests go first, except that every LISTENER_LARGE_SHARE-th
+ * turn goes to a large one if any is waiting.
+ */
+static enum listener_lane pick_lane(const struct listener_tenant *tenant)
+{
+    if(tenant->ready_head[LISTENER_LARGE] == NULL || (tenant->ready_head[LISTENER_SMALL] != NULL && tenant->small_run + 1 < LISTENER_LARGE_SHARE))
+    {
+        return LISTENER_SMALL;
+    }
+
+    return LISTENER_LARGE;
+}
+
+/*
+ * Deficit round robin over the tenants with complete requests. The
+ * tenant at the front is served while its credit covers the cost of
+ * its next request; otherwise it is credited a quantum and goes to the
+ * back.
+ */
+static struct listener_conn *take_ready(struct listener *listener)
+{
+    while(listener->active_head != NULL)
+    {
+        struct listener_tenant *tenant;
+        struct listener_conn   *conn;
+        enum listener_lane      lane;
+        size_t                  cost;
+
+        tenant = listener->active_head;
+        lane   = pick_lane(tenant);
+        conn   = tenant->ready_head[lane];
+        cost   = 1 + (conn->body_len / LISTENER_SMALL_BODY_LEN);
+
+        if(tenant->deficit < cost)
+        {
+            tenant->deficit += LISTENER_QUANTUM;
+
+            if(tenant->next_active != NULL)
+            {
+                listener->active_head              = tenant->next_active;
+                listener->active_tail->next_active = tenant;
+                listener->active_tail              = tenant;
+                tenant->next_active                = NULL;
+            }
+
+            continue;
+        }
+
+        tenant->deficit -= cost;
+        tenant->small_run        = lane == LISTENER_SMALL ? tenant->small_run + 1 : 0;
+        tenant->ready_head[lane] = conn->next_ready;
+
+        if(tenant->ready_head[lane] == NULL)
+        {
+            tenant->ready_tail[lane] = NULL;
+        }
+
+        // an idle tenant keeps no credit, or it could save up for a burst
+        if(tenant->ready_head[LISTENER_SMALL] == NULL && tenant->ready_head[LISTENER_LARGE] == NULL)
+        {
+            tenant->active        = false;
+            tenant->deficit       = 0;
+            listener->active_head = tenant->next_active;
+
+            if(listener->active_head == NULL)
+            {
+                listener->active_tail = NULL;
+            }
+        }
+
+        return conn;
+    }
+
+    return NULL;
+}
+
+/*
+ * Takes a bounded number of clients per pass, so a flood of them
+ * cannot keep the requests already in hand from being served.
+ */
+static void accept_all(struct listener *listener)
+{
+    for(size_t accepted = 0; accepted < LISTENER_ACCEPT_BATCH; accepted++)
+    {
+        struct listener_conn   *conn;
+        struct listener_tenant *tenant;
+        size_t                  retry_ms;
+        int                     fd;
+
+        fd = accept(listener->socket_fd, NULL, NULL);
+
+        if(fd == -1)
+        {
+            // EAGAIN once the queue is drained; anything else is the client's problem, not the daemon's
+            return;
+        }
+
+        // a new client may need room for a whole name line before it has sent anything
+        if(listener->free_count == 0 || listener->buffered + LISTENER_NAME_LEN > listener->options.buffer_budget)
+        {
+            turn_away(fd, LISTENER_BUSY_RETRY_MS);
+            listener->busy++;
+            continue;
+        }
+
+        tenant   = find_tenant(listener, peer_uid(fd));
+        retry_ms = take_token(listener, tenant);
+
+        if(retry_ms != 0)
+        {
+            turn_away(fd, retry_ms);
+            listener->limited++;
+            continue;
+        }
+
+        if(fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+        {
+            close(fd);
+            continue;
+        }
+
+        conn = &listener->conns[listener->free_list[--listener->free_count]];
+        memset(conn, 0, sizeof(*conn));
+        tenant->conns++;
+        conn->tenant      = tenant;
+        conn->fd          = fd;
+        conn->phase       = LISTENER_NAME;
+        conn->accepted_ms = listener->wheel.now;
+        conn->accepted_ns = now_ns();
+        conn->timer.data  = conn;
+        listener->accepted++;
+        arm_deadline(listener, conn, listener->options.header_ms, conn->accepted_ms);
+        PROBE2(elfinspectd, accept, fd, listener->options.max_connections - listener->free_count);
+    }
+}
+
+static void consume(struct listener *listener, struct listener_conn *conn, const uint8_t *data, size_t len)
+{
+    size_t used;
+
+    used = 0;
+
+    while(conn->phase == LISTENER_NAME && used < len)
+    {
+        uint8_t byte;
+
+        byte = data[used++];
+
+        if(byte == '\n')
+        {
+            conn->name[conn->name_len] = '\0';
+
+            if(!take_budget(listener, conn))
+            {
+                finish_read(listener, conn, "Bad request: Unparsable time budget");
+                return;
+            }
+
+            conn->phase = LISTENER_BODY;
+            arm_deadline(listener, conn, listener->options.body_ms, listener->wheel.now);
+
+            if(listener->options.timestamps || PROBE_ENABLED(elfinspectd, name_parsed))
+            {
+                conn->named_ns = now_ns();
+                PROBE3(elfinspectd, name_parsed, conn->name, conn->name_len, conn->named_ns - conn->accepted_ns);
+            }
+        }
+        else if(conn->name_len + 1 == LISTENER_NAME_LEN)
+        {
+            finish_read(listener, conn, "Bad request: Too long/no termination for file name");
+            return;
+        }
+        else if(over_budget(listener, conn, 1))
+        {
+            return;
+        }
+        else
+        {
+            conn->name[conn->name_len++] = (char)byte;
+            listener->buffered++;
+        }
+    }
+
+    if(conn->phase != LISTENER_BODY || used == len)
+    {
+        return;
+    }
+
+    if(conn->header_len < sizeof(conn->header))
+    {
+        size_t take;
+
+        take = len - used < sizeof(conn->header) - conn->header_len ? len - used : sizeof(conn->header) - conn->header_len;
+
+        if(over_budget(listener, conn, take))
+        {
+            return;
+        }
+
+        memcpy(conn->header + conn->header_len, data + used, take);
+        conn->header_len += take;
+        listener->buffered += take;
+    }
+
+    conn->body_len += len - used;
+
+    if(conn->body_len > LISTENER_SMALL_BODY_LEN)
+    {
+        conn->lane = LISTENER_LARGE;
+    }
+
+    if(conn->body_len > LISTENER_MAX_BODY_LEN)
+    {
+        finish_read(listener, conn, "Bad request: File data too large");
+    }
+}
+
+/*
+ * A large request yields after its share of reads; poll reports the
+ * rest of its data again on the next pass.
+ */
+static void read_conn(struct listener *listener, struct listener_conn *conn)
+{
+    uint8_t chunk[LISTENER_READ_CHUNK];
+    size_t  reads;
+
+    reads = 0;
+
+    while(conn->phase == LISTENER_NAME || conn->phase == LISTENER_BODY)
+    {
+        ssize_t read_len;
+
+        if(conn->lane == LISTENER_LARGE && reads++ == LISTENER_LARGE_READS)
+        {
+            return;
+        }
+
+        read_len = read(conn->fd, chunk, sizeof(chunk));
+
+        if(read_len > 0)
+        {
+            consume(listener, conn, chunk, (size_t)read_len);
+        }
+        else if(read_len == 0)
+        {
+            // the client shuts down its side once the whole request is sent
+            if(conn->phase == LISTENER_BODY)
+            {
+                finish_read(listener, conn, NULL);
+            }
+            else
+            {
+                finish_read(listener, conn, conn->name_len == 0 ? "Bad request: Unparsable file name" : "Bad request: Too long/no termination for file name");
+            }
+        }
+        else if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return;
+        }
+        else if(errno != EINTR)
+        {
+            finish_read(listener, conn, conn->phase == LISTENER_NAME ? "Bad request: Unparsable file name" : "Bad request: Unparsable file data");
+        }
+    }
+}
+
+/*
+ * A client that missed its deadline is told so if its socket has room
+ * and then cut off; it gets no more of the daemon's time either way.
+ * One whose own deadline passed is no longer listening and is only cut
+ * off.
+ */
+static void expire(struct listener *listener)
+{
+    struct timer_entry *fired;
+
+    fired = timer_wheel_advance(&listener->wheel, now_ms());
+
+    while(fired != NULL)
+    {
+        struct listener_conn *conn;
+
+        conn  = (struct listener_conn *)fired->data;
+        fired = fired->next;
+
+        if(conn->deadline == LISTENER_CLIENT_DEADLINE)
+        {
+            listener->abandoned++;
+            free_conn(listener, conn);
+            continue;
+        }
+
+        if(conn->deadline == LISTENER_TOTAL_DEADLINE)
+        {
+            listener->total_timeouts++;
+        }
+        else if(conn->phase == LISTENER_NAME)
+        {
+            listener->header_timeouts++;
+        }
+        else
+        {
+            listener->body_timeouts++;
+        }
+
+        send(conn->fd, TIMED_OUT_MSG, sizeof(TIMED_OUT_MSG) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        free_conn(listener, conn);
+    }
+}
+
+int listener_open(struct listener *listener, int socket_fd, const struct listener_options *options)
+{
+    int flags;
+
+    memset(listener, 0, sizeof(*listener));
+    listener->socket_fd = socket_fd;
+    listener->options   = *options;
+    listener->conns     = (struct listener_conn *)calloc(options->max_connections, sizeof(struct listener_conn));
+    listener->free_list = (size_t *)calloc(listener->options.max_connections, sizeof(size_t));
+    listener->fds       = (struct pollfd *)calloc(listener->options.max_connections + 1 + LISTENER_WATCHES, sizeof(struct pollfd));
+    listener->fd_conns  = (size_t *)calloc(listener->options.max_connections + 1 + LISTENER_WATCHES, sizeof(size_t));
+    listener->tenants   = (struct listener_tenant *)calloc(listener->options.max_connections, sizeof(struct listener_tenant));
+    flags               = fcntl(socket_fd, F_GETFL);
+
+    if(listener->conns == NULL || listener->free_list == NULL || listener->fds == NULL || listener->fd_conns == NULL || listener->tenants == NULL || flags == -1 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        listener_close(listener);
+        return -1;
+    }
+
+    // handed out lowest index first, which keeps the poll set compact
+    for(size_t i = 0; i < listener->options.max_connections; i++)
+    {
+        listener->free_list[i] = listener->options.max_connections - 1 - i;
+    }
+
+    listener->free_count = listener->options.max_connections;
+    timer_wheel_init(&listener->wheel, now_ms());
+
+    return 0;
+}
+
+void listener_close(struct listener *listener)
+{
+    if(listener->conns != NULL)
+    {
+        for(size_t i = 0; i < listener->options.max_connections; i++)
+        {
+            if(listener->conns[i].fd > 0)
+            {
+                close(listener->conns[i].fd);
+            }
+        }
+    }
+
+    free(listener->tenants);
+    free(listener->fd_conns);
+    free(listener->fds);
+    free(listener->free_list);
+    free(listener->conns);
+    memset(listener, 0, sizeof(*listener));
+}
+
+void listener_watch(struct listener *listener, size_t slot, int control_fd)
+{
+    listener->control_fds[slot]   = control_fd;
+    listener->control_ready[slot] = false;
+}
+
+void listener_drain(struct listener *listener)
+{
+    listener->draining = true;
+}
+
+enum listener_wait listener_next(struct listener *listener, struct listener_conn **conn)
+{
+    for(;;)
+    {
+        nfds_t  nfds;
+        int64_t timeout;
+        int     ready;
+        bool    control;
+
+        nfds    = 0;
+        control = false;
+
+        // every slot free means nothing is being read, queued or answered
+        if(listener->draining && listener->free_count == listener->options.max_connections)
+        {
+            return LISTENER_DRAINED;
+        }
+
+        // always polled, so clients over the caps hear back at once rather than waiting in the kernel's queue
+        if(!listener->draining)
+        {
+            listener->fds[nfds].fd      = listener->socket_fd;
+            listener->fds[nfds].events  = POLLIN;
+            listener->fds[nfds].revents = 0;
+            listener->fd_conns[nfds]    = listener->options.max_connections;
+            nfds++;
+        }
+
+        for(size_t slot = 0; slot < LISTENER_WATCHES; slot++)
+        {
+            listener->control_ready[slot] = false;
+
+            if(!listener->draining && listener->control_fds[slot] > 0)
+            {
+                listener->fds[nfds].fd      = listener->control_fds[slot];
+                listener->fds[nfds].events  = POLLIN;
+                listener->fds[nfds].revents = 0;
+                listener->fd_conns[nfds]    = listener->options.max_connections + 1 + slot;
+                nfds++;
+            }
+        }
+
+        for(size_t i = 0; i < listener->options.max_connections; i++)
+        {
+            if(listener->conns[i].phase == LISTENER_NAME || listener->conns[i].phase == LISTENER_BODY)
+            {
+                listener->fds[nfds].fd      = listener->conns[i].fd;
+                listener->fds[nfds].events  = POLLIN;
+                listener->fds[nfds].revents = 0;
+                listener->fd_conns[nfds]    = i;
+                nfds++;
+            }
+        }
+
+        // a request already waiting only gets a look at the sockets, not a wait
+        timeout = listener->active_head != NULL ? 0 : timer_wheel_timeout(&listener->wheel);
+        ready   = poll(listener->fds, nfds, timeout > INT_MAX ? INT_MAX : (int)timeout);
+
+        if(ready == -1)
+        {
+            return errno == EINTR ? LISTENER_INTERRUPTED : LISTENER_FAILED;
+        }
+
+        expire(listener);
+
+        for(nfds_t i = 0; ready > 0 && i < nfds; i++)
+        {
+            struct listener_conn *polled;
+
+            if(listener->fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            if(listener->fd_conns[i] == listener->options.max_connections)
+            {
+                accept_all(listener);
+                continue;
+            }
+
+            if(listener->fd_conns[i] > listener->options.max_connections)
+            {
+                listener->control_ready[listener->fd_conns[i] - listener->options.max_connections - 1] = true;
+                control                                                                             = true;
+                continue;
+            }
+
+            // expire may have cut this one off already
+            polled = &listener->conns[listener->fd_conns[i]];
+
+            if(polled->fd == listener->fds[i].fd && (polled->phase == LISTENER_NAME || polled->phase == LISTENER_BODY))
+            {
+                read_conn(listener, polled);
+            }
+        }
+
+        // the clients just read are kept for the next call
+        if(control)
+        {
+            *conn = NULL;
+            return LISTENER_CONTROL;
+        }
+
+        *conn = take_ready(listener);
+
+        while(*conn != NULL && given_up(*conn))
+        {
+            listener->abandoned++;
+            free_conn(listener, *conn);
+            *conn = take_ready(listener);
+        }
+
+        if(*conn != NULL)
+        {
+            int flags;
+
+            flags          = fcntl((*conn)->fd, F_GETFL);
+            (*conn)->phase = LISTENER_ACTIVE;
+
+            if(flags != -1)
+            {
+                fcntl((*conn)->fd, F_SETFL, flags & ~O_NONBLOCK);
+            }
+
+            return LISTENER_REQUEST;
+        }
+    }
+}
+
+void listener_release(struct listener *listener, struct listener_conn *conn)
+{
+    free_conn(listener, conn);
+}
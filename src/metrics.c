@@ -0,0 +1,73 @@
+#include "metrics.h"
+#include <inttypes.h>
+
+#define NS_PER_SEC_F 1000000000.0    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define EXPORT_FIRST_BIT 10          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define EXPORT_LAST_BIT 36           // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static void write_family(FILE *out, const char *name, const char *help, const char *type);
+
+static const char *const stage_names[METRICS_STAGES] = {"queue", "lookup", "inspect", "respond", "service"};
+
+static void write_family(FILE *out, const char *name, const char *help, const char *type)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_count(struct metrics *metrics, enum metrics_counter counter)
+{
+    metrics->counters[counter]++;
+}
+
+void metrics_record(struct metrics *metrics, enum metrics_stage stage, uint64_t ns)
+{
+    histogram_record(&metrics->stages[stage], ns);
+}
+
+void metrics_write(const struct metrics *metrics, const struct listener *listener, FILE *out)
+{
+    write_family(out, "elfinspectd_responses_total", "Requests answered, by outcome.", "counter");
+    fprintf(out, "elfinspectd_responses_total{outcome=\"elf\"} %" PRIu64 "\n", metrics->counters[METRICS_ELF]);
+    fprintf(out, "elfinspectd_responses_total{outcome=\"not_elf\"} %" PRIu64 "\n", metrics->counters[METRICS_NOT_ELF]);
+    fprintf(out, "elfinspectd_responses_total{outcome=\"bad_request\"} %" PRIu64 "\n", metrics->counters[METRICS_BAD_REQUEST]);
+
+    write_family(out, "elfinspectd_lookups_total", "Results found in the shared cache or the catalog, or inspected afresh.", "counter");
+    fprintf(out, "elfinspectd_lookups_total{source=\"shm\"} %" PRIu64 "\n", metrics->counters[METRICS_SHM_HIT]);
+    fprintf(out, "elfinspectd_lookups_total{source=\"catalog\"} %" PRIu64 "\n", metrics->counters[METRICS_CATALOG_HIT]);
+    fprintf(out, "elfinspectd_lookups_total{source=\"inspected\"} %" PRIu64 "\n", metrics->counters[METRICS_INSPECTED]);
+
+    write_family(out, "elfinspectd_clients_gone_total", "Answers the client hung up before receiving.", "counter");
+    fprintf(out, "elfinspectd_clients_gone_total %" PRIu64 "\n", metrics->counters[METRICS_CLIENT_GONE]);
+
+    write_family(out, "elfinspectd_connections_total", "Connections accepted to be read, or turned away busy or over their rate.", "counter");
+    fprintf(out, "elfinspectd_connections_total{result=\"accepted\"} %" PRIu64 "\n", listener->accepted);
+    fprintf(out, "elfinspectd_connections_total{result=\"busy\"} %" PRIu64 "\n", listener->busy);
+    fprintf(out, "elfinspectd_connections_total{result=\"limited\"} %" PRIu64 "\n", listener->limited);
+
+    write_family(out, "elfinspectd_cut_off_total", "Connections cut off for missing a deadline.", "counter");
+    fprintf(out, "elfinspectd_cut_off_total{deadline=\"header\"} %" PRIu64 "\n", listener->header_timeouts);
+    fprintf(out, "elfinspectd_cut_off_total{deadline=\"body\"} %" PRIu64 "\n", listener->body_timeouts);
+    fprintf(out, "elfinspectd_cut_off_total{deadline=\"total\"} %" PRIu64 "\n", listener->total_timeouts);
+
+    write_family(out, "elfinspectd_abandoned_total", "Requests dropped because their client had given up.", "counter");
+    fprintf(out, "elfinspectd_abandoned_total %" PRIu64 "\n", listener->abandoned);
+
+    // from accept to hand-out, then each stage of the answer, then hand-out to close
+    write_family(out, "elfinspectd_stage_seconds", "Time requests spent queued, in each stage of the answer, and being served in all.", "histogram");
+
+    for(size_t stage = 0; stage < METRICS_STAGES; stage++)
+    {
+        const struct histogram *histogram;
+
+        histogram = &metrics->stages[stage];
+
+        for(unsigned bit = EXPORT_FIRST_BIT; bit <= EXPORT_LAST_BIT; bit++)
+        {
+            fprintf(out, "elfinspectd_stage_seconds_bucket{stage=\"%s\",le=\"%.9f\"} %" PRIu64 "\n", stage_names[stage], (double)((1ULL << bit) - 1) / NS_PER_SEC_F, histogram_below(histogram, bit));
+        }
+
+        fprintf(out, "elfinspectd_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", stage_names[stage], histogram->count);
+        fprintf(out, "elfinspectd_stage_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[stage], (double)histogram->sum_ns / NS_PER_SEC_F);
+        fprintf(out, "elfinspectd_stage_seconds_count{stage=\"%s\"} %" PRIu64 "\n", stage_names[stage], histogram->count);
+    }
+}
@@ -0,0 +1,231 @@
+#if defined(__linux__)
+    #define _DEFAULT_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) syscall() for perf_event_open
+#endif
+
+#include "perf_counters.h"
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef PERF_COUNTERS_AVAILABLE
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+#endif
+
+static const char *const counter_names[PERF_COUNTERS] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+#ifdef PERF_COUNTERS_AVAILABLE
+
+// the layout read(2) returns for PERF_FORMAT_GROUP with both times
+struct group_read
+{
+    uint64_t count;
+    uint64_t enabled_ns;
+    uint64_t running_ns;
+    uint64_t values[PERF_COUNTERS];
+};
+
+static int  open_group(struct perf_counters *counters, bool user_only);
+static bool read_group(const struct perf_counters *counters, struct group_read *group);
+
+static const uint64_t counter_configs[PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+static int open_group(struct perf_counters *counters, bool user_only)
+{
+    for(size_t i = 0; i < PERF_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        long                   fd;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = counter_configs[i];
+        attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = user_only;
+        attr.exclude_hv     = 1;
+
+        // the leader starts disabled so the whole group is started at once
+        attr.disabled = i == 0;
+        fd            = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : counters->fds[0], PERF_FLAG_FD_CLOEXEC);
+
+        if(fd == -1)
+        {
+            for(size_t j = i; j > 0; j--)
+            {
+                close(counters->fds[j - 1]);
+            }
+
+            return -1;
+        }
+
+        counters->fds[i] = (int)fd;
+    }
+
+    return 0;
+}
+
+static bool read_group(const struct perf_counters *counters, struct group_read *group)
+{
+    return read(counters->fds[0], group, sizeof(*group)) == (ssize_t)sizeof(*group) && group->count == PERF_COUNTERS;
+}
+
+int perf_counters_open(struct perf_counters *counters)
+{
+    struct group_read group;
+
+    memset(counters, 0, sizeof(*counters));
+    counters->current = -1;
+
+    // kernel time is most of a response, but a paranoid host only lets user space be counted
+    if(open_group(counters, false) == -1)
+    {
+        if(open_group(counters, true) == -1)
+        {
+            return -1;
+        }
+
+        counters->user_only = true;
+    }
+
+    if(ioctl(counters->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1 || !read_group(counters, &group))
+    {
+        for(size_t i = 0; i < PERF_COUNTERS; i++)
+        {
+            close(counters->fds[i]);
+        }
+
+        return -1;
+    }
+
+    memcpy(counters->last, group.values, sizeof(group.values));
+    counters->last_enabled_ns = group.enabled_ns;
+    counters->last_running_ns = group.running_ns;
+    counters->open            = true;
+
+    return 0;
+}
+
+void perf_counters_close(struct perf_counters *counters)
+{
+    if(!counters->open)
+    {
+        return;
+    }
+
+    for(size_t i = PERF_COUNTERS; i > 0; i--)
+    {
+        close(counters->fds[i - 1]);
+    }
+
+    counters->open = false;
+}
+
+void perf_counters_enter(struct perf_counters *counters, int stage)
+{
+    struct group_read group;
+
+    if(!counters->open || !read_group(counters, &group))
+    {
+        return;
+    }
+
+    if(counters->current >= 0 && counters->current < PERF_COUNTERS_STAGES)
+    {
+        uint64_t enabled_ns;
+        uint64_t running_ns;
+
+        enabled_ns = group.enabled_ns - counters->last_enabled_ns;
+        running_ns = group.running_ns - counters->last_running_ns;
+        counters->enabled_ns[counters->current] += enabled_ns;
+        counters->running_ns[counters->current] += running_ns;
+
+        // multiplexed out for part of the stage: scale up to the whole of it, as perf stat does
+        for(size_t i = 0; running_ns != 0 && i < PERF_COUNTERS; i++)
+        {
+            uint64_t delta;
+
+            delta = group.values[i] - counters->last[i];
+            counters->totals[counters->current][i] += running_ns == enabled_ns ? delta : (uint64_t)((double)delta * (double)enabled_ns / (double)running_ns);
+        }
+    }
+
+    if(stage >= 0 && stage < PERF_COUNTERS_STAGES)
+    {
+        counters->entries[stage]++;
+    }
+
+    memcpy(counters->last, group.values, sizeof(group.values));
+    counters->last_enabled_ns = group.enabled_ns;
+    counters->last_running_ns = group.running_ns;
+    counters->current         = stage;
+}
+
+#else
+
+int perf_counters_open(struct perf_counters *counters)
+{
+    memset(counters, 0, sizeof(*counters));
+
+    return -1;
+}
+
+void perf_counters_close(struct perf_counters *counters)
+{
+    counters->open = false;
+}
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wunused-parameter"
+
+void perf_counters_enter(struct perf_counters *counters, int stage)
+{
+}
+
+    #pragma GCC diagnostic pop
+
+#endif
+
+void perf_counters_write(const struct perf_counters *counters, const char *prefix, const char *const names[], size_t name_count, FILE *out)
+{
+    if(!counters->open)
+    {
+        return;
+    }
+
+    fprintf(out, "# HELP %s_stage_events_total Hardware events counted while in each stage%s, scaled up where the counters were multiplexed.\n# TYPE %s_stage_events_total counter\n", prefix,
+            counters->user_only ? ", in user space only" : "", prefix);
+
+    for(size_t stage = 0; stage < PERF_COUNTERS_STAGES; stage++)
+    {
+        if(counters->entries[stage] == 0 || stage >= name_count || names[stage] == NULL)
+        {
+            continue;
+        }
+
+        for(size_t i = 0; i < PERF_COUNTERS; i++)
+        {
+            fprintf(out, "%s_stage_events_total{stage=\"%s\",event=\"%s\"} %" PRIu64 "\n", prefix, names[stage], counter_names[i], counters->totals[stage][i]);
+        }
+    }
+
+    fprintf(out, "# HELP %s_stage_entries_total Times each stage was entered while counting.\n# TYPE %s_stage_entries_total counter\n", prefix, prefix);
+
+    for(size_t stage = 0; stage < PERF_COUNTERS_STAGES; stage++)
+    {
+        if(counters->entries[stage] != 0 && stage < name_count && names[stage] != NULL)
+        {
+            fprintf(out, "%s_stage_entries_total{stage=\"%s\"} %" PRIu64 "\n", prefix, names[stage], counters->entries[stage]);
+        }
+    }
+
+    fprintf(out, "# HELP %s_stage_counted_ratio Share of each stage's time the counters ran; below 1 its events are estimates.\n# TYPE %s_stage_counted_ratio gauge\n", prefix, prefix);
+
+    for(size_t stage = 0; stage < PERF_COUNTERS_STAGES; stage++)
+    {
+        if(counters->entries[stage] != 0 && stage < name_count && names[stage] != NULL)
+        {
+            fprintf(out, "%s_stage_counted_ratio{stage=\"%s\"} %.3f\n", prefix, names[stage], counters->enabled_ns[stage] == 0 ? 1.0 : (double)counters->running_ns[stage] / (double)counters->enabled_ns[stage]);
+        }
+    }
+}
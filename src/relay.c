@@ -0,0 +1,739 @@
+#include "relay.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MS_PER_SEC 1000       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_MS 1000000     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BUSY_MSG_LEN 64       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define RESPONSE_PREFIX "File: "
+#define NO_BACKEND_MSG "Bad gateway: No backend daemon available\n"
+#define TIMED_OUT_MSG "Bad request: Request timed out"
+
+static uint64_t now_ms(void);
+static void     free_conn(struct relay *relay, struct relay_conn *conn);
+static void     turn_away(int fd);
+static void     accept_all(struct relay *relay);
+static void     consume(struct relay *relay, struct relay_conn *conn, const uint8_t *data, size_t len);
+static void     read_client(struct relay *relay, struct relay_conn *conn);
+static void     request_read(struct relay *relay, struct relay_conn *conn);
+static void     try_backend(struct relay *relay, struct relay_conn *conn);
+static void     next_backend(struct relay *relay, struct relay_conn *conn);
+static size_t   forward_len(const struct relay_conn *conn);
+static void     write_backend(struct relay *relay, struct relay_conn *conn);
+static void     read_backend(struct relay *relay, struct relay_conn *conn);
+static void     store_response(struct relay *relay, const struct relay_conn *conn);
+static void     start_reply(struct relay *relay, struct relay_conn *conn, const char *text, size_t len);
+static void     write_client(struct relay *relay, struct relay_conn *conn);
+static void     expire(struct relay *relay);
+
+// what a body over the limit is padded with, so the daemon turns it down itself
+static const uint8_t zeros[RELAY_READ_CHUNK];    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static uint64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * MS_PER_SEC) + ((uint64_t)now.tv_nsec / NS_PER_MS);
+}
+
+static void free_conn(struct relay *relay, struct relay_conn *conn)
+{
+    timer_wheel_cancel(&relay->wheel, &conn->timer);
+
+    if(conn->client_fd > 0)
+    {
+        close(conn->client_fd);
+    }
+
+    if(conn->backend_fd > 0)
+    {
+        close(conn->backend_fd);
+    }
+
+    conn->client_fd                     = 0;
+    conn->backend_fd                    = 0;
+    conn->phase                         = RELAY_FREE;
+    relay->free_list[relay->free_count++] = (size_t)(conn - relay->conns);
+}
+
+// the reply fits any fresh socket buffer, so it never waits on the client
+static void turn_away(int fd)
+{
+    char msg[BUSY_MSG_LEN];
+    int  msg_len;
+
+    msg_len = snprintf(msg, sizeof(msg), "%s%d%s", BUSY_PREFIX, RELAY_BUSY_RETRY_MS, BUSY_SUFFIX);
+
+    if(msg_len > 0)
+    {
+        send(fd, msg, (size_t)msg_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+
+    close(fd);
+}
+
+/*
+ * Takes a bounded number of clients per pass, so a flood of them
+ * cannot keep the requests already in hand from moving.
+ */
+static void accept_all(struct relay *relay)
+{
+    for(size_t accepted = 0; accepted < RELAY_ACCEPT_BATCH; accepted++)
+    {
+        struct relay_conn *conn;
+        int                fd;
+
+        fd = accept(relay->socket_fd, NULL, NULL);
+
+        if(fd == -1)
+        {
+            return;
+        }
+
+        if(relay->free_count == 0)
+        {
+            turn_away(fd);
+            relay->busy++;
+            continue;
+        }
+
+        if(fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 || fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+        {
+            close(fd);
+            continue;
+        }
+
+        conn = &relay->conns[relay->free_list[--relay->free_count]];
+        memset(conn, 0, sizeof(*conn));
+        conn->client_fd  = fd;
+        conn->phase      = RELAY_NAME;
+        conn->timer.data = conn;
+        relay->accepted++;
+        timer_wheel_add(&relay->wheel, &conn->timer, relay->wheel.now + relay->options.header_ms);
+
+        // a client usually sends its whole request along with the connect, which saves a poll
+        read_client(relay, conn);
+    }
+}
+
+/*
+ * The name line ends at its newline, or unterminated once it fills
+ * RELAY_NAME_LEN, and the daemon is left to turn such a name down.
+ */
+static void consume(struct relay *relay, struct relay_conn *conn, const uint8_t *data, size_t len)
+{
+    size_t used;
+
+    used = 0;
+
+    while(conn->phase == RELAY_NAME && used < len)
+    {
+        conn->name[conn->name_len++] = (char)data[used++];
+
+        if(conn->name[conn->name_len - 1] == '\n' || conn->name_len == RELAY_NAME_LEN)
+        {
+            const char *separator;
+
+            separator      = (const char *)memchr(conn->name, BUDGET_SEPARATOR, conn->name_len);
+            conn->file_len = separator != NULL ? (size_t)(separator - conn->name) : conn->name_len - 1;
+            conn->phase    = RELAY_BODY;
+            timer_wheel_add(&relay->wheel, &conn->timer, relay->wheel.now + relay->options.body_ms);
+        }
+    }
+
+    if(conn->phase != RELAY_BODY || used == len)
+    {
+        return;
+    }
+
+    if(conn->header_len < sizeof(conn->header))
+    {
+        size_t take;
+
+        take = len - used < sizeof(conn->header) - conn->header_len ? len - used : sizeof(conn->header) - conn->header_len;
+        memcpy(conn->header + conn->header_len, data + used, take);
+        conn->header_len += take;
+    }
+
+    conn->body_len += len - used;
+
+    // the answer is settled, whatever else the client sends
+    if(conn->body_len > RELAY_MAX_BODY_LEN)
+    {
+        request_read(relay, conn);
+    }
+}
+
+static void read_client(struct relay *relay, struct relay_conn *conn)
+{
+    uint8_t chunk[RELAY_READ_CHUNK];
+
+    while(conn->phase == RELAY_NAME || conn->phase == RELAY_BODY)
+    {
+        ssize_t read_len;
+
+        read_len = read(conn->client_fd, chunk, sizeof(chunk));
+
+        if(read_len > 0)
+        {
+            consume(relay, conn, chunk, (size_t)read_len);
+        }
+        else if(read_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        else if(read_len == 0 || errno != EINTR)
+        {
+            // the client shuts down its side once the whole request is sent
+            request_read(relay, conn);
+        }
+    }
+}
+
+/*
+ * Only a well formed request has an answer that depends on nothing but
+ * its content, so only those are looked up and stored.
+ */
+static void request_read(struct relay *relay, struct relay_conn *conn)
+{
+    conn->cacheable   = conn->name_len > 0 && conn->name[conn->name_len - 1] == '\n' && conn->body_len <= RELAY_MAX_BODY_LEN;
+    conn->content_key = content_key(conn->header, conn->header_len);
+
+    if(conn->cacheable)
+    {
+        const char *body;
+        size_t      body_len;
+
+        body = response_cache_get(relay->cache, conn->content_key, conn->header, conn->header_len, &body_len);
+
+        if(body != NULL)
+        {
+            int len;
+
+            // cached bodies exclude the "File: <name>" line, which belongs to this request
+            len = snprintf(conn->response, sizeof(conn->response), RESPONSE_PREFIX "%.*s\n%.*s", (int)conn->file_len, conn->name, (int)body_len, body);
+            relay->hits++;
+            start_reply(relay, conn, conn->response, len > 0 && (size_t)len < sizeof(conn->response) ? (size_t)len : 0);
+            return;
+        }
+    }
+
+    conn->candidates = shard_ring_route(relay->backends, conn->content_key, conn->order, MAX_SHARD_ENDPOINTS);
+    conn->candidate  = 0;
+    conn->deadline   = relay->wheel.now + relay->options.backend_ms;
+    relay->forwarded++;
+    try_backend(relay, conn);
+}
+
+/*
+ * Non-blocking connect down the request's failover order. A backend
+ * whose listen queue is full (EAGAIN on a Unix socket) is tried again
+ * shortly, within the attempt's deadline, rather than given up on.
+ */
+static void try_backend(struct relay *relay, struct relay_conn *conn)
+{
+    while(conn->candidate < conn->candidates)
+    {
+        struct sockaddr_un addr;
+        int                fd;
+        int                connect_error;
+
+        memset(&addr, 0, sizeof(addr));
+
+        if(init_sockaddr_un(&addr, relay->backends->endpoints[conn->order[conn->candidate]]) == -1)
+        {
+            conn->candidate++;
+            relay->failovers++;
+            conn->deadline = relay->wheel.now + relay->options.backend_ms;
+            continue;
+        }
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if(fd == -1)
+        {
+            break;
+        }
+
+        conn->sent = 0;
+
+        if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            conn->backend_fd = fd;
+            conn->phase      = RELAY_SEND;
+            timer_wheel_add(&relay->wheel, &conn->timer, conn->deadline);
+            write_backend(relay, conn);
+            return;
+        }
+
+        if(errno == EINPROGRESS)
+        {
+            conn->backend_fd = fd;
+            conn->phase      = RELAY_CONNECT;
+            timer_wheel_add(&relay->wheel, &conn->timer, conn->deadline);
+            return;
+        }
+
+        connect_error = errno;
+        close(fd);
+
+        if(connect_error == EAGAIN && relay->wheel.now + RELAY_CONNECT_RETRY_MS < conn->deadline)
+        {
+            conn->phase = RELAY_CONNECT;
+            timer_wheel_add(&relay->wheel, &conn->timer, relay->wheel.now + RELAY_CONNECT_RETRY_MS);
+            return;
+        }
+
+        conn->candidate++;
+        relay->failovers++;
+        conn->deadline = relay->wheel.now + relay->options.backend_ms;
+    }
+
+    fprintf(stderr, "Failed to connect to any backend\n");
+    relay->no_backend++;
+    start_reply(relay, conn, NO_BACKEND_MSG, strlen(NO_BACKEND_MSG));
+}
+
+// gives up on the current backend, for whatever reason, in favour of the next one
+static void next_backend(struct relay *relay, struct relay_conn *conn)
+{
+    if(conn->backend_fd > 0)
+    {
+        close(conn->backend_fd);
+        conn->backend_fd = 0;
+    }
+
+    relay->failovers++;
+    conn->candidate++;
+    conn->deadline = relay->wheel.now + relay->options.backend_ms;
+    try_backend(relay, conn);
+}
+
+static size_t forward_len(const struct relay_conn *conn)
+{
+    size_t body_len;
+
+    body_len = conn->body_len > RELAY_MAX_BODY_LEN ? RELAY_MAX_BODY_LEN + 1 : conn->header_len;
+
+    return conn->name_len + body_len;
+}
+
+static void write_backend(struct relay *relay, struct relay_conn *conn)
+{
+    if(conn->phase == RELAY_CONNECT)
+    {
+        int       socket_error;
+        socklen_t len;
+
+        len = sizeof(socket_error);
+
+        if(getsockopt(conn->backend_fd, SOL_SOCKET, SO_ERROR, &socket_error, &len) == -1 || socket_error != 0)
+        {
+            next_backend(relay, conn);
+            return;
+        }
+
+        conn->phase = RELAY_SEND;
+    }
+
+    while(conn->sent < forward_len(conn))
+    {
+        const void *from;
+        size_t      len;
+        ssize_t     written;
+
+        if(conn->sent < conn->name_len)
+        {
+            from = conn->name + conn->sent;
+            len  = conn->name_len - conn->sent;
+        }
+        else if(conn->sent < conn->name_len + conn->header_len)
+        {
+            from = conn->header + (conn->sent - conn->name_len);
+            len  = conn->name_len + conn->header_len - conn->sent;
+        }
+        else
+        {
+            from = zeros;
+            len  = forward_len(conn) - conn->sent < sizeof(zeros) ? forward_len(conn) - conn->sent : sizeof(zeros);
+        }
+
+        written = send(conn->backend_fd, from, len, MSG_NOSIGNAL);
+
+        if(written == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return;
+            }
+
+            // the daemon may have answered and closed already, read whatever it left
+            break;
+        }
+
+        conn->sent += (size_t)written;
+    }
+
+    shutdown(conn->backend_fd, SHUT_WR);
+    conn->phase        = RELAY_RECEIVE;
+    conn->response_len = 0;
+}
+
+static void read_backend(struct relay *relay, struct relay_conn *conn)
+{
+    for(;;)
+    {
+        ssize_t read_len;
+
+        read_len = read(conn->backend_fd, conn->response + conn->response_len, RELAY_RESPONSE_LEN - conn->response_len);
+
+        if(read_len > 0)
+        {
+            conn->response_len += (size_t)read_len;
+
+            if(conn->response_len < RELAY_RESPONSE_LEN)
+            {
+                continue;
+            }
+        }
+        else if(read_len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        else if(read_len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        break;
+    }
+
+    // a backend that closed without a word is as good as gone
+    if(conn->response_len == 0)
+    {
+        next_backend(relay, conn);
+        return;
+    }
+
+    if(conn->cacheable)
+    {
+        store_response(relay, conn);
+    }
+
+    start_reply(relay, conn, conn->response, conn->response_len);
+}
+
+/*
+ * Stores the part of a backend response after the "File: <name>" line,
+ * unless the response is not a per-file result (bad requests, busy).
+ */
+static void store_response(struct relay *relay, const struct relay_conn *conn)
+{
+    size_t prefix_len;
+
+    prefix_len = strlen(RESPONSE_PREFIX) + conn->file_len + 1;
+
+    if(conn->response_len < prefix_len || strncmp(conn->response, RESPONSE_PREFIX, strlen(RESPONSE_PREFIX)) != 0 ||
+       memcmp(conn->response + strlen(RESPONSE_PREFIX), conn->name, conn->file_len) != 0 || conn->response[prefix_len - 1] != '\n')
+    {
+        return;
+    }
+
+    response_cache_put(relay->cache, conn->content_key, conn->header, conn->header_len, conn->response + prefix_len, conn->response_len - prefix_len);
+}
+
+static void start_reply(struct relay *relay, struct relay_conn *conn, const char *text, size_t len)
+{
+    if(conn->backend_fd > 0)
+    {
+        close(conn->backend_fd);
+        conn->backend_fd = 0;
+    }
+
+    if(text != conn->response)
+    {
+        memcpy(conn->response, text, len);
+    }
+
+    conn->response_len = len;
+    conn->response_off = 0;
+    conn->phase        = RELAY_REPLY;
+    timer_wheel_add(&relay->wheel, &conn->timer, relay->wheel.now + RELAY_REPLY_MS);
+    write_client(relay, conn);
+}
+
+static void write_client(struct relay *relay, struct relay_conn *conn)
+{
+    while(conn->response_off < conn->response_len)
+    {
+        ssize_t written;
+
+        written = send(conn->client_fd, conn->response + conn->response_off, conn->response_len - conn->response_off, MSG_NOSIGNAL);
+
+        if(written == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return;
+            }
+
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        conn->response_off += (size_t)written;
+    }
+
+    shutdown(conn->client_fd, SHUT_RDWR);
+    free_conn(relay, conn);
+}
+
+/*
+ * A client that missed its deadline is told so if its socket has room
+ * and cut off. A backend that missed it is dropped for the next one,
+ * and a connect put off by a full listen queue is tried again.
+ */
+static void expire(struct relay *relay)
+{
+    struct timer_entry *fired;
+
+    fired = timer_wheel_advance(&relay->wheel, now_ms());
+
+    while(fired != NULL)
+    {
+        struct relay_conn *conn;
+
+        conn  = (struct relay_conn *)fired->data;
+        fired = fired->next;
+
+        switch(conn->phase)
+        {
+            case RELAY_NAME:
+            case RELAY_BODY:
+            {
+                relay->client_timeouts++;
+                send(conn->client_fd, TIMED_OUT_MSG, sizeof(TIMED_OUT_MSG) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+                free_conn(relay, conn);
+                break;
+            }
+            case RELAY_CONNECT:
+            case RELAY_SEND:
+            case RELAY_RECEIVE:
+            {
+                if(conn->backend_fd == 0 && relay->wheel.now < conn->deadline)
+                {
+                    try_backend(relay, conn);
+                }
+                else
+                {
+                    next_backend(relay, conn);
+                }
+
+                break;
+            }
+            case RELAY_REPLY:
+            {
+                relay->client_timeouts++;
+                free_conn(relay, conn);
+                break;
+            }
+            case RELAY_FREE:
+            default:
+            {
+                break;
+            }
+        }
+    }
+}
+
+int relay_open(struct relay *relay, int socket_fd, const struct relay_options *options, const struct shard_ring *backends, struct response_cache *cache)
+{
+    int flags;
+
+    memset(relay, 0, sizeof(*relay));
+    relay->socket_fd = socket_fd;
+    relay->options   = *options;
+    relay->backends  = backends;
+    relay->cache     = cache;
+    relay->conns     = (struct relay_conn *)calloc(options->max_connections, sizeof(struct relay_conn));
+    relay->free_list = (size_t *)calloc(options->max_connections, sizeof(size_t));
+    relay->fds       = (struct pollfd *)calloc(options->max_connections + 1, sizeof(struct pollfd));
+    relay->fd_conns  = (size_t *)calloc(options->max_connections + 1, sizeof(size_t));
+    flags            = fcntl(socket_fd, F_GETFL);
+
+    if(relay->conns == NULL || relay->free_list == NULL || relay->fds == NULL || relay->fd_conns == NULL || flags == -1 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        relay_close(relay);
+        return -1;
+    }
+
+    // handed out lowest index first, which keeps the poll set compact
+    for(size_t i = 0; i < options->max_connections; i++)
+    {
+        relay->free_list[i] = options->max_connections - 1 - i;
+    }
+
+    relay->free_count = options->max_connections;
+    timer_wheel_init(&relay->wheel, now_ms());
+
+    return 0;
+}
+
+void relay_close(struct relay *relay)
+{
+    if(relay->conns != NULL)
+    {
+        for(size_t i = 0; i < relay->options.max_connections; i++)
+        {
+            if(relay->conns[i].client_fd > 0)
+            {
+                close(relay->conns[i].client_fd);
+            }
+
+            if(relay->conns[i].backend_fd > 0)
+            {
+                close(relay->conns[i].backend_fd);
+            }
+        }
+    }
+
+    free(relay->fd_conns);
+    free(relay->fds);
+    free(relay->free_list);
+    free(relay->conns);
+    memset(relay, 0, sizeof(*relay));
+}
+
+enum relay_wait relay_wait(struct relay *relay)
+{
+    int64_t timeout;
+    size_t  in_use;
+
+    relay->nfds                = 0;
+    relay->fds[0].fd           = relay->socket_fd;
+    relay->fds[0].events       = POLLIN;
+    relay->fds[0].revents      = 0;
+    relay->fd_conns[0]         = relay->options.max_connections;
+    relay->nfds++;
+    in_use = relay->options.max_connections - relay->free_count;
+
+    // each request waits on the one socket its phase is blocked on; free slots end the scan early
+    for(size_t i = 0; i < relay->options.max_connections && in_use > 0; i++)
+    {
+        const struct relay_conn *conn;
+        int                      fd;
+        short                    events;
+
+        conn = &relay->conns[i];
+
+        switch(conn->phase)
+        {
+            case RELAY_NAME:
+            case RELAY_BODY:
+                fd     = conn->client_fd;
+                events = POLLIN;
+                break;
+            case RELAY_CONNECT:
+            case RELAY_SEND:
+                fd     = conn->backend_fd;
+                events = POLLOUT;
+                break;
+            case RELAY_RECEIVE:
+                fd     = conn->backend_fd;
+                events = POLLIN;
+                break;
+            case RELAY_REPLY:
+                fd     = conn->client_fd;
+                events = POLLOUT;
+                break;
+            case RELAY_FREE:
+            default:
+                fd     = 0;
+                events = 0;
+                break;
+        }
+
+        if(conn->phase != RELAY_FREE)
+        {
+            in_use--;
+        }
+
+        // a connect waiting out a full listen queue has no socket yet, only its timer
+        if(fd > 0)
+        {
+            relay->fds[relay->nfds].fd      = fd;
+            relay->fds[relay->nfds].events  = events;
+            relay->fds[relay->nfds].revents = 0;
+            relay->fd_conns[relay->nfds]    = i;
+            relay->nfds++;
+        }
+    }
+
+    timeout = timer_wheel_timeout(&relay->wheel);
+
+    if(poll(relay->fds, relay->nfds, timeout > INT_MAX ? INT_MAX : (int)timeout) == -1)
+    {
+        relay->nfds = 0;
+        return errno == EINTR ? RELAY_INTERRUPTED : RELAY_FAILED;
+    }
+
+    return RELAY_EVENTS;
+}
+
+void relay_dispatch(struct relay *relay)
+{
+    expire(relay);
+
+    for(nfds_t i = 0; i < relay->nfds; i++)
+    {
+        struct relay_conn *conn;
+
+        if(relay->fds[i].revents == 0)
+        {
+            continue;
+        }
+
+        if(relay->fd_conns[i] == relay->options.max_connections)
+        {
+            accept_all(relay);
+            continue;
+        }
+
+        // expire or an earlier event may have moved this request on already
+        conn = &relay->conns[relay->fd_conns[i]];
+
+        if((conn->phase == RELAY_NAME || conn->phase == RELAY_BODY) && conn->client_fd == relay->fds[i].fd)
+        {
+            read_client(relay, conn);
+        }
+        else if((conn->phase == RELAY_CONNECT || conn->phase == RELAY_SEND) && conn->backend_fd == relay->fds[i].fd)
+        {
+            write_backend(relay, conn);
+        }
+        else if(conn->phase == RELAY_RECEIVE && conn->backend_fd == relay->fds[i].fd)
+        {
+            read_backend(relay, conn);
+        }
+        else if(conn->phase == RELAY_REPLY && conn->client_fd == relay->fds[i].fd)
+        {
+            write_client(relay, conn);
+        }
+    }
+
+    relay->nfds = 0;
+}
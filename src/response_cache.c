@@ -0,0 +1,96 @@
+#include "response_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+static struct response_entry *find_set(const struct response_cache *cache, uint64_t key);
+
+static struct response_entry *find_set(const struct response_cache *cache, uint64_t key)
+{
+    return &cache->entries[(key % cache->sets) * RESPONSE_CACHE_WAYS];
+}
+
+int response_cache_create(struct response_cache *cache, size_t entries)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    cache->sets = (entries + RESPONSE_CACHE_WAYS - 1) / RESPONSE_CACHE_WAYS;
+
+    if(cache->sets == 0)
+    {
+        cache->sets = 1;
+    }
+
+    cache->entries = (struct response_entry *)calloc(cache->sets * RESPONSE_CACHE_WAYS, sizeof(*cache->entries));
+
+    if(cache->entries == NULL)
+    {
+        cache->sets = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void response_cache_destroy(struct response_cache *cache)
+{
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+const char *response_cache_get(struct response_cache *cache, uint64_t key, const void *header, size_t header_len, size_t *len)
+{
+    struct response_entry *set;
+
+    set        = find_set(cache, key);
+    header_len = content_key_span(header_len);
+
+    for(size_t way = 0; way < RESPONSE_CACHE_WAYS; way++)
+    {
+        // last_used doubles as the occupied flag, the tick starts at 1
+        if(set[way].last_used != 0 && set[way].key == key && set[way].header_len == header_len && memcmp(set[way].header, header, header_len) == 0)
+        {
+            set[way].last_used = ++cache->tick;
+            *len               = set[way].len;
+            cache->hits++;
+            return set[way].text;
+        }
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+void response_cache_put(struct response_cache *cache, uint64_t key, const void *header, size_t header_len, const char *text, size_t len)
+{
+    struct response_entry *set;
+    struct response_entry *victim;
+
+    if(len > RESPONSE_CACHE_TEXT_LEN)
+    {
+        return;
+    }
+
+    set    = find_set(cache, key);
+    victim = &set[0];
+
+    for(size_t way = 0; way < RESPONSE_CACHE_WAYS; way++)
+    {
+        if(set[way].last_used != 0 && set[way].key == key)
+        {
+            victim = &set[way];
+            break;
+        }
+
+        if(set[way].last_used < victim->last_used)
+        {
+            victim = &set[way];
+        }
+    }
+
+    victim->key        = key;
+    victim->last_used  = ++cache->tick;
+    victim->header_len = (uint16_t)content_key_span(header_len);
+    victim->len        = (uint16_t)len;
+    memcpy(victim->header, header, victim->header_len);
+    memcpy(victim->text, text, len);
+}
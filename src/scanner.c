@@ -0,0 +1,545 @@
+#if defined(__linux__)
+    #define _DEFAULT_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) syscall() and DT_* for getdents64
+#endif
+
+#include "scanner.h"
+#include "util.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/syscall.h>
+#endif
+
+#define DEQUE_INITIAL_CAPACITY 64    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define IDLE_WAIT_NS 1000000L        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_SEC 1000000000L       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+enum entry_kind
+{
+    ENTRY_OTHER,
+    ENTRY_DIRECTORY,
+    ENTRY_FILE,
+};
+
+static int   deque_push(struct scan_deque *deque, char *path);
+static char *deque_pop(struct scan_deque *deque);
+static char *deque_steal(struct scan_deque *deque);
+static void  emit(struct scanner *scanner, char *path);
+static void  visit_entry(struct scan_worker *worker, const char *dir_path, const char *name, enum entry_kind kind);
+static void  scan_directory(struct scan_worker *worker, const char *path);
+static char *find_work(struct scan_worker *worker);
+static void  idle_wait(struct scanner *scanner);
+static void *worker_main(void *arg);
+
+static int deque_push(struct scan_deque *deque, char *path)
+{
+    int ret_val;
+
+    ret_val = 0;
+    pthread_mutex_lock(&deque->lock);
+
+    if(deque->tail == deque->capacity && deque->head != 0)
+    {
+        memmove(deque->items, deque->items + deque->head, (deque->tail - deque->head) * sizeof(char *));
+        deque->tail -= deque->head;
+        deque->head = 0;
+    }
+
+    if(deque->tail == deque->capacity)
+    {
+        char **items;
+        size_t capacity;
+
+        capacity = deque->capacity == 0 ? DEQUE_INITIAL_CAPACITY : deque->capacity * 2;
+        items    = (char **)realloc(deque->items, capacity * sizeof(char *));
+
+        if(items == NULL)
+        {
+            ret_val = -1;
+            goto unlock;
+        }
+
+        deque->items    = items;
+        deque->capacity = capacity;
+    }
+
+    deque->items[deque->tail++] = path;
+
+unlock:
+    pthread_mutex_unlock(&deque->lock);
+    return ret_val;
+}
+
+static char *deque_pop(struct scan_deque *deque)
+{
+    char *path;
+
+    path = NULL;
+    pthread_mutex_lock(&deque->lock);
+
+    if(deque->tail != deque->head)
+    {
+        path = deque->items[--deque->tail];
+    }
+
+    if(deque->tail == deque->head)
+    {
+        deque->head = 0;
+        deque->tail = 0;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+    return path;
+}
+
+static char *deque_steal(struct scan_deque *deque)
+{
+    char *path;
+
+    path = NULL;
+
+    // a busy victim is skipped, another one will do
+    if(pthread_mutex_trylock(&deque->lock) != 0)
+    {
+        return NULL;
+    }
+
+    if(deque->tail != deque->head)
+    {
+        path = deque->items[deque->head++];
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+    return path;
+}
+
+static void emit(struct scanner *scanner, char *path)
+{
+    pthread_mutex_lock(&scanner->out_lock);
+
+    while(scanner->out_count == SCANNER_QUEUE_LEN && !atomic_load(&scanner->stop))
+    {
+        pthread_cond_wait(&scanner->out_not_full, &scanner->out_lock);
+    }
+
+    if(atomic_load(&scanner->stop))
+    {
+        free(path);
+    }
+    else
+    {
+        scanner->out[(scanner->out_head + scanner->out_count) % SCANNER_QUEUE_LEN] = path;
+        scanner->out_count++;
+        pthread_cond_signal(&scanner->out_not_empty);
+    }
+
+    pthread_mutex_unlock(&scanner->out_lock);
+}
+
+static void visit_entry(struct scan_worker *worker, const char *dir_path, const char *name, enum entry_kind kind)
+{
+    struct scanner *scanner;
+    char           *path;
+
+    scanner = worker->scanner;
+
+    if(kind == ENTRY_OTHER)
+    {
+        return;
+    }
+
+    path = join_path(dir_path, name);
+
+    if(path == NULL)
+    {
+        return;
+    }
+
+    if(kind == ENTRY_FILE)
+    {
+        // whether it is an ELF file is left to whoever reads its header, so it is only opened once
+        atomic_fetch_add(&scanner->files, 1);
+        emit(scanner, path);
+        return;
+    }
+
+    atomic_fetch_add(&scanner->pending, 1);
+
+    if(deque_push(&worker->deque, path) == -1)
+    {
+        atomic_fetch_sub(&scanner->pending, 1);
+        free(path);
+        return;
+    }
+
+    pthread_cond_signal(&scanner->idle_cond);
+}
+
+#if defined(__linux__)
+
+struct linux_dirent64
+{
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+/*
+ * Reads the directory with raw getdents64 into a large per-worker
+ * buffer. d_type saves a stat per entry; only filesystems that
+ * report DT_UNKNOWN pay for fstatat.
+ */
+static void scan_directory(struct scan_worker *worker, const char *path)
+{
+    int dir_fd;
+
+    dir_fd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(dir_fd == -1)
+    {
+        return;
+    }
+
+    atomic_fetch_add(&worker->scanner->directories, 1);
+
+    for(;;)
+    {
+        long len;
+
+        len = syscall(SYS_getdents64, dir_fd, worker->dirents, SCANNER_DIRENT_BUF_LEN);
+
+        if(len <= 0)
+        {
+            break;
+        }
+
+        for(long offset = 0; offset < len;)
+        {
+            const struct linux_dirent64 *entry;
+            enum entry_kind              kind;
+
+            entry = (const struct linux_dirent64 *)(worker->dirents + offset);
+            offset += entry->d_reclen;
+
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            {
+                continue;
+            }
+
+            if(entry->d_type == DT_UNKNOWN)
+            {
+                struct stat entry_stats;
+
+                kind = ENTRY_OTHER;
+
+                if(fstatat(dir_fd, entry->d_name, &entry_stats, AT_SYMLINK_NOFOLLOW) == 0)
+                {
+                    kind = S_ISDIR(entry_stats.st_mode) ? ENTRY_DIRECTORY : (S_ISREG(entry_stats.st_mode) ? ENTRY_FILE : ENTRY_OTHER);
+                }
+            }
+            else
+            {
+                kind = entry->d_type == DT_DIR ? ENTRY_DIRECTORY : (entry->d_type == DT_REG ? ENTRY_FILE : ENTRY_OTHER);
+            }
+
+            visit_entry(worker, path, entry->d_name, kind);
+        }
+    }
+
+    close(dir_fd);
+}
+
+#else
+
+static void scan_directory(struct scan_worker *worker, const char *path)
+{
+    const struct dirent *entry;
+    DIR                 *dir;
+    int                  dir_fd;
+
+    dir_fd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(dir_fd == -1)
+    {
+        return;
+    }
+
+    dir = fdopendir(dir_fd);
+
+    if(dir == NULL)
+    {
+        close(dir_fd);
+        return;
+    }
+
+    atomic_fetch_add(&worker->scanner->directories, 1);
+
+    while((entry = readdir(dir)) != NULL)
+    {
+        struct stat     entry_stats;
+        enum entry_kind kind;
+
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        kind = ENTRY_OTHER;
+
+        if(fstatat(dir_fd, entry->d_name, &entry_stats, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            kind = S_ISDIR(entry_stats.st_mode) ? ENTRY_DIRECTORY : (S_ISREG(entry_stats.st_mode) ? ENTRY_FILE : ENTRY_OTHER);
+        }
+
+        visit_entry(worker, path, entry->d_name, kind);
+    }
+
+    // closes dir_fd as well
+    closedir(dir);
+}
+
+#endif
+
+static char *find_work(struct scan_worker *worker)
+{
+    struct scanner *scanner;
+    char           *path;
+
+    scanner = worker->scanner;
+    path    = deque_pop(&worker->deque);
+
+    for(size_t i = 1; path == NULL && i < scanner->worker_count; i++)
+    {
+        path = deque_steal(&scanner->workers[(worker->index + i) % scanner->worker_count].deque);
+    }
+
+    return path;
+}
+
+static void idle_wait(struct scanner *scanner)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += IDLE_WAIT_NS;
+
+    if(deadline.tv_nsec >= NS_PER_SEC)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= NS_PER_SEC;
+    }
+
+    // the timeout covers a push that lands between the failed steal and the wait
+    pthread_mutex_lock(&scanner->idle_lock);
+
+    if(atomic_load(&scanner->pending) != 0 && !atomic_load(&scanner->stop))
+    {
+        pthread_cond_timedwait(&scanner->idle_cond, &scanner->idle_lock, &deadline);
+    }
+
+    pthread_mutex_unlock(&scanner->idle_lock);
+}
+
+static void *worker_main(void *arg)
+{
+    struct scan_worker *worker;
+    struct scanner     *scanner;
+
+    worker  = (struct scan_worker *)arg;
+    scanner = worker->scanner;
+
+    while(!atomic_load(&scanner->stop))
+    {
+        char *path;
+
+        path = find_work(worker);
+
+        if(path == NULL)
+        {
+            if(atomic_load(&scanner->pending) == 0)
+            {
+                break;
+            }
+
+            idle_wait(scanner);
+            continue;
+        }
+
+        scan_directory(worker, path);
+        free(path);
+
+        if(atomic_fetch_sub(&scanner->pending, 1) == 1)
+        {
+            pthread_mutex_lock(&scanner->idle_lock);
+            pthread_cond_broadcast(&scanner->idle_cond);
+            pthread_mutex_unlock(&scanner->idle_lock);
+        }
+    }
+
+    if(atomic_fetch_sub(&scanner->running, 1) == 1)
+    {
+        pthread_mutex_lock(&scanner->out_lock);
+        scanner->out_done = true;
+        pthread_cond_broadcast(&scanner->out_not_empty);
+        pthread_mutex_unlock(&scanner->out_lock);
+    }
+
+    return NULL;
+}
+
+int scanner_start(struct scanner *scanner, const char *root, size_t worker_count)
+{
+    struct stat root_stats;
+    char       *root_copy;
+
+    memset(scanner, 0, sizeof(*scanner));
+
+    if(worker_count == 0 || worker_count > SCANNER_MAX_THREADS || stat(root, &root_stats) == -1 || !S_ISDIR(root_stats.st_mode))
+    {
+        return -1;
+    }
+
+    pthread_mutex_init(&scanner->idle_lock, NULL);
+    pthread_cond_init(&scanner->idle_cond, NULL);
+    pthread_mutex_init(&scanner->out_lock, NULL);
+    pthread_cond_init(&scanner->out_not_empty, NULL);
+    pthread_cond_init(&scanner->out_not_full, NULL);
+    atomic_init(&scanner->pending, 1);
+    atomic_init(&scanner->running, worker_count);
+    atomic_init(&scanner->stop, false);
+    atomic_init(&scanner->directories, 0);
+    atomic_init(&scanner->files, 0);
+
+    scanner->workers = (struct scan_worker *)calloc(worker_count, sizeof(struct scan_worker));
+    scanner->threads = (pthread_t *)calloc(worker_count, sizeof(pthread_t));
+    root_copy        = strdup(root);
+
+    if(scanner->workers == NULL || scanner->threads == NULL || root_copy == NULL)
+    {
+        free(root_copy);
+        scanner_stop(scanner);
+        return -1;
+    }
+
+    for(size_t i = 0; i < worker_count; i++)
+    {
+        scanner->workers[i].scanner = scanner;
+        scanner->workers[i].index   = i;
+        scanner->workers[i].dirents = (char *)malloc(SCANNER_DIRENT_BUF_LEN);
+        pthread_mutex_init(&scanner->workers[i].deque.lock, NULL);
+        scanner->worker_count = i + 1;
+
+        if(scanner->workers[i].dirents == NULL)
+        {
+            free(root_copy);
+            scanner_stop(scanner);
+            return -1;
+        }
+    }
+
+    if(deque_push(&scanner->workers[0].deque, root_copy) == -1)
+    {
+        free(root_copy);
+        scanner_stop(scanner);
+        return -1;
+    }
+
+    for(size_t i = 0; i < worker_count; i++)
+    {
+        if(pthread_create(&scanner->threads[i], NULL, worker_main, &scanner->workers[i]) != 0)
+        {
+            scanner_stop(scanner);
+            return -1;
+        }
+
+        scanner->started++;
+    }
+
+    return 0;
+}
+
+enum scanner_next scanner_next(struct scanner *scanner, bool wait, char **path)
+{
+    enum scanner_next next;
+
+    pthread_mutex_lock(&scanner->out_lock);
+
+    while(wait && scanner->out_count == 0 && !scanner->out_done)
+    {
+        pthread_cond_wait(&scanner->out_not_empty, &scanner->out_lock);
+    }
+
+    if(scanner->out_count != 0)
+    {
+        *path             = scanner->out[scanner->out_head];
+        scanner->out_head = (scanner->out_head + 1) % SCANNER_QUEUE_LEN;
+        scanner->out_count--;
+        next = SCANNER_PATH;
+        pthread_cond_signal(&scanner->out_not_full);
+    }
+    else
+    {
+        next = scanner->out_done ? SCANNER_DONE : SCANNER_PENDING;
+    }
+
+    pthread_mutex_unlock(&scanner->out_lock);
+    return next;
+}
+
+void scanner_stop(struct scanner *scanner)
+{
+    atomic_store(&scanner->stop, true);
+
+    pthread_mutex_lock(&scanner->out_lock);
+    pthread_cond_broadcast(&scanner->out_not_full);
+    pthread_mutex_unlock(&scanner->out_lock);
+
+    pthread_mutex_lock(&scanner->idle_lock);
+    pthread_cond_broadcast(&scanner->idle_cond);
+    pthread_mutex_unlock(&scanner->idle_lock);
+
+    for(size_t i = 0; i < scanner->started; i++)
+    {
+        pthread_join(scanner->threads[i], NULL);
+    }
+
+    for(size_t i = 0; i < scanner->out_count; i++)
+    {
+        free(scanner->out[(scanner->out_head + i) % SCANNER_QUEUE_LEN]);
+    }
+
+    for(size_t i = 0; i < scanner->worker_count; i++)
+    {
+        struct scan_deque *deque;
+
+        deque = &scanner->workers[i].deque;
+
+        for(size_t j = deque->head; j < deque->tail; j++)
+        {
+            free(deque->items[j]);
+        }
+
+        free(deque->items);
+        free(scanner->workers[i].dirents);
+        pthread_mutex_destroy(&deque->lock);
+    }
+
+    free(scanner->workers);
+    free(scanner->threads);
+
+    pthread_cond_destroy(&scanner->out_not_full);
+    pthread_cond_destroy(&scanner->out_not_empty);
+    pthread_mutex_destroy(&scanner->out_lock);
+    pthread_cond_destroy(&scanner->idle_cond);
+    pthread_mutex_destroy(&scanner->idle_lock);
+
+    memset(scanner, 0, sizeof(*scanner));
+}
@@ -0,0 +1,190 @@
+#include "shard_ring.h"
+#include "content_key.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define VNODE_STRIDE 0x9e3779b97f4a7c15ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static uint64_t hash_endpoint(const char *endpoint);
+static int      compare_points(const void *a, const void *b);
+
+static uint64_t hash_endpoint(const char *endpoint)
+{
+    return fnv1a64(endpoint, strlen(endpoint), FNV64_OFFSET_BASIS);
+}
+
+static int compare_points(const void *a, const void *b)
+{
+    const struct shard_point *pa;
+    const struct shard_point *pb;
+
+    pa = (const struct shard_point *)a;
+    pb = (const struct shard_point *)b;
+
+    if(pa->hash != pb->hash)
+    {
+        return pa->hash < pb->hash ? -1 : 1;
+    }
+
+    // equal hashes are broken by endpoint so every client builds the same ring
+    if(pa->endpoint != pb->endpoint)
+    {
+        return pa->endpoint < pb->endpoint ? -1 : 1;
+    }
+
+    return 0;
+}
+
+int shard_ring_create(struct shard_ring *ring, const char *endpoint_list)
+{
+    char  *cursor;
+    size_t count;
+
+    memset(ring, 0, sizeof(*ring));
+
+    if(endpoint_list == NULL || *endpoint_list == '\0')
+    {
+        return -1;
+    }
+
+    ring->endpoint_list = strdup(endpoint_list);
+    ring->endpoints     = (const char **)calloc(MAX_SHARD_ENDPOINTS, sizeof(*ring->endpoints));
+
+    if(ring->endpoint_list == NULL || ring->endpoints == NULL)
+    {
+        shard_ring_destroy(ring);
+        return -1;
+    }
+
+    count  = 0;
+    cursor = ring->endpoint_list;
+
+    while(cursor != NULL)
+    {
+        char *separator;
+
+        separator = strchr(cursor, SHARD_ENDPOINT_SEPARATOR);
+
+        if(separator != NULL)
+        {
+            *separator = '\0';
+        }
+
+        if(*cursor != '\0')
+        {
+            if(count == MAX_SHARD_ENDPOINTS)
+            {
+                shard_ring_destroy(ring);
+                return -1;
+            }
+
+            ring->endpoints[count++] = cursor;
+        }
+
+        cursor = separator == NULL ? NULL : separator + 1;
+    }
+
+    if(count == 0)
+    {
+        shard_ring_destroy(ring);
+        return -1;
+    }
+
+    ring->endpoint_count = count;
+    ring->point_count    = count * SHARD_VNODES;
+    ring->points         = (struct shard_point *)calloc(ring->point_count, sizeof(*ring->points));
+
+    if(ring->points == NULL)
+    {
+        shard_ring_destroy(ring);
+        return -1;
+    }
+
+    for(size_t e = 0; e < count; e++)
+    {
+        uint64_t base;
+
+        base = hash_endpoint(ring->endpoints[e]);
+
+        for(size_t v = 0; v < SHARD_VNODES; v++)
+        {
+            struct shard_point *point;
+
+            point           = &ring->points[(e * SHARD_VNODES) + v];
+            point->hash     = mix64(base + ((uint64_t)v * VNODE_STRIDE));
+            point->endpoint = e;
+        }
+    }
+
+    qsort(ring->points, ring->point_count, sizeof(*ring->points), compare_points);
+
+    return 0;
+}
+
+void shard_ring_destroy(struct shard_ring *ring)
+{
+    free(ring->points);
+    free((void *)ring->endpoints);
+    free(ring->endpoint_list);
+    memset(ring, 0, sizeof(*ring));
+}
+
+size_t shard_ring_route(const struct shard_ring *ring, uint64_t key, size_t *order, size_t max)
+{
+    size_t low;
+    size_t high;
+    size_t found;
+
+    if(ring->point_count == 0 || max == 0)
+    {
+        return 0;
+    }
+
+    // first point at or after the key, wrapping past the top of the ring
+    low  = 0;
+    high = ring->point_count;
+
+    while(low < high)
+    {
+        size_t mid;
+
+        mid = low + ((high - low) / 2);
+
+        if(ring->points[mid].hash < key)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    found = 0;
+
+    for(size_t step = 0; step < ring->point_count && found < max && found < ring->endpoint_count; step++)
+    {
+        size_t endpoint;
+        int    seen;
+
+        endpoint = ring->points[(low + step) % ring->point_count].endpoint;
+        seen     = 0;
+
+        for(size_t i = 0; i < found; i++)
+        {
+            if(order[i] == endpoint)
+            {
+                seen = 1;
+                break;
+            }
+        }
+
+        if(!seen)
+        {
+            order[found++] = endpoint;
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,267 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) F_OFD_SETLK for the slot locks
+#endif
+
+#include "shm_cache.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_CACHE_READ_RETRIES 4    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define VICTIM_SHIFT 58             // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+// open file description locks belong to the mapping's descriptor, not to a pid; elsewhere process locks have to do
+#if defined(F_OFD_SETLK)
+    #define SLOT_SETLK F_OFD_SETLK
+#else
+    #define SLOT_SETLK F_SETLK
+#endif
+
+static int                    lock_file(int fd, short type);
+static size_t                 map_size(size_t slot_count);
+// fails at once if another writer holds the slot
+static int lock_slot(const struct shm_cache *cache, const struct shm_cache_slot *slot, short type)
+{
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type   = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start  = (off_t)((const char *)slot - (const char *)cache->header);
+    lock.l_len    = (off_t)sizeof(*slot);
+
+    return fcntl(cache->fd, SLOT_SETLK, &lock);
+}
+
+static struct shm_cache_slot *find_set(const struct shm_cache *cache, uint64_t key);
+static int                    lock_slot(const struct shm_cache *cache, const struct shm_cache_slot *slot, short type);
+static int                    read_slot(const struct shm_cache_slot *slot, uint64_t key, const void *header, size_t span, struct elf_result *result);
+
+static int lock_file(int fd, short type)
+{
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type   = type;
+    lock.l_whence = SEEK_SET;
+
+    return fcntl(fd, F_SETLKW, &lock);
+}
+
+static size_t map_size(size_t slot_count)
+{
+    return sizeof(struct shm_cache_header) + (slot_count * sizeof(struct shm_cache_slot));
+}
+
+static struct shm_cache_slot *find_set(const struct shm_cache *cache, uint64_t key)
+{
+    return &cache->slots[(key % (cache->slot_count / SHM_CACHE_WAYS)) * SHM_CACHE_WAYS];
+}
+
+int shm_cache_open(struct shm_cache *cache, const char *path, size_t slot_count)
+{
+    struct stat file_stats;
+    void       *map;
+    int         fd;
+
+    memset(cache, 0, sizeof(*cache));
+    slot_count = ((slot_count + SHM_CACHE_WAYS - 1) / SHM_CACHE_WAYS) * SHM_CACHE_WAYS;
+
+    if(slot_count == 0)
+    {
+        return -1;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    // the first process sizes the file and writes the header; the rest wait for it
+    if(lock_file(fd, F_WRLCK) == -1 || fstat(fd, &file_stats) == -1)
+    {
+        goto close_fd;
+    }
+
+    if(file_stats.st_size == 0)
+    {
+        struct shm_cache_header header;
+
+        memset(&header, 0, sizeof(header));
+        header.magic      = SHM_CACHE_MAGIC;
+        header.version    = SHM_CACHE_VERSION;
+        header.slot_count = slot_count;
+        header.slot_size  = sizeof(struct shm_cache_slot);
+
+        if(ftruncate(fd, (off_t)map_size(slot_count)) == -1 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        {
+            goto close_fd;
+        }
+    }
+    else
+    {
+        struct shm_cache_header header;
+
+        if(pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        {
+            goto close_fd;
+        }
+
+        // an existing cache keeps its geometry, whatever this process asked for
+        if(header.magic != SHM_CACHE_MAGIC || header.version != SHM_CACHE_VERSION || header.slot_size != sizeof(struct shm_cache_slot) || header.slot_count == 0 ||
+           header.slot_count % SHM_CACHE_WAYS != 0 || (off_t)map_size(header.slot_count) != file_stats.st_size)
+        {
+            goto close_fd;
+        }
+
+        slot_count = header.slot_count;
+    }
+
+    map = mmap(NULL, map_size(slot_count), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(map == MAP_FAILED)
+    {
+        goto close_fd;
+    }
+
+    cache->header     = (struct shm_cache_header *)map;
+    cache->slots      = (struct shm_cache_slot *)((char *)map + sizeof(struct shm_cache_header));
+    cache->slot_count = slot_count;
+    cache->map_len    = map_size(slot_count);
+    cache->fd         = fd;
+
+    // the descriptor stays open for the slot locks, only the setup lock goes
+    lock_file(fd, F_UNLCK);
+    return 0;
+
+close_fd:
+    close(fd);
+    return -1;
+}
+
+void shm_cache_close(struct shm_cache *cache)
+{
+    if(cache->header != NULL)
+    {
+        munmap(cache->header, cache->map_len);
+        close(cache->fd);
+    }
+
+    memset(cache, 0, sizeof(*cache));
+}
+
+static int read_slot(const struct shm_cache_slot *slot, uint64_t key, const void *header, size_t span, struct elf_result *result)
+{
+    for(int attempt = 0; attempt < SHM_CACHE_READ_RETRIES; attempt++)
+    {
+        uint8_t  slot_header[CONTENT_KEY_SPAN];
+        uint64_t before;
+        uint64_t after;
+        uint64_t slot_key;
+        uint32_t used;
+        uint32_t slot_header_len;
+
+        before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if((before & 1U) != 0)
+        {
+            continue;
+        }
+
+        used            = slot->used;
+        slot_key        = slot->key;
+        slot_header_len = slot->header_len;
+        memcpy(slot_header, slot->header, sizeof(slot_header));
+        memcpy(result, &slot->result, sizeof(*result));
+
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+        if(before == after)
+        {
+            return used != 0 && slot_key == key && slot_header_len == span && memcmp(slot_header, header, span) == 0 ? 0 : -1;
+        }
+    }
+
+    return -1;
+}
+
+int shm_cache_get(const struct shm_cache *cache, uint64_t key, const void *header, size_t header_len, struct elf_result *result)
+{
+    const struct shm_cache_slot *set;
+    size_t                       span;
+
+    set  = find_set(cache, key);
+    span = content_key_span(header_len);
+
+    for(size_t way = 0; way < SHM_CACHE_WAYS; way++)
+    {
+        if(read_slot(&set[way], key, header, span, result) == 0)
+        {
+            result->error[sizeof(result->error) - 1] = '\0';
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+void shm_cache_put(struct shm_cache *cache, uint64_t key, const void *header, size_t header_len, const struct elf_result *result)
+{
+    struct shm_cache_slot *set;
+    struct shm_cache_slot *slot;
+    uint64_t               seq;
+    size_t                 span;
+
+    set  = find_set(cache, key);
+    slot = NULL;
+    span = content_key_span(header_len);
+
+    // the same key, then a free way, then a victim picked from the key so writers agree
+    for(size_t way = 0; way < SHM_CACHE_WAYS && slot == NULL; way++)
+    {
+        if(set[way].used != 0 && set[way].key == key)
+        {
+            slot = &set[way];
+        }
+    }
+
+    for(size_t way = 0; way < SHM_CACHE_WAYS && slot == NULL; way++)
+    {
+        if(set[way].used == 0)
+        {
+            slot = &set[way];
+        }
+    }
+
+    if(slot == NULL)
+    {
+        slot = &set[(key >> VICTIM_SHIFT) % SHM_CACHE_WAYS];
+    }
+
+    if(lock_slot(cache, slot, F_WRLCK) == -1)
+    {
+        return;
+    }
+
+    // under the lock an odd seqlock can only be a dead writer's, so entering moves it two on
+    seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    seq += (seq & 1U) != 0 ? 2U : 1U;
+    atomic_store_explicit(&slot->seq, seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->key        = key;
+    slot->used       = 1;
+    slot->header_len = (uint32_t)span;
+    memset(slot->header, 0, sizeof(slot->header));
+    memcpy(slot->header, header, span);
+    memcpy(&slot->result, result, sizeof(*result));
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+    lock_slot(cache, slot, F_UNLCK);
+}
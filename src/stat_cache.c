@@ -0,0 +1,313 @@
+#include "stat_cache.h"
+#include "content_key.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static uint32_t checksum(const struct stat_cache_record *record);
+static uint64_t slot_of(const struct stat_cache_header *header, uint64_t dev, uint64_t ino);
+static int      create_file(const char *path, uint64_t capacity, int *fd, void **map, size_t *len);
+static int      grow(struct stat_cache *cache);
+
+static uint32_t checksum(const struct stat_cache_record *record)
+{
+    uint32_t hash;
+
+    // the fixed part and the used part of the body, so a torn write is caught
+    hash = fnv1a32(record, offsetof(struct stat_cache_record, checksum), FNV32_OFFSET_BASIS);
+
+    return fnv1a32(&record->body_len, sizeof(record->body_len) + record->body_len, hash);
+}
+
+static uint64_t slot_of(const struct stat_cache_header *header, uint64_t dev, uint64_t ino)
+{
+    return mix64(ino ^ mix64(dev)) & (header->capacity - 1);
+}
+
+static int create_file(const char *path, uint64_t capacity, int *fd, void **map, size_t *len)
+{
+    struct stat_cache_header *header;
+    struct flock              lock;
+    void                     *mapped;
+
+    *len = sizeof(struct stat_cache_header) + (capacity * sizeof(struct stat_cache_record));
+    *fd  = open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+    if(*fd == -1)
+    {
+        return -1;
+    }
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type   = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+
+    // lock before truncating so a cache another run holds is left alone
+    if(fcntl(*fd, F_SETLK, &lock) == -1 || ftruncate(*fd, 0) == -1 || ftruncate(*fd, (off_t)*len) == -1)
+    {
+        close(*fd);
+        return -1;
+    }
+
+    mapped = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+
+    if(mapped == MAP_FAILED)
+    {
+        close(*fd);
+        return -1;
+    }
+
+    header              = (struct stat_cache_header *)mapped;
+    header->magic       = STAT_CACHE_MAGIC;
+    header->version     = STAT_CACHE_VERSION;
+    header->record_size = sizeof(struct stat_cache_record);
+    header->capacity    = capacity;
+    *map                = mapped;
+
+    return 0;
+}
+
+/*
+ * Rehashes into a file twice the size and renames it over the old one,
+ * so a crash part way leaves the old cache intact.
+ */
+static int grow(struct stat_cache *cache)
+{
+    struct stat_cache_header *header;
+    struct stat_cache_record *records;
+    char                     *tmp_path;
+    void                     *map;
+    size_t                    len;
+    int                       fd;
+
+    tmp_path = concat_path(cache->path, STAT_CACHE_TMP_SUFFIX);
+
+    if(tmp_path == NULL || create_file(tmp_path, cache->header->capacity * 2, &fd, &map, &len) == -1)
+    {
+        free(tmp_path);
+        return -1;
+    }
+
+    header  = (struct stat_cache_header *)map;
+    records = (struct stat_cache_record *)(header + 1);
+
+    for(uint64_t i = 0; i < cache->header->capacity; i++)
+    {
+        const struct stat_cache_record *record;
+        uint64_t                        position;
+
+        record = &cache->records[i];
+
+        if(record->body_len == 0)
+        {
+            continue;
+        }
+
+        position = slot_of(header, record->identity.dev, record->identity.ino);
+
+        while(records[position].body_len != 0)
+        {
+            position = (position + 1) & (header->capacity - 1);
+        }
+
+        records[position] = *record;
+        header->count++;
+    }
+
+    if(rename(tmp_path, cache->path) == -1)
+    {
+        munmap(map, len);
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    free(tmp_path);
+    munmap(cache->header, cache->map_len);
+    close(cache->fd);
+
+    cache->fd      = fd;
+    cache->header  = header;
+    cache->records = records;
+    cache->map_len = len;
+
+    return 0;
+}
+
+void file_identity_from_stat(const struct stat *stats, struct file_identity *identity)
+{
+    identity->dev        = (uint64_t)stats->st_dev;
+    identity->ino        = (uint64_t)stats->st_ino;
+    identity->size       = (uint64_t)stats->st_size;
+    identity->mtime_sec  = (int64_t)stats->st_mtim.tv_sec;
+    identity->mtime_nsec = (int64_t)stats->st_mtim.tv_nsec;
+    identity->ctime_sec  = (int64_t)stats->st_ctim.tv_sec;
+    identity->ctime_nsec = (int64_t)stats->st_ctim.tv_nsec;
+}
+
+int stat_cache_open(struct stat_cache *cache, const char *path)
+{
+    struct stat_cache_header header;
+    struct flock             lock;
+    struct stat              file_stats;
+    void                    *map;
+    int                      fd;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->path = strdup(path);
+
+    if(cache->path == NULL)
+    {
+        return -1;
+    }
+
+    fd = open(path, O_RDWR | O_CLOEXEC);
+
+    if(fd != -1)
+    {
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type   = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+
+        if(fcntl(fd, F_SETLK, &lock) == -1 || fstat(fd, &file_stats) == -1)
+        {
+            close(fd);
+            stat_cache_close(cache);
+            return -1;
+        }
+
+        if(file_stats.st_size > 0 && (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != STAT_CACHE_MAGIC))
+        {
+            // not a cache at all, refuse rather than overwrite it
+            close(fd);
+            stat_cache_close(cache);
+            return -1;
+        }
+
+        if(file_stats.st_size > 0 && header.version == STAT_CACHE_VERSION && header.record_size == sizeof(struct stat_cache_record) && header.capacity != 0 &&
+           (header.capacity & (header.capacity - 1)) == 0 && (size_t)file_stats.st_size == sizeof(header) + (header.capacity * sizeof(struct stat_cache_record)))
+        {
+            map = mmap(NULL, (size_t)file_stats.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+            if(map == MAP_FAILED)
+            {
+                close(fd);
+                stat_cache_close(cache);
+                return -1;
+            }
+
+            cache->fd      = fd;
+            cache->header  = (struct stat_cache_header *)map;
+            cache->records = (struct stat_cache_record *)(cache->header + 1);
+            cache->map_len = (size_t)file_stats.st_size;
+            return 0;
+        }
+
+        close(fd);
+    }
+
+    // new, or written by an older layout: start an empty cache
+    if(create_file(path, STAT_CACHE_INITIAL_CAPACITY, &cache->fd, &map, &cache->map_len) == -1)
+    {
+        cache->fd = 0;
+        stat_cache_close(cache);
+        return -1;
+    }
+
+    cache->header  = (struct stat_cache_header *)map;
+    cache->records = (struct stat_cache_record *)(cache->header + 1);
+
+    return 0;
+}
+
+void stat_cache_close(struct stat_cache *cache)
+{
+    if(cache->header != NULL)
+    {
+        munmap(cache->header, cache->map_len);
+    }
+
+    if(cache->fd > 0)
+    {
+        close(cache->fd);
+    }
+
+    free(cache->path);
+    memset(cache, 0, sizeof(*cache));
+}
+
+int stat_cache_get(const struct stat_cache *cache, const struct file_identity *identity, const char **body, size_t *body_len)
+{
+    uint64_t position;
+
+    position = slot_of(cache->header, identity->dev, identity->ino);
+
+    while(cache->records[position].body_len != 0)
+    {
+        const struct stat_cache_record *record;
+
+        record = &cache->records[position];
+
+        if(record->identity.dev == identity->dev && record->identity.ino == identity->ino)
+        {
+            if(memcmp(&record->identity, identity, sizeof(*identity)) != 0 || record->stored_sec <= identity->ctime_sec || record->body_len > STAT_CACHE_BODY_LEN ||
+               record->checksum != checksum(record))
+            {
+                return -1;
+            }
+
+            *body     = record->body;
+            *body_len = record->body_len;
+            return 0;
+        }
+
+        position = (position + 1) & (cache->header->capacity - 1);
+    }
+
+    return -1;
+}
+
+int stat_cache_put(struct stat_cache *cache, const struct file_identity *identity, const char *body, size_t body_len)
+{
+    struct stat_cache_record *record;
+    uint64_t                  position;
+
+    if(body_len == 0 || body_len > STAT_CACHE_BODY_LEN)
+    {
+        return -1;
+    }
+
+    // keep the load factor at or under one half so probes stay short
+    if((cache->header->count + 1) * 2 > cache->header->capacity && grow(cache) == -1)
+    {
+        return -1;
+    }
+
+    position = slot_of(cache->header, identity->dev, identity->ino);
+
+    while(cache->records[position].body_len != 0 && (cache->records[position].identity.dev != identity->dev || cache->records[position].identity.ino != identity->ino))
+    {
+        position = (position + 1) & (cache->header->capacity - 1);
+    }
+
+    record = &cache->records[position];
+
+    if(record->body_len == 0)
+    {
+        cache->header->count++;
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->identity   = *identity;
+    record->stored_sec = (int64_t)time(NULL);
+    record->body_len   = (uint32_t)body_len;
+    memcpy(record->body, body, body_len);
+    record->checksum = checksum(record);
+
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "timer_wheel.h"
+#include <string.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static void link_entry(struct timer_wheel *wheel, struct timer_entry *entry);
+static void unlink_entry(struct timer_entry *entry);
+static void cascade(struct timer_wheel *wheel, unsigned level);
+
+/*
+ * Picks the lowest level whose span still reaches the timer, and the
+ * slot there that the clock will pass when the timer is due.
+ */
+static void link_entry(struct timer_wheel *wheel, struct timer_entry *entry)
+{
+    struct timer_entry **slot;
+    uint64_t             delta;
+    unsigned             level;
+
+    delta = entry->expires - wheel->now;
+    level = 0;
+
+    while(level + 1 < TIMER_WHEEL_LEVELS && delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    slot        = &wheel->slots[level][(entry->expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK];
+    entry->slot = slot;
+    entry->prev = NULL;
+    entry->next = *slot;
+
+    if(*slot != NULL)
+    {
+        (*slot)->prev = entry;
+    }
+
+    *slot = entry;
+}
+
+static void unlink_entry(struct timer_entry *entry)
+{
+    if(entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        *entry->slot = entry->next;
+    }
+
+    if(entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+
+    entry->slot = NULL;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/*
+ * Spreads the slot of a higher level that the clock just reached over
+ * the levels below it.
+ */
+static void cascade(struct timer_wheel *wheel, unsigned level)
+{
+    struct timer_entry **slot;
+    struct timer_entry  *entry;
+
+    slot  = &wheel->slots[level][(wheel->now >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK];
+    entry = *slot;
+    *slot = NULL;
+
+    while(entry != NULL)
+    {
+        struct timer_entry *next;
+
+        next = entry->next;
+        link_entry(wheel, entry);
+        entry = next;
+    }
+}
+
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_entry *entry, uint64_t expires)
+{
+    if(entry->slot != NULL)
+    {
+        unlink_entry(entry);
+        wheel->count--;
+    }
+
+    // the current slot has been handed out already, so the earliest is the next tick
+    if(expires <= wheel->now)
+    {
+        expires = wheel->now + 1;
+    }
+
+    if(expires - wheel->now >= TIMER_WHEEL_SPAN)
+    {
+        expires = wheel->now + TIMER_WHEEL_SPAN - 1;
+    }
+
+    entry->expires = expires;
+    link_entry(wheel, entry);
+    wheel->count++;
+}
+
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer_entry *entry)
+{
+    if(entry->slot != NULL)
+    {
+        unlink_entry(entry);
+        wheel->count--;
+    }
+}
+
+bool timer_wheel_armed(const struct timer_entry *entry)
+{
+    return entry->slot != NULL;
+}
+
+struct timer_entry *timer_wheel_advance(struct timer_wheel *wheel, uint64_t now)
+{
+    struct timer_entry *fired;
+
+    fired = NULL;
+
+    while(wheel->now < now)
+    {
+        struct timer_entry **slot;
+        unsigned             top;
+
+        // an empty wheel has nothing to cascade, so the clock can jump
+        if(wheel->count == 0)
+        {
+            wheel->now = now;
+            break;
+        }
+
+        wheel->now++;
+        top = 0;
+
+        while(top + 1 < TIMER_WHEEL_LEVELS && (wheel->now & ((1ULL << (TIMER_WHEEL_BITS * (top + 1))) - 1)) == 0)
+        {
+            top++;
+        }
+
+        // higher levels first, since they may refill the slots cascaded next
+        for(unsigned level = top; level > 0; level--)
+        {
+            cascade(wheel, level);
+        }
+
+        slot = &wheel->slots[0][wheel->now & SLOT_MASK];
+
+        while(*slot != NULL)
+        {
+            struct timer_entry *entry;
+
+            entry = *slot;
+            unlink_entry(entry);
+            wheel->count--;
+            entry->next = fired;
+            fired       = entry;
+        }
+    }
+
+    return fired;
+}
+
+int64_t timer_wheel_timeout(const struct timer_wheel *wheel)
+{
+    uint64_t index;
+
+    if(wheel->count == 0)
+    {
+        return -1;
+    }
+
+    index = wheel->now & SLOT_MASK;
+
+    for(uint64_t ticks = 1; index + ticks < TIMER_WHEEL_SLOTS; ticks++)
+    {
+        if(wheel->slots[0][index + ticks] != NULL)
+        {
+            return (int64_t)ticks;
+        }
+    }
+
+    return (int64_t)(TIMER_WHEEL_SLOTS - index);
+}
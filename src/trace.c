@@ -0,0 +1,320 @@
+#include "trace.h"
+#include "content_key.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NS_PER_US 1000.0          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_MS 1000000L        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define NS_PER_SEC 1000000000L    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CONTROL_CHAR 0x20         // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DELETE_CHAR 0x7f          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static _Thread_local struct trace_ring  *thread_ring;     // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static _Thread_local const struct trace *thread_trace;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static struct trace_ring *claim_ring(struct trace *trace);
+static void               write_string(FILE *out, const char *str);
+static void               write_event(struct trace *trace, size_t tid, const struct trace_event *event);
+static void               drain(struct trace *trace);
+static void              *flusher_main(void *arg);
+
+/*
+ * A thread keeps the ring it claimed for as long as it records into the
+ * same trace. Threads past TRACE_RINGS get none and their spans are
+ * dropped.
+ */
+static struct trace_ring *claim_ring(struct trace *trace)
+{
+    size_t index;
+
+    if(thread_trace == trace)
+    {
+        return thread_ring;
+    }
+
+    index        = atomic_fetch_add(&trace->ring_count, 1);
+    thread_trace = trace;
+    thread_ring  = index < TRACE_RINGS ? &trace->rings[index] : NULL;
+
+    return thread_ring;
+}
+
+// file names may hold anything but NUL, and JSON strings may not
+static void write_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+
+    for(const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++)
+    {
+        if(*p == '"' || *p == '\\')
+        {
+            fputc('\\', out);
+            fputc(*p, out);
+        }
+        else if(*p < CONTROL_CHAR || *p >= DELETE_CHAR)
+        {
+            fprintf(out, "\\u%04x", *p);
+        }
+        else
+        {
+            fputc(*p, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+/*
+ * Spans are written as nestable async events keyed by request id, since
+ * the requests of one thread overlap each other.
+ */
+static void write_event(struct trace *trace, size_t tid, const struct trace_event *event)
+{
+    bool instant;
+
+    instant = event->start_ns == event->end_ns;
+
+    fputs(",\n", trace->out);
+    fprintf(trace->out, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"id\":\"0x%016" PRIx64 "\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f", event->name, trace->category, instant ? "n" : "b", event->id, trace->pid, tid, (double)event->start_ns / NS_PER_US);
+
+    if(event->detail[0] != '\0')
+    {
+        fputs(",\"args\":{\"path\":", trace->out);
+        write_string(trace->out, event->detail);
+        fputc('}', trace->out);
+    }
+
+    fputc('}', trace->out);
+
+    if(!instant)
+    {
+        fprintf(trace->out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":\"0x%016" PRIx64 "\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f}", event->name, trace->category, event->id, trace->pid, tid, (double)event->end_ns / NS_PER_US);
+    }
+}
+
+static void drain(struct trace *trace)
+{
+    size_t ring_count;
+
+    ring_count = atomic_load(&trace->ring_count);
+
+    for(size_t i = 0; i < ring_count && i < TRACE_RINGS; i++)
+    {
+        struct trace_ring *ring;
+        size_t             head;
+        size_t             tail;
+
+        ring = &trace->rings[i];
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for(; tail != head; tail++)
+        {
+            write_event(trace, i + 1, &ring->events[tail % TRACE_RING_EVENTS]);
+        }
+
+        // the slots are only handed back once written out
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    fflush(trace->out);
+}
+
+static void *flusher_main(void *arg)
+{
+    struct trace *trace;
+
+    trace = (struct trace *)arg;
+
+    while(!atomic_load(&trace->stop))
+    {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += TRACE_FLUSH_MS * NS_PER_MS;
+
+        if(deadline.tv_nsec >= NS_PER_SEC)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= NS_PER_SEC;
+        }
+
+        pthread_mutex_lock(&trace->lock);
+
+        if(!atomic_load(&trace->stop))
+        {
+            pthread_cond_timedwait(&trace->wake, &trace->lock, &deadline);
+        }
+
+        pthread_mutex_unlock(&trace->lock);
+        drain(trace);
+    }
+
+    return NULL;
+}
+
+int trace_open(struct trace *trace, const char *path, const char *category, uint64_t sample)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->rings = (struct trace_ring *)calloc(TRACE_RINGS, sizeof(*trace->rings));
+
+    if(trace->rings == NULL)
+    {
+        return -1;
+    }
+
+    trace->out = fopen(path, "w");
+
+    if(trace->out == NULL)
+    {
+        goto free_rings;
+    }
+
+    trace->sample   = sample == 0 ? 1 : sample;
+    trace->category = category;
+    trace->pid      = (int)getpid();
+    atomic_init(&trace->ring_count, 0);
+    atomic_init(&trace->dropped, 0);
+    atomic_init(&trace->stop, false);
+
+    // the array form needs no closing bracket, so a file cut short by a crash still loads
+    fputc('[', trace->out);
+    fprintf(trace->out, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", trace->pid, category);
+
+    if(pthread_mutex_init(&trace->lock, NULL) != 0)
+    {
+        goto close_file;
+    }
+
+    if(pthread_cond_init(&trace->wake, NULL) != 0)
+    {
+        goto destroy_lock;
+    }
+
+    if(pthread_create(&trace->flusher, NULL, flusher_main, trace) != 0)
+    {
+        goto destroy_cond;
+    }
+
+    return 0;
+
+destroy_cond:
+    pthread_cond_destroy(&trace->wake);
+
+destroy_lock:
+    pthread_mutex_destroy(&trace->lock);
+
+close_file:
+    fclose(trace->out);
+    trace->out = NULL;
+
+free_rings:
+    free(trace->rings);
+    trace->rings = NULL;
+
+    return -1;
+}
+
+void trace_close(struct trace *trace)
+{
+    uint64_t dropped;
+
+    if(trace->rings == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    atomic_store(&trace->stop, true);
+    pthread_cond_signal(&trace->wake);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->flusher, NULL);
+
+    // the recording threads are done, so whatever is left is drained here
+    drain(trace);
+    fputs("\n]\n", trace->out);
+    fclose(trace->out);
+    dropped = atomic_load(&trace->dropped);
+
+    if(dropped != 0)
+    {
+        fprintf(stderr, "Dropped %" PRIu64 " trace spans that found their ring full\n", dropped);
+    }
+
+    pthread_cond_destroy(&trace->wake);
+    pthread_mutex_destroy(&trace->lock);
+    free(trace->rings);
+    trace->rings = NULL;
+    trace->out   = NULL;
+}
+
+bool trace_sample(const struct trace *trace, const char *name, uint64_t *id)
+{
+    if(trace->rings == NULL)
+    {
+        return false;
+    }
+
+    *id = name_key(name);
+
+    return *id % trace->sample == 0;
+}
+
+void trace_span(struct trace *trace, uint64_t id, const char *name, uint64_t start_ns, uint64_t end_ns, const char *detail)
+{
+    struct trace_ring  *ring;
+    struct trace_event *event;
+    size_t              head;
+    size_t              used;
+
+    ring = claim_ring(trace);
+
+    if(ring == NULL)
+    {
+        atomic_fetch_add_explicit(&trace->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    used = head - atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if(used == TRACE_RING_EVENTS)
+    {
+        atomic_fetch_add_explicit(&trace->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    // a burst gets the flusher going early; a missed wake up only waits for the next period
+    if(used == TRACE_RING_EVENTS / 2)
+    {
+        pthread_cond_signal(&trace->wake);
+    }
+
+    event            = &ring->events[head % TRACE_RING_EVENTS];
+    event->name      = name;
+    event->id        = id;
+    event->start_ns  = start_ns;
+    event->end_ns    = end_ns < start_ns ? start_ns : end_ns;
+    event->detail[0] = '\0';
+
+    if(detail != NULL)
+    {
+        size_t len;
+
+        // the end of a long path tells files apart better than its start
+        len = strlen(detail);
+
+        if(len >= TRACE_DETAIL_LEN)
+        {
+            detail += len - (TRACE_DETAIL_LEN - 1);
+            len = TRACE_DETAIL_LEN - 1;
+        }
+
+        memcpy(event->detail, detail, len + 1);
+    }
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
@@ -1,10 +1,17 @@
 #include "../include/util.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 
+#define DECIMAL_BASE 10     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define JITTER_SHIFT_A 13    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define JITTER_SHIFT_B 7     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define JITTER_SHIFT_C 17    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
 ssize_t safe_read(const int fd, void *buf, const size_t count, bool exact)
 {
     unsigned char *p;
@@ -173,3 +180,209 @@ int init_sockaddr_un(struct sockaddr_un *addr, const char *path)
     strncpy(addr->sun_path, path, sizeof(addr->sun_path));
     return 0;
 }
+
+int parse_size(const char *str, size_t *value)
+{
+    char              *end;
+    unsigned long long parsed;
+
+    if(str == NULL || *str < '0' || *str > '9')
+    {
+        return -1;
+    }
+
+    errno  = 0;
+    parsed = strtoull(str, &end, 10);
+
+    if(errno != 0 || *end != '\0' || parsed > SIZE_MAX)
+    {
+        return -1;
+    }
+
+    *value = (size_t)parsed;
+    return 0;
+}
+
+int parse_busy(const char *response, size_t len, size_t *retry_ms)
+{
+    size_t prefix_len;
+    size_t suffix_len;
+    size_t value;
+    size_t i;
+
+    prefix_len = sizeof(BUSY_PREFIX) - 1;
+    suffix_len = sizeof(BUSY_SUFFIX) - 1;
+
+    if(len < prefix_len + 1 + suffix_len || memcmp(response, BUSY_PREFIX, prefix_len) != 0)
+    {
+        return -1;
+    }
+
+    value = 0;
+
+    for(i = prefix_len; i < len && response[i] >= '0' && response[i] <= '9'; i++)
+    {
+        size_t digit;
+
+        digit = (size_t)(response[i] - '0');
+
+        if(value > (SIZE_MAX - digit) / DECIMAL_BASE)
+        {
+            return -1;
+        }
+
+        value = (value * DECIMAL_BASE) + digit;
+    }
+
+    if(i == prefix_len || len - i != suffix_len || memcmp(response + i, BUSY_SUFFIX, suffix_len) != 0)
+    {
+        return -1;
+    }
+
+    *retry_ms = value;
+    return 0;
+}
+
+size_t busy_delay(size_t retry_ms, size_t attempt, size_t max_ms, uint64_t *jitter)
+{
+    for(size_t i = 0; i < attempt && retry_ms < max_ms; i++)
+    {
+        retry_ms *= 2;
+    }
+
+    retry_ms = retry_ms < max_ms ? retry_ms : max_ms;
+
+    // xorshift, good enough to spread clients apart
+    *jitter ^= *jitter << JITTER_SHIFT_A;
+    *jitter ^= *jitter >> JITTER_SHIFT_B;
+    *jitter ^= *jitter << JITTER_SHIFT_C;
+
+    return retry_ms + (size_t)(*jitter % ((retry_ms / 2) + 1));
+}
+
+int inherited_socket(void)
+{
+    const char *pid;
+    const char *fds;
+    size_t      listen_pid;
+    size_t      listen_fds;
+    int         accepting;
+    socklen_t   len;
+
+    pid = getenv(LISTEN_PID_ENV);
+    fds = getenv(LISTEN_FDS_ENV);
+
+    if(pid == NULL || fds == NULL || parse_size(pid, &listen_pid) == -1 || listen_pid != (size_t)getpid())
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // both values are parsed first: unsetenv may free the strings getenv pointed into
+    if(parse_size(fds, &listen_fds) == -1)
+    {
+        listen_fds = 0;
+    }
+
+    unsetenv(LISTEN_PID_ENV);
+    unsetenv(LISTEN_FDS_ENV);
+    unsetenv(LISTEN_FDNAMES_ENV);
+
+    if(listen_fds == 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    len = sizeof(accepting);
+
+    if(getsockopt(LISTEN_FDS_START, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) == -1)
+    {
+        return -1;
+    }
+
+    if(accepting == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // passed without close-on-exec so it survives into this process, which is as far as it should go
+    if(fcntl(LISTEN_FDS_START, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        return -1;
+    }
+
+    return LISTEN_FDS_START;
+}
+
+char *concat_path(const char *path, const char *suffix)
+{
+    char  *joined;
+    size_t path_len;
+    size_t suffix_len;
+
+    path_len   = strlen(path);
+    suffix_len = strlen(suffix);
+    joined     = (char *)malloc(path_len + suffix_len + 1);
+
+    if(joined != NULL)
+    {
+        memcpy(joined, path, path_len);
+        memcpy(joined + path_len, suffix, suffix_len + 1);
+    }
+
+    return joined;
+}
+
+char *join_path(const char *parent, const char *name)
+{
+    char  *joined;
+    size_t parent_len;
+    size_t name_len;
+    size_t separator;
+
+    parent_len = strlen(parent);
+    name_len   = strlen(name);
+    separator  = parent_len > 0 && parent[parent_len - 1] == '/' ? 0 : 1;
+    joined     = (char *)malloc(parent_len + separator + name_len + 1);
+
+    if(joined != NULL)
+    {
+        memcpy(joined, parent, parent_len);
+        joined[parent_len] = '/';
+        memcpy(joined + parent_len + separator, name, name_len + 1);
+    }
+
+    return joined;
+}
+
+uint32_t fnv1a32(const void *buf, size_t len, uint32_t hash)
+{
+    const uint8_t *p;
+
+    p = (const uint8_t *)buf;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV32_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t fnv1a64(const void *buf, size_t len, uint64_t hash)
+{
+    const uint8_t *p;
+
+    p = (const uint8_t *)buf;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV64_PRIME;
+    }
+
+    return hash;
+}
@@ -0,0 +1,605 @@
+#if defined(__linux__)
+    #define _DEFAULT_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) DT_* for readdir
+#endif
+
+#include "watcher.h"
+#include "util.h"
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/inotify.h>
+#endif
+
+#if defined(__linux__)
+
+    #define INITIAL_BUCKETS 256    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define INITIAL_DIRS 64        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define MS_PER_SEC 1000        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+    #define NS_PER_MS 1000000      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+    // a close after writing or a rename into place means the file is complete, new directories are walked
+    #define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+static int64_t  now_ms(void);
+static uint64_t hash_path(const char *path);
+static int      grow_buckets(struct watcher *watcher);
+static void     unlink_change(struct watcher *watcher, struct watch_change *change);
+static void     note_change(struct watcher *watcher, char *path);
+static int      add_watch(struct watcher *watcher, const char *path);
+static void     watch_tree(struct watcher *watcher, const char *root, bool queue_files);
+static void     handle_event(struct watcher *watcher, const struct inotify_event *event);
+static void     drain_events(struct watcher *watcher);
+
+static int64_t now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((int64_t)now.tv_sec * MS_PER_SEC) + (now.tv_nsec / NS_PER_MS);
+}
+
+static uint64_t hash_path(const char *path)
+{
+    return fnv1a64(path, strlen(path), FNV64_OFFSET_BASIS);
+}
+
+static int grow_buckets(struct watcher *watcher)
+{
+    struct watch_change **buckets;
+    size_t                bucket_count;
+
+    bucket_count = watcher->bucket_count == 0 ? INITIAL_BUCKETS : watcher->bucket_count * 2;
+    buckets      = (struct watch_change **)calloc(bucket_count, sizeof(struct watch_change *));
+
+    if(buckets == NULL)
+    {
+        return -1;
+    }
+
+    for(struct watch_change *change = watcher->oldest; change != NULL; change = change->newer)
+    {
+        size_t bucket;
+
+        bucket              = change->hash & (bucket_count - 1);
+        change->bucket_next = buckets[bucket];
+        buckets[bucket]     = change;
+    }
+
+    free((void *)watcher->buckets);
+    watcher->buckets      = buckets;
+    watcher->bucket_count = bucket_count;
+
+    return 0;
+}
+
+static void unlink_change(struct watcher *watcher, struct watch_change *change)
+{
+    struct watch_change **link;
+
+    link = &watcher->buckets[change->hash & (watcher->bucket_count - 1)];
+
+    while(*link != change)
+    {
+        link = &(*link)->bucket_next;
+    }
+
+    *link = change->bucket_next;
+
+    if(change->older == NULL)
+    {
+        watcher->oldest = change->newer;
+    }
+    else
+    {
+        change->older->newer = change->newer;
+    }
+
+    if(change->newer == NULL)
+    {
+        watcher->newest = change->older;
+    }
+    else
+    {
+        change->newer->older = change->older;
+    }
+
+    watcher->change_count--;
+}
+
+/*
+ * Restarts the debounce window of path, which the watcher now owns. A
+ * burst of writes to one file collapses into a single change.
+ */
+static void note_change(struct watcher *watcher, char *path)
+{
+    struct watch_change *change;
+    uint64_t             hash;
+
+    if(path == NULL)
+    {
+        return;
+    }
+
+    hash   = hash_path(path);
+    change = NULL;
+
+    if(watcher->bucket_count != 0)
+    {
+        change = watcher->buckets[hash & (watcher->bucket_count - 1)];
+
+        while(change != NULL && (change->hash != hash || strcmp(change->path, path) != 0))
+        {
+            change = change->bucket_next;
+        }
+    }
+
+    if(change != NULL)
+    {
+        free(path);
+        unlink_change(watcher, change);
+    }
+    else
+    {
+        if(watcher->change_count >= watcher->bucket_count && grow_buckets(watcher) == -1)
+        {
+            free(path);
+            return;
+        }
+
+        change = (struct watch_change *)malloc(sizeof(*change));
+
+        if(change == NULL)
+        {
+            free(path);
+            return;
+        }
+
+        change->path = path;
+        change->hash = hash;
+    }
+
+    change->deadline_ms = now_ms() + watcher->debounce_ms;
+    change->older       = watcher->newest;
+    change->newer       = NULL;
+    change->bucket_next = watcher->buckets[hash & (watcher->bucket_count - 1)];
+
+    watcher->buckets[hash & (watcher->bucket_count - 1)] = change;
+
+    if(watcher->newest == NULL)
+    {
+        watcher->oldest = change;
+    }
+    else
+    {
+        watcher->newest->newer = change;
+    }
+
+    watcher->newest = change;
+    watcher->change_count++;
+}
+
+/*
+ * Watch descriptors are small and handed out in increasing order, so
+ * the directory behind each one is found by index. Watching a directory
+ * again, say after it was moved, returns its old descriptor and only
+ * updates the path.
+ */
+static int add_watch(struct watcher *watcher, const char *path)
+{
+    char  *copy;
+    size_t index;
+    int    wd;
+
+    wd = inotify_add_watch(watcher->notify_fd, path, WATCH_MASK);
+
+    if(wd == -1)
+    {
+        return -1;
+    }
+
+    index = (size_t)wd;
+
+    if(index >= watcher->dir_capacity)
+    {
+        char **dirs;
+        size_t capacity;
+
+        capacity = watcher->dir_capacity == 0 ? INITIAL_DIRS : watcher->dir_capacity;
+
+        while(capacity <= index)
+        {
+            capacity *= 2;
+        }
+
+        dirs = (char **)realloc((void *)watcher->dirs, capacity * sizeof(char *));
+
+        if(dirs == NULL)
+        {
+            inotify_rm_watch(watcher->notify_fd, wd);
+            return -1;
+        }
+
+        memset((void *)(dirs + watcher->dir_capacity), 0, (capacity - watcher->dir_capacity) * sizeof(char *));
+        watcher->dirs         = dirs;
+        watcher->dir_capacity = capacity;
+    }
+
+    copy = strdup(path);
+
+    if(copy == NULL)
+    {
+        return -1;
+    }
+
+    if(watcher->dirs[index] == NULL)
+    {
+        watcher->dir_count++;
+    }
+
+    free(watcher->dirs[index]);
+    watcher->dirs[index] = copy;
+
+    return 0;
+}
+
+/*
+ * Watches root and every directory below it. The watch goes on before
+ * a directory is read, so a file written while the walk runs is either
+ * seen by the walk or reported by an event; queue_files covers the
+ * files that were already there.
+ */
+static void watch_tree(struct watcher *watcher, const char *root, bool queue_files)
+{
+    char **stack;
+    size_t stack_len;
+    size_t stack_cap;
+
+    stack_cap = INITIAL_DIRS;
+    stack     = (char **)malloc(stack_cap * sizeof(char *));
+
+    if(stack == NULL)
+    {
+        return;
+    }
+
+    stack[0]  = strdup(root);
+    stack_len = stack[0] == NULL ? 0 : 1;
+
+    while(stack_len > 0)
+    {
+        const struct dirent *entry;
+        DIR                 *dir;
+        char                *path;
+
+        path = stack[--stack_len];
+
+        if(add_watch(watcher, path) == -1)
+        {
+            free(path);
+            continue;
+        }
+
+        dir = opendir(path);
+
+        if(dir == NULL)
+        {
+            free(path);
+            continue;
+        }
+
+        while((entry = readdir(dir)) != NULL)
+        {
+            unsigned char type;
+            char         *child;
+
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            {
+                continue;
+            }
+
+            child = join_path(path, entry->d_name);
+
+            if(child == NULL)
+            {
+                continue;
+            }
+
+            type = entry->d_type;
+
+            if(type == DT_UNKNOWN)
+            {
+                struct stat stats;
+
+                if(lstat(child, &stats) == 0)
+                {
+                    type = S_ISDIR(stats.st_mode) ? DT_DIR : (S_ISREG(stats.st_mode) ? DT_REG : DT_UNKNOWN);
+                }
+            }
+
+            if(type == DT_DIR)
+            {
+                if(stack_len == stack_cap)
+                {
+                    char **grown;
+
+                    grown = (char **)realloc((void *)stack, stack_cap * 2 * sizeof(char *));
+
+                    if(grown == NULL)
+                    {
+                        free(child);
+                        continue;
+                    }
+
+                    stack      = grown;
+                    stack_cap *= 2;
+                }
+
+                stack[stack_len++] = child;
+            }
+            else if(type == DT_REG && queue_files)
+            {
+                note_change(watcher, child);
+            }
+            else
+            {
+                free(child);
+            }
+        }
+
+        closedir(dir);
+        free(path);
+    }
+
+    free((void *)stack);
+}
+
+static void handle_event(struct watcher *watcher, const struct inotify_event *event)
+{
+    const char *dir;
+    char       *path;
+
+    watcher->events_seen++;
+
+    // the kernel dropped events, so anything below the roots may have changed
+    if(event->mask & IN_Q_OVERFLOW)
+    {
+        watcher->overflows++;
+
+        for(size_t i = 0; i < watcher->root_count; i++)
+        {
+            watch_tree(watcher, watcher->roots[i], true);
+        }
+
+        return;
+    }
+
+    if(event->wd < 0 || (size_t)event->wd >= watcher->dir_capacity || watcher->dirs[event->wd] == NULL)
+    {
+        return;
+    }
+
+    if(event->mask & IN_IGNORED)
+    {
+        free(watcher->dirs[event->wd]);
+        watcher->dirs[event->wd] = NULL;
+        watcher->dir_count--;
+        return;
+    }
+
+    if(event->len == 0 || event->name[0] == '\0')
+    {
+        return;
+    }
+
+    dir  = watcher->dirs[event->wd];
+    path = join_path(dir, event->name);
+
+    if(path == NULL)
+    {
+        return;
+    }
+
+    if(event->mask & IN_ISDIR)
+    {
+        // a directory made or moved in may already hold files written before its watch existed
+        if(event->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            watch_tree(watcher, path, true);
+        }
+
+        free(path);
+        return;
+    }
+
+    if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        note_change(watcher, path);
+        return;
+    }
+
+    free(path);
+}
+
+static void drain_events(struct watcher *watcher)
+{
+    for(;;)
+    {
+        ssize_t read_len;
+
+        read_len = read(watcher->notify_fd, watcher->events, WATCHER_EVENT_BUF_LEN);
+
+        if(read_len <= 0)
+        {
+            return;
+        }
+
+        // the kernel pads each name so the next event stays aligned
+        for(size_t offset = 0; offset < (size_t)read_len;)
+        {
+            const struct inotify_event *event;
+
+            event = (const struct inotify_event *)(watcher->events + offset);
+            handle_event(watcher, event);
+            offset += sizeof(*event) + event->len;
+        }
+    }
+}
+
+int watcher_start(struct watcher *watcher, const char **roots, size_t root_count, size_t debounce_ms, int wake_fd)
+{
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->notify_fd = -1;
+    watcher->wake_fd   = wake_fd;
+
+    if(root_count == 0 || root_count > WATCHER_MAX_ROOTS)
+    {
+        return -1;
+    }
+
+    for(size_t i = 0; i < root_count; i++)
+    {
+        struct stat root_stats;
+
+        if(stat(roots[i], &root_stats) == -1 || !S_ISDIR(root_stats.st_mode))
+        {
+            return -1;
+        }
+    }
+
+    watcher->roots       = roots;
+    watcher->root_count  = root_count;
+    watcher->debounce_ms = (int64_t)debounce_ms;
+    watcher->events      = (char *)malloc(WATCHER_EVENT_BUF_LEN);
+    watcher->notify_fd   = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if(watcher->events == NULL || watcher->notify_fd == -1 || grow_buckets(watcher) == -1)
+    {
+        watcher_stop(watcher);
+        return -1;
+    }
+
+    for(size_t i = 0; i < root_count; i++)
+    {
+        watch_tree(watcher, roots[i], false);
+    }
+
+    if(watcher->dir_count == 0)
+    {
+        watcher_stop(watcher);
+        return -1;
+    }
+
+    return 0;
+}
+
+enum watcher_next watcher_next(struct watcher *watcher, bool wait, char **path)
+{
+    for(;;)
+    {
+        struct pollfd poll_fds[2];
+        int64_t       now;
+        int           timeout;
+
+        drain_events(watcher);
+        now = now_ms();
+
+        if(watcher->oldest != NULL && watcher->oldest->deadline_ms <= now)
+        {
+            struct watch_change *change;
+
+            change = watcher->oldest;
+            *path  = change->path;
+            unlink_change(watcher, change);
+            free(change);
+            watcher->submitted++;
+
+            return WATCHER_PATH;
+        }
+
+        if(!wait)
+        {
+            return WATCHER_PENDING;
+        }
+
+        // a negative fd is skipped by poll, so a watcher without wake_fd waits on its events alone
+        timeout             = watcher->oldest == NULL ? -1 : (int)(watcher->oldest->deadline_ms - now);
+        poll_fds[0].fd      = watcher->notify_fd;
+        poll_fds[0].events  = POLLIN;
+        poll_fds[0].revents = 0;
+        poll_fds[1].fd      = watcher->wake_fd;
+        poll_fds[1].events  = POLLIN;
+        poll_fds[1].revents = 0;
+
+        if((poll(poll_fds, 2, timeout) == -1 && errno == EINTR) || poll_fds[1].revents != 0)
+        {
+            return WATCHER_PENDING;
+        }
+    }
+}
+
+void watcher_stop(struct watcher *watcher)
+{
+    while(watcher->oldest != NULL)
+    {
+        struct watch_change *change;
+
+        change          = watcher->oldest;
+        watcher->oldest = change->newer;
+        free(change->path);
+        free(change);
+    }
+
+    for(size_t i = 0; i < watcher->dir_capacity; i++)
+    {
+        free(watcher->dirs[i]);
+    }
+
+    if(watcher->notify_fd != -1)
+    {
+        close(watcher->notify_fd);
+    }
+
+    free((void *)watcher->dirs);
+    free((void *)watcher->buckets);
+    free(watcher->events);
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->notify_fd = -1;
+    watcher->wake_fd   = -1;
+}
+
+#else
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wunused-parameter"
+
+int watcher_start(struct watcher *watcher, const char **roots, size_t root_count, size_t debounce_ms, int wake_fd)
+{
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->notify_fd = -1;
+    watcher->wake_fd   = -1;
+
+    return -1;
+}
+
+enum watcher_next watcher_next(struct watcher *watcher, bool wait, char **path)
+{
+    return WATCHER_PENDING;
+}
+
+    #pragma GCC diagnostic pop
+
+void watcher_stop(struct watcher *watcher)
+{
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->notify_fd = -1;
+    watcher->wake_fd   = -1;
+}
+
+#endif
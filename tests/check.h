@@ -0,0 +1,45 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK_SHIFT_A 12                          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CHECK_SHIFT_B 25                          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CHECK_SHIFT_C 27                          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define CHECK_MULTIPLIER 0x2545F4914F6CDD1DULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * The tests are plain programs run by ctest: every failed check is
+ * reported with its line and the program exits non-zero at the end, so
+ * one run shows every check that failed rather than only the first.
+ */
+static int check_failures = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+#define CHECK(condition)                                                                 \
+    do                                                                                   \
+    {                                                                                    \
+        if(!(condition))                                                                 \
+        {                                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            check_failures++;                                                            \
+        }                                                                                \
+    } while(0)
+
+#define CHECK_DONE() (check_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+/*
+ * A fixed seed keeps a failing run reproducible; the generator is
+ * xorshift64*, which is plenty for shuffling test inputs.
+ */
+static inline uint64_t check_random(uint64_t *state)
+{
+    *state ^= *state >> CHECK_SHIFT_A;
+    *state ^= *state << CHECK_SHIFT_B;
+    *state ^= *state >> CHECK_SHIFT_C;
+
+    return *state * CHECK_MULTIPLIER;
+}
+
+#endif    // CHECK_H
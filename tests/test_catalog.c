@@ -0,0 +1,219 @@
+#include "catalog.h"
+#include "check.h"
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KEYS 100000                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SUPERSEDED 20000              // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PROBES 4                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAINTAIN_ROUNDS 100000        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAINTAIN_WAIT_NS 1000000      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PATH_LEN 256                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SEED 0x9e3779b97f4a7c15ULL
+#define DIR_TEMPLATE "/tmp/test_catalogXXXXXX"
+
+static uint64_t key_of(uint64_t i);
+static void     make_result(struct elf_result *result, uint64_t i, uint32_t generation);
+static bool     has_result(const struct catalog *catalog, uint64_t i, uint32_t generation);
+static void     count_visit(uint64_t key, const struct elf_result *result, void *arg);
+static void     test_growth(const char *path);
+static bool     index_in_place(const struct catalog *catalog);
+static void     test_compaction(const char *path);
+
+// spread the keys over the table as content keys would be
+static uint64_t key_of(uint64_t i)
+{
+    return (i + 1) * SEED;
+}
+
+static void make_result(struct elf_result *result, uint64_t i, uint32_t generation)
+{
+    memset(result, 0, sizeof(*result));
+    result->entry = i;
+    result->flags = generation;
+    result->valid = 1;
+}
+
+static bool has_result(const struct catalog *catalog, uint64_t i, uint32_t generation)
+{
+    struct elf_result result;
+
+    return catalog_get(catalog, key_of(i), &i, sizeof(i), &result) == 0 && result.entry == i && result.flags == generation;
+}
+
+static void count_visit(uint64_t key, const struct elf_result *result, void *arg)
+{
+    (void)key;
+    (void)result;
+    (*(uint64_t *)arg)++;
+}
+
+/*
+ * Puts enough keys to grow the index twice, checking on the way that
+ * keys stay visible while the old table is still being moved, and
+ * that the index left behind serves a reopen without a replay.
+ */
+static void test_growth(const char *path)
+{
+    struct catalog    catalog;
+    struct elf_result result;
+    uint64_t          state;
+    uint64_t          visited;
+    uint64_t          capacity;
+    uint64_t          other;
+    bool              saw_growth;
+
+    CHECK(catalog_open(&catalog, path) == 0);
+    capacity   = catalog.index->capacity;
+    state      = SEED;
+    saw_growth = false;
+
+    for(uint64_t i = 0; i < KEYS; i++)
+    {
+        make_result(&result, i, 1);
+        CHECK(catalog_put(&catalog, key_of(i), &i, sizeof(i), &result) == 0);
+        saw_growth = saw_growth || catalog.old_index != NULL;
+
+        for(size_t probe = 0; probe < PROBES; probe++)
+        {
+            CHECK(has_result(&catalog, check_random(&state) % (i + 1), 1));
+        }
+    }
+
+    CHECK(saw_growth);
+    CHECK(catalog.index->capacity > capacity);
+    CHECK(catalog.index->count == KEYS);
+
+    // supersede keys while a move may still be going, the newer results must win
+    for(uint64_t i = 0; i < SUPERSEDED; i++)
+    {
+        make_result(&result, i, 2);
+        CHECK(catalog_put(&catalog, key_of(i), &i, sizeof(i), &result) == 0);
+    }
+
+    for(uint64_t i = 0; i < KEYS; i++)
+    {
+        CHECK(has_result(&catalog, i, i < SUPERSEDED ? 2 : 1));
+    }
+
+    CHECK(catalog.index->dead == SUPERSEDED);
+    catalog_close(&catalog);
+
+    CHECK(catalog_open(&catalog, path) == 0);
+    CHECK(catalog.old_index == NULL);
+    CHECK(catalog.index->count == KEYS);
+    visited = 0;
+    CHECK(catalog_scan(&catalog, count_visit, &visited) == KEYS);
+    CHECK(visited == KEYS);
+
+    for(uint64_t i = 0; i < KEYS; i++)
+    {
+        CHECK(has_result(&catalog, i, i < SUPERSEDED ? 2 : 1));
+    }
+
+    // the key alone is not enough, the header it came from has to match as well
+    other = KEYS;
+    CHECK(catalog_get(&catalog, key_of(0), &other, sizeof(other), &result) == -1);
+    catalog_close(&catalog);
+}
+
+// the table being written is the one a restart would find at index_path
+static bool index_in_place(const struct catalog *catalog)
+{
+    struct stat open_stats;
+    struct stat path_stats;
+
+    return fstat(catalog->index_fd, &open_stats) == 0 && stat(catalog->index_path, &path_stats) == 0 && open_stats.st_ino == path_stats.st_ino;
+}
+
+/*
+ * Supersedes more than half the keys so maintenance compacts, and
+ * grows the index while the compaction runs, then checks the swapped
+ * in catalog and that its index is the one on disk.
+ */
+static void test_compaction(const char *path)
+{
+    static const struct timespec wait = {0, MAINTAIN_WAIT_NS};
+    struct catalog               catalog;
+    struct elf_result            result;
+    size_t                       rounds;
+    uint64_t                     total;
+
+    CHECK(catalog_open(&catalog, path) == 0);
+
+    for(uint64_t i = 0; i < KEYS; i++)
+    {
+        make_result(&result, i, 3);
+        CHECK(catalog_put(&catalog, key_of(i), &i, sizeof(i), &result) == 0);
+    }
+
+    CHECK(catalog_maintain(&catalog) == 0);
+    CHECK(catalog.compacting);
+
+    // new keys until the index starts to grow, which is left mid move when the compaction is swapped in
+    for(total = KEYS; catalog.old_index == NULL; total++)
+    {
+        make_result(&result, total, 3);
+        CHECK(catalog_put(&catalog, key_of(total), &total, sizeof(total), &result) == 0);
+    }
+
+    for(rounds = 0; !atomic_load(&catalog.compact_done) && rounds < MAINTAIN_ROUNDS; rounds++)
+    {
+        nanosleep(&wait, NULL);
+    }
+
+    for(rounds = 0; catalog.compacting && rounds < MAINTAIN_ROUNDS; rounds++)
+    {
+        CHECK(catalog_maintain(&catalog) == 0);
+        nanosleep(&wait, NULL);
+    }
+
+    CHECK(!catalog.compacting);
+    CHECK(catalog.old_index == NULL);
+    CHECK(catalog.index->dead == 0);
+    CHECK(catalog.index->count == total);
+    CHECK(index_in_place(&catalog));
+
+    for(uint64_t i = 0; i < total; i++)
+    {
+        CHECK(has_result(&catalog, i, 3));
+    }
+
+    catalog_close(&catalog);
+
+    CHECK(catalog_open(&catalog, path) == 0);
+    CHECK(catalog.index->count == total);
+    CHECK(index_in_place(&catalog));
+    catalog_close(&catalog);
+}
+
+int main(void)
+{
+    static const char *const suffixes[] = {"", CATALOG_INDEX_SUFFIX};
+    char                     dir[]      = DIR_TEMPLATE;
+    char                     path[PATH_LEN];
+    char                     file_path[PATH_LEN];
+
+    if(mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    snprintf(path, sizeof(path), "%s/catalog", dir);
+    test_growth(path);
+    test_compaction(path);
+
+    for(size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++)
+    {
+        snprintf(file_path, sizeof(file_path), "%s/catalog%s", dir, suffixes[i]);
+        unlink(file_path);
+    }
+
+    rmdir(dir);
+
+    return CHECK_DONE();
+}
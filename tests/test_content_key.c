@@ -0,0 +1,146 @@
+#include "check.h"
+#include "content_key.h"
+#include "elf_validator.h"
+#include <string.h>
+
+#define SAMPLES 4096                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SEED 0x2F6B1C3D4E5A7980ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define LONG_NAME_LEN 8192            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define KEY_BITS 64                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIN_FLIPPED 8                 // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAX_FLIPPED 56                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static int  bits_set(uint64_t value);
+static void test_pinned_values(void);
+static void test_span(void);
+static void test_names(void);
+static void test_mix(void);
+
+static int bits_set(uint64_t value)
+{
+    int count;
+
+    count = 0;
+
+    while(value != 0)
+    {
+        value &= value - 1;
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Keys are written to the catalog and the shared cache and compared
+ * across processes and releases, so their values are part of the file
+ * formats and must not drift.
+ */
+static void test_pinned_values(void)
+{
+    uint8_t header[CONTENT_KEY_SPAN];
+
+    memset(header, 0, sizeof(header));
+    header[0] = ELFMAG0;
+    header[1] = ELFMAG1;
+    header[2] = ELFMAG2;
+    header[3] = ELFMAG3;
+
+    CHECK(content_key("", 0) == 0x25fc6dd36ce04b20ULL);
+    CHECK(content_key(header, sizeof(header)) == 0xd0d9efe78c526249ULL);
+    CHECK(name_key("/bin/ls") == 0xae0cbe4c95499bfbULL);
+    CHECK(mix64(1) == 0x5692161d100b05e5ULL);
+}
+
+static void test_span(void)
+{
+    uint8_t  buf[CONTENT_KEY_SPAN * 2];
+    uint64_t key;
+    uint64_t state;
+
+    state = SEED;
+
+    for(size_t i = 0; i < sizeof(buf); i++)
+    {
+        buf[i] = (uint8_t)check_random(&state);
+    }
+
+    key = content_key(buf, sizeof(buf));
+
+    // nothing past the span takes part
+    CHECK(content_key(buf, CONTENT_KEY_SPAN) == key);
+    buf[CONTENT_KEY_SPAN] ^= 1;
+    CHECK(content_key(buf, sizeof(buf)) == key);
+
+    // every byte inside it does
+    for(size_t i = 0; i < CONTENT_KEY_SPAN; i++)
+    {
+        buf[i] ^= 1;
+        CHECK(content_key(buf, sizeof(buf)) != key);
+        buf[i] ^= 1;
+    }
+
+    // a short file is not its zero padded twin
+    memset(buf, 0, sizeof(buf));
+    CHECK(content_key(buf, CONTENT_KEY_SPAN / 2) != content_key(buf, CONTENT_KEY_SPAN));
+    CHECK(content_key(buf, 0) != content_key(buf, 1));
+}
+
+static void test_names(void)
+{
+    static char long_name[LONG_NAME_LEN + 1];
+
+    CHECK(name_key("/bin/ls") == name_key("/bin/ls"));
+    CHECK(name_key("/bin/ls") != name_key("/bin/sl"));
+    CHECK(name_key("") != name_key("/"));
+
+    // names longer than any span still hash in full
+    memset(long_name, 'a', LONG_NAME_LEN);
+    long_name[LONG_NAME_LEN] = '\0';
+    CHECK(name_key(long_name) != name_key(long_name + 1));
+    long_name[LONG_NAME_LEN - 1] = 'b';
+    CHECK(name_key(long_name) != name_key(long_name + 1));
+}
+
+static void test_mix(void)
+{
+    static uint64_t outputs[SAMPLES];
+    uint64_t        state;
+
+    CHECK(mix64(0) == 0);
+
+    // nearby inputs must land far apart; a collision among neighbours would be a bug
+    for(uint64_t value = 0; value < SAMPLES; value++)
+    {
+        outputs[value] = mix64(value + 1);
+        CHECK(outputs[value] != value + 1);
+
+        for(uint64_t earlier = 0; earlier < value; earlier++)
+        {
+            CHECK(outputs[earlier] != outputs[value]);
+        }
+    }
+
+    state = SEED;
+
+    // a one bit change flips close to half the output bits
+    for(int i = 0; i < SAMPLES; i++)
+    {
+        uint64_t value;
+        int      flipped;
+
+        value   = check_random(&state);
+        flipped = bits_set(mix64(value) ^ mix64(value ^ (1ULL << (i % KEY_BITS))));
+        CHECK(flipped > MIN_FLIPPED && flipped < MAX_FLIPPED);
+    }
+}
+
+int main(void)
+{
+    test_pinned_values();
+    test_span();
+    test_names();
+    test_mix();
+
+    return CHECK_DONE();
+}
@@ -0,0 +1,146 @@
+#include "check.h"
+#include "elf32_header.h"
+#include "elf_inspect.h"
+#include <string.h>
+
+/*
+ * Headers are laid out byte by byte at the offsets the ELF
+ * specification gives, not through the header structs, so a decoding
+ * that leans on the host's byte order or struct layout shows up here.
+ */
+#define EI_CLASS 4                       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define EI_DATA 5                        // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define EI_VERSION 6                     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define TYPE_OFFSET 16                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MACHINE_OFFSET 18                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ENTRY_OFFSET 24                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FLAGS32_OFFSET 36                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FLAGS64_OFFSET 48                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ENTRY32 0x08049000ULL            // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ENTRY64 0x0000123456789ABCULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define FLAGS 0x01020304U                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BITS_PER_BYTE 8                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static void put(uint8_t *field, size_t len, uint64_t value, uint8_t data);
+static void make_header(uint8_t *header, uint8_t class, uint8_t data, uint16_t type, uint16_t machine, uint64_t entry);
+static void test_byte_orders(void);
+static void test_format(void);
+static void test_rejects(void);
+
+static void put(uint8_t *field, size_t len, uint64_t value, uint8_t data)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        size_t shift;
+
+        shift    = data == ELFDATA2MSB ? len - 1 - i : i;
+        field[i] = (uint8_t)(value >> (shift * BITS_PER_BYTE));
+    }
+}
+
+static void make_header(uint8_t *header, uint8_t class, uint8_t data, uint16_t type, uint16_t machine, uint64_t entry)
+{
+    memset(header, 0, ELF_INSPECT_HEADER_LEN);
+    header[0]          = ELFMAG0;
+    header[1]          = ELFMAG1;
+    header[2]          = ELFMAG2;
+    header[3]          = ELFMAG3;
+    header[EI_CLASS]   = class;
+    header[EI_DATA]    = data;
+    header[EI_VERSION] = EV_CURRENT;
+    put(header + TYPE_OFFSET, sizeof(uint16_t), type, data);
+    put(header + MACHINE_OFFSET, sizeof(uint16_t), machine, data);
+
+    if(class == ELFCLASS32)
+    {
+        put(header + ENTRY_OFFSET, sizeof(uint32_t), entry, data);
+        put(header + FLAGS32_OFFSET, sizeof(uint32_t), FLAGS, data);
+    }
+    else
+    {
+        put(header + ENTRY_OFFSET, sizeof(uint64_t), entry, data);
+        put(header + FLAGS64_OFFSET, sizeof(uint32_t), FLAGS, data);
+    }
+}
+
+static void test_byte_orders(void)
+{
+    static const uint8_t classes[] = {ELFCLASS32, ELFCLASS64};
+    static const uint8_t orders[]  = {ELFDATA2LSB, ELFDATA2MSB};
+
+    for(size_t c = 0; c < sizeof(classes); c++)
+    {
+        for(size_t o = 0; o < sizeof(orders); o++)
+        {
+            uint8_t           header[ELF_INSPECT_HEADER_LEN];
+            struct elf_result result;
+            uint64_t          entry;
+
+            // a type and machine whose two bytes differ, so a swap cannot pass unnoticed
+            entry = classes[c] == ELFCLASS32 ? ENTRY32 : ENTRY64;
+            make_header(header, classes[c], orders[o], ET_DYN, EM_AARCH64, entry);
+
+            CHECK(elf_inspect_buffer(header, sizeof(header), &result) == 0);
+            CHECK(result.valid);
+            CHECK(result.class == classes[c]);
+            CHECK(result.data == orders[o]);
+            CHECK(result.version == EV_CURRENT);
+            CHECK(result.type == ET_DYN);
+            CHECK(result.machine == EM_AARCH64);
+            CHECK(result.entry == entry);
+            CHECK(result.flags == FLAGS);
+        }
+    }
+}
+
+static void test_format(void)
+{
+    uint8_t           header[ELF_INSPECT_HEADER_LEN];
+    struct elf_result result;
+    char              response[ELF_INSPECT_RESPONSE_LEN];
+
+    make_header(header, ELFCLASS64, ELFDATA2MSB, ET_EXEC, EM_PPC64, ENTRY64);
+    CHECK(elf_inspect_buffer(header, sizeof(header), &result) == 0 && result.valid);
+    CHECK(elf_inspect_format("/bin/big", &result, response, sizeof(response)) > 0);
+    CHECK(strstr(response, "File: /bin/big\nValid ELF: yes\n") == response);
+    CHECK(strstr(response, "Entry point: 0x123456789abc") != NULL);
+    CHECK(elf_inspect_format("/bin/big", &result, response, 1) == -1);
+
+    make_header(header, ELFCLASS32, ELFDATA2LSB, ET_EXEC, EM_386, ENTRY32);
+    CHECK(elf_inspect_buffer(header, sizeof(header), &result) == 0 && result.valid);
+    CHECK(elf_inspect_format("/bin/small", &result, response, sizeof(response)) > 0);
+    CHECK(strstr(response, "Entry point: 0x8049000") != NULL);
+}
+
+static void test_rejects(void)
+{
+    uint8_t           header[ELF_INSPECT_HEADER_LEN];
+    struct elf_result result;
+
+    // a 32 bit header fits in 52 bytes, a 64 bit one does not
+    make_header(header, ELFCLASS32, ELFDATA2LSB, ET_EXEC, EM_386, ENTRY32);
+    CHECK(elf_inspect_buffer(header, ELF32_HEADER_LEN - 1, &result) == 0 && !result.valid);
+    CHECK(elf_inspect_buffer(header, ELF32_HEADER_LEN, &result) == 0 && result.valid);
+
+    make_header(header, ELFCLASS64, ELFDATA2LSB, ET_EXEC, EM_X86_64, ENTRY64);
+    CHECK(elf_inspect_buffer(header, ELF32_HEADER_LEN, &result) == 0 && !result.valid);
+    CHECK(strcmp(result.error, "File data too short to be ELF64") == 0);
+
+    make_header(header, ELFCLASSNONE, ELFDATA2LSB, ET_EXEC, EM_X86_64, ENTRY64);
+    CHECK(elf_inspect_buffer(header, sizeof(header), &result) == 0 && !result.valid);
+    CHECK(strcmp(result.error, "Unknown ELF class") == 0);
+
+    make_header(header, ELFCLASS64, ELFDATA2LSB, ET_EXEC, EM_X86_64, ENTRY64);
+    header[1] = 'e';
+    CHECK(elf_inspect_buffer(header, sizeof(header), &result) == 0 && !result.valid);
+    CHECK(strcmp(result.error, "Bad magic number") == 0);
+}
+
+int main(void)
+{
+    test_byte_orders();
+    test_format();
+    test_rejects();
+
+    return CHECK_DONE();
+}
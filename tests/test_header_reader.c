@@ -0,0 +1,197 @@
+#include "check.h"
+#include "header_reader.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FILES 300                     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DEPTH 8                       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DRIVES 4                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PATH_LEN 256                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DIR_TEMPLATE "/tmp/test_header_readerXXXXXX"
+#define FD_DIR "/proc/self/fd"
+
+static size_t open_fds(void);
+static void   make_files(const char *dir);
+static char  *file_path(const char *dir, size_t i);
+static void   test_reads(const char *dir, bool use_uring);
+static void   test_close_in_flight(const char *dir);
+
+static size_t open_fds(void)
+{
+    DIR                 *fds;
+    const struct dirent *entry;
+    size_t               count;
+
+    fds   = opendir(FD_DIR);
+    count = 0;
+
+    if(fds == NULL)
+    {
+        return 0;
+    }
+
+    while((entry = readdir(fds)) != NULL)
+    {
+        count += entry->d_name[0] != '.';
+    }
+
+    closedir(fds);
+
+    return count;
+}
+
+// file i holds i + 1 bytes of i, so every header tells which file it came from
+static void make_files(const char *dir)
+{
+    for(size_t i = 0; i < FILES; i++)
+    {
+        uint8_t data[FILES];
+        char   *path;
+        int     fd;
+
+        path = file_path(dir, i);
+        memset(data, (int)(i % UINT8_MAX), sizeof(data));
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        CHECK(fd != -1 && write(fd, data, i + 1) == (ssize_t)(i + 1));
+        close(fd);
+        free(path);
+    }
+}
+
+static char *file_path(const char *dir, size_t i)
+{
+    char *path;
+
+    path = (char *)malloc(PATH_LEN);
+
+    if(path != NULL)
+    {
+        snprintf(path, PATH_LEN, "%s/%zu", dir, i);
+    }
+
+    return path;
+}
+
+static void test_reads(const char *dir, bool use_uring)
+{
+    struct header_reader reader;
+    size_t               submitted;
+    size_t               taken;
+    size_t               fds_before;
+
+    fds_before = open_fds();
+    CHECK(header_reader_open(&reader, DEPTH, use_uring) == 0);
+    submitted = 0;
+    taken     = 0;
+
+    while(taken < FILES + 1)
+    {
+        struct header_read *read;
+
+        // one path that does not exist, to see failures come back as well
+        while(submitted < FILES + 1 && header_reader_has_room(&reader))
+        {
+            header_reader_submit(&reader, submitted < FILES ? file_path(dir, submitted) : strdup("/nonexistent/file"));
+            submitted++;
+        }
+
+        header_reader_drive(&reader);
+
+        while((read = header_reader_take(&reader)) != NULL)
+        {
+            if(strcmp(read->path, "/nonexistent/file") == 0)
+            {
+                CHECK(read->error != NULL);
+            }
+            else
+            {
+                size_t i;
+
+                i = strtoul(strrchr(read->path, '/') + 1, NULL, 10);
+                CHECK(read->error == NULL);
+                CHECK(read->identity.size == i + 1);
+                CHECK(read->header_len == (i + 1 < CONTENT_KEY_SPAN ? i + 1 : CONTENT_KEY_SPAN));
+                CHECK(read->header[read->header_len - 1] == (uint8_t)(i % UINT8_MAX));
+            }
+
+            free(read->path);
+            header_reader_release(&reader, read);
+            taken++;
+        }
+    }
+
+    CHECK(header_reader_empty(&reader));
+    header_reader_close(&reader);
+    CHECK(open_fds() == fds_before);
+}
+
+/*
+ * Closing with opens, reads and closes still queued or in flight must
+ * not leave any of their descriptors behind, wherever along the way
+ * the reads are.
+ */
+static void test_close_in_flight(const char *dir)
+{
+    size_t fds_before;
+
+    fds_before = open_fds();
+
+    for(size_t drives = 0; drives < DRIVES; drives++)
+    {
+        struct header_reader reader;
+        struct header_read  *read;
+
+        CHECK(header_reader_open(&reader, DEPTH, true) == 0);
+
+        while(header_reader_has_room(&reader))
+        {
+            header_reader_submit(&reader, file_path(dir, reader.free_count));
+        }
+
+        for(size_t i = 0; i < drives; i++)
+        {
+            header_reader_drive(&reader);
+
+            while((read = header_reader_take(&reader)) != NULL)
+            {
+                free(read->path);
+                header_reader_release(&reader, read);
+            }
+        }
+
+        header_reader_close(&reader);
+    }
+
+    CHECK(open_fds() == fds_before);
+}
+
+int main(void)
+{
+    char dir[] = DIR_TEMPLATE;
+
+    if(mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    make_files(dir);
+    test_reads(dir, false);
+    test_reads(dir, true);
+    test_close_in_flight(dir);
+
+    for(size_t i = 0; i < FILES; i++)
+    {
+        char *path;
+
+        path = file_path(dir, i);
+        unlink(path);
+        free(path);
+    }
+
+    rmdir(dir);
+
+    return CHECK_DONE();
+}
@@ -0,0 +1,132 @@
+#include "check.h"
+#include "histogram.h"
+#include <string.h>
+
+#define SAMPLES 100000                // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SEED 0xD1B54A32D192ED03ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BITS 64                       // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define HALF 0.5                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static uint64_t bucket_top_of(uint64_t ns);
+static void     test_small_values(void);
+static void     test_bucket_bounds(void);
+static void     test_below(void);
+static void     test_quantiles(void);
+
+/*
+ * The top of the bucket a value lands in, read back through the public
+ * API: with the value and UINT64_MAX recorded, the median is the first
+ * bucket's top.
+ */
+static uint64_t bucket_top_of(uint64_t ns)
+{
+    struct histogram histogram;
+
+    memset(&histogram, 0, sizeof(histogram));
+    histogram_record(&histogram, ns);
+    histogram_record(&histogram, UINT64_MAX);
+
+    return histogram_quantile(&histogram, HALF);
+}
+
+static void test_small_values(void)
+{
+    // below HISTOGRAM_SUB_BUCKETS every value has a bucket of its own
+    for(uint64_t ns = 0; ns < HISTOGRAM_SUB_BUCKETS; ns++)
+    {
+        CHECK(bucket_top_of(ns) == ns);
+    }
+}
+
+static void test_bucket_bounds(void)
+{
+    uint64_t state;
+
+    // powers of two and their neighbours are where bucketing goes wrong
+    for(unsigned bit = HISTOGRAM_SUB_BITS; bit < BITS; bit++)
+    {
+        uint64_t power;
+
+        power = 1ULL << bit;
+        CHECK(bucket_top_of(power) >= power);
+        CHECK(bucket_top_of(power) - power < (power >> HISTOGRAM_SUB_BITS));
+        CHECK(bucket_top_of(power - 1) == power - 1);
+    }
+
+    CHECK(bucket_top_of(UINT64_MAX) == UINT64_MAX);
+
+    state = SEED;
+
+    // any value is known to within an eighth, and never under its own size
+    for(int i = 0; i < SAMPLES; i++)
+    {
+        uint64_t ns;
+        uint64_t top;
+
+        ns  = check_random(&state) >> (check_random(&state) % BITS);
+        top = bucket_top_of(ns);
+        CHECK(top >= ns);
+        CHECK(top - ns <= (ns >> HISTOGRAM_SUB_BITS));
+        CHECK(bucket_top_of(top) == top);
+    }
+}
+
+static void test_below(void)
+{
+    struct histogram histogram;
+
+    memset(&histogram, 0, sizeof(histogram));
+
+    for(unsigned bit = 0; bit < BITS; bit++)
+    {
+        histogram_record(&histogram, (1ULL << bit) - 1);
+        histogram_record(&histogram, 1ULL << bit);
+    }
+
+    // 2^b - 1 for b up to k and 2^b for b under k, so 2k + 1 values sit below 2^k
+    for(unsigned bit = 0; bit < BITS; bit++)
+    {
+        CHECK(histogram_below(&histogram, bit) == (uint64_t)((2 * bit) + 1));
+    }
+
+    CHECK(histogram_below(&histogram, BITS) == histogram.count);
+    CHECK(histogram.count == 2 * BITS);
+    CHECK(histogram.max_ns == 1ULL << (BITS - 1));
+}
+
+static void test_quantiles(void)
+{
+    struct histogram histogram;
+    uint64_t         sum;
+
+    memset(&histogram, 0, sizeof(histogram));
+    CHECK(histogram_quantile(&histogram, HALF) == 0);
+
+    sum = 0;
+
+    for(uint64_t ns = 1; ns <= SAMPLES; ns++)
+    {
+        histogram_record(&histogram, ns);
+        sum += ns;
+    }
+
+    CHECK(histogram.count == SAMPLES);
+    CHECK(histogram.sum_ns == sum);
+    CHECK(histogram.max_ns == SAMPLES);
+
+    // the estimate is the top of the quantile's bucket, capped at the largest value seen
+    CHECK(histogram_quantile(&histogram, HALF) >= SAMPLES / 2);
+    CHECK(histogram_quantile(&histogram, HALF) <= SAMPLES / 2 + (SAMPLES / 2 >> HISTOGRAM_SUB_BITS));
+    CHECK(histogram_quantile(&histogram, 1.0) == SAMPLES);
+    CHECK(histogram_quantile(&histogram, 0.0) == 1);
+}
+
+int main(void)
+{
+    test_small_values();
+    test_bucket_bounds();
+    test_below();
+    test_quantiles();
+
+    return CHECK_DONE();
+}
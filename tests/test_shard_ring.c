@@ -0,0 +1,174 @@
+#include "check.h"
+#include "content_key.h"
+#include "shard_ring.h"
+#include <stdio.h>
+#include <string.h>
+
+#define KEYS 100000                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SEED 0x5851F42D4C957F2DULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ENDPOINTS 4                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MIN_SHARE_PERCENT 15          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAX_SHARE_PERCENT 35          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PERCENT 100                   // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ENDPOINT_NAME_LEN 16          // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+static const char *owner(const struct shard_ring *ring, uint64_t key);
+static void        test_create(void);
+static void        test_route(void);
+static void        test_balance(void);
+static void        test_stability(void);
+
+static const char *owner(const struct shard_ring *ring, uint64_t key)
+{
+    size_t order[MAX_SHARD_ENDPOINTS];
+
+    if(shard_ring_route(ring, key, order, 1) != 1)
+    {
+        return NULL;
+    }
+
+    return ring->endpoints[order[0]];
+}
+
+static void test_create(void)
+{
+    struct shard_ring ring;
+    char              list[(MAX_SHARD_ENDPOINTS + 1) * ENDPOINT_NAME_LEN];
+    size_t            len;
+
+    CHECK(shard_ring_create(&ring, NULL) == -1);
+    CHECK(shard_ring_create(&ring, "") == -1);
+    CHECK(shard_ring_create(&ring, ",,,") == -1);
+
+    // empty entries are skipped
+    CHECK(shard_ring_create(&ring, ",/a.sock,,/b.sock,") == 0);
+    CHECK(ring.endpoint_count == 2);
+    CHECK(strcmp(ring.endpoints[0], "/a.sock") == 0);
+    CHECK(strcmp(ring.endpoints[1], "/b.sock") == 0);
+    CHECK(ring.point_count == 2 * SHARD_VNODES);
+    shard_ring_destroy(&ring);
+
+    len = 0;
+
+    for(int i = 0; i < MAX_SHARD_ENDPOINTS; i++)
+    {
+        len += (size_t)snprintf(list + len, sizeof(list) - len, "%s/%d.sock", i == 0 ? "" : ",", i);
+    }
+
+    CHECK(shard_ring_create(&ring, list) == 0);
+    CHECK(ring.endpoint_count == MAX_SHARD_ENDPOINTS);
+    shard_ring_destroy(&ring);
+
+    snprintf(list + len, sizeof(list) - len, ",/extra.sock");
+    CHECK(shard_ring_create(&ring, list) == -1);
+}
+
+static void test_route(void)
+{
+    struct shard_ring ring;
+    size_t            order[MAX_SHARD_ENDPOINTS];
+    uint64_t          state;
+
+    CHECK(shard_ring_create(&ring, "/a.sock,/b.sock,/c.sock,/d.sock") == 0);
+    state = SEED;
+
+    for(int i = 0; i < KEYS; i++)
+    {
+        uint64_t key;
+        size_t   found;
+        size_t   first[1];
+
+        key   = check_random(&state);
+        found = shard_ring_route(&ring, key, order, MAX_SHARD_ENDPOINTS);
+
+        // every endpoint once, as a failover order, whatever the capacity
+        CHECK(found == ENDPOINTS);
+
+        for(size_t a = 0; a < found; a++)
+        {
+            CHECK(order[a] < ENDPOINTS);
+
+            for(size_t b = 0; b < a; b++)
+            {
+                CHECK(order[a] != order[b]);
+            }
+        }
+
+        CHECK(shard_ring_route(&ring, key, first, 1) == 1);
+        CHECK(first[0] == order[0]);
+    }
+
+    CHECK(shard_ring_route(&ring, 0, order, 0) == 0);
+    CHECK(shard_ring_route(&ring, UINT64_MAX, order, MAX_SHARD_ENDPOINTS) == ENDPOINTS);
+    shard_ring_destroy(&ring);
+}
+
+static void test_balance(void)
+{
+    struct shard_ring ring;
+    size_t            owned[ENDPOINTS];
+    size_t            order[1];
+
+    CHECK(shard_ring_create(&ring, "/a.sock,/b.sock,/c.sock,/d.sock") == 0);
+    memset(owned, 0, sizeof(owned));
+
+    for(uint64_t i = 0; i < KEYS; i++)
+    {
+        CHECK(shard_ring_route(&ring, content_key(&i, sizeof(i)), order, 1) == 1);
+        owned[order[0]]++;
+    }
+
+    for(size_t e = 0; e < ENDPOINTS; e++)
+    {
+        CHECK(owned[e] * PERCENT > (size_t)KEYS * MIN_SHARE_PERCENT);
+        CHECK(owned[e] * PERCENT < (size_t)KEYS * MAX_SHARE_PERCENT);
+    }
+
+    shard_ring_destroy(&ring);
+}
+
+/*
+ * Consistent hashing's promise: the order endpoints are listed in does
+ * not matter, and dropping one only moves the keys it owned.
+ */
+static void test_stability(void)
+{
+    struct shard_ring ring;
+    struct shard_ring reordered;
+    struct shard_ring shrunk;
+    uint64_t          state;
+
+    CHECK(shard_ring_create(&ring, "/a.sock,/b.sock,/c.sock,/d.sock") == 0);
+    CHECK(shard_ring_create(&reordered, "/d.sock,/b.sock,/a.sock,/c.sock") == 0);
+    CHECK(shard_ring_create(&shrunk, "/a.sock,/b.sock,/d.sock") == 0);
+    state = SEED;
+
+    for(int i = 0; i < KEYS; i++)
+    {
+        uint64_t    key;
+        const char *before;
+
+        key    = check_random(&state);
+        before = owner(&ring, key);
+        CHECK(strcmp(before, owner(&reordered, key)) == 0);
+
+        if(strcmp(before, "/c.sock") != 0)
+        {
+            CHECK(strcmp(before, owner(&shrunk, key)) == 0);
+        }
+    }
+
+    shard_ring_destroy(&ring);
+    shard_ring_destroy(&reordered);
+    shard_ring_destroy(&shrunk);
+}
+
+int main(void)
+{
+    test_create();
+    test_route();
+    test_balance();
+    test_stability();
+
+    return CHECK_DONE();
+}
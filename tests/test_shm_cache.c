@@ -0,0 +1,159 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE    // NOLINT(bugprone-reserved-identifier, cert-dcl37-c, cert-dcl51-cpp) F_OFD_SETLK to stand in for another writer
+#endif
+
+#include "check.h"
+#include "shm_cache.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(F_OFD_SETLK)
+    #define SLOT_SETLK F_OFD_SETLK
+#else
+    #define SLOT_SETLK F_SETLK
+#endif
+
+#define SLOTS 64                      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define KEY 0x1234567890abcdefULL
+#define HEADER "\177ELF first header"
+#define OTHER_HEADER "\177ELF other header"
+#define PATH_TEMPLATE "/tmp/test_shm_cacheXXXXXX"
+
+static void                   make_result(struct elf_result *result, uint64_t entry);
+static struct shm_cache_slot *slot_of(const struct shm_cache *cache, uint64_t key);
+static int                    hold_slot(const char *path, const struct shm_cache *cache, const struct shm_cache_slot *slot);
+static void                   test_round_trip(const char *path);
+static void                   test_collision(const char *path);
+static void                   test_abandoned_slot(const char *path);
+
+static void make_result(struct elf_result *result, uint64_t entry)
+{
+    memset(result, 0, sizeof(*result));
+    result->entry = entry;
+    result->valid = 1;
+}
+
+static struct shm_cache_slot *slot_of(const struct shm_cache *cache, uint64_t key)
+{
+    for(size_t i = 0; i < cache->slot_count; i++)
+    {
+        if(cache->slots[i].used != 0 && cache->slots[i].key == key)
+        {
+            return &cache->slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Locks the slot through a descriptor of its own, as a writer in
+ * another process would; closing it is that writer dying.
+ */
+static int hold_slot(const char *path, const struct shm_cache *cache, const struct shm_cache_slot *slot)
+{
+    struct flock lock;
+    int          fd;
+
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type   = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start  = (off_t)((const char *)slot - (const char *)cache->header);
+    lock.l_len    = (off_t)sizeof(*slot);
+    CHECK(fd != -1 && fcntl(fd, SLOT_SETLK, &lock) == 0);
+
+    return fd;
+}
+
+static void test_round_trip(const char *path)
+{
+    struct shm_cache  cache;
+    struct elf_result result;
+    struct elf_result found;
+
+    CHECK(shm_cache_open(&cache, path, SLOTS) == 0);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER), &found) == -1);
+    make_result(&result, 1);
+    shm_cache_put(&cache, KEY, HEADER, sizeof(HEADER), &result);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER), &found) == 0 && found.entry == 1);
+    shm_cache_close(&cache);
+
+    // the record outlives the mapping that stored it
+    CHECK(shm_cache_open(&cache, path, SLOTS) == 0);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER), &found) == 0 && found.entry == 1);
+    shm_cache_close(&cache);
+}
+
+// a header that shares the key with a stored one is a miss, not the stored answer
+static void test_collision(const char *path)
+{
+    struct shm_cache  cache;
+    struct elf_result found;
+
+    CHECK(shm_cache_open(&cache, path, SLOTS) == 0);
+    CHECK(shm_cache_get(&cache, KEY, OTHER_HEADER, sizeof(OTHER_HEADER), &found) == -1);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER) - 1, &found) == -1);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER), &found) == 0);
+    shm_cache_close(&cache);
+}
+
+/*
+ * A slot left odd by a writer that died mid-update is taken back by
+ * the next put, while one a live writer holds is still left alone.
+ */
+static void test_abandoned_slot(const char *path)
+{
+    struct shm_cache       cache;
+    struct shm_cache_slot *slot;
+    struct elf_result      result;
+    struct elf_result      found;
+    int                    writer_fd;
+
+    CHECK(shm_cache_open(&cache, path, SLOTS) == 0);
+    slot = slot_of(&cache, KEY);
+    CHECK(slot != NULL);
+
+    if(slot == NULL)
+    {
+        shm_cache_close(&cache);
+        return;
+    }
+
+    writer_fd = hold_slot(path, &cache, slot);
+    atomic_fetch_add(&slot->seq, 1);
+    make_result(&result, 2);
+    shm_cache_put(&cache, KEY, HEADER, sizeof(HEADER), &result);
+    CHECK((atomic_load(&slot->seq) & 1U) != 0);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER), &found) == -1);
+
+    close(writer_fd);
+    shm_cache_put(&cache, KEY, HEADER, sizeof(HEADER), &result);
+    CHECK((atomic_load(&slot->seq) & 1U) == 0);
+    CHECK(shm_cache_get(&cache, KEY, HEADER, sizeof(HEADER), &found) == 0 && found.entry == 2);
+    shm_cache_close(&cache);
+}
+
+int main(void)
+{
+    char path[] = PATH_TEMPLATE;
+    int  fd;
+
+    fd = mkstemp(path);
+
+    if(fd == -1)
+    {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+
+    // shm_cache_open sizes an empty file itself
+    close(fd);
+    test_round_trip(path);
+    test_collision(path);
+    test_abandoned_slot(path);
+    unlink(path);
+
+    return CHECK_DONE();
+}
@@ -0,0 +1,231 @@
+#include "check.h"
+#include "stat_cache.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RECORDS 10000    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define BODY_LEN 64      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define AGE_SEC 100      // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define PATH_LEN 256     // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define DIR_TEMPLATE "/tmp/test_stat_cacheXXXXXX"
+
+static void make_identity(struct file_identity *identity, uint64_t ino);
+static int  make_body(char *body, size_t len, uint64_t ino);
+static void test_round_trip(const char *path);
+static void test_identity_changes(const char *path);
+static void test_growth(const char *path);
+static void test_refusals(const char *dir);
+
+// a file that last changed well before now, so its answer may be cached
+static void make_identity(struct file_identity *identity, uint64_t ino)
+{
+    // one time for every identity, so a put and a get either side of a second boundary still agree
+    static int64_t changed_sec = 0;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+    if(changed_sec == 0)
+    {
+        changed_sec = (int64_t)time(NULL) - AGE_SEC;
+    }
+
+    memset(identity, 0, sizeof(*identity));
+    identity->dev        = 1;
+    identity->ino        = ino;
+    identity->size       = ino * 2;
+    identity->mtime_sec  = changed_sec;
+    identity->mtime_nsec = (int64_t)ino;
+    identity->ctime_sec  = identity->mtime_sec;
+    identity->ctime_nsec = identity->mtime_nsec;
+}
+
+static int make_body(char *body, size_t len, uint64_t ino)
+{
+    return snprintf(body, len, "Class: ELF64\nInode: %llu\n", (unsigned long long)ino);
+}
+
+static void test_round_trip(const char *path)
+{
+    struct stat_cache    cache;
+    struct file_identity identity;
+    char                 body[BODY_LEN];
+    const char          *found;
+    size_t               found_len;
+    int                  body_len;
+
+    CHECK(stat_cache_open(&cache, path) == 0);
+    make_identity(&identity, 1);
+    body_len = make_body(body, sizeof(body), 1);
+
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == -1);
+    CHECK(stat_cache_put(&cache, &identity, body, (size_t)body_len) == 0);
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == 0);
+    CHECK(found_len == (size_t)body_len && memcmp(found, body, found_len) == 0);
+    stat_cache_close(&cache);
+
+    // the answer outlives the process that recorded it
+    CHECK(stat_cache_open(&cache, path) == 0);
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == 0);
+    CHECK(found_len == (size_t)body_len && memcmp(found, body, found_len) == 0);
+    CHECK(cache.header->count == 1);
+    stat_cache_close(&cache);
+}
+
+static void test_identity_changes(const char *path)
+{
+    struct stat_cache    cache;
+    struct file_identity identity;
+    struct file_identity changed;
+    char                 body[STAT_CACHE_BODY_LEN + 1];
+    const char          *found;
+    size_t               found_len;
+    int                  body_len;
+
+    CHECK(stat_cache_open(&cache, path) == 0);
+    make_identity(&identity, 2);
+    body_len = make_body(body, sizeof(body), 2);
+    CHECK(stat_cache_put(&cache, &identity, body, (size_t)body_len) == 0);
+
+    // any field stat reports differently is a miss
+    changed = identity;
+    changed.size++;
+    CHECK(stat_cache_get(&cache, &changed, &found, &found_len) == -1);
+    changed = identity;
+    changed.mtime_nsec++;
+    CHECK(stat_cache_get(&cache, &changed, &found, &found_len) == -1);
+    changed = identity;
+    changed.ctime_sec++;
+    CHECK(stat_cache_get(&cache, &changed, &found, &found_len) == -1);
+    changed = identity;
+    changed.dev++;
+    CHECK(stat_cache_get(&cache, &changed, &found, &found_len) == -1);
+
+    // a change in the second the answer was stored cannot be told apart from a later write
+    changed           = identity;
+    changed.ctime_sec = (int64_t)time(NULL);
+    CHECK(stat_cache_put(&cache, &changed, body, (size_t)body_len) == 0);
+    CHECK(stat_cache_get(&cache, &changed, &found, &found_len) == -1);
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == -1);
+
+    // a changed file overwrites its own record
+    CHECK(stat_cache_put(&cache, &identity, body, (size_t)body_len) == 0);
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == 0);
+
+    // a torn record fails its checksum
+    for(uint64_t i = 0; i < cache.header->capacity; i++)
+    {
+        if(cache.records[i].identity.ino == 2 && cache.records[i].body_len != 0)
+        {
+            cache.records[i].body[0] ^= 1;
+        }
+    }
+
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == -1);
+
+    memset(body, 'x', sizeof(body));
+    CHECK(stat_cache_put(&cache, &identity, body, 0) == -1);
+    CHECK(stat_cache_put(&cache, &identity, body, STAT_CACHE_BODY_LEN + 1) == -1);
+    CHECK(stat_cache_put(&cache, &identity, body, STAT_CACHE_BODY_LEN) == 0);
+    CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == 0 && found_len == STAT_CACHE_BODY_LEN);
+    stat_cache_close(&cache);
+}
+
+static void test_growth(const char *path)
+{
+    struct stat_cache cache;
+
+    CHECK(stat_cache_open(&cache, path) == 0);
+
+    // past half of the first capacity, so the table has to grow and rehash
+    for(uint64_t ino = 1; ino <= RECORDS; ino++)
+    {
+        struct file_identity identity;
+        char                 body[BODY_LEN];
+        int                  body_len;
+
+        make_identity(&identity, ino);
+        body_len = make_body(body, sizeof(body), ino);
+        CHECK(stat_cache_put(&cache, &identity, body, (size_t)body_len) == 0);
+    }
+
+    CHECK(cache.header->capacity > STAT_CACHE_INITIAL_CAPACITY);
+    CHECK(cache.header->count == RECORDS);
+    stat_cache_close(&cache);
+    CHECK(stat_cache_open(&cache, path) == 0);
+
+    for(uint64_t ino = 1; ino <= RECORDS; ino++)
+    {
+        struct file_identity identity;
+        char                 body[BODY_LEN];
+        const char          *found;
+        size_t               found_len;
+        int                  body_len;
+
+        make_identity(&identity, ino);
+        body_len = make_body(body, sizeof(body), ino);
+        CHECK(stat_cache_get(&cache, &identity, &found, &found_len) == 0);
+        CHECK(found_len == (size_t)body_len && memcmp(found, body, found_len) == 0);
+    }
+
+    stat_cache_close(&cache);
+}
+
+static void test_refusals(const char *dir)
+{
+    struct stat_cache        cache;
+    struct stat_cache_header header;
+    char                     path[PATH_LEN];
+    int                      fd;
+
+    // something that is not a cache is left alone
+    snprintf(path, sizeof(path), "%s/not-a-cache", dir);
+    memset(&header, 'x', sizeof(header));
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    CHECK(fd != -1 && write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header));
+    close(fd);
+    CHECK(stat_cache_open(&cache, path) == -1);
+    unlink(path);
+
+    // a cache written by another layout is started over
+    snprintf(path, sizeof(path), "%s/old-layout", dir);
+    memset(&header, 0, sizeof(header));
+    header.magic   = STAT_CACHE_MAGIC;
+    header.version = STAT_CACHE_VERSION + 1;
+    header.count   = RECORDS;
+    fd             = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    CHECK(fd != -1 && write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header));
+    close(fd);
+    CHECK(stat_cache_open(&cache, path) == 0);
+    CHECK(cache.header->version == STAT_CACHE_VERSION && cache.header->count == 0);
+    CHECK(cache.header->capacity == STAT_CACHE_INITIAL_CAPACITY);
+    stat_cache_close(&cache);
+    unlink(path);
+}
+
+int main(void)
+{
+    char dir[] = DIR_TEMPLATE;
+    char path[PATH_LEN];
+    char tmp_path[PATH_LEN * 2];
+
+    if(mkdtemp(dir) == NULL)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    snprintf(path, sizeof(path), "%s/cache", dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, STAT_CACHE_TMP_SUFFIX);
+    test_round_trip(path);
+    test_identity_changes(path);
+    unlink(path);
+    test_growth(path);
+    test_refusals(dir);
+
+    // growing renames its temporary file away, so nothing of it may remain
+    CHECK(access(tmp_path, F_OK) == -1);
+    unlink(path);
+    rmdir(dir);
+
+    return CHECK_DONE();
+}
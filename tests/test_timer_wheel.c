@@ -0,0 +1,227 @@
+#include "check.h"
+#include "timer_wheel.h"
+#include <string.h>
+
+#define TIMERS 512                    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define ROUNDS 20000                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define START 1000                    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define MAX_STEP 300                  // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+#define SEED 0x9E3779B97F4A7C15ULL    // NOLINT(cppcoreguidelines-macro-to-enum, modernize-macro-to-enum)
+
+/*
+ * The model is what the wheel promises: an armed timer fires in the
+ * first advance whose range of ticks holds its (clamped) due tick, and
+ * never earlier.
+ */
+struct model
+{
+    struct timer_entry entry;
+    bool               armed;
+    uint64_t           due;
+};
+
+static uint64_t clamp_due(uint64_t now, uint64_t expires);
+static void     test_basics(void);
+static void     test_clamping(void);
+static void     test_against_model(void);
+
+static uint64_t clamp_due(uint64_t now, uint64_t expires)
+{
+    if(expires <= now)
+    {
+        return now + 1;
+    }
+
+    if(expires - now >= TIMER_WHEEL_SPAN)
+    {
+        return now + TIMER_WHEEL_SPAN - 1;
+    }
+
+    return expires;
+}
+
+static void test_basics(void)
+{
+    struct timer_wheel  wheel;
+    struct timer_entry  first;
+    struct timer_entry  second;
+    struct timer_entry *fired;
+
+    memset(&first, 0, sizeof(first));
+    memset(&second, 0, sizeof(second));
+    timer_wheel_init(&wheel, START);
+
+    CHECK(timer_wheel_timeout(&wheel) == -1);
+    CHECK(timer_wheel_advance(&wheel, START + 1) == NULL);
+
+    timer_wheel_add(&wheel, &first, START + 10);
+    CHECK(timer_wheel_armed(&first));
+    CHECK(timer_wheel_timeout(&wheel) == 9);
+    CHECK(timer_wheel_advance(&wheel, START + 9) == NULL);
+    fired = timer_wheel_advance(&wheel, START + 10);
+    CHECK(fired == &first && fired->next == NULL);
+    CHECK(!timer_wheel_armed(&first));
+
+    // moving an armed timer leaves it armed once, at the new tick
+    timer_wheel_add(&wheel, &first, START + 20);
+    timer_wheel_add(&wheel, &first, START + 5000);
+    CHECK(wheel.count == 1);
+    CHECK(timer_wheel_advance(&wheel, START + 4999) == NULL);
+    CHECK(timer_wheel_advance(&wheel, START + 5000) == &first);
+
+    timer_wheel_add(&wheel, &first, START + 6000);
+    timer_wheel_add(&wheel, &second, START + 6000);
+    timer_wheel_cancel(&wheel, &first);
+    timer_wheel_cancel(&wheel, &first);
+    CHECK(wheel.count == 1);
+    fired = timer_wheel_advance(&wheel, START + 7000);
+    CHECK(fired == &second && fired->next == NULL);
+    CHECK(timer_wheel_timeout(&wheel) == -1);
+}
+
+static void test_clamping(void)
+{
+    struct timer_wheel  wheel;
+    struct timer_entry  past;
+    struct timer_entry  far;
+    struct timer_entry *fired;
+
+    memset(&past, 0, sizeof(past));
+    memset(&far, 0, sizeof(far));
+    timer_wheel_init(&wheel, START);
+
+    // a tick already gone fires on the next one
+    timer_wheel_add(&wheel, &past, START - 5);
+    CHECK(past.expires == START + 1);
+    CHECK(timer_wheel_advance(&wheel, START + 1) == &past);
+
+    // beyond the span fires at the edge of the wheel
+    timer_wheel_add(&wheel, &far, UINT64_MAX);
+    CHECK(far.expires == START + 1 + TIMER_WHEEL_SPAN - 1);
+    CHECK(timer_wheel_advance(&wheel, far.expires - 1) == NULL);
+    fired = timer_wheel_advance(&wheel, far.expires);
+    CHECK(fired == &far);
+}
+
+static void test_against_model(void)
+{
+    static struct model timers[TIMERS];
+    struct timer_wheel  wheel;
+    uint64_t            state;
+    uint64_t            now;
+
+    memset(timers, 0, sizeof(timers));
+    timer_wheel_init(&wheel, START);
+    state = SEED;
+    now   = START;
+
+    for(int round = 0; round < ROUNDS; round++)
+    {
+        struct model       *timer;
+        struct timer_entry *fired;
+        uint64_t            action;
+        uint64_t            next;
+        size_t              armed;
+        uint64_t            earliest;
+
+        timer  = &timers[check_random(&state) % TIMERS];
+        action = check_random(&state) % 4;
+
+        if(action < 2)
+        {
+            uint64_t expires;
+
+            // mostly near, sometimes on a higher level, now and then past the span
+            switch(check_random(&state) % 4)
+            {
+                case 0:
+                    expires = now + (check_random(&state) % TIMER_WHEEL_SLOTS);
+                    break;
+                case 1:
+                    expires = now + (check_random(&state) % (TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS));
+                    break;
+                case 2:
+                    expires = now + (check_random(&state) % (TIMER_WHEEL_SPAN / TIMER_WHEEL_SLOTS));
+                    break;
+                default:
+                    expires = now - (check_random(&state) % START) + (check_random(&state) % (TIMER_WHEEL_SPAN * 2));
+                    break;
+            }
+
+            timer_wheel_add(&wheel, &timer->entry, expires);
+            timer->armed = true;
+            timer->due   = clamp_due(now, expires);
+            CHECK(timer->entry.expires == timer->due);
+        }
+        else if(action == 2)
+        {
+            timer_wheel_cancel(&wheel, &timer->entry);
+            timer->armed = false;
+        }
+
+        // the wheel must never let the caller sleep past the earliest timer
+        armed    = 0;
+        earliest = UINT64_MAX;
+
+        for(size_t i = 0; i < TIMERS; i++)
+        {
+            if(timers[i].armed)
+            {
+                armed++;
+                earliest = timers[i].due < earliest ? timers[i].due : earliest;
+            }
+        }
+
+        CHECK(wheel.count == armed);
+
+        if(armed == 0)
+        {
+            CHECK(timer_wheel_timeout(&wheel) == -1);
+        }
+        else
+        {
+            int64_t timeout;
+
+            timeout = timer_wheel_timeout(&wheel);
+            CHECK(timeout > 0 && now + (uint64_t)timeout <= earliest);
+
+            if(earliest - now < TIMER_WHEEL_SLOTS - (now & (TIMER_WHEEL_SLOTS - 1)))
+            {
+                CHECK(now + (uint64_t)timeout == earliest);
+            }
+        }
+
+        // jump to the earliest timer now and then, so long advances get exercised too
+        next  = (action == 3 && earliest != UINT64_MAX) ? earliest : now + (check_random(&state) % MAX_STEP);
+        fired = timer_wheel_advance(&wheel, next);
+
+        while(fired != NULL)
+        {
+            struct model *owner;
+
+            owner = (struct model *)(void *)fired;
+            CHECK(owner->armed);
+            CHECK(owner->due > now && owner->due <= next);
+            CHECK(!timer_wheel_armed(fired));
+            owner->armed = false;
+            fired        = fired->next;
+        }
+
+        for(size_t i = 0; i < TIMERS; i++)
+        {
+            CHECK(!timers[i].armed || timers[i].due > next);
+            CHECK(timers[i].armed == timer_wheel_armed(&timers[i].entry));
+        }
+
+        now = next;
+    }
+}
+
+int main(void)
+{
+    test_basics();
+    test_clamping();
+    test_against_model();
+
+    return CHECK_DONE();
+}